@@ -0,0 +1,146 @@
+/**
+ * @file            dir_prefetcher.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Background threads that read directories ahead of a walk, so that their entries and the metadata of
+ *                  their files are already cached by the time the walk reaches them
+ *
+ */
+
+#ifndef DIR_PREFETCHER_H
+#define DIR_PREFETCHER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dir_reader.h"
+
+/** Number of directories waiting to be prefetched, after which the oldest ones are dropped */
+#define PREFETCH_QUEUE_LEN      (1024)
+
+/** Number of threads that prefetch directories, if no number is given */
+#define PREFETCH_DEFAULT_THREADS    (4)
+
+
+/**
+ * @brief                   Reads the subdirectories of every directory that a walk has read, on a few threads of its own,
+ *                          while the walk is busy with the directory itself
+ *
+ *                          On a cold cache, every directory a walk reads (and every file it fetches the metadata of) waits
+ *                          for a seek, and the walk only asks for the next one once the previous one is done. The
+ *                          prefetcher reads the subdirectories that the walk has just found (and fetches the metadata of
+ *                          their files, in the order of their inode numbers), so several requests are in flight at once
+ *                          and the disk (or the NFS server) can serve them in whatever order suits it best, and the walk
+ *                          finds them in the cache. What it reads is thrown away. The most recently found directories
+ *                          are read first, since a depth-first walk reaches them next, and once too many are waiting, the
+ *                          oldest ones (which the walk has most likely reached on its own) are dropped
+ */
+class DirPrefetcher
+{
+    /** Paths of the directories waiting to be read (the most recently found at the back) */
+    std::deque<std::filesystem::path::string_type>  mPending;
+    /** Lock protecting mPending and mIsStopping */
+    std::mutex              mLock;
+    /** Signalled whenever directories are added, or the prefetcher is stopped */
+    std::condition_variable mWake;
+    /** Whether the threads should stop */
+    bool                    mIsStopping         {false};
+
+    /** Threads reading the directories */
+    std::vector<std::thread>    mThreads;
+    /** Metadata fetched for each regular file of a directory (0 if only the directory is read) */
+    uint32_t                mFileMask           {};
+
+    /** Number of directories that were read */
+    std::atomic<uint64_t>   mNumRead            {};
+    /** Number of directories that were dropped before they could be read */
+    std::atomic<uint64_t>   mNumDropped         {};
+
+    /**
+     * @brief               Reads the directories waiting to be read, until the prefetcher is stopped
+     */
+    void
+    run () noexcept;
+
+public:
+
+    DirPrefetcher () = default;
+    DirPrefetcher (const DirPrefetcher &) = delete;
+    DirPrefetcher &operator= (const DirPrefetcher &) = delete;
+
+    ~DirPrefetcher ()
+    {
+        stop ();
+    }
+
+    /**
+     * @brief               Starts the threads of the prefetcher (if some could not be started, the ones that were are kept)
+     *
+     * @param pNumThreads   Number of threads reading directories at once
+     * @param pFileMask     Metadata fetched for each regular file (and each symlink, which is followed) of a directory
+     *                      that is read, as the walk will fetch it (0 if the walk fetches none)
+     *
+     * @return true         If at least one thread was started
+     * @return false        If no thread could be started
+     */
+    [[nodiscard]] bool
+    start (const uint32_t &pNumThreads, const uint32_t &pFileMask) noexcept;
+
+    /**
+     * @brief               Stops the threads of the prefetcher, dropping the directories still waiting to be read
+     */
+    void
+    stop () noexcept;
+
+    /**
+     * @brief               Adds the subdirectories of a batch that was just read to the directories waiting to be read
+     *                      (nothing is added if the prefetcher is not running)
+     *
+     * @param pBatch        Batch whose subdirectories to add
+     */
+    void
+    hint (const DirBatch &pBatch) noexcept;
+
+    /**
+     * @brief               Checks whether the threads of the prefetcher are running
+     *
+     * @return true         If the prefetcher is running
+     * @return false        If it was not started, or has been stopped
+     */
+    [[nodiscard]] bool
+    is_running () const noexcept
+    {
+        return !mThreads.empty ();
+    }
+
+    /**
+     * @brief               Returns the number of directories that were read ahead of the walk
+     *
+     * @return uint64_t     Number of directories
+     */
+    [[nodiscard]] uint64_t
+    num_read () const noexcept
+    {
+        return mNumRead.load (std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief               Returns the number of directories that were dropped before they could be read
+     *
+     * @return uint64_t     Number of directories
+     */
+    [[nodiscard]] uint64_t
+    num_dropped () const noexcept
+    {
+        return mNumDropped.load (std::memory_order_relaxed);
+    }
+};
+
+#endif
@@ -0,0 +1,349 @@
+/**
+ * @file            dir_reader.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Reads the entries of a directory in one go, and fetches only the metadata that is asked for
+ *
+ *                  On Linux, directories are read with getdents64 (the type of each entry comes with the directory
+ *                  itself), and metadata is fetched with a single statx per entry that only asks for the required
+ *                  fields (optionally submitting all of them at once through io_uring). Elsewhere (or if
+ *                  FSS_PORTABLE_BACKEND is defined) std::filesystem is used instead
+ *
+ */
+
+#ifndef DIR_READER_H
+#define DIR_READER_H
+
+#include <cstdint>
+#include <ctime>
+
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if !defined (FSS_PORTABLE_BACKEND) && defined (__linux__)
+/** Defined if directories are read through the native Linux system calls */
+#define FSS_LINUX_BACKEND       true
+#endif
+
+
+/** Number of null characters after the last name of a batch, so that names can be read in whole blocks of this many characters */
+#define DIR_NAME_PADDING        (64)
+
+/** Metadata bit requesting the type of an entry (only needed for symlinks, whose targets are reported) */
+#define STAT_TYPE               (1U << 0)
+/** Metadata bit requesting the size of an entry */
+#define STAT_SIZE               (1U << 1)
+/** Metadata bit requesting the time of last modification of an entry */
+#define STAT_MTIME              (1U << 2)
+/** Metadata bit requesting the permissions of an entry */
+#define STAT_PERMS              (1U << 3)
+/** Metadata bit requesting that symlinks are followed (the metadata of the target is reported instead) */
+#define STAT_FOLLOW             (1U << 4)
+/** Metadata bit requesting the device, the inode number and the number of hard links of an entry */
+#define STAT_LINKS              (1U << 5)
+/** Metadata bit requesting the space allocated to an entry */
+#define STAT_BLOCKS             (1U << 6)
+
+
+/** Type of a filesystem entry */
+enum class EntryType : uint8_t
+{
+    UNKNOWN,
+    REGULAR,
+    DIRECTORY,
+    SYMLINK,
+    BLOCK,
+    CHARACTER,
+    FIFO,
+    SOCKET
+};
+
+/** Ways of fetching the metadata of the entries of a batch */
+enum class StatMode : uint8_t
+{
+    /** One blocking call per entry */
+    SYNC,
+    /** Requests for all the entries of a batch are kept in flight at once through io_uring (Linux only) */
+    IO_URING
+};
+
+/** Native path (or name) that is not owned by a std::filesystem::path */
+using PathView              = std::basic_string_view<std::filesystem::path::value_type>;
+
+/** Metadata of a filesystem entry (only the fields that were asked for are valid) */
+struct EntryStat
+{
+    /** Type of the entry (of the target if the entry is a symlink that was followed) */
+    EntryType               type                {EntryType::UNKNOWN};
+    /** Permissions of the entry */
+    std::filesystem::perms  perms               {std::filesystem::perms::none};
+    /** Size of the entry in bytes */
+    int64_t                 size                {-1};
+    /** Time of last modification of the entry */
+    time_t                  mtime               {};
+
+    /** Device containing the entry */
+    uint64_t                dev                 {};
+    /** Inode number of the entry (0 if the filesystem has none) */
+    uint64_t                ino                 {};
+    /** Number of hard links to the entry */
+    uint64_t                nlink               {1};
+    /** Space allocated to the entry in bytes (-1 if it is not known) */
+    int64_t                 allocSize           {-1};
+};
+
+/** Identity of a directory, which changes whenever an entry is added to, removed from or renamed within it */
+struct DirIdentity
+{
+    /** Inode number of the directory (0 if the filesystem has none) */
+    uint64_t                ino                 {};
+    /** Time of last modification of the directory, in nanoseconds since the epoch */
+    int64_t                 mtimeNs             {};
+    /** Device containing the directory (0 if it is not known) */
+    uint64_t                dev                 {};
+};
+
+/** Single entry of a directory read by read_dir */
+struct DirEntry
+{
+    /** Offset of the name of the entry in the names buffer of the batch */
+    uint32_t                nameOffset;
+    /** Length of the name of the entry */
+    uint32_t                nameLen;
+
+    /** Type of the entry, as reported by the directory (symlinks are not followed) */
+    EntryType               type;
+    /** Metadata requested for the entry (combination of STAT_* bits, 0 if none is needed) */
+    uint32_t                statMask;
+    /** Inode number of the entry, as reported by the directory (0 if it is not known) */
+    uint64_t                dirIno;
+
+    /** Metadata of the entry (filled by stat_dir_entries) */
+    EntryStat               stat;
+    /** Error that occoured while fetching the metadata of the entry */
+    std::error_code         statError;
+};
+
+/**
+ * @brief                   All the entries of a single directory
+ *
+ *                          The directory stays open until the batch is closed (or destroyed), so that the metadata of
+ *                          its entries can be fetched relative to it
+ */
+class DirBatch
+{
+public:
+
+    /** Character type of native paths */
+    using char_t            = std::filesystem::path::value_type;
+
+    /** Entries of the directory (in the order in which the directory returned them) */
+    std::vector<DirEntry>   entries;
+    /** Null-terminated names of all the entries, one after the other (followed by DIR_NAME_PADDING null characters) */
+    std::vector<char_t>     names;
+
+    /** Path of the directory */
+    std::filesystem::path   dirPath;
+    /** Path of the directory followed by a separator, and then by the name of the entry whose path was built last */
+    std::basic_string<char_t>   entryPath       {};
+    /** Length of the path of the directory (along with the separator) at the start of entryPath */
+    size_t                  dirPathLen          {};
+
+    /** Identity of the directory from just before it was read (only filled if it was asked for) */
+    DirIdentity             identity            {};
+    /** Whether the batch was restored from an index, with the metadata of every entry already filled in */
+    bool                    isRestored          {false};
+    /** Positions of the entries in the order in which their metadata is fetched (reused for every directory) */
+    std::vector<uint32_t>   statOrder           {};
+
+#if defined (FSS_LINUX_BACKEND)
+    /** File descriptor of the open directory (-1 if closed) */
+    int                     dirFd               {-1};
+#endif
+
+    DirBatch () = default;
+    DirBatch (const DirBatch &) = delete;
+    DirBatch &operator= (const DirBatch &) = delete;
+
+    ~DirBatch ()
+    {
+        close ();
+    }
+
+    /**
+     * @brief               Returns the null-terminated name of an entry of the batch
+     *
+     * @param pEntry        Entry whose name to return
+     *
+     * @return const char_t* Name of the entry
+     */
+    [[nodiscard]] const char_t
+    *name_of (const DirEntry &pEntry) const noexcept
+    {
+        return names.data () + pEntry.nameOffset;
+    }
+
+    /**
+     * @brief               Returns the path of an entry of the batch
+     *
+     * @param pEntry        Entry whose path to return
+     *
+     * @return std::filesystem::path Path of the entry (the path of the directory followed by the name of the entry)
+     */
+    [[nodiscard]] std::filesystem::path
+    path_of (const DirEntry &pEntry) const
+    {
+        return dirPath / name_of (pEntry);
+    }
+
+    /**
+     * @brief               Builds the path of an entry of the batch in place, by replacing the name of the entry whose path
+     *                      was built before it (the buffer only allocates when a name is longer than any before it)
+     *
+     * @param pEntry        Entry whose path to build
+     *
+     * @return PathView     Path of the entry, the same as path_of returns (only valid until the next path is built)
+     */
+    [[nodiscard]] PathView
+    build_path (const DirEntry &pEntry)
+    {
+        entryPath.resize (dirPathLen);
+        entryPath.append (name_of (pEntry), pEntry.nameLen);
+
+        return entryPath;
+    }
+
+    /**
+     * @brief               Sets the path of the directory that the batch holds the entries of
+     *
+     * @param pPath         Path of the directory
+     */
+    void
+    set_path (const std::filesystem::path &pPath)
+    {
+        dirPath     = pPath;
+
+        // a separator is added the same way as appending a name to the path would add one
+        entryPath.assign (pPath.native ());
+        if (pPath.has_filename ()) {
+            entryPath.push_back (std::filesystem::path::preferred_separator);
+        }
+        dirPathLen  = entryPath.size ();
+    }
+
+    /**
+     * @brief               Appends DIR_NAME_PADDING null characters after the last name (once all the names have been added)
+     */
+    void
+    pad_names ()
+    {
+        names.insert (names.end (), DIR_NAME_PADDING, 0);
+    }
+
+    /**
+     * @brief               Closes the directory (the entries and their metadata remain available)
+     */
+    void
+    close () noexcept;
+};
+
+/**
+ * @brief                   Batches reused by a recursive walk, one for each level of directories that it has open at once
+ *
+ *                          A batch keeps the memory of its entries, names and paths when it is read into again, so once a
+ *                          walk has been through its deepest and widest directories, reading another one no longer
+ *                          allocates. Each thread walking directories needs its own stack
+ */
+class BatchStack
+{
+    /** Batch of each level (a deque never moves the batches that are already in it) */
+    std::deque<DirBatch>    mBatches;
+
+public:
+
+    /**
+     * @brief               Returns the batch of a given level of the walk
+     *
+     * @param pLevel        Level of the directory that will be read into the batch
+     *
+     * @return DirBatch&    Batch of the level (which may hold the entries of a directory read before at the same level)
+     */
+    [[nodiscard]] DirBatch
+    &at (const uint64_t &pLevel)
+    {
+        while (mBatches.size () <= pLevel) {
+            mBatches.emplace_back ();
+        }
+
+        return mBatches[pLevel];
+    }
+};
+
+/**
+ * @brief                   Reads all the entries of a directory (except "." and "..") into a batch
+ *
+ * @param pPath             Path of the directory to read
+ * @param pBatch            Batch to read the entries into (any previous contents are discarded)
+ * @param pErr              Error that occoured while reading the directory
+ *
+ * @return true             If the directory was read
+ * @return false            If the directory could not be read
+ */
+[[nodiscard]] bool
+read_dir (const std::filesystem::path &pPath, DirBatch &pBatch, std::error_code &pErr) noexcept;
+
+/**
+ * @brief                   Fetches the identity of a directory
+ *
+ * @param pPath             Path of the directory
+ * @param pIdentity         Identity of the directory
+ * @param pErr              Error that occoured while fetching the identity
+ *
+ * @return true             If the identity was fetched
+ * @return false            If the identity could not be fetched
+ */
+[[nodiscard]] bool
+read_dir_identity (const std::filesystem::path &pPath, DirIdentity &pIdentity, std::error_code &pErr) noexcept;
+
+/**
+ * @brief                   Checks whether metadata can be fetched in the given way on this system (and by this thread)
+ *
+ * @param pMode             Way of fetching metadata to check
+ *
+ * @return true             If metadata can be fetched in the given way
+ * @return false            If stat_dir_entries would fall back to blocking calls
+ */
+[[nodiscard]] bool
+stat_mode_available (const StatMode &pMode) noexcept;
+
+/**
+ * @brief                   Fetches the requested metadata of every entry of a batch whose statMask is set
+ *
+ *                          The batch must not have been closed yet (unless it was restored, in which case there is
+ *                          nothing to fetch). If the requested mode is not available, the metadata is fetched with
+ *                          blocking calls instead. On Linux, blocking calls for large directories are made in the order of
+ *                          the inode numbers reported by the directory (the order of the entries themselves is kept), which
+ *                          keeps a cold disk from seeking back and forth between the tables of inodes
+ *
+ * @param pBatch            Batch whose entries to fetch the metadata of
+ * @param pMode             Way of fetching the metadata
+ */
+void
+stat_dir_entries (DirBatch &pBatch, const StatMode &pMode = StatMode::SYNC) noexcept;
+
+/**
+ * @brief                   Fetches the requested metadata of a single entry of a batch (whatever was fetched for it before
+ *                          is fetched again)
+ *
+ *                          If the batch has already been closed, the entry is found through its whole path instead
+ *
+ * @param pBatch            Batch containing the entry
+ * @param pEntry            Entry whose metadata to fetch (as given by its statMask)
+ */
+void
+stat_dir_entry (DirBatch &pBatch, DirEntry &pEntry) noexcept;
+
+#endif
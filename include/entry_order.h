@@ -0,0 +1,114 @@
+/**
+ * @file            entry_order.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Sorts the entries of a single directory before they are printed, so that sorted output can be
+ *                  streamed without holding on to the rest of the tree
+ *
+ */
+
+#ifndef ENTRY_ORDER_H
+#define ENTRY_ORDER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "dir_reader.h"
+
+
+/** Order in which the entries of each directory are printed */
+enum class SortOrder : uint8_t
+{
+    /** As the directory returned them */
+    NONE,
+    /** By name (comparing the native names code unit by code unit) */
+    NAME,
+    /** Largest first (entries whose size is not known come last), and then by name */
+    SIZE,
+    /** Most recently modified first (entries whose time is not known come last), and then by name */
+    MTIME
+};
+
+/** Compact record of an entry that is being sorted */
+struct SortRecord
+{
+    /** Primary key of the entry (records are sorted in ascending order of it) */
+    int64_t                 key;
+    /** First code units of the name of the entry, packed so that comparing them compares the start of the names */
+    uint64_t                prefix;
+    /** Position of the entry in the batch */
+    uint32_t                index;
+};
+
+/**
+ * @brief                   Sorts the entries of batches, one directory at a time
+ *
+ *                          The keys of the entries are worked out once into compact records (the key, the first code
+ *                          units of the name, and the position of the entry), which are then sorted on their own, so the
+ *                          names only need to be compared in full when two records share both the key and the prefix.
+ *                          The entries are finally moved into their sorted positions, so everything that walks the
+ *                          batch afterwards sees them in order. The records and the buffer the entries are moved through
+ *                          belong to the sorter and are reused for every directory, so memory is proportional to the
+ *                          largest directory sorted
+ */
+class EntryOrder
+{
+    /** Records of the batch that is being sorted */
+    std::vector<SortRecord> mRecords;
+    /** Entries of the batch, in their sorted positions */
+    std::vector<DirEntry>   mSorted;
+    /** Tags of the entries of the batch, in their sorted positions */
+    std::vector<int32_t>    mSortedTags;
+
+public:
+
+    /**
+     * @brief               Works out the records of the entries of a batch (its metadata must have been fetched)
+     *
+     *                      Sizes are taken from the entries whose sizes were fetched (apart from directories, whose
+     *                      keys can be set with set_key), and times from the entries whose times were fetched (the
+     *                      entries of a batch restored from an index have both)
+     *
+     * @param pBatch        Batch whose entries to sort
+     * @param pOrder        Order to sort the entries in (must not be SortOrder::NONE)
+     */
+    void
+    prepare (const DirBatch &pBatch, const SortOrder &pOrder);
+
+    /**
+     * @brief               Overrides the key of an entry (for keys that are not part of the metadata of the entry)
+     *
+     * @param pIndex        Position of the entry in the batch
+     * @param pKey          Key of the entry (entries are sorted in ascending order of their keys)
+     */
+    void
+    set_key (const size_t &pIndex, const int64_t &pKey) noexcept
+    {
+        mRecords[pIndex].key    = pKey;
+    }
+
+    /**
+     * @brief               Sorts the records prepared last, and moves the entries of the batch into their sorted positions
+     *
+     * @param pBatch        Batch that the records were prepared from
+     * @param pTags         Values kept alongside each entry, which are moved along with them (nullptr if there are none)
+     */
+    void
+    apply (DirBatch &pBatch, std::vector<int32_t> *pTags = nullptr);
+
+    /**
+     * @brief               Returns the key that sorts an entry of a given size among the others
+     *
+     * @param pSize         Size of the entry (-1 if it is not known)
+     *
+     * @return int64_t      Key of the entry
+     */
+    [[nodiscard]] static int64_t
+    size_key (const int64_t &pSize) noexcept
+    {
+        return (pSize < 0) ? (1) : (-pSize);
+    }
+};
+
+#endif
@@ -0,0 +1,151 @@
+/**
+ * @file            file_stats.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Distributions of the regular files found by a walk (by size, by age and by extension)
+ *
+ */
+
+#ifndef FILE_STATS_H
+#define FILE_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include <filesystem>
+#include <unordered_map>
+
+#include "dir_reader.h"
+
+/** Number of buckets of sizes (the first holds empty files, and bucket k holds sizes from 2^(k-1) up to 2^k - 1) */
+#define STATS_SIZE_BUCKETS      (65)
+/** Number of buckets of ages (the last holds files modified after the walk started) */
+#define STATS_AGE_BUCKETS       (9)
+
+
+/** Number of files in a bucket, and their combined size */
+struct StatsBucket
+{
+    /** Number of files */
+    uint64_t                count               {};
+    /** Combined size of the files in bytes */
+    uint64_t                bytes               {};
+};
+
+/**
+ * @brief                   Histograms of the sizes and ages of regular files, along with their counts and sizes per
+ *                          extension
+ *
+ *                          Adding a file costs a couple of increments in fixed arrays (the bucket of a size is found from
+ *                          its highest set bit), and one lookup in the table of extensions, which only allocates the
+ *                          first time an extension is seen. Each worker of a walk keeps its own, and they are merged once
+ *                          the walk is complete
+ */
+class FileStats
+{
+    /** Time from which the ages of files are measured */
+    time_t                  mNow                {};
+
+    /** Files by size */
+    StatsBucket             mSizes[STATS_SIZE_BUCKETS]  {};
+    /** Files by age */
+    StatsBucket             mAges[STATS_AGE_BUCKETS]    {};
+    /** Files by extension (in lowercase, without the dot, and empty for files without one) */
+    std::unordered_map<std::filesystem::path::string_type, StatsBucket>    mExtensions {};
+
+    /** Extension of the file added last (kept so that looking up an extension does not allocate) */
+    std::filesystem::path::string_type  mKey    {};
+
+public:
+
+    FileStats () = default;
+
+    /**
+     * @brief               Prepares empty histograms
+     *
+     * @param pNow          Time from which the ages of files are measured (usually the time at which the walk started)
+     */
+    explicit
+    FileStats (const time_t &pNow)
+        : mNow (pNow)
+    {
+    }
+
+    /**
+     * @brief               Adds a regular file to the histograms
+     *
+     * @param pSize         Size of the file
+     * @param pMtime        Time of last modification of the file
+     * @param pName         Name of the file
+     * @param pNameLen      Length of the name
+     */
+    void
+    add (const int64_t &pSize, const time_t &pMtime, const DirBatch::char_t *pName, const size_t &pNameLen);
+
+    /**
+     * @brief               Adds all the files of other histograms to these
+     *
+     * @param pOther        Histograms to add
+     */
+    void
+    merge (const FileStats &pOther);
+
+    /**
+     * @brief               Returns the files of a bucket of sizes
+     *
+     * @param pBucket       Position of the bucket
+     *
+     * @return const StatsBucket& Files in the bucket
+     */
+    [[nodiscard]] const StatsBucket
+    &size_bucket (const size_t &pBucket) const noexcept
+    {
+        return mSizes[pBucket];
+    }
+
+    /**
+     * @brief               Returns the files of a bucket of ages
+     *
+     * @param pBucket       Position of the bucket
+     *
+     * @return const StatsBucket& Files in the bucket
+     */
+    [[nodiscard]] const StatsBucket
+    &age_bucket (const size_t &pBucket) const noexcept
+    {
+        return mAges[pBucket];
+    }
+
+    /**
+     * @brief               Returns the files of each extension
+     *
+     * @return const std::unordered_map<std::filesystem::path::string_type, StatsBucket>& Files by extension
+     */
+    [[nodiscard]] const std::unordered_map<std::filesystem::path::string_type, StatsBucket>
+    &extensions () const noexcept
+    {
+        return mExtensions;
+    }
+
+    /**
+     * @brief               Writes a description of the sizes in a bucket (such as "4 KiB - 8 KiB")
+     *
+     * @param pBucket       Position of the bucket
+     * @param pBuff         Buffer to write the description into
+     * @param pBuffLen      Length of the buffer
+     */
+    static void
+    size_label (const size_t &pBucket, char *pBuff, const size_t &pBuffLen) noexcept;
+
+    /**
+     * @brief               Returns a description of the ages in a bucket (such as "1 - 7 days")
+     *
+     * @param pBucket       Position of the bucket
+     *
+     * @return const char*  Description of the bucket
+     */
+    [[nodiscard]] static const char
+    *age_label (const size_t &pBucket) noexcept;
+};
+
+#endif
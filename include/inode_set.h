@@ -0,0 +1,75 @@
+/**
+ * @file            inode_set.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Compact set of the (device, inode) pairs of files, so that hard-linked files are only counted once
+ *
+ */
+
+#ifndef INODE_SET_H
+#define INODE_SET_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+/** Number of slots of an InodeSet once the first pair is inserted (must be a power of 2) */
+#define INODE_SET_MIN_SLOTS     (1024)
+
+
+/**
+ * @brief                   Set of the identities (device and inode number) of files
+ *
+ *                          The pairs are stored inline in one flat table with open addressing and linear probing, two
+ *                          words per slot with no nodes or pointers, so looking up a pair usually touches a single cache
+ *                          line. The table is doubled once it is half full. Inode number 0 marks an empty slot, so pairs
+ *                          with inode number 0 (filesystems without inode numbers) can not be inserted
+ */
+class InodeSet
+{
+    /** Device (at even positions) and inode number (at odd positions) of each slot */
+    std::vector<uint64_t>   mSlots;
+    /** Number of pairs in the set */
+    size_t                  mSize               {};
+    /** Mask to wrap positions of slots (the number of slots minus 1) */
+    size_t                  mMask               {};
+
+    /**
+     * @brief               Doubles the number of slots, and inserts every pair again
+     */
+    void
+    grow ();
+
+public:
+
+    /**
+     * @brief               Inserts a pair into the set, unless it is in the set already
+     *
+     * @param pDev          Device containing the file
+     * @param pIno          Inode number of the file (must not be 0)
+     *
+     * @return true         If the pair was inserted (it was not in the set before)
+     * @return false        If the pair was in the set already
+     */
+    [[nodiscard]] bool
+    insert (const uint64_t &pDev, const uint64_t &pIno);
+
+    /**
+     * @brief               Removes every pair from the set (the slots are kept)
+     */
+    void
+    clear () noexcept;
+
+    /**
+     * @brief               Returns the number of pairs in the set
+     *
+     * @return size_t       Number of pairs
+     */
+    [[nodiscard]] size_t
+    size () const noexcept
+    {
+        return mSize;
+    }
+};
+
+#endif
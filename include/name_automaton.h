@@ -0,0 +1,104 @@
+/**
+ * @file            name_automaton.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Glob and regular expression patterns for the names of entries, compiled once into a DFA
+ *
+ */
+
+#ifndef NAME_AUTOMATON_H
+#define NAME_AUTOMATON_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dir_reader.h"
+
+/** Largest number of states of the automaton of a pattern, beyond which the pattern is rejected */
+#define AUTOMATON_MAX_STATES    (8192)
+
+
+/** Language in which a pattern of a NameAutomaton is written */
+enum class PatternSyntax : uint8_t
+{
+    /** Shell wildcards ("*", "?" and bracket expressions), matched against the whole name */
+    GLOB,
+    /** Extended regular expression, matched anywhere within the name unless anchored with "^" or "$" */
+    REGEX
+};
+
+/**
+ * @brief                   Checks whether names match a glob or a regular expression
+ *
+ *                          The pattern is compiled once into a DFA over the bytes of names (UTF-8), so checking a name
+ *                          costs a single table lookup per byte. Literal text that every match must start or end with is
+ *                          compared first, which rejects most names without running the automaton at all, and patterns
+ *                          that are nothing but such text (along with a single "*" in between) never run it
+ */
+class NameAutomaton
+{
+    /** Ways of deciding a match once the literal prefix and suffix have been found */
+    enum class Shortcut : uint8_t
+    {
+        /** The rest of the name is run through the automaton */
+        NONE,
+        /** The name must be the prefix itself */
+        LITERAL,
+        /** Anything may come between the prefix and the suffix */
+        PREFIX_SUFFIX
+    };
+
+    /** Text that every matching name starts with */
+    std::string             mPrefix             {};
+    /** Text that every matching name ends with (after the prefix) */
+    std::string             mSuffix             {};
+    /** How a match is decided once the prefix and the suffix have been found */
+    Shortcut                mShortcut           {Shortcut::NONE};
+
+    /** Class of each byte (bytes of the same class always lead to the same state) */
+    uint8_t                 mByteClasses[256]   {};
+    /** Number of classes of bytes */
+    uint32_t                mNumClasses         {1};
+    /** Next state for each state and class of bytes (state 0 never leads to a match) */
+    std::vector<uint32_t>   mTransitions        {};
+    /** Whether a name ending in each state matches */
+    std::vector<uint8_t>    mAccepting          {};
+    /** State reached once the prefix has been read */
+    uint32_t                mPrefixState        {};
+
+public:
+
+    /**
+     * @brief               Compiles a pattern, replacing whatever pattern was compiled before
+     *
+     *                      Bracket expressions may only list ASCII characters, while "?", "." and negated bracket
+     *                      expressions match a whole UTF-8 character. Anchors are only supported at the very start and
+     *                      the very end of a regular expression
+     *
+     * @param pSyntax       Language in which the pattern is written
+     * @param pPattern      Pattern to compile (UTF-8)
+     * @param pErr          Description of what is wrong with the pattern (if it could not be compiled)
+     *
+     * @return true         If the pattern was compiled
+     * @return false        If the pattern is not valid, or is too complex
+     */
+    [[nodiscard]] bool
+    compile (const PatternSyntax &pSyntax, const std::string_view &pPattern, const char *&pErr);
+
+    /**
+     * @brief               Checks whether a name matches the pattern
+     *
+     * @param pName         Name to check
+     * @param pNameLen      Length of the name
+     *
+     * @return true         If the name matches the pattern
+     * @return false        If the name does not match the pattern
+     */
+    [[nodiscard]] bool
+    matches (const DirBatch::char_t *pName, const size_t &pNameLen) const;
+};
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * @file            name_matcher.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Matchers for the names of entries, prepared once before a search starts
+ *
+ */
+
+#ifndef NAME_MATCHER_H
+#define NAME_MATCHER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "dir_reader.h"
+
+
+/**
+ * @brief                   Checks whether names contain a fixed pattern
+ *
+ *                          Names are compared as the raw characters read from the directory (no string is built for
+ *                          them). Positions where both the first and the last character of the pattern match are found
+ *                          a whole vector register at a time (AVX2, SSE2 or NEON, whichever the build targets), and only
+ *                          those are compared in full, so most names are rejected without comparing a single character
+ *                          of the pattern one by one
+ */
+class SubstringMatcher
+{
+    /** Pattern to look for */
+    std::basic_string<DirBatch::char_t>     mPattern;
+
+public:
+
+    SubstringMatcher () = default;
+
+    /**
+     * @brief               Prepares a matcher for the given pattern
+     *
+     * @param pPattern      Pattern to look for (in the native encoding of names)
+     */
+    explicit
+    SubstringMatcher (std::basic_string<DirBatch::char_t> pPattern)
+        : mPattern (std::move (pPattern))
+    {
+    }
+
+    /**
+     * @brief               Checks whether a name contains the pattern
+     *
+     * @param pName         Name to check, which must be followed by at least DIR_NAME_PADDING readable characters (as
+     *                      the names of a DirBatch are)
+     * @param pNameLen      Length of the name
+     *
+     * @return true         If the name contains the pattern
+     * @return false        If the name does not contain the pattern
+     */
+    [[nodiscard]] bool
+    matches (const DirBatch::char_t *pName, const size_t &pNameLen) const noexcept;
+};
+
+/** Way in which a pattern of a MultiPatternMatcher is compared with names */
+enum class PatternMode : uint8_t
+{
+    /** The whole name must be the pattern */
+    EXACT,
+    /** The name without its extension must be the pattern */
+    NOEXT,
+    /** The name must contain the pattern */
+    CONTAINS
+};
+
+/**
+ * @brief                   Checks names against a whole list of patterns (each with its own mode) at once
+ *
+ *                          The patterns are compiled once: those compared with the whole name (or its stem) go into
+ *                          hash tables, and those looked for within the name go into a single Aho-Corasick automaton,
+ *                          so each name is checked against every pattern with two lookups and one pass over its
+ *                          characters, no matter how many patterns there are. Names and patterns are compared as UTF-8
+ */
+class MultiPatternMatcher
+{
+    /** Hash of strings that can be looked up by a view, without building a string out of it */
+    struct PatternHash
+    {
+        using is_transparent        = void;
+
+        [[nodiscard]] size_t
+        operator() (const std::string_view &pStr) const noexcept
+        {
+            return std::hash<std::string_view> {} (pStr);
+        }
+    };
+
+    /** Table of patterns keyed by their text, along with the position of the first pattern with that text */
+    using PatternTable          = std::unordered_map<std::string, int32_t, PatternHash, std::equal_to<>>;
+
+    /** Patterns as they were given, in order (reported for the names that match them) */
+    std::vector<std::string>    mPatterns       {};
+
+    /** Patterns that must be the whole name */
+    PatternTable                mExact          {};
+    /** Patterns that must be the name without its extension */
+    PatternTable                mStems          {};
+
+    /** Next state of the automaton for each state and byte (256 for each state, empty if there are no such patterns) */
+    std::vector<uint32_t>       mTransitions    {};
+    /** First pattern (by position) found on reaching each state of the automaton (-1 if none) */
+    std::vector<int32_t>        mOutputs        {};
+
+public:
+
+    /**
+     * @brief               Adds a pattern to the list (build must be called once all the patterns have been added)
+     *
+     * @param pMode         Way in which the pattern is compared with names
+     * @param pText         Text of the pattern (UTF-8)
+     * @param pDisplay      Pattern as it is reported for the names that match it
+     */
+    void
+    add (const PatternMode &pMode, const std::string_view &pText, std::string pDisplay);
+
+    /**
+     * @brief               Completes the automaton of the patterns that are looked for within names
+     */
+    void
+    build ();
+
+    /**
+     * @brief               Reads the list of patterns from a file, and builds the matcher
+     *
+     *                      Each line holds a single pattern, prefixed by its mode ("exact:", "noext:" or "contains:").
+     *                      Lines without any of these prefixes are exact patterns, while empty lines and lines starting
+     *                      with '#' are ignored
+     *
+     * @param pPath         Path of the file
+     * @param pErr          Error that occoured while reading the file
+     *
+     * @return true         If the patterns were read
+     * @return false        If the file could not be read, or has no patterns
+     */
+    [[nodiscard]] bool
+    load (const std::filesystem::path &pPath, std::error_code &pErr);
+
+    /**
+     * @brief               Returns the number of patterns
+     *
+     * @return size_t       Number of patterns
+     */
+    [[nodiscard]] size_t
+    size () const noexcept
+    {
+        return mPatterns.size ();
+    }
+
+    /**
+     * @brief               Returns a pattern as it is reported for the names that match it
+     *
+     * @param pPattern      Position of the pattern (less than size)
+     *
+     * @return const std::string& Pattern, along with its mode prefix (if it had one)
+     */
+    [[nodiscard]] const std::string
+    &display (const int32_t &pPattern) const noexcept
+    {
+        return mPatterns[(size_t)pPattern];
+    }
+
+    /**
+     * @brief               Finds the first pattern (in the order they were added) that a name matches
+     *
+     * @param pName         Name to check
+     * @param pNameLen      Length of the name
+     *
+     * @return int32_t      Position of the pattern (-1 if the name matches none of the patterns)
+     */
+    [[nodiscard]] int32_t
+    match (const DirBatch::char_t *pName, const size_t &pNameLen) const;
+};
+
+#endif
@@ -0,0 +1,345 @@
+/**
+ * @file            output_writer.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Buffered writer that formats the output of a scan as narrow (UTF-8) text
+ *
+ */
+
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#include <cstdint>
+#include <ctime>
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "dir_reader.h"
+
+
+/** Number of bytes that are collected by a writer before they are written out */
+#define OUTPUT_BUFF_LEN         (64 * 1024)
+
+/** Size of a cache line, used to keep the writers of different workers from sharing one */
+#define OUTPUT_CACHE_LINE       (64)
+
+/** Magic bytes at the start of a stream of binary records */
+#define OUTPUT_BIN_MAGIC        "FSSB"
+/** Version of the layout of binary records */
+#define OUTPUT_BIN_VERSION      (1)
+
+/** Flag of a binary record set if the size of the entry is present */
+#define RECORD_HAS_SIZE         (1U << 0)
+/** Flag of a binary record set if the time of last modification of the entry is present */
+#define RECORD_HAS_MTIME        (1U << 1)
+/** Flag of a binary record set if the permissions of the entry are present */
+#define RECORD_HAS_PERMS        (1U << 2)
+/** Flag of a binary record set if the record ends with the target of the entry (which is a symlink) */
+#define RECORD_HAS_TARGET       (1U << 3)
+/** Flag of a binary record set if the record ends with the pattern that the entry matched */
+#define RECORD_HAS_PATTERN      (1U << 4)
+
+
+/** Layout of the output of a scan */
+enum class OutputFormat : uint8_t
+{
+    /** Human readable table, along with summaries */
+    TEXT,
+    /** Paths only, each followed by a NUL byte (as "find -print0" prints them) */
+    NUL,
+    /** One JSON object per entry, each on its own line */
+    JSONL,
+    /** Length-prefixed binary records (see write_record for the layout) */
+    BIN
+};
+
+/** Everything that is written out about a single entry in one of the machine-readable formats */
+struct EntryRecord
+{
+    /** Path of the entry */
+    PathView                        path;
+    /** Target of the entry if it is a symlink (nullptr otherwise) */
+    const std::filesystem::path     *target;
+    /** Pattern that the entry matched, if the search has more than one (nullptr otherwise) */
+    const std::string               *pattern;
+
+    /** Type of the entry (symlinks are not followed) */
+    EntryType               type;
+    /** Fields below that are present (combination of RECORD_HAS_SIZE, RECORD_HAS_MTIME and RECORD_HAS_PERMS) */
+    uint32_t                fields;
+
+    /** Size of the entry in bytes (of all its contents, if it is a directory) */
+    int64_t                 size;
+    /** Time of last modification of the entry */
+    time_t                  mtime;
+    /** Permissions of the entry */
+    std::filesystem::perms  perms;
+};
+
+
+/**
+ * @brief                   Collects formatted output in a large buffer, and writes it out with as few calls as possible
+ *
+ *                          Text is formatted directly into the buffer (paths are written as their native bytes, which
+ *                          are UTF-8 on POSIX), and the buffer is only written out at the end of a line, so the lines of
+ *                          writers owned by different workers never interleave as long as they share the same lock. If
+ *                          the output is a terminal, every line is written out as soon as it ends
+ */
+class alignas (OUTPUT_CACHE_LINE) OutputWriter
+{
+    /** Buffered output that has not been written yet */
+    std::string             mBuff;
+    /** File descriptor to write the output to */
+    int                     mFd;
+    /** Lock held while writing out the buffer (nullptr if the writer is not shared between threads) */
+    std::mutex              *mLock;
+    /** Whether each line is written out as soon as it ends */
+    bool                    mIsLineBuffered;
+    /** Whether the time spent writing out the buffer is measured */
+    bool                    mIsTimed            {false};
+    /** Number of bytes written out so far */
+    uint64_t                mBytesWritten       {};
+    /** Time spent writing out the buffer so far, in nanoseconds (only measured if the writer is timed) */
+    uint64_t                mWriteNs            {};
+
+    /**
+     * @brief               Appends an integer as a fixed number of little-endian bytes
+     *
+     * @param pValue        Integer to append
+     * @param pNumBytes     Number of bytes to append
+     */
+    void
+    write_le (uint64_t pValue, const uint32_t &pNumBytes);
+
+    /**
+     * @brief               Appends UTF-8 text as a JSON string (quotes, backslashes and control characters are escaped)
+     *
+     * @param pStr          Text to append
+     */
+    void
+    write_json_string (const std::string_view &pStr);
+
+    /**
+     * @brief               Appends a path as a JSON string
+     *
+     * @param pPath         Path to append
+     */
+    void
+    write_json_path (const PathView &pPath);
+
+    /**
+     * @brief               Appends a path as its length (4 little-endian bytes) followed by the path (UTF-8)
+     *
+     * @param pPath         Path to append
+     */
+    void
+    write_bin_path (const PathView &pPath);
+
+public:
+
+    /**
+     * @brief               Constructs a writer for the given file descriptor
+     *
+     * @param pFd           File descriptor to write the output to
+     * @param pLock         Lock to hold while writing out the buffer (shared by all writers of the same output)
+     */
+    explicit
+    OutputWriter (const int &pFd, std::mutex *pLock = nullptr);
+
+    OutputWriter (const OutputWriter &) = delete;
+    OutputWriter &operator= (const OutputWriter &) = delete;
+    OutputWriter (OutputWriter &&) = default;
+    OutputWriter &operator= (OutputWriter &&) = default;
+
+    ~OutputWriter ()
+    {
+        flush ();
+    }
+
+    /**
+     * @brief               Appends a string to the buffer
+     *
+     * @param pStr          String to append
+     * @param pLen          Length of the string
+     */
+    void
+    write (const char *pStr, const size_t &pLen)
+    {
+        mBuff.append (pStr, pLen);
+    }
+
+    /**
+     * @brief               Appends a null-terminated string to the buffer
+     *
+     * @param pStr          String to append
+     */
+    void
+    write (const char *pStr)
+    {
+        mBuff.append (pStr);
+    }
+
+    /**
+     * @brief               Appends a character to the buffer multiple times
+     *
+     * @param pChar         Character to append
+     * @param pCount        Number of times to append the character
+     */
+    void
+    write_repeat (const char &pChar, const uint64_t &pCount)
+    {
+        mBuff.append (pCount, pChar);
+    }
+
+    /**
+     * @brief               Appends a null-terminated string to the buffer, right-aligned within a field (as "%*s" would)
+     *
+     * @param pStr          String to append
+     * @param pWidth        Width of the field (the string is not truncated if it is longer)
+     */
+    void
+    write_padded (const char *pStr, const uint64_t &pWidth);
+
+    /**
+     * @brief               Appends a path to the buffer (as UTF-8)
+     *
+     * @param pPath         Path to append
+     */
+    void
+    write_path (const std::filesystem::path &pPath);
+
+    /**
+     * @brief               Appends a native path that is not held by a std::filesystem::path to the buffer (as UTF-8)
+     *
+     * @param pPath         Path to append
+     */
+    void
+    write_path (const PathView &pPath);
+
+    /**
+     * @brief               Appends permissions to the buffer (as "rwxrwxrwx" followed by 3 spaces)
+     *
+     * @param pPerms        Permissions to append
+     */
+    void
+    write_permissions (const std::filesystem::perms &pPerms);
+
+    /**
+     * @brief               Appends a time point to the buffer in local time (as "%b %d %Y  %H:%M", right-aligned within 20
+     *                      columns)
+     *
+     * @param pTime         Time point to append
+     */
+    void
+    write_time (const time_t &pTime);
+
+    /**
+     * @brief               Appends text formatted with printf-style conversions to the buffer (for output that is not
+     *                      printed per entry)
+     *
+     * @param pFmt          Format string
+     * @param ...           Values to format
+     */
+    void
+    write_fmt (const char *pFmt, ...)
+#if defined (__GNUC__)
+    __attribute__ ((format (printf, 2, 3)))
+#endif
+    ;
+
+    /**
+     * @brief               Appends whatever needs to come before the first record of a stream in the given format
+     *
+     * @param pFormat       Format of the stream
+     */
+    void
+    write_stream_header (const OutputFormat &pFormat);
+
+    /**
+     * @brief               Appends a single record in one of the machine-readable formats, and ends it
+     *
+     *                      A binary record is laid out as follows (all integers are little-endian)
+     *
+     *                          uint32  length of the rest of the record
+     *                          uint8   type of the entry (EntryType)
+     *                          uint8   fields that are present (RECORD_HAS_* bits)
+     *                          uint16  permissions (the lower 12 bits of the mode)
+     *                          int64   size in bytes (-1 if not present)
+     *                          int64   time of last modification, in seconds since the epoch
+     *                          uint32  length of the path, followed by the path (UTF-8)
+     *                          uint32  length of the target, followed by the target (only if RECORD_HAS_TARGET is set)
+     *                          uint32  length of the pattern, followed by the pattern (only if RECORD_HAS_PATTERN is set)
+     *
+     *                      and the stream starts with the 4 bytes of OUTPUT_BIN_MAGIC, followed by an uint8 version
+     *                      (OUTPUT_BIN_VERSION) and 3 reserved zero bytes
+     *
+     * @param pFormat       Format of the record (must not be OutputFormat::TEXT)
+     * @param pRecord       Record to append
+     */
+    void
+    write_record (const OutputFormat &pFormat, const EntryRecord &pRecord);
+
+    /**
+     * @brief               Ends the current record, and writes out the buffer if it is full (or if the output is a terminal)
+     */
+    void
+    end_record ()
+    {
+        if (mIsLineBuffered || mBuff.size () >= OUTPUT_BUFF_LEN) {
+            flush ();
+        }
+    }
+
+    /**
+     * @brief               Ends the current line, and writes out the buffer if it is full (or if the output is line buffered)
+     */
+    void
+    end_line ()
+    {
+        mBuff.push_back ('\n');
+        end_record ();
+    }
+
+    /**
+     * @brief               Writes out everything in the buffer
+     */
+    void
+    flush () noexcept;
+
+    /**
+     * @brief               Sets whether the time spent writing out the buffer is measured
+     *
+     * @param pIsTimed      Whether the time is measured
+     */
+    void
+    set_timed (const bool &pIsTimed) noexcept
+    {
+        mIsTimed    = pIsTimed;
+    }
+
+    /**
+     * @brief               Returns the number of bytes written out so far
+     *
+     * @return uint64_t     Number of bytes
+     */
+    [[nodiscard]] uint64_t
+    bytes_written () const noexcept
+    {
+        return mBytesWritten;
+    }
+
+    /**
+     * @brief               Returns the time spent writing out the buffer so far (0 unless the writer is timed)
+     *
+     * @return uint64_t     Time in nanoseconds
+     */
+    [[nodiscard]] uint64_t
+    write_ns () const noexcept
+    {
+        return mWriteNs;
+    }
+};
+
+#endif
@@ -0,0 +1,337 @@
+/**
+ * @file            scan_context.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           State of a single scan (options, counters and caches), so that multiple scans can run at once
+ *
+ */
+
+#ifndef SCAN_CONTEXT_H
+#define SCAN_CONTEXT_H
+
+#include <cstdint>
+#include <ctime>
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dir_prefetcher.h"
+#include "dir_reader.h"
+#include "entry_order.h"
+#include "file_stats.h"
+#include "inode_set.h"
+#include "name_automaton.h"
+#include "name_matcher.h"
+#include "output_writer.h"
+#include "scan_index.h"
+#include "scan_profile.h"
+#include "scan_throttle.h"
+#include "top_entries.h"
+#include "tree_walker.h"
+
+/** Size of a cache line, used to keep the counters of different workers from sharing one */
+#define SCAN_CACHE_LINE         (64)
+
+/** File descriptor of the standard output */
+#define SCAN_STDOUT_FD          (1)
+/** File descriptor of the standard error */
+#define SCAN_STDERR_FD          (2)
+
+
+/**
+ * @brief                   Counters of the entries traversed by a single worker of a scan
+ *
+ *                          Each worker of a scan updates its own shard (which is padded to a cache line so that the
+ *                          shards of different workers do not share one), and the shards are merged once the scan is done
+ */
+struct alignas (SCAN_CACHE_LINE) ScanCounters
+{
+    /** Total number of files traversed */
+    uint64_t                numFilesTotal       {};
+    /** Total number of Symlinks traversed */
+    uint64_t                numSymlinksTotal    {};
+    /** Total number of special files traversed */
+    uint64_t                numSpecialTotal     {};
+    /** Total number of directories traversed */
+    uint64_t                numDirsTotal        {};
+
+    /** Number of files traversed in the root directory */
+    uint64_t                numFilesRoot        {};
+    /** Number of symlinks traversed in the root directory */
+    uint64_t                numSymlinksRoot     {};
+    /** Number of special files traversed in the root directory */
+    uint64_t                numSpecialRoot      {};
+    /** Number of subdirectories in the root directory */
+    uint64_t                numDirsRoot         {};
+
+    /** Number of files matching the search pattern */
+    uint64_t                numFilesMatched     {};
+    /** Number of symlinks matching the search pattern */
+    uint64_t                numSymlinksMatched  {};
+    /** Number of special files matching the search pattern */
+    uint64_t                numSpecialMatched   {};
+    /** Number of subdirectories matching the search pattern */
+    uint64_t                numDirsMatched      {};
+
+    /**
+     * @brief               Adds the counts of another shard to this one
+     *
+     * @param pOther        Shard whose counts to add
+     */
+    void
+    merge (const ScanCounters &pOther) noexcept
+    {
+        numFilesTotal       += pOther.numFilesTotal;
+        numSymlinksTotal    += pOther.numSymlinksTotal;
+        numSpecialTotal     += pOther.numSpecialTotal;
+        numDirsTotal        += pOther.numDirsTotal;
+
+        numFilesRoot        += pOther.numFilesRoot;
+        numSymlinksRoot     += pOther.numSymlinksRoot;
+        numSpecialRoot      += pOther.numSpecialRoot;
+        numDirsRoot         += pOther.numDirsRoot;
+
+        numFilesMatched     += pOther.numFilesMatched;
+        numSymlinksMatched  += pOther.numSymlinksMatched;
+        numSpecialMatched   += pOther.numSpecialMatched;
+        numDirsMatched      += pOther.numDirsMatched;
+    }
+};
+
+/**
+ * @brief                   Metadata that a scan fetches for each kind of entry
+ *
+ *                          The plan is worked out once from the options, the output format and the predicates of a scan,
+ *                          before anything is read, so that each entry is only stat-ed for what will actually be printed
+ *                          or checked (a listing that only shows names and types is answered from the directory alone)
+ */
+struct ScanPlan
+{
+    /** Metadata fetched for the regular files of a listed directory */
+    uint32_t                fileMask            {};
+    /** Metadata fetched for the subdirectories of a listed directory */
+    uint32_t                dirMask             {};
+    /** Metadata fetched for the symlinks of a listed directory */
+    uint32_t                symlinkMask         {};
+    /** Metadata fetched for the special files of a listed directory */
+    uint32_t                specialMask         {};
+
+    /** Metadata fetched for every entry that matched a search */
+    uint32_t                matchMask           {};
+    /** Metadata fetched for regular files that matched a search (on top of matchMask) */
+    uint32_t                matchFileMask       {};
+
+    /** Metadata fetched for regular files whose sizes are added to the sizes of directories */
+    uint32_t                sizeMask            {};
+    /** Metadata fetched for every subdirectory before it is entered (its device, if the scan stays on one filesystem) */
+    uint32_t                descendMask         {};
+};
+
+/**
+ * @brief                   Everything that a single scan (or search) reads and updates
+ *
+ *                          Nothing about a scan lives in process-wide state, so any number of scans can run at the same
+ *                          time as long as each has its own context. The options and the search pattern are set up before
+ *                          the scan starts and are only read while it runs, while everything else that is updated by the
+ *                          workers of a scan is either sharded per worker or protected by a lock
+ */
+struct ScanContext
+{
+    /** Bitmask to represent the options of the scan */
+    uint64_t                optionMask          {};
+
+    /** Number of threads to use for searching and for calculating directory sizes */
+    uint64_t                numThreads          {1};
+    /** Way of fetching the metadata of the entries of each directory */
+    StatMode                statMode            {StatMode::SYNC};
+    /** Layout of the output of the scan */
+    OutputFormat            outputFormat        {OutputFormat::TEXT};
+    /** Order in which the entries of each directory are printed */
+    SortOrder               sortOrder           {SortOrder::NONE};
+    /** Metadata fetched for each kind of entry */
+    ScanPlan                plan                {};
+
+    /** Filters of the walks of the scan (the depth of the listing, the globs of names to skip compiled once before the
+        scan starts, the size and time predicates and whether it stays on one filesystem), applied by libfss */
+    WalkOptions             filters             {};
+
+    /** Path of the directory from which the scan starts, as the walk builds the paths of entries from it */
+    std::filesystem::path   rootPath            {};
+    /** Canonical path of rootPath, resolved once before the scan starts (empty if it could not be resolved) */
+    std::filesystem::path   resolvedRoot        {};
+    /** Device containing rootPath, if the scan stays on one filesystem */
+    uint64_t                rootDev             {};
+
+    /** Pattern to search for if any of the search options are set, in the native encoding (empty otherwise) */
+    std::filesystem::path::string_type  searchPattern   {};
+    /** Matcher of the search pattern, prepared once before the search starts (only used by the contains search) */
+    SubstringMatcher        containsMatcher     {};
+    /** Automaton of the search pattern, compiled once before the search starts (only used by the glob and regex searches) */
+    NameAutomaton           nameAutomaton       {};
+    /** Patterns to search for all at once if the search has more than one (read from a file) */
+    MultiPatternMatcher     patternMatcher      {};
+
+    /** Flag to determine whether the summary should be printed or not */
+    bool                    printSummary        {};
+
+    /** Counters of the scan, one shard per worker */
+    std::vector<ScanCounters>   counters        = std::vector<ScanCounters> (1);
+
+    /** Sizes of subdirectories already aggregated which the scan will ask for again, keyed by path */
+    std::unordered_map<std::filesystem::path::string_type, int64_t>    dirSizeCache    {};
+    /** Lock protecting dirSizeCache while it is being filled by multiple workers */
+    std::mutex              dirSizeCacheLock    {};
+
+    /** Number of the largest entries that are printed instead of the contents of directories (0 to print the contents) */
+    uint64_t                topCount            {};
+    /** Largest entries found so far, one shard per worker */
+    std::vector<TopEntries> topShards           {};
+
+    /** Number of threads reading directories ahead of the walk (0 if nothing is prefetched) */
+    uint64_t                prefetchThreads     {};
+    /** Threads reading the subdirectories of each directory the walk reads, before the walk reaches them */
+    DirPrefetcher           prefetcher          {};
+
+    /** Bounds on how fast the scan reads directories and fetches metadata, and on how many workers do so at once */
+    ScanThrottle            throttle            {};
+
+    /** Number of seconds between the totals printed while the tree is watched for changes (0 if it is not watched) */
+    uint64_t                watchInterval       {};
+
+    /** Histograms of the regular files found so far, one shard per worker (only filled if histograms are printed) */
+    std::vector<FileStats>  statsShards         {};
+
+    /** Identities of the hard-linked files already added to the size of a directory (only filled if they are counted once) */
+    InodeSet                seenInodes          {};
+    /** Lock protecting seenInodes while it is being filled by multiple workers */
+    std::mutex              seenInodesLock      {};
+
+    /** Path of the index that the scan reuses and then updates (empty if the scan does not use one) */
+    std::filesystem::path   indexPath           {};
+    /** Index written by the previous scan (only used if it is open) */
+    ScanIndex               prevIndex           {};
+    /** Whether searches are answered from prevIndex alone, without reading the filesystem */
+    bool                    queryIndex          {false};
+    /** Index of the directories read by this scan, written out once it is complete */
+    IndexBuilder            nextIndex           {};
+
+    /** Lock held while writing out the output of a worker, so that the output of different workers is not interleaved */
+    std::mutex              outputLock          {};
+    /** Writers of the output of the scan, one per worker */
+    std::vector<OutputWriter>   writers         {};
+
+    /** Profiles of the workers of the scan, one per worker (empty unless the scan is profiled) */
+    std::vector<ScanProfile>    profiles        {};
+    /** Number of bytes written out by the writers that were already replaced */
+    uint64_t                outputBytes         {};
+    /** Time spent writing out the output by the writers that were already replaced, in nanoseconds */
+    uint64_t                outputNs            {};
+
+    /**
+     * @brief               Returns whether a given option is set or not
+     *
+     * @param pBit          Option to check
+     *
+     * @return true         If the given option is set
+     * @return false        If the given option is cleared
+     */
+    [[nodiscard]] bool
+    get_option (const uint8_t &pBit) const noexcept
+    {
+        return (optionMask & (1ULL << pBit)) != 0;
+    }
+
+    /**
+     * @brief               Sets an option
+     *
+     * @param pBit          Option to set
+     */
+    void
+    set_option (const uint8_t &pBit) noexcept
+    {
+        // a given bit can be set by generating a bitmask where only the desired bit is set
+        // and performing a logical OR operation between the initial value and the mask
+        optionMask |= (1ULL << pBit);
+    }
+
+    /**
+     * @brief               Clears an option
+     *
+     * @param pBit          Option to clear
+     */
+    void
+    clear_option (const uint8_t &pBit) noexcept
+    {
+        // a given bit can be cleared by generating a bitmask where only the desired bit is not
+        // set and performing a logical AND operation between the initial value and the mask
+        optionMask &= ~(1ULL << pBit);
+    }
+
+    /**
+     * @brief               Clears the counters and makes one shard available for each of the given number of workers
+     *
+     * @param pNumWorkers   Number of workers that will update the counters
+     */
+    void
+    reset_counters (const uint32_t &pNumWorkers)
+    {
+        counters.assign ((pNumWorkers == 0) ? (1) : (pNumWorkers), ScanCounters {});
+    }
+
+    /**
+     * @brief               Writes out everything buffered by the writers of all the workers
+     */
+    void
+    flush_writers () noexcept
+    {
+        for (auto &writer : writers) {
+            writer.flush ();
+        }
+    }
+
+    /**
+     * @brief               Writes out the output of all the workers, and makes one writer available for each of the
+     *                      given number of workers (all writing to the standard output)
+     *
+     * @param pNumWorkers   Number of workers that will write output
+     */
+    void
+    reset_writers (const uint32_t &pNumWorkers)
+    {
+        // the existing writers are written out before any of the new ones write anything
+        flush_writers ();
+        for (const auto &writer : writers) {
+            outputBytes += writer.bytes_written ();
+            outputNs    += writer.write_ns ();
+        }
+
+        writers.clear ();
+        writers.reserve ((pNumWorkers == 0) ? (1) : (pNumWorkers));
+        for (uint32_t i = 0; i < ((pNumWorkers == 0) ? (1) : (pNumWorkers)); ++i) {
+            writers.emplace_back (SCAN_STDOUT_FD, &outputLock);
+            writers.back ().set_timed (!profiles.empty ());
+        }
+    }
+
+    /**
+     * @brief               Returns the counters of all the workers combined
+     *
+     * @return ScanCounters Combined counters
+     */
+    [[nodiscard]] ScanCounters
+    merged_counters () const noexcept
+    {
+        /** Sum of the shards of all the workers */
+        ScanCounters        result;
+
+        for (const auto &shard : counters) {
+            result.merge (shard);
+        }
+
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,314 @@
+/**
+ * @file            scan_index.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Persistent on-disk index of the directories read by a scan, so that later scans can skip the ones
+ *                  that have not changed
+ *
+ *                  An index is a single file with no pointers in it (only offsets), so it can be mapped into memory
+ *                  and used as is. It starts with an IndexHeader, followed by the table of directories (IndexDir,
+ *                  sorted by path), the table of entries (IndexEntry, the entries of each directory next to each
+ *                  other) and finally all the paths and names (UTF-8, each followed by a null byte). All integers are
+ *                  in the native byte order
+ *
+ */
+
+#ifndef SCAN_INDEX_H
+#define SCAN_INDEX_H
+
+#include <cstdint>
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "dir_reader.h"
+
+
+/** Magic bytes at the start of an index */
+#define INDEX_MAGIC             "FSSI"
+/** Version of the layout of an index */
+#define INDEX_VERSION           (2)
+
+/** Metadata stored in an index for every entry (symlinks are followed as well) */
+#define INDEX_STAT_MASK         (STAT_TYPE | STAT_SIZE | STAT_MTIME | STAT_PERMS | STAT_LINKS | STAT_BLOCKS)
+
+
+/** Header at the start of an index */
+struct IndexHeader
+{
+    /** INDEX_MAGIC (without the null byte) */
+    char                    magic[4];
+    /** INDEX_VERSION */
+    uint32_t                version;
+    /** Number of directories in the index */
+    uint64_t                numDirs;
+    /** Number of entries of all the directories combined */
+    uint64_t                numEntries;
+    /** Number of bytes of paths and names */
+    uint64_t                namesLen;
+};
+
+/** Directory stored in an index */
+struct IndexDir
+{
+    /** Offset of the path of the directory (as it was read by the scan) */
+    uint64_t                pathOffset;
+    /** Length of the path of the directory */
+    uint32_t                pathLen;
+    /** Number of entries of the directory */
+    uint32_t                numEntries;
+    /** Position of the first entry of the directory in the table of entries */
+    uint64_t                firstEntry;
+    /** Inode number of the directory when it was read */
+    uint64_t                ino;
+    /** Time of last modification of the directory when it was read, in nanoseconds since the epoch */
+    int64_t                 mtimeNs;
+};
+
+/** Entry of a directory stored in an index */
+struct IndexEntry
+{
+    /** Offset of the name of the entry */
+    uint64_t                nameOffset;
+    /** Length of the name of the entry */
+    uint32_t                nameLen;
+    /** Error value (in the generic category) reported while fetching the metadata of the entry (0 if none) */
+    uint32_t                statErrno;
+    /** Type of the entry (EntryType), as reported by the directory */
+    uint8_t                 type;
+    /** Type of the entry (EntryType), of the target if the entry is a symlink */
+    uint8_t                 statType;
+    /** Permissions of the entry (the lower 12 bits of the mode) */
+    uint16_t                perms;
+    /** Number of hard links to the entry (saturated at UINT32_MAX) */
+    uint32_t                nlink;
+    /** Size of the entry in bytes (-1 if it is not a regular file) */
+    int64_t                 size;
+    /** Time of last modification of the entry, in seconds since the epoch */
+    int64_t                 mtime;
+    /** Device containing the entry */
+    uint64_t                dev;
+    /** Inode number of the entry */
+    uint64_t                ino;
+    /** Space allocated to the entry in bytes (-1 if it is not known) */
+    int64_t                 allocSize;
+};
+
+static_assert (sizeof (IndexHeader) == 32, "Layout of the index header must not depend on the platform");
+static_assert (sizeof (IndexDir) == 40, "Layout of the index directories must not depend on the platform");
+static_assert (sizeof (IndexEntry) == 64, "Layout of the index entries must not depend on the platform");
+
+
+/**
+ * @brief                   Converts a path into the form in which it is stored in an index
+ *
+ * @param pPath             Path to convert
+ *
+ * @return std::string      Path as UTF-8
+ */
+[[nodiscard]] std::string
+index_key (const std::filesystem::path &pPath);
+
+/**
+ * @brief                   Converts a path stored in an index back into a path
+ *
+ * @param pKey              Path as stored in the index
+ *
+ * @return std::filesystem::path Path in the native encoding
+ */
+[[nodiscard]] std::filesystem::path
+index_path (const std::string_view &pKey);
+
+/**
+ * @brief                   Index written by an earlier scan, mapped read-only into memory
+ */
+class ScanIndex
+{
+    /** Contents of the index (nullptr if no index is open) */
+    const char              *mData              {nullptr};
+    /** Length of the contents of the index */
+    size_t                  mLen                {};
+
+#if defined (_WIN32) || defined (_WIN64)
+    /** Contents of the index, read into memory (it is not mapped on Windows) */
+    std::vector<char>       mBuff               {};
+#endif
+
+    /** Header of the index */
+    const IndexHeader       *mHeader            {nullptr};
+    /** Table of directories */
+    const IndexDir          *mDirs              {nullptr};
+    /** Table of entries */
+    const IndexEntry        *mEntries           {nullptr};
+    /** Paths and names */
+    const char              *mNames             {nullptr};
+
+public:
+
+    ScanIndex () = default;
+    ScanIndex (const ScanIndex &) = delete;
+    ScanIndex &operator= (const ScanIndex &) = delete;
+
+    ~ScanIndex ()
+    {
+        close ();
+    }
+
+    /**
+     * @brief               Opens an index and checks that its layout is valid
+     *
+     * @param pPath         Path of the index
+     * @param pErr          Error that occoured while opening the index
+     *
+     * @return true         If the index was opened
+     * @return false        If the index does not exist or is not valid
+     */
+    [[nodiscard]] bool
+    open (const std::filesystem::path &pPath, std::error_code &pErr) noexcept;
+
+    /**
+     * @brief               Closes the index (if one is open)
+     */
+    void
+    close () noexcept;
+
+    /**
+     * @brief               Returns whether an index is open
+     *
+     * @return true         If an index is open
+     * @return false        If no index is open
+     */
+    [[nodiscard]] bool
+    is_open () const noexcept
+    {
+        return mData != nullptr;
+    }
+
+    /**
+     * @brief               Returns the number of directories in the index
+     *
+     * @return uint64_t     Number of directories (0 if no index is open)
+     */
+    [[nodiscard]] uint64_t
+    num_dirs () const noexcept
+    {
+        return (mData == nullptr) ? (0) : (mHeader->numDirs);
+    }
+
+    /**
+     * @brief               Returns a directory of the index
+     *
+     * @param pPos          Position of the directory (less than num_dirs)
+     *
+     * @return const IndexDir& Directory at the given position
+     */
+    [[nodiscard]] const IndexDir
+    &dir_at (const uint64_t &pPos) const noexcept
+    {
+        return mDirs[pPos];
+    }
+
+    /**
+     * @brief               Returns the path of a directory of the index, as it is stored
+     *
+     * @param pDir          Directory whose path to return
+     *
+     * @return std::string_view Path of the directory (empty if it lies outside the index)
+     */
+    [[nodiscard]] std::string_view
+    dir_key (const IndexDir &pDir) const noexcept
+    {
+        if (pDir.pathOffset > mHeader->namesLen || pDir.pathLen > mHeader->namesLen - pDir.pathOffset) {
+            return std::string_view {};
+        }
+        return std::string_view (mNames + pDir.pathOffset, pDir.pathLen);
+    }
+
+    /**
+     * @brief               Returns the position of the first directory whose path is not ordered before the given one
+     *
+     *                      Since directories are ordered by path, all the directories within a directory come after it,
+     *                      starting at this position
+     *
+     * @param pKey          Path as it is stored in the index
+     *
+     * @return uint64_t     Position of the first such directory (num_dirs if there is none)
+     */
+    [[nodiscard]] uint64_t
+    lower_bound (const std::string_view &pKey) const noexcept;
+
+    /**
+     * @brief               Looks up a directory in the index
+     *
+     * @param pPath         Path of the directory (as it is read by the scan)
+     *
+     * @return const IndexDir* Directory in the index (nullptr if it is not in the index)
+     */
+    [[nodiscard]] const IndexDir
+    *find_dir (const std::filesystem::path &pPath) const noexcept;
+
+    /**
+     * @brief               Restores the entries of a directory of the index (along with all their metadata) into a batch
+     *
+     * @param pDir          Directory to restore
+     * @param pPath         Path of the directory
+     * @param pBatch        Batch to restore the entries into (any previous contents are discarded)
+     *
+     * @return true         If the directory was restored
+     * @return false        If the entries of the directory are not valid
+     */
+    [[nodiscard]] bool
+    restore_dir (const IndexDir &pDir, const std::filesystem::path &pPath, DirBatch &pBatch) const;
+};
+
+/**
+ * @brief                   Collects the directories read by a scan (from any number of workers), and writes them out
+ *                          as an index
+ */
+class IndexBuilder
+{
+    /** Directory collected by the builder */
+    struct PendingDir
+    {
+        /** Path of the directory (UTF-8) */
+        std::string                 path;
+        /** Identity of the directory */
+        DirIdentity                 identity;
+        /** Entries of the directory (offsets of names are relative to the names of the directory) */
+        std::vector<IndexEntry>     entries;
+        /** Names of the entries of the directory, each followed by a null byte */
+        std::string                 names;
+    };
+
+    /** Directories collected so far */
+    std::vector<PendingDir> mDirs               {};
+    /** Lock protecting the collected directories */
+    std::mutex              mLock               {};
+
+public:
+
+    /**
+     * @brief               Adds a directory whose entries have all the metadata in INDEX_STAT_MASK
+     *
+     * @param pBatch        Entries of the directory (the identity of the batch must be filled)
+     */
+    void
+    add_dir (const DirBatch &pBatch);
+
+    /**
+     * @brief               Writes out the collected directories as an index (replacing any existing file at once)
+     *
+     * @param pPath         Path of the index
+     * @param pErr          Error that occoured while writing the index
+     *
+     * @return true         If the index was written
+     * @return false        If the index could not be written
+     */
+    [[nodiscard]] bool
+    write (const std::filesystem::path &pPath, std::error_code &pErr);
+};
+
+#endif
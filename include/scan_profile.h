@@ -0,0 +1,187 @@
+/**
+ * @file            scan_profile.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Counters and per-phase timers of a scan, kept by each worker when the scan is profiled
+ *
+ */
+
+#ifndef SCAN_PROFILE_H
+#define SCAN_PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <chrono>
+#include <system_error>
+
+/** Size of a cache line, used to keep the profiles of different workers from sharing one */
+#define PROFILE_CACHE_LINE      (64)
+
+
+/** Phases of a scan whose time is measured */
+enum class ProfilePhase : uint8_t
+{
+    /** Reading the entries of directories (or restoring them from an index) */
+    READ_DIR,
+    /** Fetching the metadata of entries */
+    STAT,
+    /** Resolving the absolute paths of entries */
+    RESOLVE,
+    /** Calculating the sizes of directories (which includes the reads and stats of the directories walked for them) */
+    DIR_SIZE,
+    /** Writing out the output */
+    OUTPUT,
+
+    /** Number of phases */
+    COUNT
+};
+
+/** Kinds of errors that are counted */
+enum class ProfileError : uint8_t
+{
+    /** A directory could not be read */
+    READ_DIR,
+    /** The metadata of an entry could not be fetched */
+    STAT,
+    /** The absolute path of an entry could not be resolved */
+    RESOLVE,
+
+    /** Number of kinds */
+    COUNT
+};
+
+/**
+ * @brief                   Counters and timers of the work done by a single worker of a scan
+ *
+ *                          Each worker updates its own profile (which is padded to a cache line so that the profiles of
+ *                          different workers do not share one), and the profiles are merged once the scan is done. Nothing
+ *                          is counted unless the scan is profiled, in which case counting an event is a single increment,
+ *                          and timing a phase costs two reads of the monotonic clock
+ */
+struct alignas (PROFILE_CACHE_LINE) ScanProfile
+{
+    /** Number of directories read from the filesystem */
+    uint64_t                dirsRead            {};
+    /** Number of directories restored from the index of a previous scan */
+    uint64_t                dirsRestored        {};
+    /** Number of entries found in the directories that were read or restored */
+    uint64_t                entriesSeen         {};
+    /** Number of entries whose metadata was fetched from the filesystem */
+    uint64_t                entriesStat         {};
+    /** Number of paths resolved through the filesystem */
+    uint64_t                pathsResolved       {};
+    /** Number of subtrees walked to calculate their sizes (sizes found in the cache are not counted) */
+    uint64_t                sizeWalks           {};
+
+    /** Number of errors of each kind */
+    uint64_t                errors[(size_t)ProfileError::COUNT]         {};
+    /** Number of errors caused by missing permissions (of any kind) */
+    uint64_t                permissionErrors    {};
+    /** Number of errors caused by entries that no longer exist (of any kind) */
+    uint64_t                missingErrors       {};
+
+    /** Time spent in each phase, in nanoseconds */
+    uint64_t                phaseNs[(size_t)ProfilePhase::COUNT]        {};
+
+    /** Number of tasks processed by the worker (only counted for multi-threaded walks) */
+    uint64_t                tasks               {};
+    /** Number of tasks the worker stole from others */
+    uint64_t                steals              {};
+    /** Time the worker spent processing tasks, in nanoseconds */
+    uint64_t                busyNs              {};
+    /** Time the worker was part of a pool, in nanoseconds */
+    uint64_t                poolNs              {};
+
+    /**
+     * @brief               Counts an error of a given kind
+     *
+     * @param pKind         Kind of the error
+     * @param pErr          Error that occoured
+     */
+    void
+    add_error (const ProfileError &pKind, const std::error_code &pErr) noexcept
+    {
+        ++errors[(size_t)pKind];
+        if (pErr == std::errc::permission_denied || pErr == std::errc::operation_not_permitted) {
+            ++permissionErrors;
+        }
+        else if (pErr == std::errc::no_such_file_or_directory) {
+            ++missingErrors;
+        }
+    }
+
+    /**
+     * @brief               Adds the counts and times of another profile to this one
+     *
+     * @param pOther        Profile whose counts and times to add
+     */
+    void
+    merge (const ScanProfile &pOther) noexcept
+    {
+        dirsRead            += pOther.dirsRead;
+        dirsRestored        += pOther.dirsRestored;
+        entriesSeen         += pOther.entriesSeen;
+        entriesStat         += pOther.entriesStat;
+        pathsResolved       += pOther.pathsResolved;
+        sizeWalks           += pOther.sizeWalks;
+
+        for (size_t i = 0; i < (size_t)ProfileError::COUNT; ++i) {
+            errors[i]       += pOther.errors[i];
+        }
+        permissionErrors    += pOther.permissionErrors;
+        missingErrors       += pOther.missingErrors;
+
+        for (size_t i = 0; i < (size_t)ProfilePhase::COUNT; ++i) {
+            phaseNs[i]      += pOther.phaseNs[i];
+        }
+
+        tasks               += pOther.tasks;
+        steals              += pOther.steals;
+        busyNs              += pOther.busyNs;
+        poolNs              += pOther.poolNs;
+    }
+};
+
+/**
+ * @brief                   Adds the time from its construction to its destruction to a phase of a profile (and does nothing
+ *                          at all if there is no profile)
+ */
+class PhaseTimer
+{
+    /** Profile to add the time to (nullptr if the scan is not profiled) */
+    ScanProfile             *mProfile;
+    /** Phase to add the time to */
+    ProfilePhase            mPhase;
+    /** Time at which the timer was constructed */
+    std::chrono::steady_clock::time_point   mStart  {};
+
+public:
+
+    /**
+     * @brief               Starts timing a phase
+     *
+     * @param pProfile      Profile to add the time to (nullptr if the scan is not profiled)
+     * @param pPhase        Phase to add the time to
+     */
+    PhaseTimer (ScanProfile *pProfile, const ProfilePhase &pPhase) noexcept
+        : mProfile (pProfile)
+        , mPhase (pPhase)
+    {
+        if (mProfile != nullptr) {
+            mStart  = std::chrono::steady_clock::now ();
+        }
+    }
+
+    PhaseTimer (const PhaseTimer &) = delete;
+    PhaseTimer &operator= (const PhaseTimer &) = delete;
+
+    ~PhaseTimer ()
+    {
+        if (mProfile != nullptr) {
+            mProfile->phaseNs[(size_t)mPhase]   += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds> (
+                                                    std::chrono::steady_clock::now () - mStart).count ();
+        }
+    }
+};
+
+#endif
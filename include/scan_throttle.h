@@ -0,0 +1,237 @@
+/**
+ * @file            scan_throttle.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Bounds on how fast a scan reads directories and fetches metadata, and on how many workers do so at
+ *                  once, so that a scan of a busy host does not starve the rest of its workload
+ *
+ */
+
+#ifndef SCAN_THROTTLE_H
+#define SCAN_THROTTLE_H
+
+#include <cstdint>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+
+/** Number of calls whose latency is averaged before the number of workers allowed to make calls is adjusted */
+#define THROTTLE_WINDOW_CALLS   (64)
+
+
+/**
+ * @brief                   Rate at which some kind of call may be made, with a burst of up to one second worth of calls
+ */
+struct TokenBucket
+{
+    /** Number of calls allowed per second (0 if the calls are not limited) */
+    double                  rate                {};
+    /** Number of calls that may still be made right away (negative when calls have been reserved ahead of time) */
+    double                  tokens              {};
+    /** Time at which the tokens were last topped up */
+    std::chrono::steady_clock::time_point   last    {};
+
+    /**
+     * @brief               Reserves the tokens of a number of calls, and returns how long the caller must wait before
+     *                      making them
+     *
+     * @param pCount        Number of calls
+     * @param pNow          Current time
+     *
+     * @return std::chrono::nanoseconds Time to wait for (0 if the calls can be made right away)
+     */
+    [[nodiscard]] std::chrono::nanoseconds
+    reserve (const uint64_t &pCount, const std::chrono::steady_clock::time_point &pNow) noexcept;
+};
+
+/**
+ * @brief                   Throttle shared by all the workers of a scan
+ *
+ *                          Reading a directory and fetching the metadata of entries each take tokens from their own
+ *                          bucket, and a worker that runs out sleeps until enough of them have been added back (tokens are
+ *                          reserved before sleeping, so the workers are served in the order in which they asked). If a
+ *                          target latency is set, only a limited number of workers may be reading directories or fetching
+ *                          metadata at once: the average latency of each call is measured, the limit grows by one worker
+ *                          whenever a window of calls was faster than the target, and halves whenever it was slower, so
+ *                          the scan runs as wide as the filesystem allows without making it slow for everyone else
+ */
+class ScanThrottle
+{
+    /** Lock protecting the buckets */
+    std::mutex              mBucketLock;
+    /** Bucket of the directories that are read */
+    TokenBucket             mDirs;
+    /** Bucket of the entries whose metadata is fetched */
+    TokenBucket             mStats;
+
+    /** Lock protecting the number of workers making calls, and the latencies of the current window */
+    std::mutex              mGateLock;
+    /** Signalled whenever a worker stops making calls, or the limit grows */
+    std::condition_variable mGateFree;
+    /** Latency of a single call that the scan aims to stay under, in nanoseconds (0 if the workers are not limited) */
+    uint64_t                mTargetNs           {};
+    /** Largest number of workers that may ever make calls at once */
+    uint32_t                mMaxWorkers         {1};
+    /** Number of workers that may currently make calls at once */
+    uint32_t                mLimit              {1};
+    /** Number of workers currently making calls */
+    uint32_t                mActive             {};
+    /** Time taken by the calls of the current window, in nanoseconds */
+    uint64_t                mWindowNs           {};
+    /** Number of calls of the current window */
+    uint64_t                mWindowCalls        {};
+
+    /** Time the workers spent waiting for tokens or for their turn to make calls, in nanoseconds */
+    std::atomic<uint64_t>   mWaitNs             {};
+    /** Largest limit on the number of workers that was reached (0 if the workers are not limited) */
+    std::atomic<uint32_t>   mPeakLimit          {};
+
+public:
+
+    ScanThrottle () = default;
+    ScanThrottle (const ScanThrottle &) = delete;
+    ScanThrottle &operator= (const ScanThrottle &) = delete;
+
+    /**
+     * @brief               Sets the rates at which directories may be read and metadata may be fetched
+     *
+     * @param pDirsPerSec   Number of directories that may be read per second (0 if they are not limited)
+     * @param pStatsPerSec  Number of entries whose metadata may be fetched per second (0 if they are not limited)
+     */
+    void
+    set_rates (const uint64_t &pDirsPerSec, const uint64_t &pStatsPerSec) noexcept;
+
+    /**
+     * @brief               Limits the number of workers making calls at once, adjusting the limit to keep the latency of
+     *                      each call under a target
+     *
+     * @param pTargetNs     Latency of a single call to stay under, in nanoseconds (0 to not limit the workers)
+     * @param pMaxWorkers   Number of workers of the scan (the limit starts at one worker, and never grows past this)
+     */
+    void
+    set_latency_target (const uint64_t &pTargetNs, const uint32_t &pMaxWorkers) noexcept;
+
+    /**
+     * @brief               Checks whether the scan is throttled in any way
+     *
+     * @return true         If calls are limited in rate, or in how many workers make them at once
+     * @return false        If the throttle does nothing
+     */
+    [[nodiscard]] bool
+    is_active () const noexcept
+    {
+        return mDirs.rate != 0 || mStats.rate != 0 || mTargetNs != 0;
+    }
+
+    /**
+     * @brief               Waits until a directory may be read
+     */
+    void
+    acquire_dir () noexcept;
+
+    /**
+     * @brief               Waits until the metadata of a number of entries may be fetched
+     *
+     * @param pCount        Number of entries
+     */
+    void
+    acquire_stats (const uint64_t &pCount) noexcept;
+
+    /**
+     * @brief               Waits until the current worker may make calls (right away, unless the workers are limited)
+     *
+     * @return std::chrono::steady_clock::time_point Time at which the worker started making calls
+     */
+    [[nodiscard]] std::chrono::steady_clock::time_point
+    enter () noexcept;
+
+    /**
+     * @brief               Marks the current worker as done making calls, and adds the time they took to the latency of
+     *                      the current window
+     *
+     * @param pStart        Time returned by the matching call to enter
+     * @param pCalls        Number of calls the worker made
+     */
+    void
+    leave (const std::chrono::steady_clock::time_point &pStart, const uint64_t &pCalls) noexcept;
+
+    /**
+     * @brief               Returns the time the workers spent waiting on the throttle
+     *
+     * @return uint64_t     Time in nanoseconds
+     */
+    [[nodiscard]] uint64_t
+    wait_ns () const noexcept
+    {
+        return mWaitNs.load (std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief               Returns the largest number of workers that were allowed to make calls at once
+     *
+     * @return uint32_t     Number of workers (0 if the workers are not limited)
+     */
+    [[nodiscard]] uint32_t
+    peak_limit () const noexcept
+    {
+        return mPeakLimit.load (std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief                   Holds the turn of the current worker to make calls from its construction to its destruction (and
+ *                          does nothing at all if there is no throttle)
+ */
+class ThrottleTurn
+{
+    /** Throttle whose turn is held (nullptr if the scan is not throttled) */
+    ScanThrottle            *mThrottle;
+    /** Time at which the turn started */
+    std::chrono::steady_clock::time_point   mStart  {};
+    /** Number of calls made during the turn */
+    uint64_t                mCalls;
+
+public:
+
+    /**
+     * @brief               Waits for the turn of the current worker
+     *
+     * @param pThrottle     Throttle to wait on (nullptr if the scan is not throttled)
+     * @param pCalls        Number of calls that will be made during the turn
+     */
+    ThrottleTurn (ScanThrottle *pThrottle, const uint64_t &pCalls) noexcept
+        : mThrottle (pThrottle)
+        , mCalls (pCalls)
+    {
+        if (mThrottle != nullptr) {
+            mStart  = mThrottle->enter ();
+        }
+    }
+
+    ThrottleTurn (const ThrottleTurn &) = delete;
+    ThrottleTurn &operator= (const ThrottleTurn &) = delete;
+
+    ~ThrottleTurn ()
+    {
+        if (mThrottle != nullptr) {
+            mThrottle->leave (mStart, mCalls);
+        }
+    }
+};
+
+/**
+ * @brief                   Lowers the priority of the whole process, so that it only gets the disk and the processor when
+ *                          nothing else wants them (the idle class of I/O and SCHED_IDLE on Linux, the lowest niceness on
+ *                          other POSIX systems), which the threads started afterwards inherit
+ *
+ * @param pErr              Error that occoured while lowering the priority
+ *
+ * @return true             If the priority was lowered
+ * @return false            If the priority could not be lowered (or lowering it is not supported)
+ */
+[[nodiscard]] bool
+enter_idle_priority (std::error_code &pErr) noexcept;
+
+#endif
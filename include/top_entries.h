@@ -0,0 +1,104 @@
+/**
+ * @file            top_entries.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Largest entries found by a walk, kept in a heap that never grows beyond the number asked for
+ *
+ */
+
+#ifndef TOP_ENTRIES_H
+#define TOP_ENTRIES_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <filesystem>
+#include <vector>
+
+#include "dir_reader.h"
+
+
+/** Entry ranked by TopEntries */
+struct TopEntry
+{
+    /** Size of the entry in bytes (of all its contents, if it is a directory) */
+    int64_t                 size;
+    /** Type of the entry */
+    EntryType               type;
+    /** Path of the entry, as the walk built it */
+    std::filesystem::path::string_type  path;
+};
+
+/**
+ * @brief                   Keeps the largest entries offered to it, up to a fixed number of them
+ *
+ *                          The entries are kept in a min-heap, so the smallest of them is always at the front and an
+ *                          entry that is not larger than it is turned away with a single comparison (before its path is
+ *                          even built). Memory stays proportional to the number of entries asked for, however many are
+ *                          offered. Each worker of a walk keeps its own, and they are merged once the walk is complete
+ */
+class TopEntries
+{
+    /** Largest entries offered so far (a min-heap by size) */
+    std::vector<TopEntry>   mHeap;
+    /** Largest number of entries kept */
+    size_t                  mCapacity           {};
+
+public:
+
+    TopEntries () = default;
+
+    /**
+     * @brief               Prepares an empty set of the largest entries
+     *
+     * @param pCapacity     Largest number of entries kept
+     */
+    explicit
+    TopEntries (const size_t &pCapacity)
+        : mCapacity (pCapacity)
+    {
+    }
+
+    /**
+     * @brief               Checks whether an entry of a given size would be kept (so that its path is only built if so)
+     *
+     * @param pSize         Size of the entry
+     *
+     * @return true         If an entry of the size would be kept
+     * @return false        If the entry would be turned away
+     */
+    [[nodiscard]] bool
+    admits (const int64_t &pSize) const noexcept
+    {
+        return pSize >= 0 && mCapacity != 0 && (mHeap.size () < mCapacity || pSize > mHeap.front ().size);
+    }
+
+    /**
+     * @brief               Offers an entry, which is kept if it is among the largest ones offered so far (replacing the
+     *                      smallest one kept, if there are as many as the capacity)
+     *
+     * @param pSize         Size of the entry
+     * @param pType         Type of the entry
+     * @param pPath         Path of the entry
+     */
+    void
+    offer (const int64_t &pSize, const EntryType &pType, const PathView &pPath);
+
+    /**
+     * @brief               Offers all the entries kept by another set, and empties it
+     *
+     * @param pOther        Set whose entries to offer
+     */
+    void
+    merge (TopEntries &pOther);
+
+    /**
+     * @brief               Returns the entries kept, largest first (entries of the same size are ordered by path), and
+     *                      empties the set
+     *
+     * @return std::vector<TopEntry> Entries kept
+     */
+    [[nodiscard]] std::vector<TopEntry>
+    take_sorted ();
+};
+
+#endif
@@ -0,0 +1,248 @@
+/**
+ * @file            tree_model.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Compact in-memory model of a whole tree, stored as columns, that any number of queries can be answered
+ *                  from after a single walk
+ *
+ */
+
+#ifndef TREE_MODEL_H
+#define TREE_MODEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include <filesystem>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "dir_reader.h"
+#include "tree_walker.h"
+
+/** Parent of the entry that has none (the root of the model) */
+#define MODEL_NO_PARENT         (UINT32_MAX)
+
+
+/**
+ * @brief                   Every entry below a directory, stored as one column per field rather than as one record per
+ *                          entry
+ *
+ *                          The tree is walked breadth-first, and each entry is added as it is found, so the entries of a
+ *                          directory are next to each other, every directory comes before its entries, and the column of
+ *                          parents is sorted (the root at position 0 aside). Each entry costs a parent, the offset of its
+ *                          name in a shared pool of names, a type, a size and a time (around 25 bytes along with a short
+ *                          name), and a query that only looks at one or two of the fields scans just those columns from
+ *                          start to end. The size of each directory is the combined size of everything below it, added up
+ *                          once the walk is complete
+ */
+class TreeModel
+{
+public:
+
+    /** Character type of the names of entries */
+    using char_t            = std::filesystem::path::value_type;
+
+private:
+
+    /** Position of the parent directory of each entry */
+    std::vector<uint32_t>   mParents;
+    /** Offset of the name of each entry in mNames (followed by the offset just past the last name) */
+    std::vector<uint32_t>   mNameOffsets;
+    /** Type of each entry, as reported by its directory (symlinks are not followed) */
+    std::vector<EntryType>  mTypes;
+    /** Size of each regular file (or of the target of a symlink), combined size of everything below each directory, or -1
+        if it is not known */
+    std::vector<int64_t>    mSizes;
+    /** Time of last modification of each regular file (or of the target of a symlink, and 0 for anything else) */
+    std::vector<int64_t>    mMtimes;
+    /** Null-terminated names of all the entries, one after the other (followed by DIR_NAME_PADDING null characters) */
+    std::vector<char_t>     mNames;
+
+    /** Number of directories that were read */
+    uint64_t                mNumDirs            {};
+    /** Number of directories that could not be read */
+    uint64_t                mNumErrors          {};
+
+    /**
+     * @brief               Adds an entry to the model
+     *
+     * @param pParent       Position of the parent directory
+     * @param pName         Name of the entry
+     * @param pNameLen      Length of the name
+     * @param pType         Type of the entry
+     * @param pSize         Size of the entry
+     * @param pMtime        Time of last modification of the entry
+     *
+     * @return uint32_t     Position of the entry
+     */
+    uint32_t
+    add_entry (const uint32_t &pParent, const char_t *pName, const size_t &pNameLen, const EntryType &pType,
+                const int64_t &pSize, const int64_t &pMtime);
+
+public:
+
+    /**
+     * @brief               Walks the whole tree below a directory, and replaces the model with its entries
+     *
+     * @param pRoot         Path of the directory (stored as the name of the root, so that paths built by the model start
+     *                      with it)
+     * @param pOptions      Options and filters of the walk
+     * @param pIsAllocated  Whether the space allocated to files is stored instead of their sizes
+     * @param pErr          Error that occoured while reading the directory (or the model growing past 2^32 entries)
+     *
+     * @return true         If the directory was read
+     * @return false        If the directory could not be read
+     */
+    [[nodiscard]] bool
+    build (const std::filesystem::path &pRoot, const WalkOptions &pOptions, const bool &pIsAllocated, std::error_code &pErr);
+
+    /**
+     * @brief               Returns the number of entries of the model (including the root)
+     *
+     * @return uint32_t     Number of entries
+     */
+    [[nodiscard]] uint32_t
+    num_entries () const noexcept
+    {
+        return (uint32_t)mTypes.size ();
+    }
+
+    /**
+     * @brief               Returns the number of directories that were read to build the model
+     *
+     * @return uint64_t     Number of directories
+     */
+    [[nodiscard]] uint64_t
+    num_dirs () const noexcept
+    {
+        return mNumDirs;
+    }
+
+    /**
+     * @brief               Returns the number of directories that could not be read (whose sizes are not known)
+     *
+     * @return uint64_t     Number of directories
+     */
+    [[nodiscard]] uint64_t
+    num_errors () const noexcept
+    {
+        return mNumErrors;
+    }
+
+    /**
+     * @brief               Returns the position of the parent directory of an entry
+     *
+     * @param pPos          Position of the entry
+     *
+     * @return uint32_t     Position of the parent (MODEL_NO_PARENT for the root)
+     */
+    [[nodiscard]] uint32_t
+    parent (const uint32_t &pPos) const noexcept
+    {
+        return mParents[pPos];
+    }
+
+    /**
+     * @brief               Returns the null-terminated name of an entry
+     *
+     * @param pPos          Position of the entry
+     *
+     * @return const char_t* Name of the entry (the path of the directory the model was built from, for the root)
+     */
+    [[nodiscard]] const char_t
+    *name (const uint32_t &pPos) const noexcept
+    {
+        return mNames.data () + mNameOffsets[pPos];
+    }
+
+    /**
+     * @brief               Returns the length of the name of an entry
+     *
+     * @param pPos          Position of the entry
+     *
+     * @return size_t       Length of the name
+     */
+    [[nodiscard]] size_t
+    name_len (const uint32_t &pPos) const noexcept
+    {
+        return mNameOffsets[pPos + 1] - mNameOffsets[pPos] - 1;
+    }
+
+    /**
+     * @brief               Returns the type of an entry, as reported by its directory (symlinks are not followed)
+     *
+     * @param pPos          Position of the entry
+     *
+     * @return EntryType    Type of the entry
+     */
+    [[nodiscard]] EntryType
+    type (const uint32_t &pPos) const noexcept
+    {
+        return mTypes[pPos];
+    }
+
+    /**
+     * @brief               Returns the size of an entry
+     *
+     * @param pPos          Position of the entry
+     *
+     * @return int64_t      Size of the regular file (or of the target of the symlink), combined size of everything below
+     *                      the directory, or -1 if it is not known
+     */
+    [[nodiscard]] int64_t
+    size (const uint32_t &pPos) const noexcept
+    {
+        return mSizes[pPos];
+    }
+
+    /**
+     * @brief               Returns the time of last modification of an entry
+     *
+     * @param pPos          Position of the entry
+     *
+     * @return time_t       Time of last modification of the regular file (or of the target of the symlink, and 0 for
+     *                      anything else)
+     */
+    [[nodiscard]] time_t
+    mtime (const uint32_t &pPos) const noexcept
+    {
+        return (time_t)mMtimes[pPos];
+    }
+
+    /**
+     * @brief               Returns the positions of the entries of a directory (which are next to each other)
+     *
+     * @param pPos          Position of the directory
+     *
+     * @return std::pair<uint32_t, uint32_t> Position of the first entry, and the position just past the last one
+     */
+    [[nodiscard]] std::pair<uint32_t, uint32_t>
+    children (const uint32_t &pPos) const noexcept;
+
+    /**
+     * @brief               Builds the path of an entry, from the path of the root and the names of the directories down to it
+     *
+     * @param pPos          Position of the entry
+     *
+     * @return std::filesystem::path Path of the entry
+     */
+    [[nodiscard]] std::filesystem::path
+    path_of (const uint32_t &pPos) const;
+
+    /**
+     * @brief               Returns the memory held by the columns of the model
+     *
+     * @return size_t       Number of bytes
+     */
+    [[nodiscard]] size_t
+    memory_bytes () const noexcept
+    {
+        return mParents.capacity () * sizeof (uint32_t) + mNameOffsets.capacity () * sizeof (uint32_t)
+                + mTypes.capacity () * sizeof (EntryType) + mSizes.capacity () * sizeof (int64_t)
+                + mMtimes.capacity () * sizeof (int64_t) + mNames.capacity () * sizeof (char_t);
+    }
+};
+
+#endif
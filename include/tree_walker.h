@@ -0,0 +1,599 @@
+/**
+ * @file            tree_walker.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Walks a tree of directories and hands each entry to a visitor, without printing anything itself
+ *
+ *                  This is the traversal API of libfss. The walk is specialised on the type of the visitor at compile
+ *                  time, so the metadata a visitor asks for up front is fetched for whole directories at once, metadata
+ *                  that is never asked for is never fetched, and the hooks a visitor does not define cost nothing
+ *
+ */
+
+#ifndef TREE_WALKER_H
+#define TREE_WALKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include <concepts>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+#include "dir_reader.h"
+#include "name_automaton.h"
+
+
+/** What a walk does after it has visited an entry */
+enum class WalkAction : uint8_t
+{
+    /** Goes on, entering the entry if it is a directory */
+    CONTINUE,
+    /** Goes on, without entering the entry */
+    SKIP,
+    /** Ends the walk */
+    STOP
+};
+
+/**
+ * @brief                   Options and filters of a walk
+ *
+ *                          The functions below that take a WalkOptions are the only implementation of the filters, and
+ *                          are shared by walk_tree and by the walks of the listing, the search and the parallel engines of
+ *                          the command line, so that every walk skips and enters the same entries
+ */
+struct WalkOptions
+{
+    /** Number of levels of subdirectories below the root that are entered (0 only visits the entries of the root) */
+    uint64_t                maxDepth            {UINT64_MAX};
+    /** Whether directories on other filesystems than the root are visited without being entered */
+    bool                    oneFileSystem       {false};
+    /** Way of fetching the metadata of the entries of each directory */
+    StatMode                statMode            {StatMode::SYNC};
+
+    /** Globs of the names of entries that are skipped along with everything below them (and are never visited) */
+    std::vector<NameAutomaton>  excludes        {};
+    /** Smallest size of the regular files that are visited (-1 to visit all of them) */
+    int64_t                 minSize             {-1};
+    /** Regular files modified at or before this time are not visited (0 to visit all of them) */
+    time_t                  newerThan           {};
+};
+
+/**
+ * @brief                   Entry handed to the visitor of a walk, along with its depth
+ *
+ *                          A view only refers to the batch of its directory, so it is only valid while it is being
+ *                          visited. Metadata that the visitor asked for up front has already been fetched, and anything
+ *                          else is fetched the first time it is asked for (with one call for the entry alone)
+ */
+class EntryView
+{
+    /** Batch containing the entry */
+    DirBatch                &mBatch;
+    /** Entry of the batch */
+    DirEntry                &mEntry;
+    /** Number of directories between the root of the walk and the entry (0 for the entries of the root itself) */
+    uint64_t                mDepth;
+
+    /**
+     * @brief               Makes sure that some metadata of the entry has been fetched
+     *
+     * @param pMask         Metadata that is needed (combination of STAT_* bits)
+     */
+    void
+    fetch (const uint32_t &pMask) noexcept
+    {
+        if (mBatch.isRestored || (mEntry.statMask & pMask) == pMask) {
+            return;
+        }
+
+        mEntry.statMask |= pMask;
+        stat_dir_entry (mBatch, mEntry);
+    }
+
+public:
+
+    /**
+     * @brief               Creates a view of an entry
+     *
+     * @param pBatch        Batch containing the entry
+     * @param pEntry        Entry of the batch
+     * @param pDepth        Number of directories between the root of the walk and the entry
+     */
+    EntryView (DirBatch &pBatch, DirEntry &pEntry, const uint64_t &pDepth) noexcept
+        : mBatch (pBatch)
+        , mEntry (pEntry)
+        , mDepth (pDepth)
+    {
+    }
+
+    /**
+     * @brief               Returns the name of the entry
+     *
+     * @return PathView     Name of the entry (null-terminated)
+     */
+    [[nodiscard]] PathView
+    name () const noexcept
+    {
+        return PathView (mBatch.name_of (mEntry), mEntry.nameLen);
+    }
+
+    /**
+     * @brief               Returns the type of the entry, as reported by its directory (symlinks are not followed)
+     *
+     * @return EntryType    Type of the entry
+     */
+    [[nodiscard]] EntryType
+    type () const noexcept
+    {
+        return mEntry.type;
+    }
+
+    /**
+     * @brief               Returns the number of directories between the root of the walk and the entry
+     *
+     * @return uint64_t     Depth of the entry (0 for the entries of the root itself)
+     */
+    [[nodiscard]] uint64_t
+    depth () const noexcept
+    {
+        return mDepth;
+    }
+
+    /**
+     * @brief               Returns the path of the entry (the path of the root, followed by the names of the directories
+     *                      down to it)
+     *
+     * @return PathView     Path of the entry (only valid until the walk moves on to the next entry)
+     */
+    [[nodiscard]] PathView
+    path ()
+    {
+        return mBatch.build_path (mEntry);
+    }
+
+    /**
+     * @brief               Returns the size of the entry (fetching it if it has not been fetched yet)
+     *
+     * @return int64_t      Size of the entry in bytes (-1 if it could not be fetched, or is not known for its type)
+     */
+    [[nodiscard]] int64_t
+    size () noexcept
+    {
+        fetch (STAT_SIZE);
+        return (mEntry.statError) ? (-1) : (mEntry.stat.size);
+    }
+
+    /**
+     * @brief               Returns the time of last modification of the entry (fetching it if it has not been fetched yet)
+     *
+     * @return time_t       Time of last modification (0 if it could not be fetched)
+     */
+    [[nodiscard]] time_t
+    mtime () noexcept
+    {
+        fetch (STAT_MTIME);
+        return (mEntry.statError) ? (0) : (mEntry.stat.mtime);
+    }
+
+    /**
+     * @brief               Returns the permissions of the entry (fetching them if they have not been fetched yet)
+     *
+     * @return std::filesystem::perms Permissions of the entry (none if they could not be fetched)
+     */
+    [[nodiscard]] std::filesystem::perms
+    perms () noexcept
+    {
+        fetch (STAT_PERMS);
+        return (mEntry.statError) ? (std::filesystem::perms::none) : (mEntry.stat.perms);
+    }
+
+    /**
+     * @brief               Returns the error that occoured while fetching the metadata of the entry
+     *
+     * @return const std::error_code& Error (cleared if the metadata was fetched, or none was needed)
+     */
+    [[nodiscard]] const std::error_code
+    &stat_error () const noexcept
+    {
+        return mEntry.statError;
+    }
+
+    /**
+     * @brief               Returns the entry itself, along with all the metadata fetched for it so far
+     *
+     * @return const DirEntry& Entry
+     */
+    [[nodiscard]] const DirEntry
+    &entry () const noexcept
+    {
+        return mEntry;
+    }
+
+    /**
+     * @brief               Returns the batch containing the entry
+     *
+     * @return DirBatch&    Batch of the directory of the entry
+     */
+    [[nodiscard]] DirBatch
+    &batch () const noexcept
+    {
+        return mBatch;
+    }
+};
+
+/** Visitor of a walk, which is called with each entry and decides whether the walk enters it */
+template <typename visitor_t>
+concept TreeVisitor         = requires (visitor_t &pVisitor, EntryView &pView) {
+    { pVisitor (pView) } -> std::same_as<WalkAction>;
+};
+
+/** Visitor that asks for the same metadata of every entry up front, through a static constexpr statMask */
+template <typename visitor_t>
+concept HasStaticStatMask   = requires {
+    { visitor_t::statMask } -> std::convertible_to<uint32_t>;
+};
+
+/** Visitor that asks for metadata up front depending on the type of each entry, through stat_mask */
+template <typename visitor_t>
+concept HasStatMask         = requires (const visitor_t &pVisitor, const EntryType &pType) {
+    { pVisitor.stat_mask (pType) } -> std::convertible_to<uint32_t>;
+};
+
+/** Visitor that reads directories itself, through read_dir (for example, to restore them from an index) */
+template <typename visitor_t>
+concept HasReadDir          = requires (visitor_t &pVisitor, const std::filesystem::path &pPath, DirBatch &pBatch,
+                                        std::error_code &pErr) {
+    { pVisitor.read_dir (pPath, pBatch, pErr) } -> std::same_as<bool>;
+};
+
+/** Visitor that fetches the metadata of the entries of directories itself, through stat_dir */
+template <typename visitor_t>
+concept HasStatDir          = requires (visitor_t &pVisitor, DirBatch &pBatch) {
+    pVisitor.stat_dir (pBatch);
+};
+
+/** Visitor that is told about the directories that could not be read, through on_error */
+template <typename visitor_t>
+concept HasOnError          = requires (visitor_t &pVisitor, const std::filesystem::path &pPath, const std::error_code &pErr) {
+    pVisitor.on_error (pPath, pErr);
+};
+
+/**
+ * @brief                   Returns the metadata a visitor asks for up front for an entry of a given type
+ *
+ * @tparam visitor_t        Type of the visitor
+ *
+ * @param pVisitor          Visitor of the walk
+ * @param pType             Type of the entry
+ *
+ * @return uint32_t         Metadata to fetch (combination of STAT_* bits)
+ */
+template <typename visitor_t>
+[[nodiscard]] inline uint32_t
+visitor_stat_mask (const visitor_t &pVisitor, const EntryType &pType) noexcept
+{
+    if constexpr (HasStatMask<visitor_t>) {
+        return (uint32_t)pVisitor.stat_mask (pType);
+    }
+    else if constexpr (HasStaticStatMask<visitor_t>) {
+        (void)pVisitor;
+        (void)pType;
+        return (uint32_t)visitor_t::statMask;
+    }
+    else {
+        (void)pVisitor;
+        (void)pType;
+        return 0;
+    }
+}
+
+/**
+ * @brief                   Returns the metadata that the size and time filters of a walk need for each regular file
+ *
+ * @param pOptions          Options of the walk
+ *
+ * @return uint32_t         Metadata to fetch (combination of STAT_* bits, 0 if regular files are not filtered)
+ */
+[[nodiscard]] inline uint32_t
+walk_filter_mask (const WalkOptions &pOptions) noexcept
+{
+    return ((pOptions.minSize >= 0) ? (STAT_SIZE) : (0)) | ((pOptions.newerThan != 0) ? (STAT_MTIME) : (0));
+}
+
+/**
+ * @brief                   Returns the metadata that a walk needs for each directory to decide whether to enter it
+ *
+ * @param pOptions          Options of the walk
+ *
+ * @return uint32_t         Metadata to fetch (combination of STAT_* bits, 0 if directories are entered wherever they are)
+ */
+[[nodiscard]] inline uint32_t
+walk_descend_mask (const WalkOptions &pOptions) noexcept
+{
+    return (pOptions.oneFileSystem) ? (STAT_LINKS) : (0);
+}
+
+/**
+ * @brief                   Checks whether the size and time of a regular file pass the filters of a walk
+ *
+ * @param pOptions          Options of the walk
+ * @param pSize             Size of the file (-1 if it is not known)
+ * @param pMtime            Time of last modification of the file
+ *
+ * @return true             If the file is visited
+ * @return false            If the file is filtered out (or its size is not known while it is filtered by size or time)
+ */
+[[nodiscard]] inline bool
+walk_passes_filters (const WalkOptions &pOptions, const int64_t &pSize, const time_t &pMtime) noexcept
+{
+    if (pOptions.minSize < 0 && pOptions.newerThan == 0) {
+        return true;
+    }
+
+    return pSize != -1 && (pOptions.minSize < 0 || pSize >= pOptions.minSize)
+            && (pOptions.newerThan == 0 || pMtime > pOptions.newerThan);
+}
+
+/**
+ * @brief                   Checks whether an entry passes the size and time filters of a walk (only regular files are
+ *                          filtered by them)
+ *
+ * @param pOptions          Options of the walk
+ * @param pEntry            Entry to check (along with the metadata in walk_filter_mask, if it is a regular file)
+ *
+ * @return true             If the entry is visited
+ * @return false            If the entry is a regular file that is filtered out (or whose metadata could not be fetched)
+ */
+[[nodiscard]] inline bool
+walk_passes_filters (const WalkOptions &pOptions, const DirEntry &pEntry) noexcept
+{
+    if (pEntry.type != EntryType::REGULAR) {
+        return true;
+    }
+
+    return walk_passes_filters (pOptions, (pEntry.statError) ? (-1) : (pEntry.stat.size), pEntry.stat.mtime);
+}
+
+/**
+ * @brief                   Checks whether a name matches any of the globs of names that a walk skips
+ *
+ * @param pOptions          Options of the walk
+ * @param pName             Name to check
+ * @param pNameLen          Length of the name
+ *
+ * @return true             If entries with the name are skipped, along with everything below them
+ * @return false            If entries with the name are visited
+ */
+[[nodiscard]] inline bool
+walk_is_excluded (const WalkOptions &pOptions, const DirBatch::char_t *pName, const size_t &pNameLen) noexcept
+{
+    for (const auto &glob : pOptions.excludes) {
+        if (glob.matches (pName, pNameLen)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief                   Removes the entries whose names a walk skips from a batch, before anything else is done with
+ *                          them (so excluded directories are never opened, and excluded entries are never stat-ed)
+ *
+ * @param pOptions          Options of the walk
+ * @param pBatch            Batch to remove the entries from
+ */
+inline void
+walk_prune_batch (const WalkOptions &pOptions, DirBatch &pBatch) noexcept
+{
+    if (pOptions.excludes.empty ()) {
+        return;
+    }
+
+    std::erase_if (pBatch.entries, [&] (const DirEntry &pEntry) {
+        return walk_is_excluded (pOptions, pBatch.name_of (pEntry), pEntry.nameLen);
+    });
+}
+
+/**
+ * @brief                   Checks whether a subdirectory lies on a filesystem that a walk is allowed to enter
+ *
+ * @param pOptions          Options of the walk
+ * @param pRootDev          Device containing the root of the walk (only used if the walk stays on one filesystem)
+ * @param pEntry            Subdirectory to check (along with the metadata in walk_descend_mask)
+ *
+ * @return true             If the subdirectory may be entered
+ * @return false            If the walk stays on one filesystem, and the subdirectory is on another one
+ */
+[[nodiscard]] inline bool
+walk_stays_on_filesystem (const WalkOptions &pOptions, const uint64_t &pRootDev, const DirEntry &pEntry) noexcept
+{
+    return !pOptions.oneFileSystem || (!pEntry.statError && pEntry.stat.dev == pRootDev);
+}
+
+/**
+ * @brief                   Checks whether a walk enters a subdirectory, as far as its depth and filesystem go
+ *
+ * @param pOptions          Options of the walk
+ * @param pRootDev          Device containing the root of the walk (only used if the walk stays on one filesystem)
+ * @param pEntry            Subdirectory to check (along with the metadata in walk_descend_mask)
+ * @param pDepth            Number of directories between the root of the walk and the subdirectory
+ *
+ * @return true             If the subdirectory is entered
+ * @return false            If it is too deep, or lies on another filesystem than the root of a walk that stays on one
+ */
+[[nodiscard]] inline bool
+walk_enters_dir (const WalkOptions &pOptions, const uint64_t &pRootDev, const DirEntry &pEntry, const uint64_t &pDepth) noexcept
+{
+    return pDepth < pOptions.maxDepth && walk_stays_on_filesystem (pOptions, pRootDev, pEntry);
+}
+
+/**
+ * @brief                   Reads a directory, and fetches the metadata asked for up front by the walk and the visitor
+ *
+ * @tparam visitor_t        Type of the visitor
+ *
+ * @param pOptions          Options of the walk
+ * @param pVisitor          Visitor of the walk
+ * @param pPath             Path of the directory
+ * @param pBatch            Batch to read the entries into
+ * @param pErr              Error that occoured while reading the directory
+ *
+ * @return true             If the directory was read
+ * @return false            If the directory could not be read
+ */
+template <typename visitor_t>
+[[nodiscard]] bool
+walk_read_dir (const WalkOptions &pOptions, visitor_t &pVisitor, const std::filesystem::path &pPath, DirBatch &pBatch,
+                std::error_code &pErr)
+{
+    /** Metadata the filters need for each regular file */
+    const uint32_t          filterMask      = walk_filter_mask (pOptions);
+    /** Metadata needed for each directory to check which filesystem it is on */
+    const uint32_t          descendMask     = walk_descend_mask (pOptions);
+
+    /** Whether any metadata is fetched up front at all */
+    bool                    isStatNeeded    = filterMask != 0 || descendMask != 0;
+
+    if constexpr (HasReadDir<visitor_t>) {
+        if (!pVisitor.read_dir (pPath, pBatch, pErr)) {
+            return false;
+        }
+    }
+    else {
+        if (!read_dir (pPath, pBatch, pErr)) {
+            return false;
+        }
+    }
+
+    walk_prune_batch (pOptions, pBatch);
+
+    // a visitor that never asks for metadata up front (in a walk without filters) does not even go through the entries, which
+    // are read with nothing requested
+    if constexpr (HasStatMask<visitor_t> || HasStaticStatMask<visitor_t> || HasStatDir<visitor_t>) {
+        isStatNeeded    = true;
+    }
+    if (isStatNeeded) {
+        for (auto &entry : pBatch.entries) {
+            entry.statMask  = visitor_stat_mask (pVisitor, entry.type)
+                            | ((entry.type == EntryType::REGULAR) ? (filterMask) : (0))
+                            | ((entry.type == EntryType::DIRECTORY) ? (descendMask) : (0));
+        }
+
+        if constexpr (HasStatDir<visitor_t>) {
+            pVisitor.stat_dir (pBatch);
+        }
+        else {
+            stat_dir_entries (pBatch, pOptions.statMode);
+        }
+    }
+
+    // the metadata has been fetched, so the directory does not need to stay open while its subdirectories are read
+    pBatch.close ();
+
+    return true;
+}
+
+/**
+ * @brief                   Walks the tree below a directory depth-first, and visits each of its entries (the root itself
+ *                          is not visited)
+ *
+ *                          The tree is walked with an explicit stack of the directories being visited, so the depth of the
+ *                          tree is only limited by memory, and each directory is closed as soon as its entries have been
+ *                          read and their metadata fetched. The entries of a directory are visited in the order in which
+ *                          the directory returned them, and a directory is entered right after it is visited (if the
+ *                          visitor lets the walk continue into it). Symlinks are never followed
+ *
+ * @tparam visitor_t        Type of the visitor
+ *
+ * @param pRoot             Path of the directory to walk
+ * @param pOptions          Options and filters of the walk
+ * @param pVisitor          Visitor called with each entry
+ * @param pErr              Error that occoured while reading the root (the errors of other directories go to on_error)
+ *
+ * @return true             If the root was read (the walk may still have been stopped by the visitor)
+ * @return false            If the root could not be read
+ */
+template <TreeVisitor visitor_t>
+[[nodiscard]] bool
+walk_tree (const std::filesystem::path &pRoot, const WalkOptions &pOptions, visitor_t &pVisitor, std::error_code &pErr)
+{
+    /** Position of the next entry to visit in a directory on the stack */
+    struct WalkFrame
+    {
+        /** Batch of the directory */
+        DirBatch            *batch;
+        /** Position of the next entry to visit */
+        size_t              next;
+    };
+
+    /** Batches of the levels of the walk (reused for every directory of the same level) */
+    BatchStack              batches;
+    /** Directories being visited, from the root to the deepest one */
+    std::vector<WalkFrame>  frames;
+
+    /** Identity of the root, whose device is the one the walk stays on */
+    DirIdentity             rootIdentity;
+    /** Error that occoured while reading a subdirectory */
+    std::error_code         errorCode;
+    /** Path of the subdirectory that is entered next */
+    std::filesystem::path   subdirPath;
+
+    if (pOptions.oneFileSystem && !read_dir_identity (pRoot, rootIdentity, pErr)) {
+        return false;
+    }
+    if (!walk_read_dir (pOptions, pVisitor, pRoot, batches.at (0), pErr)) {
+        return false;
+    }
+    pErr.clear ();
+
+    frames.push_back (WalkFrame {&batches.at (0), 0});
+    while (!frames.empty ()) {
+
+        /** Directory that is being visited */
+        WalkFrame           &frame          = frames.back ();
+
+        if (frame.next == frame.batch->entries.size ()) {
+            frames.pop_back ();
+            continue;
+        }
+
+        /** Entry that is being currently visited */
+        DirEntry            &entry          = frame.batch->entries[frame.next++];
+        /** Batch containing the entry */
+        DirBatch            &batch          = *frame.batch;
+        /** Depth of the entry */
+        const uint64_t      depth           = frames.size () - 1;
+
+        if (!walk_passes_filters (pOptions, entry)) {
+            continue;
+        }
+
+        /** View of the entry handed to the visitor */
+        EntryView           view (batch, entry, depth);
+        /** What the visitor wants done next */
+        const WalkAction    action          = pVisitor (view);
+
+        if (action == WalkAction::STOP) {
+            return true;
+        }
+        if (action == WalkAction::SKIP || entry.type != EntryType::DIRECTORY
+            || !walk_enters_dir (pOptions, rootIdentity.dev, entry, depth)) {
+            continue;
+        }
+
+        subdirPath      = batch.build_path (entry);
+        if (walk_read_dir (pOptions, pVisitor, subdirPath, batches.at (frames.size ()), errorCode)) {
+            frames.push_back (WalkFrame {&batches.at (frames.size ()), 0});
+        }
+        else if constexpr (HasOnError<visitor_t>) {
+            pVisitor.on_error (subdirPath, errorCode);
+        }
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,260 @@
+/**
+ * @file            watch_tree.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Tree of the directories below a path with the aggregate sizes and counts of their subtrees, kept up to
+ *                  date by watching the directories for changes
+ *
+ */
+
+#ifndef WATCH_TREE_H
+#define WATCH_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <filesystem>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "dir_reader.h"
+#include "tree_walker.h"
+
+/** Position of a directory that has no parent (the root of the tree) */
+#define WATCH_NO_PARENT         (UINT32_MAX)
+
+
+/** Directory of a WatchTree, along with the totals of everything below it */
+struct WatchDir
+{
+    /** Path of the directory */
+    std::filesystem::path   path;
+    /** Position of the parent directory (WATCH_NO_PARENT for the root) */
+    uint32_t                parent              {WATCH_NO_PARENT};
+    /** Number of directories between the root and the directory (0 for the root itself) */
+    uint64_t                depth               {};
+    /** Watch descriptor of the directory (-1 if it is not watched) */
+    int                     wd                  {-1};
+    /** Whether the directory is part of the tree (its position is reused otherwise) */
+    bool                    isLive              {false};
+    /** Whether the directory changed since it was last read */
+    bool                    isDirty             {false};
+
+    /** Combined size of the regular files directly within the directory */
+    int64_t                 ownSize             {};
+    /** Number of regular files directly within the directory */
+    uint64_t                ownFiles            {};
+
+    /** Combined size of the regular files within the whole subtree */
+    int64_t                 totalSize           {};
+    /** Number of regular files within the whole subtree */
+    uint64_t                totalFiles          {};
+    /** Number of directories within the whole subtree (not including the directory itself) */
+    uint64_t                totalDirs           {};
+
+    /** Positions of the subdirectories */
+    std::vector<uint32_t>   children            {};
+};
+
+/**
+ * @brief                   Directories below a path, with the sizes and counts of their subtrees, updated incrementally
+ *
+ *                          The whole tree is read once. After that, every directory is watched (through inotify on Linux),
+ *                          and a change only marks the directory it happened in. Refreshing the tree reads the marked
+ *                          directories again, walks the subdirectories that appeared in them, drops the ones that went
+ *                          away, and adds the difference to the totals of the directory and its ancestors, so the totals
+ *                          can be read at any time without walking anything. If some directory can not be watched (or
+ *                          events were lost, or watching is not supported), refreshing reads the whole tree again instead
+ */
+class WatchTree
+{
+    /** Directories of the tree (the root is at position 0) */
+    std::vector<WatchDir>   mDirs;
+    /** Positions of mDirs that are no longer part of the tree */
+    std::vector<uint32_t>   mFreeDirs;
+    /** Positions of the directories that changed since the last refresh */
+    std::vector<uint32_t>   mDirtyDirs;
+    /** Positions of the directories whose watches were taken over by another position since the tree was last read */
+    std::vector<uint32_t>   mDisplacedDirs;
+    /** Directory of each watch descriptor */
+    std::unordered_map<int, uint32_t>   mWatches;
+
+    /** Path of the root */
+    std::filesystem::path   mRootPath;
+    /** Options of the walks of the tree */
+    WalkOptions             mOptions;
+    /** Whether the space allocated to files is counted instead of their sizes */
+    bool                    mIsAllocated        {false};
+    /** Device of the root (directories on other devices are not entered, if the tree stays on one filesystem) */
+    uint64_t                mRootDev            {};
+
+    /** Descriptor of the inotify instance (-1 if there is none) */
+    int                     mNotifyFd           {-1};
+    /** Whether every directory of the tree is watched, and no event has been lost */
+    bool                    mIsComplete         {false};
+
+    /** Entries of the directory being read (reused for every directory) */
+    DirBatch                mBatch;
+
+    /**
+     * @brief               Makes a new directory part of the tree
+     *
+     * @param pPath         Path of the directory
+     * @param pParent       Position of the parent directory
+     *
+     * @return uint32_t     Position of the directory
+     */
+    [[nodiscard]] uint32_t
+    add_dir (const std::filesystem::path &pPath, const uint32_t &pParent);
+
+    /**
+     * @brief               Reads a directory of the tree, replacing the totals of its own files, and returns the names of
+     *                      its subdirectories (the directory is watched before it is read, so no change to it is missed)
+     *
+     * @param pDir          Position of the directory
+     * @param pSubdirs      Names of the subdirectories that the tree enters
+     * @param pErr          Error that occoured while reading the directory
+     *
+     * @return true         If the directory was read
+     * @return false        If the directory could not be read
+     */
+    [[nodiscard]] bool
+    read_own (const uint32_t &pDir, std::vector<std::filesystem::path::string_type> &pSubdirs, std::error_code &pErr);
+
+    /**
+     * @brief               Reads the whole subtree below a new directory, and fills in the totals of all its directories
+     *                      (the ones that can not be read are left empty)
+     *
+     * @param pDir          Position of the directory
+     * @param pErr          Error that occoured while reading the directory itself
+     *
+     * @return true         If the directory itself was read
+     * @return false        If the directory itself could not be read
+     */
+    [[nodiscard]] bool
+    build_subtree (const uint32_t &pDir, std::error_code &pErr);
+
+    /**
+     * @brief               Removes a directory and everything below it from the tree
+     *
+     * @param pDir          Position of the directory
+     */
+    void
+    remove_subtree (const uint32_t &pDir);
+
+    /**
+     * @brief               Reads a directory that changed again, and adds the difference to the totals of its ancestors
+     *
+     * @param pDir          Position of the directory
+     */
+    void
+    refresh_dir (const uint32_t &pDir);
+
+    /**
+     * @brief               Marks a directory as changed, so that it is read again by the next refresh
+     *
+     * @param pDir          Position of the directory
+     */
+    void
+    mark_dirty (const uint32_t &pDir);
+
+    /**
+     * @brief               Starts watching a directory for changes
+     *
+     * @param pDir          Position of the directory
+     */
+    void
+    watch_dir (const uint32_t &pDir);
+
+    /**
+     * @brief               Checks whether every directory whose watch was taken over by another position has been removed
+     *                      from the tree (it is no longer watched otherwise, so the tree is no longer complete)
+     */
+    void
+    check_displaced () noexcept;
+
+    /**
+     * @brief               Stops watching every directory, and forgets the whole tree
+     */
+    void
+    clear () noexcept;
+
+public:
+
+    WatchTree () = default;
+    WatchTree (const WatchTree &) = delete;
+    WatchTree &operator= (const WatchTree &) = delete;
+
+    ~WatchTree ()
+    {
+        clear ();
+    }
+
+    /**
+     * @brief               Reads the whole tree below a directory, and starts watching all of its directories
+     *
+     * @param pRoot         Path of the directory
+     * @param pOptions      Options of the walks of the tree (how deep it goes, whether it stays on one filesystem, and
+     *                      which names are skipped)
+     * @param pIsAllocated  Whether the space allocated to files is counted instead of their sizes
+     * @param pErr          Error that occoured while reading the directory
+     *
+     * @return true         If the directory was read
+     * @return false        If the directory could not be read
+     */
+    [[nodiscard]] bool
+    build (const std::filesystem::path &pRoot, const WalkOptions &pOptions, const bool &pIsAllocated, std::error_code &pErr);
+
+    /**
+     * @brief               Waits for changes to the tree until some time has passed, marking each directory that changed
+     *                      (nothing is read until the tree is refreshed)
+     *
+     * @param pTimeoutMs    Time to wait for, in milliseconds
+     */
+    void
+    wait (const uint64_t &pTimeoutMs);
+
+    /**
+     * @brief               Brings the totals up to date with the changes seen so far
+     */
+    void
+    refresh ();
+
+    /**
+     * @brief               Returns a directory of the tree
+     *
+     * @param pDir          Position of the directory (0 for the root)
+     *
+     * @return const WatchDir& Directory
+     */
+    [[nodiscard]] const WatchDir
+    &dir (const uint32_t &pDir) const noexcept
+    {
+        return mDirs[pDir];
+    }
+
+    /**
+     * @brief               Returns the number of directories that are watched for changes
+     *
+     * @return size_t       Number of directories
+     */
+    [[nodiscard]] size_t
+    num_watched () const noexcept
+    {
+        return mWatches.size ();
+    }
+
+    /**
+     * @brief               Checks whether every change to the tree is seen (otherwise refreshing reads all of it again)
+     *
+     * @return true         If every directory is watched, and no change was lost
+     * @return false        If refreshing reads the whole tree again
+     */
+    [[nodiscard]] bool
+    is_complete () const noexcept
+    {
+        return mIsComplete;
+    }
+};
+
+#endif
@@ -0,0 +1,306 @@
+/**
+ * @file            work_stealing_pool.h
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Pool of worker threads with per-thread deques and work stealing
+ *
+ */
+
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <cstdint>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/** Number of consecutive failed attempts at finding work after which an idle worker starts sleeping between attempts */
+#define POOL_SPIN_LIMIT         (64)
+
+/** Duration (in microseconds) for which an idle worker sleeps between attempts at finding work */
+#define POOL_IDLE_SLEEP_US      (50)
+
+/** Size of a cache line, used to keep the queues of different workers from sharing one */
+#define POOL_CACHE_LINE         (64)
+
+
+/** Work done by a single worker of a pool during a run */
+struct alignas (POOL_CACHE_LINE) PoolWorkerStats
+{
+    /** Number of tasks processed by the worker */
+    uint64_t                tasks               {};
+    /** Number of tasks the worker stole from the deques of other workers */
+    uint64_t                steals              {};
+    /** Time spent processing tasks, in nanoseconds (only measured if the pool is timed) */
+    uint64_t                busyNs              {};
+    /** Time from the start of the run until the worker ran out of work, in nanoseconds (only measured if the pool is timed) */
+    uint64_t                runNs               {};
+};
+
+/**
+ * @brief                   Pool of worker threads that process tasks which can in turn spawn more tasks
+ *
+ *                          Each worker owns a deque of tasks, and pushes the tasks spawned by it to the back of its own
+ *                          deque. A worker takes tasks from the back of its own deque (depth-first, which keeps its working
+ *                          set small), and when that is empty, steals from the front of the other workers' deques (the
+ *                          oldest tasks, which are usually the roots of the largest pending subtrees)
+ *
+ *                          The pool is done once every task that was pushed has been processed
+ *
+ * @tparam task_t           Type of the tasks processed by the pool
+ */
+template <typename task_t>
+class WorkStealingPool
+{
+    /** Deque of pending tasks owned by a single worker */
+    struct alignas (POOL_CACHE_LINE) WorkerQueue
+    {
+        /** Lock protecting the deque (taken by the owner as well as by thieves) */
+        std::mutex          lock;
+        /** Pending tasks of the worker */
+        std::deque<task_t>  tasks;
+    };
+
+    /** Queues of all the workers */
+    std::unique_ptr<WorkerQueue []> mQueues;
+    /** Work done by each worker (only updated by the worker itself) */
+    std::unique_ptr<PoolWorkerStats []> mStats;
+    /** Number of workers in the pool */
+    uint32_t                mNumWorkers;
+    /** Whether the time each worker spends processing tasks is measured */
+    bool                    mIsTimed            {false};
+
+    /** Number of tasks that have been pushed but not processed yet */
+    std::atomic<uint64_t>   mPending            {};
+
+    /**
+     * @brief               Takes the most recently pushed task from the deque of a worker
+     *
+     * @param pWorker       Index of the worker whose deque to pop from
+     * @param pTask         Reference to the variable to move the task into
+     *
+     * @return true         If a task was taken
+     * @return false        If the deque was empty
+     */
+    [[nodiscard]] bool
+    pop (const uint32_t &pWorker, task_t &pTask) noexcept
+    {
+        /** Queue to take the task from */
+        WorkerQueue         &queue  = mQueues[pWorker];
+
+        std::lock_guard<std::mutex> guard (queue.lock);
+
+        if (queue.tasks.empty ()) {
+            return false;
+        }
+
+        pTask = std::move (queue.tasks.back ());
+        queue.tasks.pop_back ();
+
+        return true;
+    }
+
+    /**
+     * @brief               Takes the oldest task from the deque of any worker other than the given one
+     *
+     * @param pWorker       Index of the worker that is stealing
+     * @param pTask         Reference to the variable to move the task into
+     *
+     * @return true         If a task was stolen
+     * @return false        If the deques of all other workers were empty
+     */
+    [[nodiscard]] bool
+    steal (const uint32_t &pWorker, task_t &pTask) noexcept
+    {
+        // start from the next worker, so that all thieves do not pile onto the same victim
+        for (uint32_t i = 1; i < mNumWorkers; ++i) {
+
+            /** Queue to steal the task from */
+            WorkerQueue     &queue  = mQueues[(pWorker + i) % mNumWorkers];
+
+            std::lock_guard<std::mutex> guard (queue.lock);
+
+            if (!queue.tasks.empty ()) {
+                pTask = std::move (queue.tasks.front ());
+                queue.tasks.pop_front ();
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief               Processes tasks until none are pending in the pool
+     *
+     * @param pWorker       Index of the worker
+     * @param pHandler      Callable invoked with each task and the index of the worker
+     */
+    template <typename handler_t>
+    void
+    work (const uint32_t pWorker, handler_t &pHandler) noexcept
+    {
+        /** Task currently being processed */
+        task_t              task;
+        /** Number of consecutive failed attempts at finding a task */
+        uint32_t            idleRounds;
+        /** Whether the current task was stolen from another worker */
+        bool                isStolen;
+
+        /** Work done by the worker */
+        PoolWorkerStats     &stats  = mStats[pWorker];
+        /** Time at which the worker started */
+        const auto          start   = (mIsTimed) ? (std::chrono::steady_clock::now ()) : (std::chrono::steady_clock::time_point {});
+        /** Time at which the current task was taken */
+        std::chrono::steady_clock::time_point   taskStart;
+
+        for (idleRounds = 0; ; ) {
+
+            isStolen    = false;
+            if (pop (pWorker, task) || (isStolen = steal (pWorker, task))) {
+                if (mIsTimed) {
+                    taskStart   = std::chrono::steady_clock::now ();
+                }
+
+                pHandler (task, pWorker);
+
+                ++stats.tasks;
+                stats.steals    += (isStolen) ? (1) : (0);
+                if (mIsTimed) {
+                    stats.busyNs    += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds> (
+                                        std::chrono::steady_clock::now () - taskStart).count ();
+                }
+
+                // the tasks spawned by the handler have already been counted, so the pending count can only hit 0 once
+                // all the work is done
+                mPending.fetch_sub (1, std::memory_order_acq_rel);
+                idleRounds  = 0;
+                continue;
+            }
+
+            if (mPending.load (std::memory_order_acquire) == 0) {
+                if (mIsTimed) {
+                    stats.runNs     = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds> (
+                                        std::chrono::steady_clock::now () - start).count ();
+                }
+                return;
+            }
+
+            if (++idleRounds < POOL_SPIN_LIMIT) {
+                std::this_thread::yield ();
+            }
+            else {
+                std::this_thread::sleep_for (std::chrono::microseconds (POOL_IDLE_SLEEP_US));
+            }
+        }
+    }
+
+public:
+
+    /**
+     * @brief               Constructs a pool with the given number of workers (the calling thread is one of them)
+     *
+     * @param pNumWorkers   Number of workers (at least 1)
+     */
+    explicit
+    WorkStealingPool (const uint32_t &pNumWorkers)
+        : mQueues (new WorkerQueue[(pNumWorkers == 0) ? (1) : (pNumWorkers)])
+        , mStats (new PoolWorkerStats[(pNumWorkers == 0) ? (1) : (pNumWorkers)])
+        , mNumWorkers ((pNumWorkers == 0) ? (1) : (pNumWorkers))
+    {
+    }
+
+    /**
+     * @brief               Sets whether the time each worker spends processing tasks is measured (to be called before run)
+     *
+     * @param pIsTimed      Whether the time is measured
+     */
+    void
+    set_timed (const bool &pIsTimed) noexcept
+    {
+        mIsTimed    = pIsTimed;
+    }
+
+    /**
+     * @brief               Returns the work done by a worker during the last run
+     *
+     * @param pWorker       Index of the worker
+     *
+     * @return const PoolWorkerStats& Work done by the worker
+     */
+    [[nodiscard]] const PoolWorkerStats
+    &worker_stats (const uint32_t &pWorker) const noexcept
+    {
+        return mStats[pWorker];
+    }
+
+    /**
+     * @brief               Returns the number of workers in the pool
+     *
+     * @return uint32_t     Number of workers
+     */
+    [[nodiscard]] uint32_t
+    num_workers () const noexcept
+    {
+        return mNumWorkers;
+    }
+
+    /**
+     * @brief               Pushes a task to the deque of a worker (to be called from within the handler, or before run)
+     *
+     * @param pWorker       Index of the worker pushing the task
+     * @param pTask         Task to push
+     */
+    void
+    push (const uint32_t &pWorker, task_t &&pTask)
+    {
+        /** Queue to push the task to */
+        WorkerQueue         &queue  = mQueues[pWorker];
+
+        mPending.fetch_add (1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> guard (queue.lock);
+        queue.tasks.push_back (std::move (pTask));
+    }
+
+    /**
+     * @brief               Processes the given task and all the tasks spawned from it, and returns once all are done
+     *
+     *                      Worker 0 runs on the calling thread, the others on threads spawned for the run
+     *
+     * @param pRoot         First task to process
+     * @param pHandler      Callable invoked as pHandler (task_t &, uint32_t) with each task and the index of the worker
+     */
+    template <typename handler_t>
+    void
+    run (task_t &&pRoot, handler_t &&pHandler)
+    {
+        /** Threads running the workers other than worker 0 */
+        std::vector<std::thread>    threads;
+
+        for (uint32_t i = 0; i < mNumWorkers; ++i) {
+            mStats[i]   = PoolWorkerStats {};
+        }
+        push (0, std::move (pRoot));
+
+        threads.reserve (mNumWorkers - 1);
+        for (uint32_t i = 1; i < mNumWorkers; ++i) {
+            threads.emplace_back ([this, i, &pHandler] () { work (i, pHandler); });
+        }
+
+        work (0, pHandler);
+
+        for (auto &thread : threads) {
+            thread.join ();
+        }
+    }
+};
+
+#endif
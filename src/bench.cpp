@@ -0,0 +1,672 @@
+/**
+ * @file            bench.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Benchmark harness for fss, which generates reproducible synthetic trees and times each mode of the
+ *                  scanner over them (one JSON object per measurement, on its own line)
+ *
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+
+/** Number of files in the directory of the wide tree (multiplied by the scale) */
+#define WIDE_FILES              (20000)
+/** Number of levels of the deep tree (multiplied by the scale) */
+#define DEEP_LEVELS             (512)
+/** Number of files on each level of the deep tree */
+#define DEEP_FILES              (4)
+/** Number of directories on the first two levels of the tree of small files (the second multiplied by the scale) */
+#define SMALL_FANOUT            (16)
+/** Number of files in each leaf directory of the tree of small files */
+#define SMALL_FILES             (48)
+/** Number of directories of the tree of hard links (multiplied by the scale) */
+#define LINK_DIRS               (64)
+/** Number of files in each directory of the tree of hard links (each of which is linked from the next directory) */
+#define LINK_FILES              (64)
+
+/** Largest size of the files of the synthetic trees, in bytes (files are sparse, so this costs no disk space) */
+#define MAX_FILE_SIZE           (1U << 20)
+
+
+static const char           usage[]         = "Usage: fss_bench [options]\n"
+                                            "\n"
+                                            "Generates synthetic trees and prints one JSON object per measurement of fss over them\n"
+                                            "\n"
+                                            "    --fss PATH      fss executable to benchmark (defaults to the one next to fss_bench)\n"
+                                            "    --dir DIR       Directory to generate the trees in (defaults to a new one in the temporary directory)\n"
+                                            "    --scale N       Multiplies the size of every tree (defaults to 1)\n"
+                                            "    --runs N        Number of warm-cache runs of each mode, of which the median is reported (defaults to 5)\n"
+                                            "    --seed N        Seed of the generated trees (defaults to 1)\n"
+                                            "    -j N            Number of threads that fss uses (passed on as is)\n"
+                                            "    --keep          Keep the generated trees once the benchmark is complete\n"
+                                            "    -h, --help      Print Usage Instructions\n";
+
+
+/** Synthetic tree that fss is benchmarked over */
+struct BenchTree
+{
+    /** Name of the tree (as reported in the results) */
+    const char              *name;
+    /** Path of the root of the tree */
+    fs::path                root;
+    /** Number of entries within the tree (of any type) */
+    uint64_t                numEntries;
+};
+
+/** Mode of fss that is benchmarked */
+struct BenchMode
+{
+    /** Name of the mode (as reported in the results) */
+    const char              *name;
+    /** Options passed to fss after the path */
+    std::vector<std::string>    args;
+};
+
+/** Measurement of a single run of fss */
+struct RunStats
+{
+    /** Wall-clock time of the run, in seconds */
+    double                  wallSecs            {};
+    /** Time spent in user mode, in seconds */
+    double                  userSecs            {};
+    /** Time spent in kernel mode, in seconds */
+    double                  sysSecs             {};
+    /** Largest resident set size of the run, in kilobytes */
+    int64_t                 maxRssKb            {};
+    /** Number of read and write system calls made by the run (-1 if the kernel does not report them) */
+    int64_t                 rwSyscalls          {-1};
+    /** Number of directories that fss read, as it reported them (-1 if it did not report its profile) */
+    int64_t                 dirsRead            {-1};
+    /** Number of entries whose metadata fss fetched, as it reported them (-1 if it did not report its profile) */
+    int64_t                 entriesStat         {-1};
+    /** Number of entries that fss saw, as it reported them (-1 if it did not report its profile) */
+    int64_t                 entriesSeen         {-1};
+    /** Number of voluntary and involuntary context switches of the run */
+    int64_t                 ctxSwitches         {};
+    /** Whether fss exited successfully */
+    bool                    isOk                {};
+};
+
+
+/**
+ * @brief                   Creates a regular file of a given size (the file is sparse, so it takes up no space)
+ *
+ * @param pPath             Path of the file
+ * @param pSize             Size of the file in bytes
+ */
+void
+make_file (const fs::path &pPath, const uint64_t &pSize)
+{
+    std::ofstream (pPath, std::ios::binary | std::ios::trunc);
+    fs::resize_file (pPath, pSize);
+}
+
+/**
+ * @brief                   Generates a single directory with many files in it
+ *
+ * @param pRoot             Path of the root of the tree
+ * @param pScale            Multiplier of the size of the tree
+ * @param pRng              Generator of the sizes of the files
+ *
+ * @return uint64_t         Number of entries created within the root
+ */
+uint64_t
+make_wide_tree (const fs::path &pRoot, const uint64_t &pScale, std::mt19937_64 &pRng)
+{
+    /** Number of entries created so far */
+    uint64_t                numEntries      = 0;
+
+    fs::create_directories (pRoot);
+    for (uint64_t i = 0; i < WIDE_FILES * pScale; ++i) {
+        make_file (pRoot / ("file_" + std::to_string (i) + ".dat"), pRng () % MAX_FILE_SIZE);
+        ++numEntries;
+    }
+
+    return numEntries;
+}
+
+/**
+ * @brief                   Generates a single chain of directories, with a few files on each level
+ *
+ * @param pRoot             Path of the root of the tree
+ * @param pScale            Multiplier of the size of the tree
+ * @param pRng              Generator of the sizes of the files
+ *
+ * @return uint64_t         Number of entries created within the root
+ */
+uint64_t
+make_deep_tree (const fs::path &pRoot, const uint64_t &pScale, std::mt19937_64 &pRng)
+{
+    /** Number of entries created so far */
+    uint64_t                numEntries      = 0;
+    /** Directory of the current level */
+    fs::path                level           = pRoot;
+
+    fs::create_directories (pRoot);
+    for (uint64_t i = 0; i < DEEP_LEVELS * pScale; ++i) {
+        for (uint64_t j = 0; j < DEEP_FILES; ++j) {
+            make_file (level / ("f" + std::to_string (j)), pRng () % MAX_FILE_SIZE);
+            ++numEntries;
+        }
+
+        level   /= "d";
+        fs::create_directory (level);
+        ++numEntries;
+    }
+
+    return numEntries;
+}
+
+/**
+ * @brief                   Generates two levels of directories, with many small files in each directory of the second
+ *
+ * @param pRoot             Path of the root of the tree
+ * @param pScale            Multiplier of the size of the tree
+ * @param pRng              Generator of the sizes of the files
+ *
+ * @return uint64_t         Number of entries created within the root
+ */
+uint64_t
+make_small_tree (const fs::path &pRoot, const uint64_t &pScale, std::mt19937_64 &pRng)
+{
+    /** Number of entries created so far */
+    uint64_t                numEntries      = 0;
+    /** Directory of the current leaf */
+    fs::path                leaf;
+
+    fs::create_directories (pRoot);
+    for (uint64_t i = 0; i < SMALL_FANOUT; ++i) {
+        fs::create_directory (pRoot / ("dir_" + std::to_string (i)));
+        ++numEntries;
+
+        for (uint64_t j = 0; j < SMALL_FANOUT * pScale; ++j) {
+            leaf    = pRoot / ("dir_" + std::to_string (i)) / ("sub_" + std::to_string (j));
+            fs::create_directory (leaf);
+            ++numEntries;
+
+            for (uint64_t k = 0; k < SMALL_FILES; ++k) {
+                make_file (leaf / ("small_" + std::to_string (k) + ".txt"), pRng () % 4096);
+                ++numEntries;
+            }
+        }
+    }
+
+    return numEntries;
+}
+
+/**
+ * @brief                   Generates directories of files that are hard-linked from the next directory, each of which
+ *                          also has symlinks pointing back up the tree (which a scan must not follow into a loop)
+ *
+ * @param pRoot             Path of the root of the tree
+ * @param pScale            Multiplier of the size of the tree
+ * @param pRng              Generator of the sizes of the files
+ *
+ * @return uint64_t         Number of entries created within the root
+ */
+uint64_t
+make_link_tree (const fs::path &pRoot, const uint64_t &pScale, std::mt19937_64 &pRng)
+{
+    /** Number of entries created so far */
+    uint64_t                numEntries      = 0;
+    /** Current directory */
+    fs::path                dir;
+
+    fs::create_directories (pRoot);
+    for (uint64_t i = 0; i < LINK_DIRS * pScale; ++i) {
+        dir     = pRoot / ("snap_" + std::to_string (i));
+        fs::create_directory (dir);
+        fs::create_directory_symlink ("..", dir / "up");
+        fs::create_directory_symlink (".", dir / "self");
+        numEntries  += 3;
+
+        for (uint64_t j = 0; j < LINK_FILES; ++j) {
+            if (i == 0) {
+                make_file (dir / ("file_" + std::to_string (j)), pRng () % MAX_FILE_SIZE);
+            }
+            else {
+                fs::create_hard_link (pRoot / ("snap_" + std::to_string (i - 1)) / ("file_" + std::to_string (j)),
+                                        dir / ("file_" + std::to_string (j)));
+            }
+            ++numEntries;
+        }
+    }
+
+    return numEntries;
+}
+
+/**
+ * @brief                   Drops the page cache, dentries and inodes of the system, so that the next run reads the tree
+ *                          from the disk (this needs privileges)
+ *
+ * @return true             If the caches were dropped
+ * @return false            If the caches could not be dropped
+ */
+[[nodiscard]] bool
+drop_caches () noexcept
+{
+    /** File through which the kernel drops its caches */
+    FILE                    *dropFile;
+
+    sync ();
+
+    dropFile    = fopen ("/proc/sys/vm/drop_caches", "w");
+    if (dropFile == nullptr) {
+        return false;
+    }
+
+    /** Whether the request was written out completely */
+    const bool              isWritten       = fputs ("3\n", dropFile) >= 0;
+
+    return fclose (dropFile) == 0 && isWritten;
+}
+
+/**
+ * @brief                   Reads the number of read and write system calls made by a process that has exited, but has not
+ *                          been reaped yet
+ *
+ * @param pPid              Identifier of the process
+ *
+ * @return int64_t          Number of system calls (-1 if the kernel does not report them)
+ */
+[[nodiscard]] int64_t
+read_io_syscalls (const pid_t &pPid) noexcept
+{
+    /** Accounting of the I/O of the process */
+    FILE                    *ioFile;
+    /** Current line of the accounting */
+    char                    line[128];
+    /** Value of the current line */
+    long long               value;
+
+    /** Number of system calls counted so far */
+    int64_t                 numSyscalls     = -1;
+
+    ioFile      = fopen (("/proc/" + std::to_string (pPid) + "/io").c_str (), "r");
+    if (ioFile == nullptr) {
+        return -1;
+    }
+
+    while (fgets (line, sizeof (line), ioFile) != nullptr) {
+        if (sscanf (line, "syscr: %lld", &value) == 1 || sscanf (line, "syscw: %lld", &value) == 1) {
+            numSyscalls     = ((numSyscalls == -1) ? (0) : (numSyscalls)) + value;
+        }
+    }
+    fclose (ioFile);
+
+    return numSyscalls;
+}
+
+/**
+ * @brief                   Reads the counters of the profile that fss prints with --stats=json (the last line of its
+ *                          standard error that holds one)
+ *
+ * @param pErrText          Standard error of the run
+ * @param pStats            Measurement to fill the counters of (left at -1 if there is no profile)
+ */
+void
+read_profile_counters (const std::string &pErrText, RunStats &pStats) noexcept
+{
+    /** Position of the last profile within the text */
+    const size_t            pos             = pErrText.rfind ("{\"wall_ms\":");
+    /** Value of the current counter */
+    long long               value;
+
+    /** Reads a single counter of the profile into a field of the measurement */
+    const auto              read_counter    = [&] (const char *pKey, int64_t &pField) {
+
+        /** Position of the key within the profile */
+        const size_t        keyPos          = pErrText.find (pKey, pos);
+
+        if (keyPos != std::string::npos && sscanf (pErrText.c_str () + keyPos + strlen (pKey), "%lld", &value) == 1) {
+            pField  = value;
+        }
+    };
+
+    if (pos == std::string::npos) {
+        return;
+    }
+
+    read_counter ("\"dirs_read\":", pStats.dirsRead);
+    read_counter ("\"entries_stat\":", pStats.entriesStat);
+    read_counter ("\"entries_seen\":", pStats.entriesSeen);
+}
+
+/**
+ * @brief                   Runs fss once with its output discarded (and its profile requested on its standard error),
+ *                          and measures the run
+ *
+ * @param pFss              Path of the fss executable
+ * @param pArgs             Arguments of fss (the path of the tree followed by the options)
+ *
+ * @return RunStats         Measurement of the run
+ */
+[[nodiscard]] RunStats
+run_fss (const std::string &pFss, const std::vector<std::string> &pArgs)
+{
+    /** Measurement of the run */
+    RunStats                stats;
+    /** Arguments of the child, as passed to exec */
+    std::vector<char *>     argv;
+
+    /** Resources used by the child */
+    struct rusage           usage;
+    /** Status of the child that has exited */
+    siginfo_t               info;
+    /** Exit status of the child */
+    int                     status;
+
+    /** Identifier of the child */
+    pid_t                   pid;
+    /** File that the output of the child is discarded into */
+    int                     nullFd;
+    /** Pipe that the standard error of the child (along with its profile) is read from */
+    int                     errPipe[2];
+    /** Standard error of the child */
+    std::string             errText;
+    /** Buffer that the standard error of the child is read into */
+    char                    buff[4096];
+    /** Number of bytes read by the last call */
+    ssize_t                 buffLen;
+
+    /** Option that has fss report the work it did (which the system calls per entry are worked out from) */
+    static const std::string    statsArg    = "--stats=json";
+
+    argv.push_back (const_cast<char *> (pFss.c_str ()));
+    for (const auto &arg : pArgs) {
+        argv.push_back (const_cast<char *> (arg.c_str ()));
+    }
+    argv.push_back (const_cast<char *> (statsArg.c_str ()));
+    argv.push_back (nullptr);
+
+    if (pipe (errPipe) == -1) {
+        return stats;
+    }
+
+    /** Time at which the run started */
+    const auto              start           = std::chrono::steady_clock::now ();
+
+    pid         = fork ();
+    if (pid == 0) {
+        nullFd      = open ("/dev/null", O_WRONLY);
+        if (nullFd != -1) {
+            dup2 (nullFd, STDOUT_FILENO);
+        }
+        dup2 (errPipe[1], STDERR_FILENO);
+        close (errPipe[0]);
+        close (errPipe[1]);
+        execv (pFss.c_str (), argv.data ());
+        _exit (127);
+    }
+    close (errPipe[1]);
+    if (pid == -1) {
+        close (errPipe[0]);
+        return stats;
+    }
+
+    // the pipe is drained until the child exits, so that the child never blocks on a full pipe
+    while ((buffLen = read (errPipe[0], buff, sizeof (buff))) > 0 || (buffLen == -1 && errno == EINTR)) {
+        if (buffLen > 0) {
+            errText.append (buff, (size_t)buffLen);
+        }
+    }
+    close (errPipe[0]);
+
+    // the child is waited for without being reaped, so that its accounting can still be read
+    if (waitid (P_PID, (id_t)pid, &info, WEXITED | WNOWAIT) == 0) {
+        stats.wallSecs      = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+        stats.rwSyscalls    = read_io_syscalls (pid);
+    }
+    if (wait4 (pid, &status, 0, &usage) == -1) {
+        return stats;
+    }
+
+    stats.userSecs      = (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6;
+    stats.sysSecs       = (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+    stats.maxRssKb      = usage.ru_maxrss;
+    stats.ctxSwitches   = usage.ru_nvcsw + usage.ru_nivcsw;
+    stats.isOk          = WIFEXITED (status) && WEXITSTATUS (status) == 0;
+    read_profile_counters (errText, stats);
+
+    return stats;
+}
+
+/**
+ * @brief                   Prints a measurement as a JSON object on its own line
+ *
+ * @param pTree             Tree that was scanned
+ * @param pMode             Mode that fss ran in
+ * @param pCache            State of the caches during the measurement ("cold" or "warm")
+ * @param pNumRuns          Number of runs that the measurement was taken from
+ * @param pStats            Measurement (the median of the runs, if there were more than one)
+ */
+void
+print_result (const BenchTree &pTree, const BenchMode &pMode, const char *pCache, const uint64_t &pNumRuns,
+                const RunStats &pStats) noexcept
+{
+    /** Whether the system calls per entry can be worked out (each directory read and each entry fetched costs one) */
+    const bool              hasSyscalls     = pStats.rwSyscalls >= 0 && pStats.dirsRead >= 0 && pStats.entriesStat >= 0
+                                            && pStats.entriesSeen > 0;
+
+    printf ("{\"tree\":\"%s\",\"mode\":\"%s\",\"cache\":\"%s\",\"runs\":%llu,\"entries\":%llu,\"ok\":%s,"
+            "\"wall_s\":%.6f,\"user_s\":%.6f,\"sys_s\":%.6f,\"entries_per_s\":%.1f,"
+            "\"rw_syscalls\":%lld,\"dirs_read\":%lld,\"entries_stat\":%lld,\"entries_seen\":%lld,\"syscalls_per_entry\":%.4f,"
+            "\"ctx_switches\":%lld,\"max_rss_kb\":%lld}\n",
+            pTree.name, pMode.name, pCache, (unsigned long long)pNumRuns, (unsigned long long)pTree.numEntries,
+            (pStats.isOk) ? ("true") : ("false"),
+            pStats.wallSecs, pStats.userSecs, pStats.sysSecs,
+            (pStats.wallSecs > 0) ? ((double)pTree.numEntries / pStats.wallSecs) : (0.0),
+            (long long)pStats.rwSyscalls, (long long)pStats.dirsRead, (long long)pStats.entriesStat, (long long)pStats.entriesSeen,
+            (!hasSyscalls) ? (-1.0) : ((double)(pStats.dirsRead + pStats.entriesStat + pStats.rwSyscalls) / (double)pStats.entriesSeen),
+            (long long)pStats.ctxSwitches, (long long)pStats.maxRssKb);
+    fflush (stdout);
+}
+
+/**
+ * @brief                   Parses a positive whole number given to an option
+ *
+ * @param pPtr              Value of the option
+ * @param pRes              Parsed number
+ *
+ * @return true             If the value is a positive whole number
+ * @return false            If the value is not valid
+ */
+[[nodiscard]] bool
+parse_count (const char *pPtr, uint64_t &pRes) noexcept
+{
+    /** Character after the last one parsed */
+    char                    *end;
+
+    pRes        = strtoull (pPtr, &end, 10);
+
+    return *pPtr != '\0' && *end == '\0' && pRes != 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+    /** Path of the fss executable */
+    std::string             fssPath         = (fs::path (argv[0]).parent_path () / "fss").string ();
+    /** Directory the trees are generated in */
+    fs::path                benchDir        = fs::temp_directory_path () / ("fss-bench-" + std::to_string (getpid ()));
+    /** Multiplier of the size of every tree */
+    uint64_t                scale           = 1;
+    /** Number of warm-cache runs of each mode */
+    uint64_t                numRuns         = 5;
+    /** Seed of the generated trees */
+    uint64_t                seed            = 1;
+    /** Number of threads passed on to fss (empty to leave it to fss) */
+    std::string             numJobs;
+    /** Whether the trees are kept once the benchmark is complete */
+    bool                    keepTrees       = false;
+
+    /** Trees that are benchmarked */
+    std::vector<BenchTree>  trees;
+    /** Measurements of the warm-cache runs of the current mode */
+    std::vector<RunStats>   runs;
+    /** Arguments of the current run */
+    std::vector<std::string>    args;
+
+    /** Whether the caches could be dropped before the cold-cache runs */
+    bool                    canDropCaches;
+
+    for (int i = 1; i < argc; ++i) {
+        if ((strcmp (argv[i], "--fss") == 0 || strcmp (argv[i], "--dir") == 0 || strcmp (argv[i], "--scale") == 0
+            || strcmp (argv[i], "--runs") == 0 || strcmp (argv[i], "--seed") == 0 || strcmp (argv[i], "-j") == 0)
+            && i == argc - 1) {
+            fprintf (stderr, "Missing value for \"%s\"\n", argv[i]);
+            return -1;
+        }
+
+        if (strcmp (argv[i], "--fss") == 0) {
+            fssPath     = argv[++i];
+        }
+        else if (strcmp (argv[i], "--dir") == 0) {
+            benchDir    = argv[++i];
+        }
+        else if (strcmp (argv[i], "--scale") == 0) {
+            if (!parse_count (argv[++i], scale)) {
+                fprintf (stderr, "Invalid scale \"%s\"\nPlease provide a positive whole number\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp (argv[i], "--runs") == 0) {
+            if (!parse_count (argv[++i], numRuns)) {
+                fprintf (stderr, "Invalid number of runs \"%s\"\nPlease provide a positive whole number\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp (argv[i], "--seed") == 0) {
+            if (!parse_count (argv[++i], seed)) {
+                fprintf (stderr, "Invalid seed \"%s\"\nPlease provide a positive whole number\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp (argv[i], "-j") == 0) {
+            numJobs     = argv[++i];
+        }
+        else if (strcmp (argv[i], "--keep") == 0) {
+            keepTrees   = true;
+        }
+        else if (strcmp (argv[i], "-h") == 0 || strcmp (argv[i], "--help") == 0) {
+            fputs (usage, stdout);
+            return 0;
+        }
+        else {
+            fprintf (stderr, "Ignoring Unknown Option \"%s\"\n", argv[i]);
+        }
+    }
+
+    if (access (fssPath.c_str (), X_OK) != 0) {
+        fprintf (stderr, "Can not execute \"%s\"\nPlease provide the path of fss with --fss\n", fssPath.c_str ());
+        return -1;
+    }
+
+    /** Modes of fss that are benchmarked over every tree */
+    const BenchMode         modes[]         = {
+                                {"-r", {"-r"}},
+                                {"-r -d", {"-r", "-d"}},
+                                {"-r -a -f", {"-r", "-a", "-f"}},
+                                {"-r -f -S", {"-r", "-f", "-S", "file_7"}},
+                                {"-r -f --contains", {"-r", "-f", "--contains", "7"}}
+                            };
+
+    // every tree is generated from its own generator, so that each one is the same whichever others are generated
+    try {
+        if (fs::exists (benchDir)) {
+            fprintf (stderr, "\"%s\" already exists\nPlease provide a directory that does not exist with --dir\n",
+                        benchDir.string ().c_str ());
+            return -1;
+        }
+
+        /** Generator of the sizes of the files of the current tree */
+        std::mt19937_64     rng;
+
+        rng.seed (seed);
+        trees.push_back (BenchTree {"wide", benchDir / "wide", 0});
+        trees.back ().numEntries    = make_wide_tree (trees.back ().root, scale, rng);
+
+        rng.seed (seed + 1);
+        trees.push_back (BenchTree {"deep", benchDir / "deep", 0});
+        trees.back ().numEntries    = make_deep_tree (trees.back ().root, scale, rng);
+
+        rng.seed (seed + 2);
+        trees.push_back (BenchTree {"small_files", benchDir / "small_files", 0});
+        trees.back ().numEntries    = make_small_tree (trees.back ().root, scale, rng);
+
+        rng.seed (seed + 3);
+        trees.push_back (BenchTree {"hard_links", benchDir / "hard_links", 0});
+        trees.back ().numEntries    = make_link_tree (trees.back ().root, scale, rng);
+    }
+    catch (const std::exception &err) {
+        fprintf (stderr, "Error while generating the trees in \"%s\": %s\n", benchDir.string ().c_str (), err.what ());
+        return -1;
+    }
+
+    canDropCaches   = drop_caches ();
+    if (!canDropCaches) {
+        fprintf (stderr, "Can not drop the caches of the system, so only warm-cache runs are measured\n");
+    }
+
+    for (const auto &tree : trees) {
+        for (const auto &mode : modes) {
+            args.assign (1, tree.root.string ());
+            args.insert (args.end (), mode.args.begin (), mode.args.end ());
+            if (!numJobs.empty ()) {
+                args.push_back ("-j");
+                args.push_back (numJobs);
+            }
+
+            if (canDropCaches && drop_caches ()) {
+                print_result (tree, mode, "cold", 1, run_fss (fssPath, args));
+            }
+
+            // the first run warms the caches up, and is not measured
+            (void)run_fss (fssPath, args);
+
+            runs.clear ();
+            for (uint64_t i = 0; i < numRuns; ++i) {
+                runs.push_back (run_fss (fssPath, args));
+            }
+            std::sort (runs.begin (), runs.end (), [] (const RunStats &pLeft, const RunStats &pRight) {
+                return pLeft.wallSecs < pRight.wallSecs;
+            });
+
+            print_result (tree, mode, "warm", numRuns, runs[runs.size () / 2]);
+        }
+    }
+
+    if (!keepTrees) {
+
+        /** Container for error codes reported while removing the trees */
+        std::error_code     errorCode;
+
+        fs::remove_all (benchDir, errorCode);
+        if (errorCode.value () != 0) {
+            fprintf (stderr, "Error while removing \"%s\": %s\n", benchDir.string ().c_str (), errorCode.message ().c_str ());
+        }
+    }
+
+    return 0;
+}
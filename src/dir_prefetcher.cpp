@@ -0,0 +1,141 @@
+/**
+ * @file            dir_prefetcher.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Background threads that read directories ahead of a walk, so that their entries and the metadata of
+ *                  their files are already cached by the time the walk reaches them
+ *
+ */
+
+#include "dir_prefetcher.h"
+
+namespace fs                    = std::filesystem;
+
+
+void
+DirPrefetcher::run () noexcept
+{
+    /** Entries of the directory being read (reused for every directory) */
+    DirBatch                batch;
+    /** Error that occoured while reading a directory (which the walk will report on its own) */
+    std::error_code         errorCode;
+    /** Path of the directory being read */
+    fs::path                path;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex>    guard (mLock);
+
+            mWake.wait (guard, [&] () { return mIsStopping || !mPending.empty (); });
+            if (mIsStopping) {
+                return;
+            }
+
+            try {
+                path    = std::move (mPending.back ());
+            }
+            catch (const std::bad_alloc &) {
+                mPending.pop_back ();
+                mNumDropped.fetch_add (1, std::memory_order_relaxed);
+                continue;
+            }
+            mPending.pop_back ();
+        }
+
+        if (!read_dir (path, batch, errorCode)) {
+            continue;
+        }
+
+        // the metadata that the walk will fetch loads the inodes of the files, which is what takes a seek
+        if (mFileMask != 0) {
+            for (auto &entry : batch.entries) {
+                entry.statMask  = (entry.type == EntryType::REGULAR) ? (mFileMask)
+                                : (entry.type == EntryType::SYMLINK) ? (STAT_FOLLOW | STAT_TYPE | mFileMask)
+                                : (0);
+            }
+            stat_dir_entries (batch);
+        }
+        batch.close ();
+
+        mNumRead.fetch_add (1, std::memory_order_relaxed);
+    }
+}
+
+bool
+DirPrefetcher::start (const uint32_t &pNumThreads, const uint32_t &pFileMask) noexcept
+{
+    stop ();
+
+    mFileMask   = pFileMask;
+    mIsStopping = false;
+
+    try {
+        mThreads.reserve (pNumThreads);
+        for (uint32_t i = 0; i < pNumThreads; ++i) {
+            mThreads.emplace_back ([this] () { run (); });
+        }
+    }
+    catch (const std::exception &) {
+    }
+
+    return !mThreads.empty ();
+}
+
+void
+DirPrefetcher::stop () noexcept
+{
+    {
+        std::lock_guard<std::mutex> guard (mLock);
+
+        mIsStopping = true;
+        mPending.clear ();
+    }
+    mWake.notify_all ();
+
+    for (auto &thread : mThreads) {
+        thread.join ();
+    }
+    mThreads.clear ();
+}
+
+void
+DirPrefetcher::hint (const DirBatch &pBatch) noexcept
+{
+    /** Number of subdirectories that were added */
+    size_t                  numAdded    = 0;
+
+    if (mThreads.empty ()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard (mLock);
+
+        // a depth-first walk usually reads the directory that was added last, which is then no longer worth reading
+        if (!mPending.empty () && mPending.back () == pBatch.dirPath.native ()) {
+            mPending.pop_back ();
+        }
+
+        // the subdirectories are added last to first, so that the first of them is read first
+        try {
+            for (auto it = pBatch.entries.rbegin (); it != pBatch.entries.rend (); ++it) {
+                if (it->type != EntryType::DIRECTORY) {
+                    continue;
+                }
+
+                mPending.push_back (pBatch.path_of (*it).native ());
+                ++numAdded;
+                if (mPending.size () > PREFETCH_QUEUE_LEN) {
+                    mPending.pop_front ();
+                    mNumDropped.fetch_add (1, std::memory_order_relaxed);
+                }
+            }
+        }
+        catch (const std::bad_alloc &) {
+        }
+    }
+
+    // only as many threads are woken up as there are directories for them
+    for (size_t i = 0; i < numAdded && i < mThreads.size (); ++i) {
+        mWake.notify_one ();
+    }
+}
@@ -0,0 +1,987 @@
+/**
+ * @file            dir_reader.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Native (getdents64 and statx) and portable (std::filesystem) backends for reading directories
+ *
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+#include "dir_reader.h"
+
+#if defined (FSS_LINUX_BACKEND)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if __has_include (<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+
+/** Defined if the metadata of entries can be fetched through io_uring */
+#define FSS_IO_URING            true
+#endif
+#else
+#if defined (_WIN32) || defined (_WIN64)
+#else
+#include <sys/stat.h>
+#endif
+#endif
+
+namespace fs                    = std::filesystem;
+namespace chrono                = std::chrono;
+
+
+/** Size of the buffer that directory entries are read into (in bytes) */
+#define DIR_READ_BUFF_LEN       (32 * 1024)
+
+/** Number of metadata requests that each io_uring instance can have in flight at once */
+#define URING_QUEUE_DEPTH       (128)
+
+/** Number of entries that a directory must have for their metadata to be fetched in the order of their inode numbers */
+#define INODE_ORDER_MIN_ENTRIES (64)
+
+
+/**
+ * @brief                   Appends the name of an entry to a batch
+ *
+ * @param pBatch            Batch to append the entry to
+ * @param pName             Name of the entry
+ * @param pNameLen          Length of the name of the entry
+ * @param pType             Type of the entry
+ */
+static void
+push_entry (DirBatch &pBatch, const DirBatch::char_t *pName, const uint32_t &pNameLen, const EntryType &pType,
+            const uint64_t &pIno = 0)
+{
+    /** Offset at which the name of the entry is stored */
+    const uint32_t          nameOffset  = (uint32_t)pBatch.names.size ();
+
+    pBatch.names.insert (pBatch.names.end (), pName, pName + pNameLen);
+    pBatch.names.push_back (0);
+
+    pBatch.entries.push_back (DirEntry {nameOffset, pNameLen, pType, 0, pIno, EntryStat {}, std::error_code {}});
+}
+
+#if defined (FSS_LINUX_BACKEND)
+
+/** Layout of the records returned by getdents64 (glibc does not export it) */
+struct LinuxDirent64
+{
+    /** Inode number of the entry */
+    uint64_t                d_ino;
+    /** Offset of the next record */
+    int64_t                 d_off;
+    /** Length of this record */
+    unsigned short          d_reclen;
+    /** Type of the entry (one of the DT_* values) */
+    unsigned char           d_type;
+    /** Null-terminated name of the entry */
+    char                    d_name[1];
+};
+
+/**
+ * @brief                   Converts a file type reported by the directory into an entry type
+ *
+ * @param pType             Type of the entry (one of the DT_* values)
+ *
+ * @return EntryType        Type of the entry
+ */
+[[nodiscard]] static EntryType
+type_from_dirent (const unsigned char &pType) noexcept
+{
+    switch (pType) {
+    case DT_REG:    return EntryType::REGULAR;
+    case DT_DIR:    return EntryType::DIRECTORY;
+    case DT_LNK:    return EntryType::SYMLINK;
+    case DT_BLK:    return EntryType::BLOCK;
+    case DT_CHR:    return EntryType::CHARACTER;
+    case DT_FIFO:   return EntryType::FIFO;
+    case DT_SOCK:   return EntryType::SOCKET;
+    default:        return EntryType::UNKNOWN;
+    }
+}
+
+/**
+ * @brief                   Converts a file mode into an entry type
+ *
+ * @param pMode             Mode of the entry (as reported by statx)
+ *
+ * @return EntryType        Type of the entry
+ */
+[[nodiscard]] static EntryType
+type_from_mode (const uint32_t &pMode) noexcept
+{
+    switch (pMode & S_IFMT) {
+    case S_IFREG:   return EntryType::REGULAR;
+    case S_IFDIR:   return EntryType::DIRECTORY;
+    case S_IFLNK:   return EntryType::SYMLINK;
+    case S_IFBLK:   return EntryType::BLOCK;
+    case S_IFCHR:   return EntryType::CHARACTER;
+    case S_IFIFO:   return EntryType::FIFO;
+    case S_IFSOCK:  return EntryType::SOCKET;
+    default:        return EntryType::UNKNOWN;
+    }
+}
+
+/**
+ * @brief                   Returns the fields to ask statx for, to fetch the given metadata
+ *
+ * @param pMask             Metadata to fetch (combination of STAT_* bits)
+ *
+ * @return unsigned int     Combination of STATX_* bits (the type always comes along with the permissions)
+ */
+[[nodiscard]] static unsigned int
+statx_fields (const uint32_t &pMask) noexcept
+{
+    /** Fields to ask statx for */
+    unsigned int            statxMask   = STATX_TYPE;
+
+    if ((pMask & STAT_PERMS) != 0) {
+        statxMask   |= STATX_MODE;
+    }
+    if ((pMask & STAT_SIZE) != 0) {
+        statxMask   |= STATX_SIZE;
+    }
+    if ((pMask & STAT_MTIME) != 0) {
+        statxMask   |= STATX_MTIME;
+    }
+    if ((pMask & STAT_LINKS) != 0) {
+        statxMask   |= STATX_INO | STATX_NLINK;
+    }
+    if ((pMask & STAT_BLOCKS) != 0) {
+        statxMask   |= STATX_BLOCKS;
+    }
+
+    return statxMask;
+}
+
+/**
+ * @brief                   Returns the flags to call statx with, to fetch the given metadata
+ *
+ * @param pMask             Metadata to fetch (combination of STAT_* bits)
+ *
+ * @return int              Combination of AT_* flags
+ */
+[[nodiscard]] static int
+statx_flags (const uint32_t &pMask) noexcept
+{
+    return AT_STATX_SYNC_AS_STAT | (((pMask & STAT_FOLLOW) != 0) ? (0) : (AT_SYMLINK_NOFOLLOW));
+}
+
+/**
+ * @brief                   Copies the metadata returned by statx into the metadata of an entry
+ *
+ * @param pStx              Metadata returned by statx
+ * @param pStat             Metadata of the entry
+ */
+static void
+fill_entry_stat (const struct statx &pStx, EntryStat &pStat) noexcept
+{
+    pStat.type  = type_from_mode (pStx.stx_mode);
+    pStat.perms = (fs::perms)(pStx.stx_mode & 07777);
+    pStat.size  = (int64_t)pStx.stx_size;
+    pStat.mtime = (time_t)pStx.stx_mtime.tv_sec;
+
+    // the device is always reported, and statx counts allocated blocks in units of 512 bytes whatever the block size is
+    pStat.dev       = ((uint64_t)pStx.stx_dev_major << 32) | pStx.stx_dev_minor;
+    pStat.ino       = pStx.stx_ino;
+    pStat.nlink     = pStx.stx_nlink;
+    pStat.allocSize = (int64_t)pStx.stx_blocks * 512;
+}
+
+/**
+ * @brief                   Fetches the metadata of a single entry of an open directory with one statx call
+ *
+ * @param pDirFd            File descriptor of the directory containing the entry
+ * @param pName             Name of the entry
+ * @param pMask             Metadata to fetch (combination of STAT_* bits)
+ * @param pStat             Metadata of the entry
+ * @param pErr              Error that occoured while fetching the metadata
+ */
+static void
+statx_entry (const int &pDirFd, const char *pName, const uint32_t &pMask, EntryStat &pStat, std::error_code &pErr) noexcept
+{
+    /** Metadata returned by statx */
+    struct statx            stx;
+
+    if (statx (pDirFd, pName, statx_flags (pMask), statx_fields (pMask), &stx) != 0) {
+        pErr.assign (errno, std::generic_category ());
+        return;
+    }
+
+    fill_entry_stat (stx, pStat);
+}
+
+#if defined (FSS_IO_URING)
+
+/**
+ * @brief                   Minimal io_uring instance (set up through the raw system calls) that fetches the metadata of
+ *                          many entries at once with IORING_OP_STATX
+ *
+ *                          Each thread owns its own ring, which is set up the first time it is used. If the kernel does
+ *                          not support io_uring (or IORING_OP_STATX), the ring is marked as unavailable and the blocking
+ *                          statx is used instead
+ */
+class UringStatRing
+{
+    /** File descriptor of the ring (-1 if it has not been set up, or could not be) */
+    int                     mFd                 {-1};
+    /** Whether setting up the ring has already been attempted */
+    bool                    mIsSetUp            {false};
+
+    /** Mapping of the submission queue (and of the completion queue, if the kernel maps both at once) */
+    void                    *mSqMap             {MAP_FAILED};
+    /** Length of the mapping of the submission queue */
+    size_t                  mSqMapLen           {};
+    /** Mapping of the completion queue (same as mSqMap if the kernel maps both at once) */
+    void                    *mCqMap             {MAP_FAILED};
+    /** Length of the mapping of the completion queue */
+    size_t                  mCqMapLen           {};
+    /** Mapping of the submission queue entries */
+    io_uring_sqe            *mSqes              {static_cast<io_uring_sqe *> (MAP_FAILED)};
+    /** Length of the mapping of the submission queue entries */
+    size_t                  mSqesLen            {};
+
+    /** Tail of the submission queue (written by the application) */
+    unsigned                *mSqTail            {};
+    /** Mask to wrap indices of the submission queue */
+    unsigned                mSqMask             {};
+    /** Indices of the submission queue entries in the order in which they are submitted */
+    unsigned                *mSqArray           {};
+    /** Head of the completion queue (written by the application) */
+    unsigned                *mCqHead            {};
+    /** Tail of the completion queue (written by the kernel) */
+    unsigned                *mCqTail            {};
+    /** Mask to wrap indices of the completion queue */
+    unsigned                mCqMask             {};
+    /** Completion queue entries */
+    io_uring_cqe            *mCqes              {};
+
+    /** Number of submission queue entries */
+    unsigned                mDepth              {};
+
+    /** Buffers that statx writes into, one for each request that can be in flight */
+    std::vector<struct statx>   mBuffs;
+    /** Index of the entry (within the batch) that each buffer belongs to */
+    std::vector<uint32_t>   mSlotEntries;
+    /** Buffers that are not in use by any request */
+    std::vector<uint32_t>   mFreeSlots;
+
+    /**
+     * @brief               Sets up the ring, and checks that it supports IORING_OP_STATX
+     *
+     * @return true         If the ring can be used
+     * @return false        If the ring could not be set up
+     */
+    [[nodiscard]] bool
+    set_up () noexcept
+    {
+        /** Parameters of the ring (filled by the kernel) */
+        io_uring_params     params;
+        /** Operations supported by the ring */
+        io_uring_probe      *probe;
+        /** Whether the ring supports IORING_OP_STATX */
+        bool                isSupported;
+
+        mIsSetUp    = true;
+
+        memset (&params, 0, sizeof (params));
+        mFd         = (int)syscall (__NR_io_uring_setup, URING_QUEUE_DEPTH, &params);
+        if (mFd < 0) {
+            mFd     = -1;
+            return false;
+        }
+
+        // make sure that the kernel actually supports statx through the ring (it was added later than the ring itself)
+        probe       = (io_uring_probe *)calloc (1, sizeof (io_uring_probe) + 256 * sizeof (io_uring_probe_op));
+        isSupported = probe != nullptr
+                    && syscall (__NR_io_uring_register, mFd, IORING_REGISTER_PROBE, probe, 256) == 0
+                    && probe->last_op >= IORING_OP_STATX
+                    && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) != 0;
+        free (probe);
+
+        if (!isSupported) {
+            tear_down ();
+            return false;
+        }
+
+        mSqMapLen   = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+        mCqMapLen   = params.cq_off.cqes + params.cq_entries * sizeof (io_uring_cqe);
+
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+            mSqMapLen   = (mCqMapLen > mSqMapLen) ? (mCqMapLen) : (mSqMapLen);
+        }
+
+        mSqMap      = mmap (nullptr, mSqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING);
+        if (mSqMap == MAP_FAILED) {
+            tear_down ();
+            return false;
+        }
+
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+            mCqMap  = mSqMap;
+        }
+        else {
+            mCqMap  = mmap (nullptr, mCqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_CQ_RING);
+            if (mCqMap == MAP_FAILED) {
+                tear_down ();
+                return false;
+            }
+        }
+
+        mSqesLen    = params.sq_entries * sizeof (io_uring_sqe);
+        mSqes       = (io_uring_sqe *)mmap (nullptr, mSqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            mFd, IORING_OFF_SQES);
+        if (mSqes == MAP_FAILED) {
+            tear_down ();
+            return false;
+        }
+
+        mSqTail     = (unsigned *)((char *)mSqMap + params.sq_off.tail);
+        mSqMask     = *(unsigned *)((char *)mSqMap + params.sq_off.ring_mask);
+        mSqArray    = (unsigned *)((char *)mSqMap + params.sq_off.array);
+        mCqHead     = (unsigned *)((char *)mCqMap + params.cq_off.head);
+        mCqTail     = (unsigned *)((char *)mCqMap + params.cq_off.tail);
+        mCqMask     = *(unsigned *)((char *)mCqMap + params.cq_off.ring_mask);
+        mCqes       = (io_uring_cqe *)((char *)mCqMap + params.cq_off.cqes);
+
+        mDepth      = params.sq_entries;
+
+        try {
+            mBuffs.resize (mDepth);
+            mSlotEntries.resize (mDepth);
+            mFreeSlots.reserve (mDepth);
+        }
+        catch (const std::bad_alloc &) {
+            tear_down ();
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief               Unmaps the queues and closes the ring
+     */
+    void
+    tear_down () noexcept
+    {
+        if (mSqes != MAP_FAILED) {
+            munmap (mSqes, mSqesLen);
+            mSqes   = static_cast<io_uring_sqe *> (MAP_FAILED);
+        }
+        if (mCqMap != MAP_FAILED && mCqMap != mSqMap) {
+            munmap (mCqMap, mCqMapLen);
+        }
+        mCqMap      = MAP_FAILED;
+        if (mSqMap != MAP_FAILED) {
+            munmap (mSqMap, mSqMapLen);
+            mSqMap  = MAP_FAILED;
+        }
+        if (mFd != -1) {
+            ::close (mFd);
+            mFd     = -1;
+        }
+    }
+
+public:
+
+    UringStatRing () = default;
+    UringStatRing (const UringStatRing &) = delete;
+    UringStatRing &operator= (const UringStatRing &) = delete;
+
+    ~UringStatRing ()
+    {
+        tear_down ();
+    }
+
+    /**
+     * @brief               Returns whether the ring can be used (setting it up if that has not been attempted yet)
+     *
+     * @return true         If the ring can be used
+     * @return false        If io_uring (or IORING_OP_STATX) is not supported
+     */
+    [[nodiscard]] bool
+    is_available () noexcept
+    {
+        return (mIsSetUp) ? (mFd != -1) : (set_up ());
+    }
+
+    /**
+     * @brief               Fetches the requested metadata of every entry of a batch whose statMask is set, keeping up to
+     *                      mDepth requests in flight at once
+     *
+     * @param pBatch        Batch whose entries to fetch the metadata of (must not have been closed yet)
+     */
+    void
+    stat_entries (DirBatch &pBatch) noexcept
+    {
+        /** Index of the next entry of the batch to submit a request for */
+        uint32_t            next;
+        /** Number of requests that have been taken up by the kernel but whose completions have not been reaped yet */
+        uint32_t            inFlight;
+        /** Number of requests that have been queued but not yet taken up by the kernel */
+        uint32_t            toSubmit;
+        /** Tail of the submission queue, as seen by this thread */
+        unsigned            sqTail;
+        /** Result of the last call to io_uring_enter */
+        long                res;
+        /** Whether the ring stopped working before every request completed */
+        bool                isFailed            = false;
+
+        /** Submission queue entry being filled */
+        io_uring_sqe        *sqe;
+        /** Buffer that the current request writes into */
+        uint32_t            slot;
+
+        /** Reaps every completion that is available, filling in the metadata of the entries they belong to */
+        const auto          reap        = [&] () noexcept {
+
+            /** Head of the completion queue, as seen by this thread */
+            unsigned        cqHead;
+
+            for (cqHead = *mCqHead; cqHead != __atomic_load_n (mCqTail, __ATOMIC_ACQUIRE); ++cqHead) {
+
+                /** Completion being reaped */
+                const io_uring_cqe  &cqe    = mCqes[cqHead & mCqMask];
+                /** Entry that the completion belongs to */
+                DirEntry            &entry  = pBatch.entries[mSlotEntries[cqe.user_data]];
+
+                if (cqe.res < 0) {
+                    entry.statError.assign (-cqe.res, std::generic_category ());
+                }
+                else {
+                    fill_entry_stat (mBuffs[cqe.user_data], entry.stat);
+                }
+
+                mFreeSlots.push_back ((uint32_t)cqe.user_data);
+                --inFlight;
+            }
+
+            __atomic_store_n (mCqHead, cqHead, __ATOMIC_RELEASE);
+        };
+
+        mFreeSlots.clear ();
+        for (uint32_t i = 0; i < mDepth; ++i) {
+            mFreeSlots.push_back (mDepth - 1 - i);
+        }
+
+        sqTail      = *mSqTail;
+
+        for (next = 0, inFlight = 0, toSubmit = 0; next < pBatch.entries.size () || inFlight != 0 || toSubmit != 0; ) {
+
+            // queue requests for as many entries as there are free buffers
+            for (; next < pBatch.entries.size () && !mFreeSlots.empty (); ++next) {
+
+                /** Entry to queue a request for */
+                DirEntry        &entry  = pBatch.entries[next];
+
+                if (entry.statMask == 0 || entry.statError) {
+                    continue;
+                }
+
+                slot                = mFreeSlots.back ();
+                mFreeSlots.pop_back ();
+                mSlotEntries[slot]  = next;
+
+                sqe                 = &mSqes[sqTail & mSqMask];
+                memset (sqe, 0, sizeof (*sqe));
+                sqe->opcode         = IORING_OP_STATX;
+                sqe->fd             = pBatch.dirFd;
+                sqe->addr           = (uint64_t)(uintptr_t)pBatch.name_of (entry);
+                sqe->len            = statx_fields (entry.statMask);
+                sqe->off            = (uint64_t)(uintptr_t)&mBuffs[slot];
+                sqe->statx_flags    = (uint32_t)statx_flags (entry.statMask);
+                sqe->user_data      = slot;
+
+                mSqArray[sqTail & mSqMask]  = sqTail & mSqMask;
+                ++sqTail;
+                ++toSubmit;
+            }
+
+            // the kernel must see the filled entries before it sees the new tail
+            __atomic_store_n (mSqTail, sqTail, __ATOMIC_RELEASE);
+
+            if (inFlight == 0 && toSubmit == 0) {
+                break;
+            }
+
+            do {
+                res     = syscall (__NR_io_uring_enter, mFd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            } while (res < 0 && errno == EINTR);
+
+            // the kernel may take up fewer entries than were queued, which stay in the queue for the next call (but if it
+            // takes up none while nothing is in flight, it will not make progress at all)
+            if (res < 0 || (res == 0 && inFlight == 0)) {
+                isFailed    = true;
+                break;
+            }
+            toSubmit    -= (uint32_t)res;
+            inFlight    += (uint32_t)res;
+
+            reap ();
+        }
+
+        if (!isFailed) {
+            return;
+        }
+
+        // the ring failed, so the requests already taken up by the kernel are waited for (their buffers are still in use)
+        while (inFlight != 0) {
+            do {
+                res     = syscall (__NR_io_uring_enter, mFd, 0, inFlight, IORING_ENTER_GETEVENTS, nullptr, 0);
+            } while (res < 0 && errno == EINTR);
+
+            if (res < 0) {
+                break;
+            }
+            reap ();
+        }
+        tear_down ();
+
+        // only the entries whose requests never completed (queued but never taken up, still in flight if the ring could
+        // not even be waited on, or never queued at all) are fetched again, with the blocking statx
+        std::sort (mFreeSlots.begin (), mFreeSlots.end ());
+        for (slot = 0; slot < mDepth; ++slot) {
+            if (!std::binary_search (mFreeSlots.begin (), mFreeSlots.end (), slot)) {
+
+                /** Entry whose request did not complete */
+                DirEntry    &entry  = pBatch.entries[mSlotEntries[slot]];
+
+                statx_entry (pBatch.dirFd, pBatch.name_of (entry), entry.statMask, entry.stat, entry.statError);
+            }
+        }
+        for (; next < pBatch.entries.size (); ++next) {
+
+            /** Entry that no request was queued for */
+            DirEntry        &entry  = pBatch.entries[next];
+
+            if (entry.statMask != 0 && !entry.statError) {
+                statx_entry (pBatch.dirFd, pBatch.name_of (entry), entry.statMask, entry.stat, entry.statError);
+            }
+        }
+    }
+};
+
+/** Ring of the current thread */
+static thread_local UringStatRing   tUringRing;
+
+#endif
+
+void
+DirBatch::close () noexcept
+{
+    if (dirFd != -1) {
+        ::close (dirFd);
+        dirFd   = -1;
+    }
+}
+
+bool
+read_dir (const fs::path &pPath, DirBatch &pBatch, std::error_code &pErr) noexcept
+{
+    /** Buffer that the records of the directory are read into */
+    alignas (LinuxDirent64) char            buff[DIR_READ_BUFF_LEN];
+    /** Number of bytes read into the buffer by the last call */
+    long                    buffLen;
+
+    /** Record that is being currently processed */
+    const LinuxDirent64     *record;
+    /** Length of the name of the current record */
+    uint32_t                nameLen;
+
+    pBatch.close ();
+    pBatch.entries.clear ();
+    pBatch.names.clear ();
+    pBatch.set_path (pPath);
+    pBatch.isRestored   = false;
+
+    pErr.clear ();
+
+    pBatch.dirFd    = ::open (pPath.c_str (), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (pBatch.dirFd == -1) {
+        pErr.assign (errno, std::generic_category ());
+        return false;
+    }
+
+    try {
+        while ((buffLen = syscall (SYS_getdents64, pBatch.dirFd, buff, sizeof (buff))) > 0) {
+
+            for (long offset = 0; offset < buffLen; offset += record->d_reclen) {
+                record  = (const LinuxDirent64 *)(buff + offset);
+                nameLen = (uint32_t)strlen (record->d_name);
+
+                // skip the entries for the directory itself and its parent
+                if (record->d_name[0] == '.'
+                    && (nameLen == 1 || (nameLen == 2 && record->d_name[1] == '.'))) {
+                    continue;
+                }
+
+                push_entry (pBatch, record->d_name, nameLen, type_from_dirent (record->d_type), record->d_ino);
+            }
+        }
+        pBatch.pad_names ();
+    }
+    catch (const std::bad_alloc &) {
+        pErr    = std::make_error_code (std::errc::not_enough_memory);
+        pBatch.close ();
+        return false;
+    }
+
+    if (buffLen < 0) {
+        pErr.assign (errno, std::generic_category ());
+        pBatch.close ();
+        return false;
+    }
+
+    // some filesystems do not report the types of entries, which then need to be found out separately
+    for (auto &entry : pBatch.entries) {
+        if (entry.type == EntryType::UNKNOWN) {
+            statx_entry (pBatch.dirFd, pBatch.name_of (entry), STAT_TYPE, entry.stat, entry.statError);
+            entry.type  = entry.stat.type;
+        }
+    }
+
+    return true;
+}
+
+bool
+read_dir_identity (const fs::path &pPath, DirIdentity &pIdentity, std::error_code &pErr) noexcept
+{
+    /** Inode number and time of last modification of the directory */
+    struct statx            stx;
+
+    pErr.clear ();
+
+    if (statx (AT_FDCWD, pPath.c_str (), 0, STATX_INO | STATX_MTIME, &stx) != 0) {
+        pErr.assign (errno, std::generic_category ());
+        return false;
+    }
+
+    pIdentity.ino       = stx.stx_ino;
+    pIdentity.mtimeNs   = (int64_t)stx.stx_mtime.tv_sec * 1000000000 + stx.stx_mtime.tv_nsec;
+    pIdentity.dev       = ((uint64_t)stx.stx_dev_major << 32) | stx.stx_dev_minor;
+
+    return true;
+}
+
+bool
+stat_mode_available (const StatMode &pMode) noexcept
+{
+#if defined (FSS_IO_URING)
+    return pMode != StatMode::IO_URING || tUringRing.is_available ();
+#else
+    return pMode != StatMode::IO_URING;
+#endif
+}
+
+void
+stat_dir_entries (DirBatch &pBatch, const StatMode &pMode) noexcept
+{
+    if (pBatch.isRestored) {
+        return;
+    }
+
+#if defined (FSS_IO_URING)
+    if (pMode == StatMode::IO_URING && tUringRing.is_available ()) {
+        tUringRing.stat_entries (pBatch);
+        return;
+    }
+#else
+    (void)pMode;
+#endif
+
+    /** Whether the metadata is fetched in the order of the inode numbers of the entries */
+    bool                    isOrdered   = pBatch.entries.size () >= INODE_ORDER_MIN_ENTRIES;
+
+    // the inodes of a directory are mostly laid out in the order of their numbers (rather than of their names)
+    if (isOrdered) {
+        try {
+            pBatch.statOrder.clear ();
+            for (uint32_t i = 0; i < (uint32_t)pBatch.entries.size (); ++i) {
+                if (pBatch.entries[i].statMask != 0 && !pBatch.entries[i].statError) {
+                    pBatch.statOrder.push_back (i);
+                }
+            }
+            std::sort (pBatch.statOrder.begin (), pBatch.statOrder.end (), [&] (const uint32_t &pLeft, const uint32_t &pRight) {
+                return pBatch.entries[pLeft].dirIno < pBatch.entries[pRight].dirIno;
+            });
+        }
+        catch (const std::bad_alloc &) {
+            isOrdered   = false;
+        }
+    }
+
+    if (!isOrdered) {
+        for (auto &entry : pBatch.entries) {
+            if (entry.statMask != 0 && !entry.statError) {
+                statx_entry (pBatch.dirFd, pBatch.name_of (entry), entry.statMask, entry.stat, entry.statError);
+            }
+        }
+        return;
+    }
+
+    for (const auto &pos : pBatch.statOrder) {
+
+        /** Entry whose metadata to fetch */
+        DirEntry            &entry      = pBatch.entries[pos];
+
+        statx_entry (pBatch.dirFd, pBatch.name_of (entry), entry.statMask, entry.stat, entry.statError);
+    }
+}
+
+void
+stat_dir_entry (DirBatch &pBatch, DirEntry &pEntry) noexcept
+{
+    if (pBatch.isRestored || pEntry.statMask == 0) {
+        return;
+    }
+
+    pEntry.statError.clear ();
+    if (pBatch.dirFd >= 0) {
+        statx_entry (pBatch.dirFd, pBatch.name_of (pEntry), pEntry.statMask, pEntry.stat, pEntry.statError);
+        return;
+    }
+
+    // once the directory has been closed, the entry is found through its whole path instead
+    try {
+        (void)pBatch.build_path (pEntry);
+    }
+    catch (const std::bad_alloc &) {
+        pEntry.statError    = std::make_error_code (std::errc::not_enough_memory);
+        return;
+    }
+    statx_entry (AT_FDCWD, pBatch.entryPath.c_str (), pEntry.statMask, pEntry.stat, pEntry.statError);
+}
+
+#else
+
+/**
+ * @brief                   Converts a file type reported by std::filesystem into an entry type
+ *
+ * @param pType             Type of the entry
+ *
+ * @return EntryType        Type of the entry
+ */
+[[nodiscard]] static EntryType
+type_from_fs (const fs::file_type &pType) noexcept
+{
+    switch (pType) {
+    case fs::file_type::regular:    return EntryType::REGULAR;
+    case fs::file_type::directory:  return EntryType::DIRECTORY;
+    case fs::file_type::symlink:    return EntryType::SYMLINK;
+    case fs::file_type::block:      return EntryType::BLOCK;
+    case fs::file_type::character:  return EntryType::CHARACTER;
+    case fs::file_type::fifo:       return EntryType::FIFO;
+    case fs::file_type::socket:     return EntryType::SOCKET;
+    default:                        return EntryType::UNKNOWN;
+    }
+}
+
+void
+DirBatch::close () noexcept
+{
+}
+
+bool
+read_dir (const fs::path &pPath, DirBatch &pBatch, std::error_code &pErr) noexcept
+{
+    /** Iterator to the elements within the directory */
+    fs::directory_iterator  iter;
+    /** Iterator to the element after the last element in the directory */
+    fs::directory_iterator  fin;
+
+    /** Status of the current entry, without following symlinks (usually cached by the iterator) */
+    fs::file_status         entryStatus;
+
+    pBatch.entries.clear ();
+    pBatch.names.clear ();
+    pBatch.set_path (pPath);
+    pBatch.isRestored   = false;
+
+    pErr.clear ();
+
+    try {
+        for (iter = fs::directory_iterator (pPath, pErr); !pErr && iter != fin; iter.increment (pErr)) {
+
+            /** Name of the current entry */
+            const fs::path          name    = iter->path ().filename ();
+
+            entryStatus     = iter->symlink_status (pErr);
+            if (pErr) {
+                pErr.clear ();
+                entryStatus = fs::file_status {};
+            }
+
+            push_entry (pBatch, name.c_str (), (uint32_t)name.native ().size (), type_from_fs (entryStatus.type ()));
+        }
+        pBatch.pad_names ();
+    }
+    catch (const std::bad_alloc &) {
+        pErr    = std::make_error_code (std::errc::not_enough_memory);
+    }
+
+    return !pErr;
+}
+
+bool
+read_dir_identity (const fs::path &pPath, DirIdentity &pIdentity, std::error_code &pErr) noexcept
+{
+#if defined (_WIN32) || defined (_WIN64)
+    /** Time point when the directory was last modified */
+    const fs::file_time_type    lastModifTpFs   = fs::last_write_time (pPath, pErr);
+
+    if (pErr) {
+        return false;
+    }
+
+    // the file index is not exposed by std::filesystem, so directories are only told apart by their modification times
+    pIdentity.ino       = 0;
+    pIdentity.mtimeNs   = (int64_t)chrono::duration_cast<chrono::nanoseconds> (lastModifTpFs.time_since_epoch ()).count ();
+    pIdentity.dev       = 0;
+#else
+    /** Inode number and time of last modification of the directory */
+    struct stat             st;
+
+    pErr.clear ();
+
+    if (::stat (pPath.c_str (), &st) != 0) {
+        pErr.assign (errno, std::generic_category ());
+        return false;
+    }
+
+    pIdentity.ino       = (uint64_t)st.st_ino;
+    pIdentity.mtimeNs   = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    pIdentity.dev       = (uint64_t)st.st_dev;
+#endif
+
+    return true;
+}
+
+bool
+stat_mode_available (const StatMode &pMode) noexcept
+{
+    return pMode != StatMode::IO_URING;
+}
+
+/**
+ * @brief                   Fetches the requested metadata of a single entry of a batch through its path
+ *
+ * @param pBatch            Batch containing the entry
+ * @param pEntry            Entry whose metadata to fetch
+ */
+static void
+stat_entry_by_path (DirBatch &pBatch, DirEntry &pEntry) noexcept
+{
+    /** Path of the entry */
+    fs::path                entryPath;
+    /** Status of the entry */
+    fs::file_status         entryStatus;
+    /** Time point when the entry was last modified */
+    fs::file_time_type      lastModifTpFs;
+
+    try {
+        entryPath   = pBatch.build_path (pEntry);
+    }
+    catch (const std::bad_alloc &) {
+        pEntry.statError    = std::make_error_code (std::errc::not_enough_memory);
+        return;
+    }
+
+    if ((pEntry.statMask & (STAT_TYPE | STAT_PERMS | STAT_FOLLOW)) != 0) {
+        entryStatus = ((pEntry.statMask & STAT_FOLLOW) != 0) ? (fs::status (entryPath, pEntry.statError))
+                                                            : (fs::symlink_status (entryPath, pEntry.statError));
+        if (pEntry.statError) {
+            return;
+        }
+
+        pEntry.stat.type    = type_from_fs (entryStatus.type ());
+        pEntry.stat.perms   = entryStatus.permissions ();
+    }
+    else {
+        pEntry.stat.type    = pEntry.type;
+    }
+
+    if ((pEntry.statMask & STAT_SIZE) != 0 && pEntry.stat.type == EntryType::REGULAR) {
+        pEntry.stat.size    = (int64_t)fs::file_size (entryPath, pEntry.statError);
+        if (pEntry.statError) {
+            return;
+        }
+    }
+
+    if ((pEntry.statMask & STAT_MTIME) != 0) {
+        lastModifTpFs   = fs::last_write_time (entryPath, pEntry.statError);
+        if (pEntry.statError) {
+            return;
+        }
+
+        // convert the time point on chrono::file_clock to a time_t object (time passed since epoch)
+#if defined (_WIN32) || defined (_WIN64)
+        pEntry.stat.mtime   = chrono::system_clock::to_time_t (
+                            chrono::utc_clock::to_sys (
+                                    chrono::file_clock::to_utc (lastModifTpFs)
+                                    )
+                            );
+#else
+        pEntry.stat.mtime   = chrono::system_clock::to_time_t (
+            chrono::file_clock::to_sys (lastModifTpFs));
+#endif
+    }
+
+    if ((pEntry.statMask & (STAT_LINKS | STAT_BLOCKS)) != 0) {
+#if defined (_WIN32) || defined (_WIN64)
+        // the file index and the allocated size are not exposed by std::filesystem, so only the number of links is known
+        pEntry.stat.nlink   = (uint64_t)fs::hard_link_count (entryPath, pEntry.statError);
+        if (pEntry.statError) {
+            return;
+        }
+#else
+        /** Device, inode number, number of links and allocated blocks of the entry */
+        struct stat             st;
+
+        if ((((pEntry.statMask & STAT_FOLLOW) != 0) ? (::stat (entryPath.c_str (), &st))
+                                                    : (::lstat (entryPath.c_str (), &st))) != 0) {
+            pEntry.statError.assign (errno, std::generic_category ());
+            return;
+        }
+
+        pEntry.stat.dev         = (uint64_t)st.st_dev;
+        pEntry.stat.ino         = (uint64_t)st.st_ino;
+        pEntry.stat.nlink       = (uint64_t)st.st_nlink;
+        pEntry.stat.allocSize   = (int64_t)st.st_blocks * 512;
+#endif
+    }
+}
+
+void
+stat_dir_entries (DirBatch &pBatch, const StatMode &) noexcept
+{
+    if (pBatch.isRestored) {
+        return;
+    }
+
+    for (auto &entry : pBatch.entries) {
+        if (entry.statMask != 0) {
+            stat_entry_by_path (pBatch, entry);
+        }
+    }
+}
+
+void
+stat_dir_entry (DirBatch &pBatch, DirEntry &pEntry) noexcept
+{
+    if (pBatch.isRestored || pEntry.statMask == 0) {
+        return;
+    }
+
+    pEntry.statError.clear ();
+    stat_entry_by_path (pBatch, pEntry);
+}
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file            entry_order.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Sorts the entries of a single directory before they are printed, so that sorted output can be
+ *                  streamed without holding on to the rest of the tree
+ *
+ */
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "entry_order.h"
+
+/** Number of code units of a name packed into the prefix of its record */
+#define PREFIX_UNITS            (sizeof (uint64_t) / sizeof (DirBatch::char_t))
+
+
+/**
+ * @brief                   Packs the first code units of a name into an integer, so that comparing the integers compares
+ *                          the start of the names (names shorter than the prefix are padded with zeros, which sort first)
+ *
+ * @param pName             Name to pack
+ * @param pNameLen          Length of the name
+ *
+ * @return uint64_t         Packed prefix of the name
+ */
+[[nodiscard]] static inline uint64_t
+pack_prefix (const DirBatch::char_t *pName, const size_t &pNameLen) noexcept
+{
+    /** Packed code units, from the most significant end */
+    uint64_t                prefix      = 0;
+
+    for (size_t i = 0; i < PREFIX_UNITS; ++i) {
+        prefix  <<= 8 * sizeof (DirBatch::char_t);
+        if (i < pNameLen) {
+            prefix  |= (uint64_t)(std::make_unsigned_t<DirBatch::char_t>)pName[i];
+        }
+    }
+
+    return prefix;
+}
+
+void
+EntryOrder::prepare (const DirBatch &pBatch, const SortOrder &pOrder)
+{
+    mRecords.resize (pBatch.entries.size ());
+
+    for (size_t i = 0; i < pBatch.entries.size (); ++i) {
+
+        /** Entry whose record is worked out */
+        const DirEntry      &entry      = pBatch.entries[i];
+        /** Metadata of the entry that is known (a restored batch has all of it) */
+        const uint32_t      knownMask   = (entry.statError) ? (0) : (pBatch.isRestored) ? (~0U) : (entry.statMask);
+
+        mRecords[i].index   = (uint32_t)i;
+        mRecords[i].prefix  = pack_prefix (pBatch.name_of (entry), entry.nameLen);
+
+        switch (pOrder) {
+        case SortOrder::SIZE:
+            mRecords[i].key = size_key (((knownMask & STAT_SIZE) && entry.type != EntryType::DIRECTORY)
+                                        ? (entry.stat.size) : (-1));
+            break;
+        case SortOrder::MTIME:
+            mRecords[i].key = (knownMask & STAT_MTIME) ? (-(int64_t)entry.stat.mtime) : (INT64_MAX);
+            break;
+        default:
+            mRecords[i].key = 0;
+            break;
+        }
+    }
+}
+
+void
+EntryOrder::apply (DirBatch &pBatch, std::vector<int32_t> *pTags)
+{
+    // the names of two records are only compared in full if their keys and prefixes are the same
+    std::sort (mRecords.begin (), mRecords.end (), [&pBatch] (const SortRecord &pLeft, const SortRecord &pRight) {
+        if (pLeft.key != pRight.key) {
+            return pLeft.key < pRight.key;
+        }
+        if (pLeft.prefix != pRight.prefix) {
+            return pLeft.prefix < pRight.prefix;
+        }
+
+        /** Entry of the left record */
+        const DirEntry      &left       = pBatch.entries[pLeft.index];
+        /** Entry of the right record */
+        const DirEntry      &right      = pBatch.entries[pRight.index];
+
+        return PathView (pBatch.name_of (left), left.nameLen) < PathView (pBatch.name_of (right), right.nameLen);
+    });
+
+    mSorted.clear ();
+    mSorted.reserve (mRecords.size ());
+    for (const auto &record : mRecords) {
+        mSorted.push_back (std::move (pBatch.entries[record.index]));
+    }
+    mSorted.swap (pBatch.entries);
+
+    if (pTags != nullptr) {
+        mSortedTags.resize (mRecords.size ());
+        for (size_t i = 0; i < mRecords.size (); ++i) {
+            mSortedTags[i]  = (*pTags)[mRecords[i].index];
+        }
+        mSortedTags.swap (*pTags);
+    }
+}
@@ -0,0 +1,128 @@
+/**
+ * @file            file_stats.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Distributions of the regular files found by a walk (by size, by age and by extension)
+ *
+ */
+
+#include <bit>
+#include <cstdio>
+
+#include "file_stats.h"
+
+/** Number of seconds in a day */
+#define STATS_DAY               (24 * 60 * 60)
+
+
+/** Oldest age of the files of each bucket of ages (apart from the last two), in seconds */
+static const int64_t        ageBounds[STATS_AGE_BUCKETS - 2]    = {
+                                STATS_DAY,
+                                7 * STATS_DAY,
+                                30 * STATS_DAY,
+                                90 * STATS_DAY,
+                                365 * STATS_DAY,
+                                2 * 365 * STATS_DAY,
+                                5 * 365 * STATS_DAY
+                            };
+
+/** Descriptions of the buckets of ages */
+static const char           *ageLabels[STATS_AGE_BUCKETS]       = {
+                                "< 1 day",
+                                "1 - 7 days",
+                                "7 - 30 days",
+                                "30 - 90 days",
+                                "90 days - 1 year",
+                                "1 - 2 years",
+                                "2 - 5 years",
+                                "> 5 years",
+                                "in the future"
+                            };
+
+/** Units of the sizes in the descriptions of buckets, one for each power of 1024 */
+static const char           *sizeUnits[]                        = {"B", "KiB", "MiB", "GiB", "TiB", "PiB", "EiB"};
+
+
+void
+FileStats::add (const int64_t &pSize, const time_t &pMtime, const DirBatch::char_t *pName, const size_t &pNameLen)
+{
+    /** Size of the file (files whose size is not known are counted as empty) */
+    const uint64_t          size        = (pSize < 0) ? (0) : ((uint64_t)pSize);
+    /** Time since the file was last modified, in seconds */
+    const int64_t           age         = (int64_t)mNow - (int64_t)pMtime;
+
+    /** Bucket of ages of the file */
+    size_t                  ageBucket;
+    /** Position of the dot before the extension of the file (the name itself if it has none) */
+    size_t                  dotPos;
+
+    // the bucket of a size is the number of bits needed to represent it
+    mSizes[std::bit_width (size)].count     += 1;
+    mSizes[std::bit_width (size)].bytes     += size;
+
+    if (age < 0) {
+        ageBucket   = STATS_AGE_BUCKETS - 1;
+    }
+    else {
+        for (ageBucket = 0; ageBucket < STATS_AGE_BUCKETS - 2 && age >= ageBounds[ageBucket]; ++ageBucket) {
+        }
+    }
+    mAges[ageBucket].count  += 1;
+    mAges[ageBucket].bytes  += size;
+
+    // a name that only starts with a dot (such as ".bashrc") has no extension
+    for (dotPos = pNameLen; dotPos > 1 && pName[dotPos - 1] != '.'; --dotPos) {
+    }
+    mKey.clear ();
+    if (dotPos > 1) {
+        for (size_t i = dotPos; i < pNameLen; ++i) {
+            mKey.push_back ((pName[i] >= 'A' && pName[i] <= 'Z') ? ((DirBatch::char_t)(pName[i] - 'A' + 'a')) : (pName[i]));
+        }
+    }
+
+    /** Files of the same extension */
+    StatsBucket             &extBucket  = mExtensions[mKey];
+
+    extBucket.count     += 1;
+    extBucket.bytes     += size;
+}
+
+void
+FileStats::merge (const FileStats &pOther)
+{
+    for (size_t i = 0; i < STATS_SIZE_BUCKETS; ++i) {
+        mSizes[i].count     += pOther.mSizes[i].count;
+        mSizes[i].bytes     += pOther.mSizes[i].bytes;
+    }
+    for (size_t i = 0; i < STATS_AGE_BUCKETS; ++i) {
+        mAges[i].count      += pOther.mAges[i].count;
+        mAges[i].bytes      += pOther.mAges[i].bytes;
+    }
+    for (const auto &[ext, bucket] : pOther.mExtensions) {
+
+        /** Files of the same extension in these histograms */
+        StatsBucket         &extBucket  = mExtensions[ext];
+
+        extBucket.count     += bucket.count;
+        extBucket.bytes     += bucket.bytes;
+    }
+}
+
+void
+FileStats::size_label (const size_t &pBucket, char *pBuff, const size_t &pBuffLen) noexcept
+{
+    // bucket k holds the sizes from 2^(k-1) up to (but not including) 2^k, which are written as powers of 1024
+    if (pBucket <= 1) {
+        snprintf (pBuff, pBuffLen, "%zu B", pBucket);
+        return;
+    }
+
+    snprintf (pBuff, pBuffLen, "%llu %s - %llu %s",
+                1ULL << ((pBucket - 1) % 10), sizeUnits[(pBucket - 1) / 10],
+                1ULL << (pBucket % 10), sizeUnits[pBucket / 10]);
+}
+
+const char
+*FileStats::age_label (const size_t &pBucket) noexcept
+{
+    return ageLabels[pBucket];
+}
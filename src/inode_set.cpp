@@ -0,0 +1,93 @@
+/**
+ * @file            inode_set.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Compact set of the (device, inode) pairs of files, so that hard-linked files are only counted once
+ *
+ */
+
+#include <algorithm>
+
+#include "inode_set.h"
+
+
+/**
+ * @brief                   Hashes the identity of a file
+ *
+ *                          Inode numbers are usually handed out sequentially, so the bits are mixed thoroughly to keep
+ *                          neighbouring inodes from landing in neighbouring slots (and forming long runs)
+ *
+ * @param pDev              Device containing the file
+ * @param pIno              Inode number of the file
+ *
+ * @return uint64_t         Hash of the pair
+ */
+[[nodiscard]] static inline uint64_t
+hash_inode (const uint64_t &pDev, const uint64_t &pIno) noexcept
+{
+    /** Bits of the pair, mixed one step at a time */
+    uint64_t                hash        = pIno ^ (pDev * 0x9E3779B97F4A7C15ULL);
+
+    hash    = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash    = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+
+    return hash ^ (hash >> 31);
+}
+
+void
+InodeSet::grow ()
+{
+    /** Slots from before the table was doubled */
+    std::vector<uint64_t>   oldSlots;
+    /** Number of slots of the doubled table */
+    const size_t            numSlots    = (mSlots.empty ()) ? (INODE_SET_MIN_SLOTS) : (2 * (mMask + 1));
+
+    oldSlots.swap (mSlots);
+    mSlots.assign (2 * numSlots, 0);
+    mMask   = numSlots - 1;
+
+    for (size_t i = 0; i < oldSlots.size (); i += 2) {
+        if (oldSlots[i + 1] == 0) {
+            continue;
+        }
+
+        /** Slot into which the pair is moved */
+        size_t              slot        = hash_inode (oldSlots[i], oldSlots[i + 1]) & mMask;
+
+        while (mSlots[2 * slot + 1] != 0) {
+            slot    = (slot + 1) & mMask;
+        }
+        mSlots[2 * slot]        = oldSlots[i];
+        mSlots[2 * slot + 1]    = oldSlots[i + 1];
+    }
+}
+
+bool
+InodeSet::insert (const uint64_t &pDev, const uint64_t &pIno)
+{
+    /** Slot at which the pair is looked for */
+    size_t                  slot;
+
+    // the table is kept at most half full, which keeps the runs of occupied slots short
+    if (2 * (mSize + 1) > mMask + 1) {
+        grow ();
+    }
+
+    for (slot = hash_inode (pDev, pIno) & mMask; mSlots[2 * slot + 1] != 0; slot = (slot + 1) & mMask) {
+        if (mSlots[2 * slot + 1] == pIno && mSlots[2 * slot] == pDev) {
+            return false;
+        }
+    }
+
+    mSlots[2 * slot]        = pDev;
+    mSlots[2 * slot + 1]    = pIno;
+    ++mSize;
+
+    return true;
+}
+
+void
+InodeSet::clear () noexcept
+{
+    std::fill (mSlots.begin (), mSlots.end (), 0);
+    mSize   = 0;
+}
@@ -5,13 +5,33 @@
  *
  */
 
+#include <cctype>
+#include <clocale>
+#include <cinttypes>
 #include <cstdlib>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
+#include <ctime>
 
 #include <filesystem>
 #include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "dir_reader.h"
+#include "scan_context.h"
+#include "tree_model.h"
+#include "tree_walker.h"
+#include "watch_tree.h"
+#include "work_stealing_pool.h"
 
 
 /** Option that specifies if directories should be recursively scanned and displayed */
@@ -61,14 +81,49 @@
 #define HELP                    (13)
 
 
-/** Maximum allowed length of an argument (other than the path) after which it is not checked further */
-#define MAX_ARG_LEN             (32)
+/** Option that specifies if only those entries whose name matches any of the patterns read from a file should be shown */
+#define SEARCH_PATTERNS         (14)
+
+/** Option that specifies if only those entries whose name matches a given glob should be shown */
+#define SEARCH_GLOB             (15)
+
+/** Option that specifies if only those entries whose name matches a given regular expression should be shown */
+#define SEARCH_REGEX            (16)
+
+
+/** Option that specifies if directories should be traversed breadth-first (each level before the next one) */
+#define TRAVERSE_BFS            (19)
+
+/** Option that specifies if hard-linked files should only be added once to the sizes of directories */
+#define SIZE_DEDUP_INODES       (20)
+
+/** Option that specifies if the sizes of directories should add up the space allocated to files instead of their sizes */
+#define SIZE_ALLOCATED          (21)
 
-/** Maximum allowed length of the provided path after which any further characters are ignored */
-#define MAX_PATH_LEN            (256)
+/** Option that specifies if the largest regular files should be printed instead of the contents of directories */
+#define TOP_FILES               (23)
 
-/** Maximum allowed length of the string that stores the last modified time (formatted) of a file */
-#define MAX_FMT_TIME_LEN        (64)
+/** Option that specifies if the largest directories should be printed instead of the contents of directories */
+#define TOP_DIRS                (24)
+
+/** Option that specifies if histograms of the regular files should be printed instead of the contents of directories */
+#define SHOW_HISTOGRAMS         (25)
+
+/** Option that specifies if a profile of the scan (its counters and the time spent in each phase) should be printed */
+#define SHOW_PROFILE            (26)
+
+/** Option that specifies if the profile of the scan should be printed as a JSON object (to the standard error) */
+#define PROFILE_JSON            (27)
+
+/** Option that specifies if the tree should be read into memory once, and every query answered from the model */
+#define IN_MEMORY_MODEL         (28)
+
+/** Option that specifies if the scan should run at idle I/O and processor priority */
+#define IDLE_PRIORITY           (29)
+
+
+/** Maximum allowed length of an argument (other than the path) after which it is not checked further */
+#define MAX_ARG_LEN             (32)
 
 /** Maximum allowed length of the string that stores a formatted integer */
 #define MAX_FMT_INT_LEN         (32)
@@ -78,9 +133,6 @@
 #define INDENT_COL_WIDTH        (4)
 
 
-/** Defined if Knuth Morris Prat search needs to be used */
-// #define USE_KMP_SEARCH          true
-
 #define red                     "\033[0;31m"
 #define Lred                    L"\033[0;31m"
 
@@ -118,19 +170,26 @@
 
 /** Determines if each error entry should have empty lines before and after */
 #if defined (ERR_NEWL)
-#define SHOW_ERR(pMsg, ...)     fwprintf (stderr,                               \
+#define SHOW_ERR(pErr, pMsg, ...)   fwprintf (stderr,                           \
                                             L"\n"                               \
                                             pMsg L" (Code %d, %hs)\n",          \
                                             L"\n",                              \
                                             __VA_ARGS__,                        \
-                                            sErrorCode.value (),                \
-                                            sErrorCode.message ().c_str ());                /** Macro to print errors in a well formatted manner */
+                                            (pErr).value (),                    \
+                                            (pErr).message ().c_str ());                    /** Macro to print errors in a well formatted manner */
 #else
-#define SHOW_ERR(pMsg, ...)     fwprintf (stderr,                               \
+#define SHOW_ERR(pErr, pMsg, ...)   fwprintf (stderr,                           \
                                             pMsg L" (Code %d, %hs)\n",          \
                                             __VA_ARGS__,                        \
-                                            sErrorCode.value (),                \
-                                            sErrorCode.message ().c_str ());                /** Macro to print errors in a well formatted manner */
+                                            (pErr).value (),                    \
+                                            (pErr).message ().c_str ());                    /** Macro to print errors in a well formatted manner */
+#endif
+
+/** Conversion of a native path within the messages of errors (native paths are only wide on Windows) */
+#if defined (_WIN32) || defined (_WIN64)
+#define PATH_FMT                L"%ls"
+#else
+#define PATH_FMT                L"%hs"
 #endif
 
 // trick to see if a type is signed
@@ -168,223 +227,118 @@ static const wchar_t    *usage      = L"\n"
                                     L"-s, --special               Show Special Files such as sockets, pipes, etc. (normally hidden)\n"
                                     L"\n"
                                     L"-d, --dir-size              Recursively calculate and display the size of each directory\n"
+                                    L"    --dedup-inodes          Only count hard-linked files once in the sizes of directories\n"
+                                    L"    --disk-usage            Count the space allocated to files in the sizes of directories (as du does)\n"
                                     L"\n"
                                     L"-a, --abs                   Show the absolute path of each entry without any indentation\n"
+                                    L"    --breadth-first         Show each level of directories before the next one (sequential scans only)\n"
+                                    L"    --sort=KEY              Show the entries of each directory sorted by name, size (largest first) or\n"
+                                    L"                            mtime (newest first)\n"
+                                    L"-x, --one-file-system       Do not enter directories on other filesystems than the one PATH is on\n"
+                                    L"    --exclude GLOB          Skip entries whose name matches GLOB, along with everything below them (can be repeated)\n"
+                                    L"    --top N [files|dirs]    Only print the N largest regular files and/or directories within the whole tree\n"
+                                    L"    --histogram             Only print histograms of the sizes, ages and extensions of the regular files\n"
+                                    L"                            within the whole tree\n"
+                                    L"    --watch SECONDS         Keep the sizes of the directories up to date as the tree changes (through inotify\n"
+                                    L"                            on Linux), and print them every SECONDS seconds until interrupted\n"
+                                    L"    --in-memory             Read the whole tree into memory once, and answer the search, --top, --histogram\n"
+                                    L"                            and -d from it, in any combination\n"
+                                    L"\n"
+                                    L"    --min-size SIZE         Only show regular files of at least SIZE bytes (can be followed by K, M, G or T)\n"
+                                    L"    --newer-than TIME       Only show regular files modified after TIME (YYYY-MM-DD[THH:MM[:SS]], or an age\n"
+                                    L"                            such as 30m, 12h, 7d or 2w)\n"
+                                    L"\n"
+                                    L"-j, --jobs                  Number of threads to use for searching and calculating directory sizes (0 uses all hardware threads)\n"
+                                    L"    --io-uring              Fetch the metadata of all entries of a directory at once through io_uring (Linux only)\n"
+                                    L"    --prefetch [N]          Read the subdirectories of each directory on N more threads (4 if not given) before\n"
+                                    L"                            the walk reaches them, for cold caches on spinning disks and NFS\n"
+                                    L"    --max-dirs N            Read at most N directories per second\n"
+                                    L"    --max-stats N           Fetch the metadata of at most N entries per second\n"
+                                    L"    --max-latency MS        Let as many threads read the filesystem at once as keep each call under MS milliseconds\n"
+                                    L"                            on average (starting from one, and never more than --jobs)\n"
+                                    L"    --idle                  Run at idle I/O and processor priority (SCHED_IDLE on Linux), so that any other work\n"
+                                    L"                            on the host comes first\n"
+                                    L"    --index FILE            Answer the search from the index in FILE alone, without reading the filesystem\n"
+                                    L"    --update-index FILE     Reuse the directories in FILE that have not changed since the last scan, and update it\n"
+                                    L"    --format=FORMAT         Print one record per entry instead of a table: null (NUL-terminated paths), jsonl or bin\n"
                                     L"\n"
                                     L"-S, --search                Only show entries whose name completely matches the following string completely\n"
                                     L"    --search-noext          Only show entries whose name(except for the extension) matches the following string completely\n"
                                     L"    --contains              Only show entries whose name contains the following string completely\n"
+                                    L"    --glob                  Only show entries whose name matches the following glob (*, ? and [...])\n"
+                                    L"    --regex                 Only show entries whose name contains a match of the following regular expression\n"
+                                    L"    --patterns-from FILE    Only show entries whose name matches any of the patterns in FILE (one per line, as\n"
+                                    L"                            \"exact:NAME\", \"noext:NAME\" or \"contains:TEXT\"), along with the pattern matched\n"
                                     L"\n"
                                     L"-e, --show-err              Show errors\n"
+                                    L"    --stats[=json]          Print counters and the time spent in each phase once the scan is done (as a\n"
+                                    L"                            JSON object on the standard error with =json)\n"
                                     L"-h, --help                  Print Usage Instructions\n"
                                     L"\n";
 
 /** Unformatted summary string for directory to Totalerse (not including subdirectories) */
-static const wchar_t    *rootSum    = L"\n"
-                                    L"Summary of \"%ls\"\n"
-                                    L"<%hs files>\n"
-                                    L"<%hs symlinks>\n"
-                                    L"<%hs special files>\n"
-                                    L"<%hs subdirectories>\n"
-                                    L"<%hs total entries>\n"
-                                    L"\n";
+static const char       *rootSum    = "\n"
+                                    "Summary of \"%s\"\n"
+                                    "<%s files>\n"
+                                    "<%s symlinks>\n"
+                                    "<%s special files>\n"
+                                    "<%s subdirectories>\n"
+                                    "<%s total entries>\n"
+                                    "\n";
 
 /** Unformatted summary string for the directory to Totalerse (including subdirectories) */
-static const wchar_t    *recSum     = L"Including subdirectories\n"
-                                    L"<%hs files>\n"
-                                    L"<%hs symlinks>\n"
-                                    L"<%hs special files>\n"
-                                    L"<%hs subdirectories>\n"
-                                    L"<%hs total entries>\n"
-                                    L"\n";
+static const char       *recSum     = "Including subdirectories\n"
+                                    "<%s files>\n"
+                                    "<%s symlinks>\n"
+                                    "<%s special files>\n"
+                                    "<%s subdirectories>\n"
+                                    "<%s total entries>\n"
+                                    "\n";
 
 /** Unformatted summary string for number of entries found matching search pattern (in search mode) */
-static const wchar_t    *foundSum   = L"\n"
-                                    L"Summary of matching entries\n"
-                                    L"<%hs files>\n"
-                                    L"<%hs symlinks>\n"
-                                    L"<%hs special files>\n"
-                                    L"<%hs subdirectories>\n"
-                                    L"<%hs total entries>\n"
-                                    L"\n";
+static const char       *foundSum   = "\n"
+                                    "Summary of matching entries\n"
+                                    "<%s files>\n"
+                                    "<%s symlinks>\n"
+                                    "<%s special files>\n"
+                                    "<%s subdirectories>\n"
+                                    "<%s total entries>\n"
+                                    "\n";
 
 /** Unformatted summary string for number of entries traversed while matching search pattern (in search mode) */
-static const wchar_t    *TotalSum    = L"Summary of traversal of \"%ls\"\n"
-                                    L"<%hs files>\n"
-                                    L"<%hs symlinks>\n"
-                                    L"<%hs special files>\n"
-                                    L"<%hs subdirectories>\n"
-                                    L"<%hs total entries>\n"
-                                    L"\n";
-
-static const wchar_t    *sInitPath          {nullptr};                                      /** Initial path to start the scan from */
-static const wchar_t    *sSearchPattern     {nullptr};                                      /** Pattern to search for if any of the search options are set */
-
-#if defined (USE_KMP_SEARCH)
-static uint64_t         sSearchPatternLen   {};
-#endif
-
-/** Bitmask to represent command line options provided by the user */
-static uint64_t         sOptionMask         {};
-/** Container for error code to be passed around when dealing with std::filesystem artifacts */
-static std::error_code  sErrorCode          {};
-
-/** Number of levels of directories to go within if the recursive option is set */
-static uint64_t         sRecursionLevel     {};
-
-/** Total number of files traversed */
-static uint64_t         sNumFilesTotal      {};
-/** Total number of Symlinks traversed */
-static uint64_t         sNumSymlinksTotal   {};
-/** Total number of special files traversed */
-static uint64_t         sNumSpecialTotal    {};
-/** Total number of directories traversed */
-static uint64_t         sNumDirsTotal       {};
-
-/** Number of files traversed in the root directory */
-static uint64_t         sNumFilesRoot       {};
-/** Number of symlinks traversed in the root directory */
-static uint64_t         sNumSymlinksRoot    {};
-/** Number of special files traversed in the root directory */
-static uint64_t         sNumSpecialRoot     {};
-/** Number of subdirectories in the root directory */
-static uint64_t         sNumDirsRoot        {};
-
-/** Number of files matching the search pattern */
-static uint64_t         sNumFilesMatched    {};
-/** Number of symlinks matching the search pattern */
-static uint64_t         sNumSymlinksMatched {};
-/** Number of special files matching the search pattern */
-static uint64_t         sNumSpecialMatched  {};
-/** Number of subdirectories matching the search pattern */
-static uint64_t         sNumDirsMatched     {};
-
-/** Flag to determine whether the summary should be printed or not */
-static bool             sPrintSummary       {};
-
-/** Buffer to use for storing formatted integers */
-static char             sFmtIntBuff[MAX_FMT_INT_LEN];
-
-#if defined (USE_KMP_SEARCH)
-static uint64_t          sLpsArray[MAX_ARG_LEN]        {};                                      /** LPS array to use */
-#endif
-
-/**
- * @brief                   Returns whether a given command line option is set or not
- *
- * @param pBit              Command Line option to check
- *
- * @return true             If the given option is set
- * @return false            If the given option is cleared
- */
-[[nodiscard]] inline bool
-get_option (const uint8_t &pBit) noexcept
-{
-    return (sOptionMask & (1ULL << pBit)) != 0;
-}
-
-/**
- * @brief                   Sets a command line option
- *
- * @param pBit              Option to set
- */
-inline void
-set_option (const uint8_t &pBit) noexcept
-{
-    // a given bit can be set by generating a bitmask where only the desired bit is set
-    // and performing a logical OR operation between the initial value and the mask
-    sOptionMask |= (1ULL << pBit);
-}
+static const char       *TotalSum    = "Summary of traversal of \"%s\"\n"
+                                    "<%s files>\n"
+                                    "<%s symlinks>\n"
+                                    "<%s special files>\n"
+                                    "<%s subdirectories>\n"
+                                    "<%s total entries>\n"
+                                    "\n";
 
 /**
- * @brief                   Clears a command line option
+ * @brief                   Formats an integer with commas separating each group of three digits
  *
- * @param pBit              Option to clear
- */
-inline void
-clear_option (const uint8_t &pBit) noexcept
-{
-    // a given bit can be cleared by generating a bitmask where only the desired bit is not
-    // set and performing a logical AND operation between the initial value and the mask
-    sOptionMask &= ~(1ULL << pBit);
-}
-
-/**
- * @brief                   Create a null-terminated wide string (of wchar_t) from a null-terminated string (of char)
- *
- *                          The new string is generated and placed on the heap, and care must be taken to free it
- *
- * @param pPtr              Null-terminated String to generate a wide string from
+ * @param pValue            Integer to format
+ * @param pBuff             Buffer to write the null-terminated formatted integer to (of at least MAX_FMT_INT_LEN characters)
  *
- * @return wchar_t*         Given String as a wide string
+ * @return char*            The given buffer
  */
-[[nodiscard]] inline wchar_t
-*widen_string (const char *pPtr) noexcept
-{
-    // setlocale (LC_CTYPE, "UTF-32");
-
-    /** Length of the string to convert to a wide string (including the null termination character) */
-    uint64_t    len;
-    /** Resultant wide string after the conversion */
-    wchar_t     *result {nullptr};
-
-    // calculate the length of the input string and allocate a wide string of the corresponding size
-    // this string needs to be freed by a call to free
-    len     = strnlen (pPtr, MAX_PATH_LEN) + 1;
-    result  = (wchar_t *)malloc (sizeof (wchar_t) * len);
-
-    // memset (result, 0, sizeof (wchar_t) * len);
-
-    if (result == nullptr) {
-        fprintf (stderr,
-        "Could not allocate Wide String when converting path\n");
-        std::exit (-1);
-    }
-
-    // On Windows and Linux/OSX, sizeof (char) is 1 and the encoding is UTF-8
-    // On Windows, sizeof (wchar_t) is 2 and the encoding is UTF-16
-    // On Linux/OSX, sizeof (wchar_t) is 4 and the encoding is UTF-32
-
-    // Simply copying the char (byte) to the least significant byte of the wchar_t
-    // should be enough to create the new wide string
-    // the remaining bytes can be cleared
-
-    for (uint64_t i = 0; i < len; ++i) {
-        ((char *)&result[i])[0] = pPtr[i];
-        ((char *)&result[i])[1] = 0;
-
-        if constexpr (sizeof (wchar_t) >= 4) {
-            ((char *)&result[i])[2] = 0;
-            ((char *)&result[i])[3] = 0;
-        }
-    }
-
-    // if (std::mbstowcs (result, pPtr, len) != len) {
-    //     fprintf (stderr,
-    //     "Could not convert charace String when converting path\n");
-    //     std::exit (-1);
-    // }
-
-    return result;
-}
-
 template <typename int_t>
-[[nodiscard]] char
-*format_int (int_t pValue)
+char
+*format_int (int_t pValue, char *pBuff) noexcept
 {
-    /** */
+    /** Number of characters written to the buffer so far */
     uint8_t         buffLen;
-    /** */
+    /** Digit that is being currently written */
     uint8_t         digit;
 
-    /** */
+    /** Stores whether the integer is negative */
     bool            isSigned;
 
     if (pValue == 0) {
-        sFmtIntBuff[0] = '0';
-        sFmtIntBuff[1] = 0;
+        pBuff[0] = '0';
+        pBuff[1] = 0;
 
-        return sFmtIntBuff;
+        return pBuff;
     }
 
     if constexpr (is_signed_type (int_t)) {
@@ -399,99 +353,53 @@ template <typename int_t>
         digit                   = pValue % 10;
         pValue                  = pValue / 10;
 
-        sFmtIntBuff[buffLen++]  = '0' + digit;
+        pBuff[buffLen++]  = '0' + digit;
 
         if (((buffLen % 4) == 3) && (pValue != 0)) {
-            sFmtIntBuff[buffLen++]  = ',';
+            pBuff[buffLen++]  = ',';
         }
     }
 
     if constexpr (is_signed_type (int_t)) {
         if (isSigned) {
-            sFmtIntBuff[buffLen++]  = '-';
+            pBuff[buffLen++]  = '-';
         }
     }
 
     for (int i = 0; i < buffLen / 2; ++i) {
-        std::swap (sFmtIntBuff[i], sFmtIntBuff[buffLen - i - 1]);
+        std::swap (pBuff[i], pBuff[buffLen - i - 1]);
     }
 
-    sFmtIntBuff[buffLen]    = 0;
-
-    return sFmtIntBuff;
-}
-
-#if defined (USE_KMP_SEARCH)/**
- * @brief                   Computes the LPS array for KMP search
- *
- */
-void
-compute_lps ()
-{
-    // clear the LPS array
-    memset (sLpsArray, 0, sizeof (sLpsArray[0]) * MAX_ARG_LEN);
-
-    // sSearchPatternLen   = wstrnlen (sSearchPattern, MAX_ARG_LEN);
+    pBuff[buffLen]    = 0;
 
-    // build the LPS array
-    for (uint64_t i = 1, maxPrefLen = 0; i < sSearchPatternLen; ++i) {
-
-        if (sSearchPattern[i] == sSearchPattern[maxPrefLen]) {
-            sLpsArray[i]    = ++maxPrefLen;
-        }
-        else if (maxPrefLen != 0) {
-            maxPrefLen      = sLpsArray[maxPrefLen - 1];
-            --i;
-        }
-        // else {
-        //     sLpsArray[i]    = 0;
-        // }
-    }
+    return pBuff;
 }
-#endif
 
 /**
- * @brief                   Checks if a given string contains the search pattern provided by the user
+ * @brief                   Parses a null-terminated string into an unsigned 64 bit integer
  *
- * @param pStr              String to check
+ * @param pPtr              Pointer to string
+ * @param pRes              Reference to resultant variable
  *
- * @return true             If the given string contains the search pattern
- * @return false            If the given string does not contains the search pattern
+ * @return true             If the conversion was successful
+ * @return false            If the conversion failed
  */
 bool
-check_contains (const std::wstring &pStr)
+parse_str_to_uint64 (const char *pPtr, uint64_t &pRes) noexcept
 {
-
-#if defined (USE_KMP_SEARCH)
-    for (uint64_t i = 0, j = 0; (pStr.size () + j) >= (sSearchPatternLen + i); ) {
-        if (sSearchPattern[j] == pStr[i]) {
-            ++i;
-            ++j;
-        }
-
-        if (j == sSearchPatternLen) {
-            return true;
-        }
-
-        else if ((i < pStr.size ()) && (sSearchPattern[j] != pStr[i])) {
-            if (j != 0) {
-                j = sLpsArray[j - 1];
-            }
-            else {
-                ++i;
-            }
+    // go through all characters and discard the string if any of the characters is not a decimal digit
+    for (; *pPtr != 0; ++pPtr) {
+        if (*pPtr < '0' || *pPtr > '9') {
+            return false;
         }
+        pRes = (pRes * 10) + (uint64_t)(*pPtr - '0');
     }
 
-    return false;
-
-#else
-    return pStr.find (sSearchPattern) != std::wstring::npos;
-#endif
+    return true;
 }
 
 /**
- * @brief                   Parses a null-terminated string into an unsigned 64 bit integer
+ * @brief                   Parses a size in bytes, optionally followed by a binary unit (K, M, G or T)
  *
  * @param pPtr              Pointer to string
  * @param pRes              Reference to resultant variable
@@ -500,983 +408,4223 @@ check_contains (const std::wstring &pStr)
  * @return false            If the conversion failed
  */
 bool
-parse_str_to_uint64 (const char *pPtr, uint64_t &pRes) noexcept
+parse_size (const char *pPtr, uint64_t &pRes) noexcept
 {
-    // go through all characters and discard the string if any of the characters is not a decimal digit
-    for (; *pPtr != 0; ++pPtr) {
-        if (*pPtr < '0' || *pPtr > '9') {
-            return false;
-        }
-        pRes = (pRes * 10) + (uint64_t)(*pPtr - '0');
+    /** Units that a size can be followed by, each 1024 times the previous one */
+    static const char       units[]     = "KMGT";
+
+    /** Digits of the size (without the unit) */
+    char                    digits[MAX_ARG_LEN];
+    /** Length of the size (along with the unit) */
+    const size_t            len         = strnlen (pPtr, MAX_ARG_LEN);
+    /** Unit following the size (nullptr if there is none) */
+    const char              *unit       = (len == 0) ? (nullptr) : (strchr (units, toupper (pPtr[len - 1])));
+
+    if (len == 0 || len >= MAX_ARG_LEN || (unit != nullptr && len == 1)) {
+        return false;
+    }
+
+    memcpy (digits, pPtr, len + 1);
+    if (unit != nullptr && *unit != 0) {
+        digits[len - 1] = 0;
+    }
+
+    pRes    = 0;
+    if (!parse_str_to_uint64 (digits, pRes)) {
+        return false;
+    }
+    if (unit != nullptr && *unit != 0) {
+        pRes    <<= 10 * (1 + (unit - units));
     }
 
     return true;
 }
 
 /**
- * @brief                   Calculates and returns the size of a directory in bytes (-1 if the size can not be found out)
+ * @brief                   Parses a point in time, either as a local date (and time) or as an age relative to now
  *
- * @param pDirPath          Path to the directory whose size needs to be calculated
+ * @param pPtr              Pointer to string (YYYY-MM-DD, YYYY-MM-DDTHH:MM, YYYY-MM-DDTHH:MM:SS, or a whole number
+ *                          followed by s, m, h, d or w)
+ * @param pRes              Reference to resultant variable
  *
- * @return int64_t          Size of the directory (-1 if size could not be calculated)
+ * @return true             If the conversion was successful
+ * @return false            If the conversion failed
  */
-[[nodiscard]] int64_t
-calc_dir_size (const wchar_t *pPath) noexcept
+bool
+parse_time (const char *pPtr, time_t &pRes) noexcept
 {
-    /** Iterator to the elements within the current directory */
-    fs::directory_iterator  iter (pPath, sErrorCode);
-    /** Iterator to the element after the last element in the current directory */
-    fs::directory_iterator  fin;
-    /** Reference to current entry (used while dereferencing iter) */
-    fs::directory_entry     entry;
-
-    /** Stores whether the current entry is a directory */
-    static bool             isDir;
-    /** Stores whether the current entry is a regular file */
-    static bool             isFile;
-    /** Stores whether the current entry is a symlink */
-    static bool             isSymlink;
-    /** Stores whether the current entry is a special file */
-    static bool             isSpecial;
+    /** Units that an age can be followed by, along with their lengths in seconds */
+    static const std::pair<char, uint64_t>  units[] = {
+        {'s', 1}, {'m', 60}, {'h', 60 * 60}, {'d', 24 * 60 * 60}, {'w', 7 * 24 * 60 * 60}
+    };
+
+    /** Digits of the age (without the unit) */
+    char                    digits[MAX_ARG_LEN];
+    /** Length of the string */
+    const size_t            len         = strnlen (pPtr, MAX_ARG_LEN);
+    /** Age, in units */
+    uint64_t                age;
+
+    /** Broken down date and time */
+    std::tm                 tm          {};
+    /** Number of characters of the date and time that were parsed */
+    int                     numParsed;
+
+    if (len == 0 || len >= MAX_ARG_LEN) {
+        return false;
+    }
 
-    /** Stores the total size of this entry */
-    int64_t                 totalDirSize;
-    /** Size of file that is being currently processed */
-    int64_t                 curFileSize;
+    for (const auto &[unit, seconds] : units) {
+        if (len < 2 || pPtr[len - 1] != unit) {
+            continue;
+        }
 
-    /** Status of the current entry (permissions, type, etc.) */
-    fs::file_status         entryStatus;
+        memcpy (digits, pPtr, len - 1);
+        digits[len - 1] = 0;
 
-    // if an error occoured while trying to get the directory iterator, then report it here
-    if (sErrorCode.value () != 0) {
-        if (get_option (SHOW_ERRORS)) {
-            SHOW_ERR (L"Error while creating directory iterator for \"%ls\"",
-                    pPath);
+        age     = 0;
+        if (!parse_str_to_uint64 (digits, age)) {
+            return false;
         }
-        return -1;
+        pRes    = time (nullptr) - (time_t)(age * seconds);
+        return true;
     }
 
-    // initialize the size variable
-    totalDirSize        = 0;
-
-    // iterate through all the entries within the current directory
-    for (fin = end (iter); iter != fin; ++iter) {
+    numParsed   = 0;
+    if (sscanf (pPtr, "%4d-%2d-%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &numParsed) != 3 || numParsed != 10) {
+        return false;
+    }
+    if (pPtr[numParsed] == 'T' || pPtr[numParsed] == ' ') {
 
-        // get the current entry and its status
-        entry           = *iter;
-        entryStatus     = entry.status (sErrorCode);
+        /** Number of characters of the time that were parsed */
+        int                 numTimeParsed   = 0;
 
-        // skip this entry if the status is not available
-        if (sErrorCode.value () != 0) {
-            if (get_option (SHOW_ERRORS)) {
-                SHOW_ERR (L"Error while getting status of \"%ls\"", entry.path ().wstring ().c_str ());
-            }
-            continue;
+        if (sscanf (pPtr + numParsed + 1, "%2d:%2d%n:%2d%n", &tm.tm_hour, &tm.tm_min, &numTimeParsed, &tm.tm_sec,
+                    &numTimeParsed) < 2) {
+            return false;
         }
+        numParsed   += 1 + numTimeParsed;
+    }
+    if (pPtr[numParsed] != 0) {
+        return false;
+    }
 
-        // find out the type of the entry
-        isDir           = entry.is_directory ();
-        isFile          = entry.is_regular_file ();
-        isSymlink       = entry.is_symlink ();
-        isSpecial       = entry.is_other ();
+    tm.tm_year  -= 1900;
+    tm.tm_mon   -= 1;
+    tm.tm_isdst = -1;
 
-        // check if the entry is a regular file
-        if (isFile) {
-            // read the size of the current file and add it to the total size of the directory
-            // if the size can not be read, don't add it to the final size
-            curFileSize     = fs::file_size (entry, sErrorCode);
-            if (sErrorCode.value () != 0) {
-                if (get_option (SHOW_ERRORS)) {
-                    SHOW_ERR (L"Error while reading size of file \"%ls\"",
-                                entry.path ().wstring ().c_str ());
-                }
-            }
-            else {
-                totalDirSize    += curFileSize;
-            }
-        }
-        // check if the entry is a directory and make sure it is not a symlink (prevents circular scanning)
-        else if (isDir && !isSymlink) {
-            curFileSize     = calc_dir_size (entry.path ().wstring ().c_str ());
+    pRes        = mktime (&tm);
+    return pRes != (time_t)-1;
+}
 
-            if (curFileSize != -1) {
-                totalDirSize    += curFileSize;
-            }
-        }
-        // if the file is not of a known type, skip it
-        else if (!isSpecial && !isSymlink) {
-            wprintf (L"File type of \"%ls\" can not be determined\n",
-                    entry.path ().wstring ().c_str ());
-            continue;
-        }
-    }
+/** Profile of the worker running on the current thread (nullptr unless the scan is profiled) */
+static thread_local ScanProfile     *threadProfile  = nullptr;
 
-    return totalDirSize;
+/**
+ * @brief                   Returns the profile of a worker of a scan
+ *
+ * @param pCtx              Context of the scan
+ * @param pWorker           Index of the worker
+ *
+ * @return ScanProfile*     Profile of the worker (nullptr unless the scan is profiled)
+ */
+[[nodiscard]] inline ScanProfile
+*profile_of (ScanContext &pCtx, const uint32_t &pWorker) noexcept
+{
+    return (pCtx.profiles.empty ()) ? (nullptr) : (&pCtx.profiles[pWorker % pCtx.profiles.size ()]);
 }
 
 /**
- * @brief                   Prints the last modified time of a filesystem entry (formatted)
+ * @brief                   Adds the work done by the workers of a pool during its last run to their profiles
  *
- * @param pFsEntry          Filesystem entry whose last modification time should be printed
+ * @tparam pool_t           Type of the pool
+ *
+ * @param pCtx              Context of the scan
+ * @param pPool             Pool whose workers to add
  */
+template <typename pool_t>
 void
-print_last_modif_time (const fs::directory_entry &pFsEntry) noexcept
+add_pool_profile (ScanContext &pCtx, const pool_t &pPool) noexcept
 {
-    /** Time point when the given entry was last modified */
-    static fs::file_time_type   lastModifTpFs;
-    /** Time point when the given entry was last modified as a time_t instance */
-    static time_t               lastModifTime;
-    /** Time point when the given entry was last modified formatted as a string */
-    static char                 formattedTime[MAX_FMT_TIME_LEN];
-
-    // get the timepoint on which it was last modified (the timepoint is on chrono::file_clock)
-    lastModifTpFs   = pFsEntry.last_write_time (sErrorCode);
-
-    // check if the time could be read
-    if (sErrorCode.value () != 0) {
-        if (get_option (SHOW_ERRORS)) {
-            SHOW_ERR (L"Error while reading last modified time for \"%ls\"",
-                        pFsEntry.path ().wstring ().c_str ());
-        }
-        // after reporting the error, put 20 blank spaces to indent the current entry
-        wprintf (L"%20c", ' ');
+    if (pCtx.profiles.empty ()) {
+        return;
     }
-    else {
-        // convert the time point on chrono::file_clock to a time_t object (time passed since epoch) and format it
 
-#if defined (_WIN32) || defined (_WIN64)
-        lastModifTime   = chrono::system_clock::to_time_t (
-                        chrono::utc_clock::to_sys (
-                                chrono::file_clock::to_utc (lastModifTpFs)
-                                )
-                        );
-#else
-        lastModifTime   = chrono::system_clock::to_time_t (
-            chrono::file_clock::to_sys (lastModifTpFs));
-#endif
+    for (uint32_t i = 0; i < pPool.num_workers (); ++i) {
 
-        strftime (formattedTime,
-                    MAX_FMT_TIME_LEN,
-                    "%b %d %Y  %H:%M",
-                    std::localtime (&lastModifTime));
+        /** Profile of the worker */
+        ScanProfile         &profile    = *profile_of (pCtx, i);
 
-        wprintf (L"%20hs", formattedTime);
+        profile.tasks       += pPool.worker_stats (i).tasks;
+        profile.steals      += pPool.worker_stats (i).steals;
+        profile.busyNs      += pPool.worker_stats (i).busyNs;
+        profile.poolNs      += pPool.worker_stats (i).runNs;
     }
 }
 
-#if defined (_WIN32) || defined (_WIN64)
-#else
-
 /**
- * @brief                   Prints the permissions of a filesystem entry (formatted)
+ * @brief                   Finds out what an entry of a directory is, following symlinks (whose targets must have been
+ *                          fetched with STAT_FOLLOW)
  *
- * @param pEntryStatus      Reference to the status of the entry whose permissions need to be printed
+ * @param pEntry            Entry to classify
+ * @param pIsDir            Set if the entry is a directory (or a symlink to one)
+ * @param pIsFile           Set if the entry is a regular file (or a symlink to one)
+ * @param pIsSymlink        Set if the entry is a symlink
+ * @param pIsSpecial        Set if the entry is a special file (or a symlink to one)
  */
-void
-print_permissions (const fs::file_status &pEntryStatus) noexcept
+inline void
+classify_entry (const DirEntry &pEntry, bool &pIsDir, bool &pIsFile, bool &pIsSymlink, bool &pIsSpecial) noexcept
 {
-    /** Permissions of the current entry */
-    static fs::perms            entryPerms;
+    /** Type of the entry (of the target, if the entry is a symlink) */
+    const EntryType         type        = (pEntry.type == EntryType::SYMLINK) ? (pEntry.stat.type) : (pEntry.type);
 
-    entryPerms      = pEntryStatus.permissions ();
-
-    wprintf (L"%c%c%c%c%c%c%c%c%c   ",
-            ((entryPerms & fs::perms::owner_read) == fs::perms::none) ? ('r') : ('-'),
-            ((entryPerms & fs::perms::owner_write) == fs::perms::none) ? ('w') : ('-'),
-            ((entryPerms & fs::perms::owner_exec) == fs::perms::none) ? ('x') : ('-'),
-            ((entryPerms & fs::perms::group_read) == fs::perms::none) ? ('r') : ('-'),
-            ((entryPerms & fs::perms::group_write) == fs::perms::none) ? ('w') : ('-'),
-            ((entryPerms & fs::perms::group_exec) == fs::perms::none) ? ('x') : ('-'),
-            ((entryPerms & fs::perms::others_read) == fs::perms::none) ? ('r') : ('-'),
-            ((entryPerms & fs::perms::others_write) == fs::perms::none) ? ('w') : ('-'),
-            ((entryPerms & fs::perms::others_exec) == fs::perms::none) ? ('x') : ('-')
-        );
+    pIsSymlink      = pEntry.type == EntryType::SYMLINK;
+    pIsDir          = type == EntryType::DIRECTORY;
+    pIsFile         = type == EntryType::REGULAR;
+    pIsSpecial      = !pIsDir && !pIsFile && type != EntryType::SYMLINK && type != EntryType::UNKNOWN;
 }
-#endif
 
 /**
- * @brief                   Scans through and prints the contents of a directory
+ * @brief                   Checks whether a character of a native path separates its components
  *
- * @param pPath             Path to the directory to scan
- * @param pLevel            The number of recursive calls of this function before the current one
+ * @param pChar             Character to check
+ *
+ * @return true             If the character is a separator
+ * @return false            If the character is not a separator
  */
-void
-scan_path (const wchar_t *pPath, const uint64_t &pLevel) noexcept
+[[nodiscard]] inline bool
+is_separator (const fs::path::value_type &pChar) noexcept
 {
-    /** Number of spaces to enter before printing the entry for the current function call */
-    const uint64_t      indentWidth     = INDENT_COL_WIDTH * pLevel;
+    return pChar == '/' || pChar == (fs::path::value_type)fs::path::preferred_separator;
+}
 
-    // the path can not be a nullptr, it must be a valid string (FIND A WAY TO FREE THE STRINGS ALLOCATED IN MAIN)
-    if (pPath == nullptr) {
-        fwprintf (stderr, L"Path can not be NULL");
-        std::exit (-1);
+/**
+ * @brief                   Resolves a path through the filesystem, and counts it in the profile of the current thread
+ *
+ * @param pPath             Path to resolve
+ * @param pErr              Error that occoured while resolving the path
+ *
+ * @return fs::path         Canonical path
+ */
+[[nodiscard]] fs::path
+canonical_path (const fs::path &pPath, std::error_code &pErr)
+{
+    /** Time spent resolving the path */
+    const PhaseTimer        timer (threadProfile, ProfilePhase::RESOLVE);
+    /** Canonical path */
+    fs::path                resolved        = fs::canonical (pPath, pErr);
+
+    if (threadProfile != nullptr) {
+        ++threadProfile->pathsResolved;
+        if (pErr) {
+            threadProfile->add_error (ProfileError::RESOLVE, pErr);
+        }
     }
 
-    /** Iterator to the elements within the current directory */
-    fs::directory_iterator  iter (pPath, sErrorCode);
-    /** Iterator to the element after the last element in the current directory */
-    fs::directory_iterator  fin;
-    /** Reference to current entry (used while dereferencing iter) */
-    fs::directory_entry     entry;
+    return resolved;
+}
 
-    /** Name of the current entry */
-    fs::path                filepath;
-    /** Status of the current entry (permissions, type, etc.) */
-    fs::file_status         entryStatus;
+/**
+ * @brief                   Resolves the path of the directory from which a scan starts, so that the absolute paths of the
+ *                          entries below it can be built without resolving each of them again
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path of the directory from which the scan starts
+ */
+void
+resolve_root (ScanContext &pCtx, const fs::path &pPath) noexcept
+{
+    /** Container for error codes reported by std::filesystem */
+    std::error_code         errorCode;
 
-    /** Stores whether the current entry is a directory */
-    static bool             isDir;
-    /** Stores whether the current entry is a regular file */
-    static bool             isFile;
-    /** Stores whether the current entry is a symlink */
-    static bool             isSymlink;
-    /** Stores whether the current entry is a special file */
-    static bool             isSpecial;
+    pCtx.rootPath       = pPath;
+    pCtx.resolvedRoot   = canonical_path (pPath, errorCode);
 
-    /** Combines sizes of all files within this directory */
-    int64_t                 totalFileSize;
-    /** Size of file that is being currently processed */
-    int64_t                 curFileSize;
+    // the entries are then resolved one by one, reporting their own errors
+    if (errorCode.value () != 0) {
+        pCtx.resolvedRoot.clear ();
+    }
+}
 
-    /** Number of symlinks in the current directory */
-    uint64_t                symlinkCnt;
-    /** Number of regular files within this directory */
-    uint64_t                regularFileCnt;
-    /** Number of special files in the current directory */
-    uint64_t                specialCnt;
-    /** Number of sub-directories in the current directory */
-    uint64_t                subdirCnt;
+/**
+ * @brief                   Finds the device containing the directory from which a scan starts, if the scan stays on the
+ *                          filesystem it starts from
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path of the directory from which the scan starts
+ */
+void
+find_root_dev (ScanContext &pCtx, const fs::path &pPath) noexcept
+{
+    /** Identity of the directory from which the scan starts */
+    DirIdentity             identity;
+    /** Error that occoured while fetching the identity (the scan then reports it while reading the directory) */
+    std::error_code         errorCode;
 
-    /** Stores the path to the target of the symlink if the entry is a symlink */
-    fs::path                targetPath;
+    if (pCtx.filters.oneFileSystem && read_dir_identity (pPath, identity, errorCode)) {
+        pCtx.rootDev    = identity.dev;
+    }
+}
 
-    /** Stores the specific type of an entry if it is a special entry (if the specific type can not be determined, stores L"SPECIAL") */
-    const char              *specialEntryType;
+/**
+ * @brief                   Returns the canonical path of an entry that the walk reached from the root of the scan
+ *
+ *                          The walk never goes through symlinks, so the canonical path of anything below the root is the
+ *                          canonical path of the root followed by the rest of the path, and only paths that do not lie
+ *                          below the root (or a root that could not be resolved) are resolved by the filesystem
+ *
+ * @param pCtx              Context of the scan (the root must have been resolved by resolve_root)
+ * @param pPath             Path of the entry, as built by the walk (must not be a symlink)
+ * @param pErr              Error that occoured while resolving the path
+ *
+ * @return fs::path         Canonical path of the entry
+ */
+[[nodiscard]] fs::path
+resolved_path (const ScanContext &pCtx, const PathView &pPath, std::error_code &pErr)
+{
+    /** Path of the root of the scan */
+    const PathView          root            = pCtx.rootPath.native ();
 
-    /** Buffer to store the total size of files formatted with periods */
-    static char             fmtIntBuff[MAX_FMT_INT_LEN];
+    /** Position in the path of the entry just past the root */
+    size_t                  restPos         = root.size ();
 
-    // if an error occoured while trying to get the directory iterator, then report it here
-    if (sErrorCode.value () != 0) {
-        if (get_option (SHOW_ERRORS)) {
-            SHOW_ERR (L"Error iterating over \"%ls\"",
-                        pPath);
-        }
-        if (pLevel == 0) {
-            if (!get_option (SHOW_ERRORS)) {
-                wprintf (L"Error iterating over \"%ls\"", pPath);
-            }
-            sPrintSummary   = false;
-        }
+    // the path only lies below the root if the root is followed by a separator (or ends with one)
+    if (pCtx.resolvedRoot.empty () || root.empty () || pPath.compare (0, root.size (), root) != 0
+            || (restPos < pPath.size () && !is_separator (pPath[restPos]) && !is_separator (root.back ()))) {
+        return canonical_path (pPath, pErr);
+    }
 
-        return;
+    while (restPos < pPath.size () && is_separator (pPath[restPos])) {
+        ++restPos;
     }
 
-    // initialize all counters to 0
-    regularFileCnt      = 0;
-    symlinkCnt          = 0;
-    specialCnt          = 0;
-    subdirCnt           = 0;
-    totalFileSize       = 0;
+    pErr.clear ();
+    return (restPos == pPath.size ()) ? (pCtx.resolvedRoot) : (pCtx.resolvedRoot / pPath.substr (restPos));
+}
 
-    // iterate through all the files in the current path
-    for (fin = end (iter); iter != fin; ++iter) {
+/**
+ * @brief                   Returns the name to print in place of the size of a special file
+ *
+ * @param pType             Type of the special file
+ *
+ * @return const char*      Specific type of the special file (if the specific type can not be determined, "SPECIAL")
+ */
+[[nodiscard]] inline const char
+*special_type_name (const EntryType &pType) noexcept
+{
+    switch (pType) {
+    case EntryType::SOCKET: return "SOCKET";
+    case EntryType::BLOCK:  return "BLOCK DEVICE";
+    case EntryType::FIFO:   return "FIFO PIPE";
+    default:                return "SPECIAL";
+    }
+}
 
-        // get the current entry, its name and its status
-        entry           = *iter;
-        filepath        = entry.path ();
-        entryStatus     = entry.status (sErrorCode);
+/**
+ * @brief                   Returns the name to print in place of the size of a special file
+ *
+ * @param pEntry            Entry of the special file
+ *
+ * @return const char*      Specific type of the special file (if the specific type can not be determined, "SPECIAL")
+ */
+[[nodiscard]] inline const char
+*special_entry_type (const DirEntry &pEntry) noexcept
+{
+    return special_type_name ((pEntry.type == EntryType::SYMLINK) ? (pEntry.stat.type) : (pEntry.type));
+}
 
-        if (sErrorCode.value () != 0) {
-            if (get_option (SHOW_ERRORS)) {
-                SHOW_ERR (L"Error while getting status of \"%ls\"", filepath.wstring ().c_str ());
+/**
+ * @brief                   Checks whether any component of a path (as it is stored in an index) matches any of the globs
+ *                          of names that the scan skips
+ *
+ * @param pCtx              Context of the scan
+ * @param pKey              Path to check
+ *
+ * @return true             If the path lies within an entry that is skipped
+ * @return false            If none of the components of the path are skipped
+ */
+[[nodiscard]] bool
+has_excluded_component (const ScanContext &pCtx, const std::string_view &pKey)
+{
+    for (const auto &component : index_path (pKey)) {
+        if (walk_is_excluded (pCtx.filters, component.c_str (), component.native ().size ())) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief                   Reads all the entries of a directory, restoring them from the index of the previous scan
+ *                          instead if the directory has not changed since
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path of the directory to read
+ * @param pBatch            Batch to read the entries into
+ * @param pErr              Error that occoured while reading the directory
+ *
+ * @return true             If the directory was read (or restored)
+ * @return false            If the directory could not be read
+ */
+[[nodiscard]] bool
+read_dir_unprofiled (ScanContext &pCtx, const fs::path &pPath, DirBatch &pBatch, std::error_code &pErr) noexcept
+{
+    /** Identity of the directory, from before it is read */
+    DirIdentity             identity;
+    /** Error that occoured while fetching the identity (the directory is then read as usual) */
+    std::error_code         identityErr;
+    /** Directory in the index of the previous scan */
+    const IndexDir          *indexedDir;
+
+    if (pCtx.indexPath.empty ()) {
+        if (!read_dir (pPath, pBatch, pErr)) {
+            return false;
+        }
+        walk_prune_batch (pCtx.filters, pBatch);
+
+        return true;
+    }
+
+    // the identity is fetched before the directory is read, so that anything changed while reading it is read again next time
+    if (!read_dir_identity (pPath, identity, identityErr)) {
+        identity    = DirIdentity {};
+    }
+
+    indexedDir  = pCtx.prevIndex.find_dir (pPath);
+    if (indexedDir != nullptr && !identityErr
+        && indexedDir->ino == identity.ino && indexedDir->mtimeNs == identity.mtimeNs) {
+        try {
+            if (pCtx.prevIndex.restore_dir (*indexedDir, pPath, pBatch)) {
+                pBatch.identity = identity;
+                pErr.clear ();
+                return true;
+            }
+        }
+        catch (const std::bad_alloc &) {
+        }
+    }
+
+    if (!read_dir (pPath, pBatch, pErr)) {
+        return false;
+    }
+    pBatch.identity = identity;
+
+    return true;
+}
+
+/**
+ * @brief                   Reads the entries of a directory, restoring them from the index of the previous scan if the
+ *                          directory has not changed since, and counts the read in the profile of the current thread
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path of the directory to read
+ * @param pBatch            Batch to read the entries into
+ * @param pErr              Error that occoured while reading the directory
+ *
+ * @return true             If the directory was read (or restored)
+ * @return false            If the directory could not be read
+ */
+[[nodiscard]] bool
+read_dir_indexed (ScanContext &pCtx, const fs::path &pPath, DirBatch &pBatch, std::error_code &pErr) noexcept
+{
+    // the time spent waiting on the throttle is not part of reading the directory
+    if (pCtx.throttle.is_active ()) {
+        pCtx.throttle.acquire_dir ();
+    }
+
+    /** Turn of the worker to read the filesystem, if the scan is throttled */
+    const ThrottleTurn      turn ((pCtx.throttle.is_active ()) ? (&pCtx.throttle) : (nullptr), 1);
+    /** Time spent reading the directory */
+    const PhaseTimer        timer (threadProfile, ProfilePhase::READ_DIR);
+    /** Whether the directory was read */
+    const bool              isRead          = read_dir_unprofiled (pCtx, pPath, pBatch, pErr);
+
+    // the subdirectories of a restored directory are most likely restored as well, so only read ones are prefetched
+    if (isRead && !pBatch.isRestored) {
+        pCtx.prefetcher.hint (pBatch);
+    }
+
+    if (threadProfile == nullptr) {
+        return isRead;
+    }
+
+    if (!isRead) {
+        threadProfile->add_error (ProfileError::READ_DIR, pErr);
+        return false;
+    }
+
+    ++((pBatch.isRestored) ? (threadProfile->dirsRestored) : (threadProfile->dirsRead));
+    threadProfile->entriesSeen  += pBatch.entries.size ();
+
+    return true;
+}
+
+/**
+ * @brief                   Fetches the requested metadata of the entries of a batch, and counts the entries (and errors)
+ *                          in the profile of the current thread
+ *
+ * @param pCtx              Context of the scan
+ * @param pBatch            Batch whose entries to fetch the metadata of
+ */
+void
+stat_dir_profiled (ScanContext &pCtx, DirBatch &pBatch) noexcept
+{
+    /** Number of entries whose metadata is fetched (only counted if the scan is throttled) */
+    uint64_t                numStats        = 0;
+
+    if (pCtx.throttle.is_active () && !pBatch.isRestored) {
+        for (const auto &entry : pBatch.entries) {
+            numStats    += entry.statMask != 0 && !entry.statError;
+        }
+        if (numStats != 0) {
+            pCtx.throttle.acquire_stats (numStats);
+        }
+    }
+
+    /** Turn of the worker to read the filesystem, if the scan is throttled (and there is anything to fetch) */
+    const ThrottleTurn      turn ((numStats != 0) ? (&pCtx.throttle) : (nullptr), numStats);
+    /** Time spent fetching the metadata */
+    const PhaseTimer        timer (threadProfile, ProfilePhase::STAT);
+
+    stat_dir_entries (pBatch, pCtx.statMode);
+    if (threadProfile == nullptr) {
+        return;
+    }
+
+    for (const auto &entry : pBatch.entries) {
+        if (entry.statMask == 0) {
+            continue;
+        }
+
+        ++threadProfile->entriesStat;
+        if (entry.statError) {
+            threadProfile->add_error (ProfileError::STAT, entry.statError);
+        }
+    }
+}
+
+/**
+ * @brief                   Fetches the requested metadata of the entries of a batch (along with everything else the index
+ *                          stores, if the scan updates one), and adds the batch to the index of the scan
+ *
+ * @param pCtx              Context of the scan
+ * @param pBatch            Batch read by read_dir_indexed
+ */
+void
+stat_dir_indexed (ScanContext &pCtx, DirBatch &pBatch) noexcept
+{
+    /** Metadata requested by the scan for each entry, while everything the index stores is being fetched */
+    static thread_local std::vector<uint32_t>   requestedMasks;
+
+    if (pCtx.indexPath.empty ()) {
+        stat_dir_profiled (pCtx, pBatch);
+        return;
+    }
+
+    if (!pBatch.isRestored) {
+        try {
+            requestedMasks.resize (pBatch.entries.size ());
+        }
+        catch (const std::bad_alloc &) {
+            stat_dir_profiled (pCtx, pBatch);
+            return;
+        }
+
+        for (uint64_t i = 0; i < pBatch.entries.size (); ++i) {
+            requestedMasks[i]           = pBatch.entries[i].statMask;
+            pBatch.entries[i].statMask  = INDEX_STAT_MASK
+                                        | ((pBatch.entries[i].type == EntryType::SYMLINK) ? (STAT_FOLLOW) : (0));
+        }
+        stat_dir_profiled (pCtx, pBatch);
+        for (uint64_t i = 0; i < pBatch.entries.size (); ++i) {
+            pBatch.entries[i].statMask  = requestedMasks[i];
+        }
+    }
+
+    // if the directory can not be added, it is simply read again by the next scan
+    try {
+        pCtx.nextIndex.add_dir (pBatch);
+    }
+    catch (const std::bad_alloc &) {
+    }
+
+    // the index keeps every entry (later scans may not skip the same ones), so entries are only skipped once it has them
+    walk_prune_batch (pCtx.filters, pBatch);
+}
+
+/**
+ * @brief                   Returns the metadata that needs to be fetched for an entry that is printed
+ *
+ * @param pCtx              Context of the scan
+ *
+ * @return uint32_t         Combination of STAT_* bits
+ */
+[[nodiscard]] inline uint32_t
+shown_stat_mask (const ScanContext &pCtx) noexcept
+{
+    /** Metadata needed to print an entry */
+    uint32_t                mask        = 0;
+
+    // records in these formats always carry the permissions and the time of last modification, while paths carry neither
+    if (pCtx.outputFormat == OutputFormat::JSONL || pCtx.outputFormat == OutputFormat::BIN) {
+        return STAT_PERMS | STAT_MTIME;
+    }
+    if (pCtx.outputFormat == OutputFormat::NUL) {
+        return 0;
+    }
+
+#if defined (_WIN32) || defined (_WIN64)
+#else
+    if (pCtx.get_option (SHOW_PERMISSIONS)) {
+        mask    |= STAT_PERMS;
+    }
+#endif
+
+    if (pCtx.get_option (SHOW_LASTTIME)) {
+        mask    |= STAT_MTIME;
+    }
+
+    return mask;
+}
+
+/**
+ * @brief                   Works out the metadata that a scan fetches for each kind of entry (see ScanPlan)
+ *
+ * @param pCtx              Context of the scan (its options, output format and predicates must have been set)
+ */
+void
+plan_scan (ScanContext &pCtx) noexcept
+{
+    /** Metadata needed to print an entry */
+    const uint32_t          shownMask       = shown_stat_mask (pCtx);
+    /** Metadata checked by the predicates (which only apply to regular files) */
+    const uint32_t          predicateMask   = walk_filter_mask (pCtx.filters);
+    /** Sizes of regular files that are printed (paths are printed without them) */
+    const uint32_t          shownSizeMask   = (pCtx.outputFormat == OutputFormat::NUL) ? (0) : (STAT_SIZE);
+    /** Metadata that the entries of each directory are sorted by */
+    const uint32_t          sortMask        = (pCtx.sortOrder == SortOrder::SIZE) ? (STAT_SIZE)
+                                            : (pCtx.sortOrder == SortOrder::MTIME) ? (STAT_MTIME)
+                                            : (0);
+
+    // tables print the combined size of the regular files of a directory even when the files themselves are not shown
+    pCtx.plan.fileMask      = ((pCtx.outputFormat == OutputFormat::TEXT) ? (STAT_SIZE) : (0))
+                            | ((pCtx.get_option (SHOW_FILES)) ? (shownMask | shownSizeMask | predicateMask | sortMask) : (0));
+    pCtx.plan.descendMask   = walk_descend_mask (pCtx.filters);
+    pCtx.plan.dirMask       = shownMask | pCtx.plan.descendMask | (sortMask & STAT_MTIME);
+
+    // symlinks are followed to find out what they point to
+    pCtx.plan.symlinkMask   = STAT_FOLLOW | STAT_TYPE
+                            | ((pCtx.get_option (SHOW_SYMLINKS)) ? ((shownMask & STAT_PERMS) | (sortMask & STAT_MTIME)) : (0));
+    pCtx.plan.specialMask   = (pCtx.get_option (SHOW_SPECIAL)) ? ((shownMask & STAT_PERMS) | (sortMask & STAT_MTIME)) : (0);
+
+    pCtx.plan.matchMask     = shownMask | (sortMask & STAT_MTIME);
+    pCtx.plan.matchFileMask = shownSizeMask | predicateMask | sortMask;
+
+    // the identities and allocated blocks of files come along with their sizes (from the same call)
+    pCtx.plan.sizeMask      = STAT_SIZE
+                            | ((pCtx.get_option (SIZE_DEDUP_INODES)) ? (STAT_LINKS) : (0))
+                            | ((pCtx.get_option (SIZE_ALLOCATED)) ? (STAT_BLOCKS) : (0))
+                            | ((pCtx.get_option (TOP_FILES) || pCtx.get_option (SHOW_HISTOGRAMS)) ? (predicateMask) : (0))
+                            | ((pCtx.get_option (SHOW_HISTOGRAMS)) ? (STAT_MTIME) : (0));
+}
+
+/**
+ * @brief                   Returns the metadata that the walk will fetch for the regular files of each directory it reads,
+ *                          which the prefetcher fetches ahead of it
+ *
+ * @param pCtx              Context of the scan (its options, output format and predicates must have been set)
+ *
+ * @return uint32_t         Combination of STAT_* bits (0 if the walk only fetches the metadata of matches, or none at all)
+ */
+[[nodiscard]] inline uint32_t
+prefetch_file_mask (ScanContext &pCtx) noexcept
+{
+    plan_scan (pCtx);
+
+    if (pCtx.get_option (SHOW_DIR_SIZE) || pCtx.topCount != 0 || pCtx.get_option (SHOW_HISTOGRAMS)) {
+        return pCtx.plan.sizeMask;
+    }
+    if (!pCtx.searchPattern.empty () || pCtx.get_option (SEARCH_PATTERNS)) {
+        return (walk_filter_mask (pCtx.filters) != 0) ? (pCtx.plan.matchFileMask) : (0);
+    }
+
+    return pCtx.plan.fileMask;
+}
+
+/**
+ * @brief                   Returns how much a regular file adds to the sizes of the directories containing it
+ *
+ *                          If hard-linked files are only counted once, the identity of each file with more than one link
+ *                          is remembered the first time it is counted, and the file adds nothing after that. With several
+ *                          workers, the link that is counted is whichever one a worker reaches first, so only the sizes of
+ *                          directories holding every link to their files (such as the root) are the same from run to run
+ *
+ * @param pCtx              Context of the scan
+ * @param pEntry            Regular file (along with the metadata in ScanPlan::sizeMask)
+ *
+ * @return int64_t          Size of the file, or the space allocated to it (0 if it was already counted through another link)
+ */
+[[nodiscard]] int64_t
+counted_size (ScanContext &pCtx, const DirEntry &pEntry) noexcept
+{
+    if (pCtx.get_option (SIZE_DEDUP_INODES) && pEntry.stat.nlink > 1 && pEntry.stat.ino != 0) {
+
+        /** Lock held while the identity of the file is looked up (and remembered) */
+        const std::lock_guard<std::mutex>   lock (pCtx.seenInodesLock);
+
+        // if the identity can not be remembered, the file is simply counted (as it would be without the option)
+        try {
+            if (!pCtx.seenInodes.insert (pEntry.stat.dev, pEntry.stat.ino)) {
+                return 0;
+            }
+        }
+        catch (const std::bad_alloc &) {
+        }
+    }
+
+    return (pCtx.get_option (SIZE_ALLOCATED) && pEntry.stat.allocSize != -1) ? (pEntry.stat.allocSize) : (pEntry.stat.size);
+}
+
+/**
+ * @brief                   Adds a regular file to the histograms of a worker, once it has been added up
+ *
+ *                          Files that fail the predicates are left out, and so are further links to files that were
+ *                          already counted through another link (which add nothing to the sizes of directories)
+ *
+ * @param pCtx              Context of the scan
+ * @param pWorker           Index of the worker that added up the file
+ * @param pBatch            Batch containing the file
+ * @param pEntry            Regular file (along with the metadata in ScanPlan::sizeMask)
+ * @param pSize             Size that the file added to its directory (see counted_size)
+ */
+inline void
+add_to_histograms (ScanContext &pCtx, const uint32_t &pWorker, const DirBatch &pBatch, const DirEntry &pEntry,
+                    const int64_t &pSize) noexcept
+{
+    if (!walk_passes_filters (pCtx.filters, pEntry)
+        || (pSize == 0 && pCtx.get_option (SIZE_DEDUP_INODES) && pEntry.stat.nlink > 1 && pEntry.stat.size != 0)) {
+        return;
+    }
+
+    // if the extension of the file can not be remembered, the file is left out of the histograms
+    try {
+        pCtx.statsShards[pWorker].add (pSize, pEntry.stat.mtime, pBatch.name_of (pEntry), pEntry.nameLen);
+    }
+    catch (const std::bad_alloc &) {
+    }
+}
+
+/** Directory of an iterative walk that calculates sizes, whose entries are being added up */
+struct SizeFrame
+{
+    /** Entries of the directory */
+    DirBatch                *batch;
+    /** Position of the next entry of the batch to add up */
+    uint64_t                next;
+    /** Combined size of the entries added up so far */
+    int64_t                 size;
+    /** Number of levels of subdirectories below this directory whose sizes will be asked for later */
+    uint64_t                cacheLevels;
+};
+
+/**
+ * @brief                   Reads the entries of a directory whose size is being calculated, along with the sizes of its
+ *                          regular files (the directory is closed once they have been fetched)
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path of the directory
+ * @param pBatch            Batch to read the entries into
+ * @param pErr              Error that occoured while reading the directory
+ *
+ * @return true             If the directory was read
+ * @return false            If the directory could not be read
+ */
+[[nodiscard]] bool
+read_size_dir (ScanContext &pCtx, const fs::path &pPath, DirBatch &pBatch, std::error_code &pErr) noexcept
+{
+    if (!read_dir_indexed (pCtx, pPath, pBatch, pErr)) {
+        return false;
+    }
+
+    // only the sizes of regular files are needed (symlinks are followed to find out what they point to)
+    for (auto &entry : pBatch.entries) {
+        entry.statMask  = (entry.type == EntryType::REGULAR) ? (pCtx.plan.sizeMask)
+                        : (entry.type == EntryType::SYMLINK) ? (STAT_FOLLOW | STAT_TYPE | pCtx.plan.sizeMask)
+                        : (entry.type == EntryType::DIRECTORY) ? (pCtx.plan.descendMask)
+                        : (0);
+    }
+    stat_dir_indexed (pCtx, pBatch);
+    pBatch.close ();
+
+    return true;
+}
+
+/**
+ * @brief                   Calculates and returns the size of a directory in bytes (-1 if the size can not be found out)
+ *
+ *                          The tree is walked depth-first with an explicit stack of the directories whose entries are
+ *                          being added up (each of which is closed before its subdirectories are read), so the depth of
+ *                          the tree is only limited by memory, and a single directory is open at a time. The sizes of the
+ *                          subdirectories found along the way are aggregated bottom-up from their own totals, and the
+ *                          ones that lie within pCacheLevels levels below pPath are remembered in the size cache of the
+ *                          scan, so that the scan can reuse them instead of walking the same subtree again
+ *
+ * @param pCtx              Context of the scan
+ * @param pOut              Writer to write the output to
+ * @param pPath             Path to the directory whose size needs to be calculated
+ * @param pCacheLevels      Number of levels of subdirectories below pPath whose sizes will be asked for later
+ *
+ * @return int64_t          Size of the directory (-1 if size could not be calculated)
+ */
+[[nodiscard]] int64_t
+calc_dir_size (ScanContext &pCtx, OutputWriter &pOut, const fs::path &pPath, const uint64_t &pCacheLevels = 0) noexcept
+{
+    /** Container for error codes reported while reading the directory */
+    std::error_code         errorCode;
+
+    /** Batches of the levels of the walk (reused for every directory of the same level) */
+    static thread_local BatchStack  batches;
+    /** Directories whose entries are being added up, from the one the walk started from to the deepest one */
+    static thread_local std::vector<SizeFrame>  frames;
+
+    /** Path of the current subdirectory */
+    fs::path                subdirPath;
+    /** Iterator to the size of the current directory, if it was already calculated while aggregating one of its ancestors */
+    std::unordered_map<fs::path::string_type, int64_t>::iterator    cached;
+
+    /** Stores whether the current entry is a directory */
+    bool                    isDir;
+    /** Stores whether the current entry is a regular file */
+    bool                    isFile;
+    /** Stores whether the current entry is a symlink */
+    bool                    isSymlink;
+    /** Stores whether the current entry is a special file */
+    bool                    isSpecial;
+
+    /** Size of the subdirectory that was added up last */
+    int64_t                 curDirSize;
+    /** Size of the regular file that was added up last */
+    int64_t                 curFileSize;
+
+    // each cached size is asked for exactly once (by the call that lists the parent directory), so it can be released
+    cached      = (pCtx.dirSizeCache.empty ()) ? (pCtx.dirSizeCache.end ()) : (pCtx.dirSizeCache.find (pPath.native ()));
+    if (cached != pCtx.dirSizeCache.end ()) {
+
+        /** Size of the directory, as remembered by the cache */
+        const int64_t       cachedSize      = cached->second;
+
+        pCtx.dirSizeCache.erase (cached);
+        return cachedSize;
+    }
+
+    /** Time spent walking the directory */
+    const PhaseTimer        timer (threadProfile, ProfilePhase::DIR_SIZE);
+
+    if (threadProfile != nullptr) {
+        ++threadProfile->sizeWalks;
+    }
+
+    // if an error occoured while trying to read the directory, then report it here
+    if (!read_size_dir (pCtx, pPath, batches.at (0), errorCode)) {
+        if (pCtx.get_option (SHOW_ERRORS)) {
+            SHOW_ERR (errorCode, L"Error while creating directory iterator for \"" PATH_FMT L"\"",
+                    pPath.c_str ());
+        }
+        return -1;
+    }
+
+    frames.clear ();
+    frames.push_back (SizeFrame {&batches.at (0), 0, 0, pCacheLevels});
+
+    while (true) {
+
+        /** Directory whose entries are being added up */
+        SizeFrame           &frame          = frames.back ();
+        /** Entries of the directory */
+        DirBatch            &batch          = *frame.batch;
+
+        // once all its entries have been added up, the size of the directory is added to its parent
+        if (frame.next == batch.entries.size ()) {
+            curDirSize      = frame.size;
+            frames.pop_back ();
+
+            if (frames.empty ()) {
+                return curDirSize;
+            }
+
+            // if the scan will ask for the size later, remember it (failures are remembered as well, so they are only reported once)
+            if (frames.back ().cacheLevels != 0) {
+                pCtx.dirSizeCache.emplace (batch.dirPath.native (), curDirSize);
+            }
+            if (pCtx.get_option (TOP_DIRS) && pCtx.topShards[0].admits (curDirSize)) {
+                pCtx.topShards[0].offer (curDirSize, EntryType::DIRECTORY, batch.dirPath.native ());
+            }
+            if (curDirSize != -1) {
+                frames.back ().size    += curDirSize;
+            }
+            continue;
+        }
+
+        /** Entry that is being currently processed */
+        const DirEntry      &entry          = batch.entries[frame.next++];
+
+        // skip this entry if the status is not available
+        if (entry.statError && entry.type != EntryType::REGULAR) {
+            if (pCtx.get_option (SHOW_ERRORS)) {
+                SHOW_ERR (entry.statError, L"Error while getting status of \"" PATH_FMT L"\"", batch.path_of (entry).c_str ());
+            }
+            continue;
+        }
+
+        // find out the type of the entry
+        classify_entry (entry, isDir, isFile, isSymlink, isSpecial);
+
+        // check if the entry is a regular file
+        if (isFile) {
+            // add the size of the current file to the total size of the directory
+            // if the size can not be read, don't add it to the final size
+            if (entry.statError) {
+                if (pCtx.get_option (SHOW_ERRORS)) {
+                    SHOW_ERR (entry.statError, L"Error while reading size of file \"" PATH_FMT L"\"",
+                                batch.path_of (entry).c_str ());
+                }
+            }
+            else {
+                curFileSize     = counted_size (pCtx, entry);
+                frame.size      += curFileSize;
+
+                // the path of a file is only built if it is among the largest ones so far
+                if (pCtx.get_option (TOP_FILES) && !isSymlink && pCtx.topShards[0].admits (curFileSize)
+                    && walk_passes_filters (pCtx.filters, entry)) {
+                    pCtx.topShards[0].offer (curFileSize, EntryType::REGULAR, batch.build_path (entry));
+                }
+                if (pCtx.get_option (SHOW_HISTOGRAMS) && !isSymlink) {
+                    add_to_histograms (pCtx, 0, batch, entry, curFileSize);
+                }
+            }
+        }
+        // check if the entry is a directory and make sure it is not a symlink (prevents circular scanning)
+        else if (isDir && !isSymlink && walk_stays_on_filesystem (pCtx.filters, pCtx.rootDev, entry)) {
+            subdirPath      = batch.build_path (entry);
+
+            // the size of the subdirectory is aggregated from its own entries (the subtree is only walked once)
+            // unless it was already calculated, or can not be read at all
+            cached          = (pCtx.dirSizeCache.empty ()) ? (pCtx.dirSizeCache.end ())
+                            : (pCtx.dirSizeCache.find (subdirPath.native ()));
+            if (cached != pCtx.dirSizeCache.end ()) {
+                curDirSize      = cached->second;
+                pCtx.dirSizeCache.erase (cached);
+            }
+            else if (read_size_dir (pCtx, subdirPath, batches.at (frames.size ()), errorCode)) {
+                frames.push_back (SizeFrame {&batches.at (frames.size ()), 0, 0,
+                                                (frame.cacheLevels == UINT64_MAX) ? (UINT64_MAX)
+                                                : (frame.cacheLevels == 0) ? (0) : (frame.cacheLevels - 1)});
+                continue;
+            }
+            else {
+                if (pCtx.get_option (SHOW_ERRORS)) {
+                    SHOW_ERR (errorCode, L"Error while creating directory iterator for \"" PATH_FMT L"\"",
+                            subdirPath.c_str ());
+                }
+                curDirSize      = -1;
+            }
+
+            if (frame.cacheLevels != 0) {
+                pCtx.dirSizeCache.emplace (subdirPath.native (), curDirSize);
+            }
+            if (curDirSize != -1) {
+                frame.size      += curDirSize;
+            }
+        }
+        // if the file is not of a known type, skip it
+        else if (!isSpecial && !isSymlink) {
+            if (pCtx.outputFormat != OutputFormat::TEXT) {
+                continue;
+            }
+            pOut.write ("File type of \"");
+            pOut.write_path (batch.path_of (entry));
+            pOut.write ("\" can not be determined");
+            pOut.end_line ();
+            continue;
+        }
+    }
+}
+
+/**
+ * @brief                   Writes the line of a single entry (its size or type, the indentation and its name)
+ *
+ * @param pOut              Writer to write the line to
+ * @param pColumn           Size or type of the entry (right-aligned within 16 columns)
+ * @param pIndentWidth      Number of spaces to indent the name with (-1 if the name is not indented at all)
+ * @param pName             Name (or path) of the entry
+ * @param pIsDir            Whether the entry is a directory (directories are enclosed in angle brackets)
+ * @param pTarget           Target of the entry if it is a symlink (nullptr otherwise)
+ * @param pPattern          Pattern that the entry matched, if the search has more than one (nullptr otherwise)
+ */
+void
+write_entry_line (OutputWriter &pOut, const char *pColumn, const int64_t &pIndentWidth, const PathView &pName,
+                    const bool &pIsDir, const fs::path *pTarget = nullptr, const std::string *pPattern = nullptr)
+{
+    pOut.write_padded (pColumn, 16);
+    pOut.write ("    ", 4);
+
+    // the indentation always takes up at least one column (as "%-*c" would)
+    if (pIndentWidth != -1) {
+        pOut.write_repeat (' ', (pIndentWidth == 0) ? (1) : ((uint64_t)pIndentWidth));
+    }
+
+    if (pIsDir) {
+        pOut.write ("<", 1);
+    }
+    pOut.write_path (pName);
+    if (pIsDir) {
+        pOut.write (">", 1);
+    }
+
+    if (pTarget != nullptr) {
+        pOut.write ((pIsDir) ? (" -> <") : (" -> "));
+        pOut.write_path (*pTarget);
+        if (pIsDir) {
+            pOut.write (">", 1);
+        }
+    }
+
+    if (pPattern != nullptr) {
+        pOut.write ("    [", 5);
+        pOut.write (pPattern->data (), pPattern->size ());
+        pOut.write ("]", 1);
+    }
+
+    pOut.end_line ();
+}
+
+/**
+ * @brief                   Writes the line summarizing the entries of a type that were not shown within a directory
+ *
+ * @param pOut              Writer to write the line to
+ * @param pColumn           Combined size of the entries (or "-"), right-aligned within 16 columns
+ * @param pIndentWidth      Number of spaces to indent the summary with
+ * @param pCount            Number of entries, formatted
+ * @param pKind             Type of entries being summarized
+ * @param pDir              Path of the directory the entries are within, if it is not the entry printed above them (nullptr
+ *                          otherwise)
+ */
+void
+write_count_line (OutputWriter &pOut, const char *pColumn, const uint64_t &pIndentWidth, const char *pCount,
+                    const char *pKind, const PathView *pDir = nullptr)
+{
+    pOut.write_padded (pColumn, 16);
+    pOut.write ("    ", 4);
+    pOut.write_repeat (' ', (pIndentWidth == 0) ? (1) : (pIndentWidth));
+    pOut.write ("<", 1);
+    pOut.write (pCount);
+    pOut.write (" ", 1);
+    pOut.write (pKind);
+    pOut.write (">", 1);
+    if (pDir != nullptr) {
+        pOut.write (" in <", 5);
+        pOut.write_path (*pDir);
+        pOut.write (">", 1);
+    }
+    pOut.end_line ();
+}
+
+/**
+ * @brief                   Writes the record of a single entry in the machine-readable format of the scan
+ *
+ * @param pCtx              Context of the scan
+ * @param pOut              Writer to write the record to
+ * @param pPath             Path of the entry
+ * @param pEntry            Entry whose metadata is written
+ * @param pSize             Size of the entry (-1 if it is not known or not shown)
+ * @param pTarget           Target of the entry if it is a symlink (nullptr otherwise)
+ * @param pPattern          Pattern that the entry matched, if the search has more than one (nullptr otherwise)
+ */
+void
+write_entry_record (const ScanContext &pCtx, OutputWriter &pOut, const PathView &pPath, const DirEntry &pEntry,
+                    const int64_t &pSize, const fs::path *pTarget = nullptr, const std::string *pPattern = nullptr)
+{
+    /** Record that is written out */
+    EntryRecord             record {pPath, pTarget, pPattern, pEntry.type, 0, pSize, 0, fs::perms::none};
+
+    // the metadata of a symlink belongs to whatever it points to, so only its target is written
+    if (pEntry.type != EntryType::SYMLINK && !pEntry.statError) {
+        if (pEntry.statMask & STAT_PERMS) {
+            record.fields   |= RECORD_HAS_PERMS;
+            record.perms    = pEntry.stat.perms;
+        }
+        if (pEntry.statMask & STAT_MTIME) {
+            record.fields   |= RECORD_HAS_MTIME;
+            record.mtime    = pEntry.stat.mtime;
+        }
+    }
+    if (pSize != -1) {
+        record.fields       |= RECORD_HAS_SIZE;
+    }
+
+    pOut.write_record (pCtx.outputFormat, record);
+}
+
+/** Options of a listing that its kernels are specialised on (any other option is checked while listing) */
+#define KERNEL_OPTIONS          ((1ULL << SHOW_FILES) | (1ULL << SHOW_SYMLINKS) | (1ULL << SHOW_SPECIAL)         \
+                                | (1ULL << SHOW_PERMISSIONS) | (1ULL << SHOW_LASTTIME) | (1ULL << SHOW_ABSNOINDENT))
+
+/** Options that a kernel of a listing is compiled for */
+struct KernelSpec
+{
+    /** Which of KERNEL_OPTIONS are set */
+    uint64_t                options;
+    /** Whether the listing is printed as text (rather than as records) */
+    bool                    isText;
+    /** Whether the kernel checks every option while listing instead (so that it handles any combination of them) */
+    bool                    isGeneric;
+};
+
+/** Kernel that handles any combination of options */
+inline constexpr KernelSpec genericKernel {0, false, true};
+
+/** Number of combinations of options that text listings have specialised kernels for */
+#define KERNEL_COMBINATIONS     (16)
+
+/**
+ * @brief                   Returns one of the combinations of options that text listings have specialised kernels for
+ *                          (every combination of showing files, permissions, times and absolute paths, with symlinks and
+ *                          special files summarised)
+ *
+ * @param pIndex            Position of the combination (below KERNEL_COMBINATIONS), each bit of which selects an option
+ *
+ * @return uint64_t         Options of the combination (a subset of KERNEL_OPTIONS)
+ */
+[[nodiscard]] constexpr uint64_t
+kernel_options (const uint64_t &pIndex) noexcept
+{
+    return (((pIndex & 1) != 0) ? (1ULL << SHOW_FILES) : (0))
+            | (((pIndex & 2) != 0) ? (1ULL << SHOW_PERMISSIONS) : (0))
+            | (((pIndex & 4) != 0) ? (1ULL << SHOW_LASTTIME) : (0))
+            | (((pIndex & 8) != 0) ? (1ULL << SHOW_ABSNOINDENT) : (0));
+}
+
+/**
+ * @brief                   Checks whether an option of a scan is set, at compile time if the kernel is specialised on it
+ *
+ * @tparam spec_v           Options that the kernel is compiled for
+ * @tparam option_v         Option to check
+ *
+ * @param pCtx              Context of the scan
+ *
+ * @return true             If the option is set
+ * @return false            If the option is cleared
+ */
+template <KernelSpec spec_v, uint8_t option_v>
+[[nodiscard]] inline bool
+has_option (const ScanContext &pCtx) noexcept
+{
+    if constexpr (!spec_v.isGeneric && (KERNEL_OPTIONS & (1ULL << option_v)) != 0) {
+        (void)pCtx;
+        return (spec_v.options & (1ULL << option_v)) != 0;
+    }
+    else {
+        return pCtx.get_option (option_v);
+    }
+}
+
+/**
+ * @brief                   Checks whether a scan is printed as text, at compile time unless the kernel is generic
+ *
+ * @tparam spec_v           Options that the kernel is compiled for
+ *
+ * @param pCtx              Context of the scan
+ *
+ * @return true             If the scan is printed as text
+ * @return false            If the scan is printed as records
+ */
+template <KernelSpec spec_v>
+[[nodiscard]] inline bool
+is_text (const ScanContext &pCtx) noexcept
+{
+    if constexpr (!spec_v.isGeneric) {
+        (void)pCtx;
+        return spec_v.isText;
+    }
+    else {
+        return pCtx.outputFormat == OutputFormat::TEXT;
+    }
+}
+
+/**
+ * @brief                   Writes the columns of the permissions and the time of last modification that precede the line
+ *                          of an entry (whichever of them are shown)
+ *
+ * @tparam spec_v           Options that the kernel is compiled for
+ *
+ * @param pCtx              Context of the scan
+ * @param pOut              Writer to write the columns to
+ * @param pEntry            Entry whose metadata is written
+ * @param pHasTime          Whether the entry has a time to show (the column is left blank otherwise)
+ */
+template <KernelSpec spec_v>
+inline void
+write_entry_columns (const ScanContext &pCtx, OutputWriter &pOut, const DirEntry &pEntry, const bool &pHasTime)
+{
+#if defined (_WIN32) || defined (_WIN64)
+#else
+    if (has_option<spec_v, SHOW_PERMISSIONS> (pCtx)) {
+        pOut.write_permissions (pEntry.stat.perms);
+    }
+#endif
+
+    if (has_option<spec_v, SHOW_LASTTIME> (pCtx)) {
+        if (pHasTime) {
+            pOut.write_time (pEntry.stat.mtime);
+        }
+        else {
+            pOut.write_repeat (' ', 20);
+        }
+    }
+}
+
+/** Directory that a breadth-first traversal is yet to read */
+struct PendingDir
+{
+    /** Path of the directory */
+    fs::path                path;
+    /** Level of the directory below the path from which the traversal started */
+    uint64_t                level;
+};
+
+/** Directory of an iterative listing, whose entries are being listed */
+struct ScanFrame
+{
+    /** Entries of the directory */
+    DirBatch                *batch              {nullptr};
+    /** Position of the next entry of the batch to list */
+    uint64_t                next                {};
+    /** Level of the directory below the path from which the scan started */
+    uint64_t                level               {};
+
+    /** Combines sizes of all files within this directory */
+    int64_t                 totalFileSize       {};
+    /** Number of symlinks in the directory */
+    uint64_t                symlinkCnt          {};
+    /** Number of regular files within the directory */
+    uint64_t                regularFileCnt      {};
+    /** Number of special files in the directory */
+    uint64_t                specialCnt          {};
+    /** Number of sub-directories in the directory */
+    uint64_t                subdirCnt           {};
+};
+
+/**
+ * @brief                   Returns the number of levels below each subdirectory of a listed directory which will be listed
+ *                          as well (and whose sizes will be asked for again)
+ *
+ * @param pCtx              Context of the scan
+ * @param pLevel            Level of the listed directory below the path from which the scan started
+ *
+ * @return uint64_t         Number of levels (UINT64_MAX if every level is listed)
+ */
+[[nodiscard]] inline uint64_t
+listed_cache_levels (const ScanContext &pCtx, const uint64_t &pLevel) noexcept
+{
+    return (pCtx.filters.maxDepth == UINT64_MAX) ? (UINT64_MAX) : (pCtx.filters.maxDepth - pLevel);
+}
+
+/**
+ * @brief                   Reads the entries of a directory that is being listed, along with the metadata worked out by
+ *                          the plan of the scan (the directory is closed once it has been fetched), and sorts them if
+ *                          the scan is sorted
+ *
+ *                          Directories are sorted by size only if their sizes are printed. Their sizes are then calculated
+ *                          here, before any entry of the directory is printed, and left in the size cache of the scan for
+ *                          the listing to pick up
+ *
+ * @param pCtx              Context of the scan
+ * @param pOut              Writer to write the output to
+ * @param pPath             Path of the directory
+ * @param pLevel            Level of the directory below the path from which the scan started
+ * @param pBatch            Batch to read the entries into
+ * @param pErr              Error that occoured while reading the directory
+ *
+ * @return true             If the directory was read
+ * @return false            If the directory could not be read
+ */
+[[nodiscard]] bool
+read_scan_dir (ScanContext &pCtx, OutputWriter &pOut, const fs::path &pPath, const uint64_t &pLevel, DirBatch &pBatch,
+                std::error_code &pErr) noexcept
+{
+    /** Sorter of the entries (reused for every directory) */
+    static thread_local EntryOrder  order;
+
+    /** Size of the current subdirectory */
+    int64_t                 dirSize;
+
+    if (!read_dir_indexed (pCtx, pPath, pBatch, pErr)) {
+        return false;
+    }
+
+    // fetch only the metadata that will be printed or checked, as worked out by the plan of the scan
+    for (auto &entry : pBatch.entries) {
+        switch (entry.type) {
+        case EntryType::REGULAR:
+            entry.statMask  = pCtx.plan.fileMask;
+            break;
+        case EntryType::DIRECTORY:
+            entry.statMask  = pCtx.plan.dirMask;
+            break;
+        case EntryType::SYMLINK:
+            entry.statMask  = pCtx.plan.symlinkMask;
+            break;
+        default:
+            entry.statMask  = pCtx.plan.specialMask;
+            break;
+        }
+    }
+    stat_dir_indexed (pCtx, pBatch);
+
+    // the metadata of the entries has been fetched, so the directory does not need to stay open while its subdirectories are read
+    pBatch.close ();
+
+    if (pCtx.sortOrder == SortOrder::NONE) {
+        return true;
+    }
+
+    // if the entries can not be sorted, they are listed in the order the directory returned them
+    try {
+        order.prepare (pBatch, pCtx.sortOrder);
+
+        if (pCtx.sortOrder == SortOrder::SIZE && pCtx.get_option (SHOW_DIR_SIZE)) {
+            for (uint64_t i = 0; i < pBatch.entries.size (); ++i) {
+
+                /** Entry that is being currently processed */
+                const DirEntry  &entry      = pBatch.entries[i];
+
+                if (entry.type != EntryType::DIRECTORY || entry.statError || !walk_stays_on_filesystem (pCtx.filters, pCtx.rootDev, entry)) {
+                    continue;
+                }
+
+                dirSize     = calc_dir_size (pCtx, pOut, pBatch.path_of (entry), listed_cache_levels (pCtx, pLevel));
+                pCtx.dirSizeCache.emplace (pBatch.path_of (entry).native (), dirSize);
+                order.set_key (i, EntryOrder::size_key (dirSize));
+            }
+        }
+
+        order.apply (pBatch);
+    }
+    catch (const std::bad_alloc &) {
+    }
+
+    return true;
+}
+
+/**
+ * @brief                   Adds the entries of a directory that has been listed to the counters of the scan, and prints
+ *                          the summary of the entries that were not shown
+ *
+ * @tparam spec_v           Options that the kernel is compiled for
+ *
+ * @param pCtx              Context of the scan
+ * @param pOut              Writer to write the output to
+ * @param pFrame            Directory that has been listed
+ */
+template <KernelSpec spec_v>
+void
+finish_scan_dir (ScanContext &pCtx, OutputWriter &pOut, const ScanFrame &pFrame) noexcept
+{
+    /** Whether entries are printed by their paths rather than indented below their directories (breadth-first, the
+        contents of a directory are not printed below its own line) */
+    const bool              isPathShown     = has_option<spec_v, SHOW_ABSNOINDENT> (pCtx) || pCtx.get_option (TRAVERSE_BFS);
+    /** Number of spaces to enter before printing the summary of the directory */
+    const uint64_t          indentWidth     = (!isPathShown) ? (INDENT_COL_WIDTH * pFrame.level)
+                                            : (pFrame.level == 0) ? (0) : (INDENT_COL_WIDTH);
+
+    /** Container for error codes reported while resolving the path of the directory */
+    std::error_code         errorCode;
+    /** Path of the directory, printed along with its summary breadth-first (absolute if the paths of entries are) */
+    fs::path                dirPath;
+    /** Path of the directory that the summary names (nullptr if it follows the line of the directory itself) */
+    const PathView          *dirName        = nullptr;
+    /** View of the path of the directory that the summary names */
+    PathView                dirView;
+
+    /** Counters of the scan (a sequential scan only uses the first shard) */
+    ScanCounters            &counter        = pCtx.counters[0];
+
+    /** Buffer to store the total size of files formatted with periods */
+    char                    fmtIntBuff[MAX_FMT_INT_LEN];
+    /** Buffer to store the number of entries of a type formatted with periods */
+    char                    fmtCntBuff[MAX_FMT_INT_LEN];
+
+
+    counter.numFilesTotal       += pFrame.regularFileCnt;
+    counter.numSymlinksTotal    += pFrame.symlinkCnt;
+    counter.numSpecialTotal     += pFrame.specialCnt;
+    counter.numDirsTotal        += pFrame.subdirCnt;
+
+    if (pFrame.level == 0) {
+        counter.numFilesRoot        += pFrame.regularFileCnt;
+        counter.numSymlinksRoot     += pFrame.symlinkCnt;
+        counter.numSpecialRoot      += pFrame.specialCnt;
+        counter.numDirsRoot         += pFrame.subdirCnt;
+    }
+
+    // scanning is complete, now print the summary of the current directory if this function call was not for scanning
+    // (the machine-readable formats only have records of the entries themselves)
+    if (!is_text<spec_v> (pCtx)) {
+        return;
+    }
+
+    // breadth-first, the summary follows the contents of the other directories of the level rather than the line of its
+    // own directory, so it names the directory (falling back to the path of the walk if it can not be resolved)
+    if (pCtx.get_option (TRAVERSE_BFS)
+        && ((pFrame.regularFileCnt != 0 && !has_option<spec_v, SHOW_FILES> (pCtx))
+            || (pFrame.symlinkCnt != 0 && !has_option<spec_v, SHOW_SYMLINKS> (pCtx))
+            || (pFrame.specialCnt != 0 && !has_option<spec_v, SHOW_SPECIAL> (pCtx)))) {
+
+        if (has_option<spec_v, SHOW_ABSNOINDENT> (pCtx)) {
+            dirPath     = resolved_path (pCtx, pFrame.batch->dirPath.native (), errorCode);
+        }
+        if (!has_option<spec_v, SHOW_ABSNOINDENT> (pCtx) || errorCode.value () != 0) {
+            dirPath     = pFrame.batch->dirPath;
+        }
+        dirView     = dirPath.native ();
+        dirName     = &dirView;
+    }
+
+    // if the current dir has some files and the show files option was not set (they were not displayed), then print the number of files atleast
+    if (pFrame.regularFileCnt != 0 && !has_option<spec_v, SHOW_FILES> (pCtx)) {
+
+#if defined (_WIN32) || defined (_WIN64)
+#else
+        // if the permissions and last modification options are set, print gaps before the directory's summary to format it better
+        if (has_option<spec_v, SHOW_PERMISSIONS> (pCtx)) {
+            pOut.write_repeat (' ', 12);
+        }
+#endif
+
+        if (has_option<spec_v, SHOW_LASTTIME> (pCtx)) {
+            pOut.write_repeat (' ', 20);
+        }
+
+        format_int (pFrame.totalFileSize, fmtIntBuff);
+
+        // if either of the noindent options were set, then dont print the indentations for this directory
+        // (a single indent is still printed if this is not the root dir)
+        write_count_line (pOut,
+                            fmtIntBuff,
+                            indentWidth,
+                            format_int (pFrame.regularFileCnt, fmtCntBuff),
+                            "files",
+                            dirName);
+
+    }
+    // if the current dir has some symlinks and the show symlinks option was not set (they were not displayed), then print the number of symlinks atleast
+    if (pFrame.symlinkCnt != 0 && !has_option<spec_v, SHOW_SYMLINKS> (pCtx)) {
+
+#if defined (_WIN32) || defined (_WIN64)
+#else
+        // if the permissions and last modification options are set, print gaps before the directory's summary to format it better
+        if (has_option<spec_v, SHOW_PERMISSIONS> (pCtx)) {
+            pOut.write_repeat (' ', 12);
+        }
+#endif
+
+        if (has_option<spec_v, SHOW_LASTTIME> (pCtx)) {
+            pOut.write_repeat (' ', 20);
+        }
+
+        // if either of the noindent options were set, then dont print the indentations for this directory
+        // (a single indent is still printed if this is not the root dir)
+        write_count_line (pOut,
+                            "-",
+                            indentWidth,
+                            format_int (pFrame.symlinkCnt, fmtCntBuff),
+                            "symlinks",
+                            dirName);
+
+    }
+    // if the current dir has some files and the show files option was not set (they were not displayed), then print the number of files atleast
+    if (pFrame.specialCnt != 0 && !has_option<spec_v, SHOW_SPECIAL> (pCtx)) {
+
+#if defined (_WIN32) || defined (_WIN64)
+#else
+        // if the permissions and last modification options are set, print gaps before the directory's summary to format it better
+        if (has_option<spec_v, SHOW_PERMISSIONS> (pCtx)) {
+            pOut.write_repeat (' ', 12);
+        }
+#endif
+
+        if (has_option<spec_v, SHOW_LASTTIME> (pCtx)) {
+            pOut.write_repeat (' ', 20);
+        }
+
+        // if either of the noindent options were set, then dont print the indentations for this directory
+        // (a single indent is still printed if this is not the root dir)
+        write_count_line (pOut,
+                            "-",
+                            indentWidth,
+                            format_int (pFrame.specialCnt, fmtCntBuff),
+                            "special entries",
+                            dirName);
+    }
+}
+
+/**
+ * @brief                   Scans through and prints the contents of a directory
+ *
+ *                          The tree is walked with an explicit stack of the directories being listed (each of which is
+ *                          closed before its subdirectories are read), so the depth of the tree is only limited by memory,
+ *                          and a single directory is open at a time. Depth-first, the contents of each subdirectory are
+ *                          listed right below it, while breadth-first each level is listed before the next one
+ *
+ *                          The options that change what is printed for each entry are fixed at compile time unless the
+ *                          kernel is generic, so the checks of those that are cleared (and the code they guard) are dropped
+ *                          from the loop
+ *
+ * @tparam spec_v           Options that the kernel is compiled for
+ *
+ * @param pCtx              Context of the scan
+ * @param pOut              Writer to write the output to
+ * @param pPath             Path to the directory to scan
+ */
+template <KernelSpec spec_v>
+void
+scan_path_kernel (ScanContext &pCtx, OutputWriter &pOut, const fs::path &pPath) noexcept
+{
+    /** Container for error codes reported by std::filesystem */
+    std::error_code         errorCode;
+
+    /** Batches of the levels of the scan (reused for every directory of the same level) */
+    static thread_local BatchStack  batches;
+    /** Directories being listed, from the one the scan started from to the deepest one */
+    static thread_local std::vector<ScanFrame>  frames;
+    /** Directories that a breadth-first scan is yet to read, in the order in which they are read */
+    std::deque<PendingDir>  pending;
+
+    /** Path of the current entry (held by the batch, or by absPath if the absolute path is shown) */
+    PathView                filepath;
+    /** Absolute path of the current entry (only built if the absolute paths of entries are shown) */
+    fs::path                absPath;
+    /** Path of the current subdirectory (as it is walked) */
+    fs::path                subdirPath;
+
+    /** Stores whether the current entry is a directory */
+    bool                    isDir;
+    /** Stores whether the current entry is a regular file */
+    bool                    isFile;
+    /** Stores whether the current entry is a symlink */
+    bool                    isSymlink;
+    /** Stores whether the current entry is a special file */
+    bool                    isSpecial;
+    /** Stores whether the current entry is listed individually */
+    bool                    isListed;
+    /** Stores whether the current entry is a directory that the scan enters */
+    bool                    isEntered;
+
+    /** Size of file that is being currently processed */
+    int64_t                 curFileSize;
+
+    /** Stores the path to the target of the symlink if the entry is a symlink */
+    fs::path                targetPath;
+
+    /** Stores the specific type of an entry if it is a special entry (if the specific type can not be determined, stores L"SPECIAL") */
+    const char              *specialEntryType;
+
+    /** Buffer to store the size of the current entry formatted with periods */
+    char                    fmtIntBuff[MAX_FMT_INT_LEN];
+
+    // if an error occoured while trying to read the directory, then report it here
+    if (!read_scan_dir (pCtx, pOut, pPath, 0, batches.at (0), errorCode)) {
+        if (has_option<spec_v, SHOW_ERRORS> (pCtx)) {
+            SHOW_ERR (errorCode, L"Error iterating over \"" PATH_FMT L"\"",
+                        pPath.c_str ());
+        }
+        if (!has_option<spec_v, SHOW_ERRORS> (pCtx) && is_text<spec_v> (pCtx)) {
+            pOut.write ("Error iterating over \"");
+            pOut.write_path (pPath);
+            pOut.write ("\"");
+        }
+        pCtx.printSummary   = false;
+
+        return;
+    }
+
+    frames.clear ();
+    frames.push_back (ScanFrame {&batches.at (0), 0, 0});
+
+    while (!frames.empty ()) {
+
+        /** Directory being listed */
+        ScanFrame           &frame          = frames.back ();
+        /** Entries of the directory */
+        DirBatch            &batch          = *frame.batch;
+
+        // once all its entries have been listed, the summary of the directory is printed
+        // (breadth-first, the next pending directory is read once the current one is done)
+        if (frame.next == batch.entries.size ()) {
+            finish_scan_dir<spec_v> (pCtx, pOut, frame);
+            frames.pop_back ();
+
+            while (frames.empty () && !pending.empty ()) {
+
+                /** Level of the pending directory */
+                const uint64_t  level           = pending.front ().level;
+
+                subdirPath      = std::move (pending.front ().path);
+                pending.pop_front ();
+
+                if (read_scan_dir (pCtx, pOut, subdirPath, level, batches.at (0), errorCode)) {
+                    frames.push_back (ScanFrame {&batches.at (0), 0, level});
+                }
+                else if (has_option<spec_v, SHOW_ERRORS> (pCtx)) {
+                    SHOW_ERR (errorCode, L"Error iterating over \"" PATH_FMT L"\"", subdirPath.c_str ());
+                }
+            }
+            continue;
+        }
+
+        /** Number of levels below each subdirectory of this directory which will be listed as well (and whose sizes will be needed) */
+        const uint64_t      cacheLevels     = listed_cache_levels (pCtx, frame.level);
+
+        /** Whether the entry is printed by its path rather than its name, as breadth-first it is not printed below its directory */
+        const bool          isPathShown     = has_option<spec_v, SHOW_ABSNOINDENT> (pCtx) || has_option<spec_v, TRAVERSE_BFS> (pCtx);
+        /** Number of spaces to indent the name of an entry with (-1 if the path is printed without indentation) */
+        const int64_t       lineIndent      = (isPathShown) ? (-1) : ((int64_t)(INDENT_COL_WIDTH * frame.level));
+
+        /** Entry that is being currently processed */
+        const DirEntry      &entry          = batch.entries[frame.next++];
+
+        // get the path of the current entry (built in place, within the batch)
+        filepath        = batch.build_path (entry);
+
+        // the size of a regular file not being readable is reported further below
+        if (entry.statError && entry.type != EntryType::REGULAR) {
+            if (has_option<spec_v, SHOW_ERRORS> (pCtx)) {
+                SHOW_ERR (entry.statError, L"Error while getting status of \"" PATH_FMT L"\"", batch.path_of (entry).c_str ());
+            }
+            continue;
+        }
+
+        // find out the type of the entry
+        classify_entry (entry, isDir, isFile, isSymlink, isSpecial);
+
+        // the predicates are checked before anything is formatted, and only the entries that are listed get their own path
+        isListed        = (isSymlink) ? (has_option<spec_v, SHOW_SYMLINKS> (pCtx))
+                        : (isFile) ? (has_option<spec_v, SHOW_FILES> (pCtx) && walk_passes_filters (pCtx.filters, entry))
+                        : (isSpecial) ? (has_option<spec_v, SHOW_SPECIAL> (pCtx))
+                        : (true);
+
+        if (has_option<spec_v, SHOW_ABSNOINDENT> (pCtx) && isListed) {
+
+            // if the entry is a symlink, it is necessary to use the absolute path as the canonical path will evaluate and return the target
+            // (below the root, only the directory of the symlink is resolved, from the root that was resolved before the scan started)
+            absPath     = (!isSymlink) ? (resolved_path (pCtx, filepath, errorCode))
+                        : (frame.level == 0) ? (fs::absolute (batch.path_of (entry), errorCode))
+                        : (resolved_path (pCtx, batch.dirPath.native (), errorCode) / batch.name_of (entry));
+            filepath    = absPath.native ();
+
+            if (errorCode.value () != 0) {
+                if (has_option<spec_v, SHOW_ERRORS> (pCtx)) {
+                    SHOW_ERR (errorCode, L"Error while converting filepath to canonical value for \"" PATH_FMT L"\"",
+                                batch.path_of (entry).c_str ());
+                }
+            }
+        }
+
+        if (isSymlink) {
+            ++frame.symlinkCnt;
+
+            if (has_option<spec_v, SHOW_SYMLINKS> (pCtx) && !is_text<spec_v> (pCtx)) {
+                targetPath  = fs::read_symlink (batch.path_of (entry), errorCode);
+
+                if (errorCode.value () != 0) {
+                    if (has_option<spec_v, SHOW_ERRORS> (pCtx)) {
+                        SHOW_ERR (errorCode, L"Error while reading target of symlink \"" PATH_FMT L"\"",
+                                    batch.path_of (entry).c_str ());
+                    }
+                }
+
+                write_entry_record (pCtx, pOut, filepath, entry, -1, (errorCode.value () != 0) ? (nullptr) : (&targetPath));
+            }
+            else if (has_option<spec_v, SHOW_SYMLINKS> (pCtx)) {
+
+#if defined (_WIN32) || defined (_WIN64)
+#else
+                if (has_option<spec_v, SHOW_PERMISSIONS> (pCtx)) {
+                    pOut.write_permissions (entry.stat.perms);
+                }
+#endif
+
+                if (has_option<spec_v, SHOW_LASTTIME> (pCtx)) {
+                    pOut.write_padded ("-", 20);
+                }
+
+                targetPath  = fs::read_symlink (batch.path_of (entry), errorCode);
+
+                if (errorCode.value () != 0) {
+                    if (has_option<spec_v, SHOW_ERRORS> (pCtx)) {
+                        SHOW_ERR (errorCode, L"Error while reading target of symlink \"" PATH_FMT L"\"",
+                                    batch.path_of (entry).c_str ());
+                    }
+                }
+                else {
+
+                    write_entry_line (pOut, "SYMLINK", lineIndent,
+                                        (isPathShown) ? (filepath) : (PathView (batch.name_of (entry), entry.nameLen)),
+                                        isDir, &targetPath);
+                }
+            }
+        }
+        else if (isFile) {
+
+            if (entry.statError) {
+                if (has_option<spec_v, SHOW_ERRORS> (pCtx)) {
+                    SHOW_ERR (entry.statError, L"Error while reading size of file \"" PATH_FMT L"\"",
+                                batch.path_of (entry).c_str ());
+                }
+
+                // if the size can not be read, set the size to -1 to indicate a failed read
+                curFileSize = -1;
+            }
+            else {
+                curFileSize     = entry.stat.size;
+                frame.totalFileSize     += curFileSize;
+            }
+
+            ++frame.regularFileCnt;
+            if (isListed && !is_text<spec_v> (pCtx)) {
+                write_entry_record (pCtx, pOut, filepath, entry, curFileSize);
+            }
+            else if (isListed) {
+
+                write_entry_columns<spec_v> (pCtx, pOut, entry, !entry.statError);
+
+                write_entry_line (pOut, format_int (curFileSize, fmtIntBuff), lineIndent,
+                                    (isPathShown) ? (filepath) : (PathView (batch.name_of (entry), entry.nameLen)),
+                                    false);
+            }
+        }
+        else if (isSpecial) {
+            ++frame.specialCnt;
+
+            if (has_option<spec_v, SHOW_SPECIAL> (pCtx) && !is_text<spec_v> (pCtx)) {
+                write_entry_record (pCtx, pOut, filepath, entry, -1);
+            }
+            else if (has_option<spec_v, SHOW_SPECIAL> (pCtx)) {
+                specialEntryType    = special_entry_type (entry);
+
+                write_entry_columns<spec_v> (pCtx, pOut, entry, false);
+
+                write_entry_line (pOut, specialEntryType, lineIndent,
+                                    (isPathShown) ? (filepath) : (PathView (batch.name_of (entry), entry.nameLen)),
+                                    false);
+            }
+        }
+        else if (isDir) {
+
+            ++frame.subdirCnt;
+
+            // subdirectories are walked by the paths the walk built (their absolute paths are only printed)
+            subdirPath      = batch.path_of (entry);
+
+            // directories on other filesystems are listed, but are neither entered nor sized (if the scan stays on one)
+            isEntered       = walk_stays_on_filesystem (pCtx.filters, pCtx.rootDev, entry);
+
+            if (has_option<spec_v, SHOW_DIR_SIZE> (pCtx) && isEntered) {
+                curFileSize     = calc_dir_size (pCtx, pOut, subdirPath, cacheLevels);
+            }
+            else {
+                curFileSize     = -1;
+            }
+
+            if (!is_text<spec_v> (pCtx)) {
+                write_entry_record (pCtx, pOut, filepath, entry, curFileSize);
+            }
+            else {
+
+                write_entry_columns<spec_v> (pCtx, pOut, entry, true);
+
+                write_entry_line (pOut, (curFileSize == -1) ? (" ") : format_int (curFileSize, fmtIntBuff), lineIndent,
+                                    (isPathShown) ? (filepath) : (PathView (batch.name_of (entry), entry.nameLen)),
+                                    true);
+            }
+
+            if (isEntered && has_option<spec_v, SHOW_RECURSIVE> (pCtx) && frame.level < pCtx.filters.maxDepth) {
+
+                // breadth-first, the subdirectory is listed once everything above it has been
+                if (has_option<spec_v, TRAVERSE_BFS> (pCtx)) {
+                    pending.push_back (PendingDir {subdirPath, 1 + frame.level});
+                }
+                // depth-first, the subdirectory is listed right below its own line
+                else if (read_scan_dir (pCtx, pOut, subdirPath, 1 + frame.level, batches.at (frames.size ()), errorCode)) {
+                    frames.push_back (ScanFrame {&batches.at (frames.size ()), 0, 1 + frame.level});
+                    continue;
+                }
+                else if (has_option<spec_v, SHOW_ERRORS> (pCtx)) {
+                    SHOW_ERR (errorCode, L"Error iterating over \"" PATH_FMT L"\"", subdirPath.c_str ());
+                }
+            }
+        }
+        else {
+            if (is_text<spec_v> (pCtx)) {
+                pOut.write ("File type of \"");
+                pOut.write_path (filepath);
+                pOut.write ("\" can not be determined\nTerminating...");
+                pOut.end_line ();
+            }
+            pOut.flush ();
+            exit (-1);
+        }
+    
+    }
+}
+
+/**
+ * @brief                   Lists a directory with the kernel specialised on one of the given combinations of options, if
+ *                          they are the ones the scan has (and with the generic kernel otherwise)
+ *
+ * @tparam index_v          Combinations of options to specialise on, as positions whose bits select the options
+ *
+ * @param pCtx              Context of the scan
+ * @param pOut              Writer to write the output to
+ * @param pPath             Path to the directory to scan
+ */
+template <uint64_t... index_v>
+void
+dispatch_scan_path (ScanContext &pCtx, OutputWriter &pOut, const fs::path &pPath, std::integer_sequence<uint64_t, index_v...>)
+{
+    /** Options of the scan that kernels are specialised on */
+    const uint64_t          options         = pCtx.optionMask & KERNEL_OPTIONS;
+
+    /** Whether a specialised kernel listed the directory (the first one compiled for the options of the scan does) */
+    const bool              isListed        = pCtx.outputFormat == OutputFormat::TEXT
+                                            && ((options == kernel_options (index_v)
+                                                && (scan_path_kernel<KernelSpec {kernel_options (index_v), true, false}> (
+                                                        pCtx, pOut, pPath), true))
+                                                || ...);
+
+    if (!isListed) {
+        scan_path_kernel<genericKernel> (pCtx, pOut, pPath);
+    }
+}
+
+/**
+ * @brief                   Scans through and prints the contents of a directory, with a kernel compiled for the options
+ *                          of the scan if it has one of the combinations of them that are most common
+ *
+ * @param pCtx              Context of the scan
+ * @param pOut              Writer to write the output to
+ * @param pPath             Path to the directory to scan
+ */
+void
+scan_path (ScanContext &pCtx, OutputWriter &pOut, const fs::path &pPath) noexcept
+{
+    dispatch_scan_path (pCtx, pOut, pPath, std::make_integer_sequence<uint64_t, KERNEL_COMBINATIONS> {});
+}
+
+/**
+ * @brief                   Writes an entry that matched the search pattern, as a line of the table or as a record
+ *
+ * @param pCtx              Context of the search
+ * @param pOut              Writer to write the output to
+ * @param pPath             Path to print for the entry
+ * @param pEntry            Entry to print (along with its metadata)
+ * @param pSize             Size of the entry if it is a regular file, or a directory whose size was calculated (-1 otherwise)
+ * @param pTarget           Target of the entry if it is a symlink (empty if it is not known)
+ * @param pPattern          Pattern that the name of the entry matched (as returned by match_name)
+ */
+void
+write_match (const ScanContext &pCtx, OutputWriter &pOut, const PathView &pPath, const DirEntry &pEntry, const int64_t &pSize,
+                const fs::path &pTarget, const int32_t &pPattern) noexcept
+{
+    /** Buffer to store the size of the entry formatted with periods */
+    char                    fmtIntBuff[MAX_FMT_INT_LEN];
+
+    /** Stores whether the entry is a directory */
+    bool                    isDir;
+    /** Stores whether the entry is a regular file */
+    bool                    isFile;
+    /** Stores whether the entry is a symlink */
+    bool                    isSymlink;
+    /** Stores whether the entry is a special file */
+    bool                    isSpecial;
+
+    /** Pattern that the entry matched, reported only if the search has more than one */
+    const std::string       *pattern    = (pCtx.get_option (SEARCH_PATTERNS) && pPattern != -1)
+                                        ? (&pCtx.patternMatcher.display (pPattern)) : (nullptr);
+
+    classify_entry (pEntry, isDir, isFile, isSymlink, isSpecial);
+
+    if (pCtx.outputFormat != OutputFormat::TEXT) {
+        write_entry_record (pCtx, pOut, pPath, pEntry,
+                            (isDir && !pCtx.get_option (SHOW_DIR_SIZE)) ? (-1) : (pSize),
+                            (isSymlink && !pTarget.empty ()) ? (&pTarget) : (nullptr), pattern);
+        return;
+    }
+
+    write_entry_columns<genericKernel> (pCtx, pOut, pEntry, true);
+
+    if (isSymlink) {
+        write_entry_line (pOut, "SYMLINK", -1, pPath, isDir, &pTarget, pattern);
+    }
+
+    else if (isFile) {
+        write_entry_line (pOut, format_int (pSize, fmtIntBuff), -1, pPath, false, nullptr, pattern);
+    }
+
+    else if (isSpecial) {
+
+#if defined (_WIN32) || defined (_WIN64)
+#else
+        if (pCtx.get_option (SHOW_PERMISSIONS)) {
+            pOut.write_permissions (pEntry.stat.perms);
+        }
+#endif
+
+        if (pCtx.get_option (SHOW_LASTTIME)) {
+            pOut.write_repeat (' ', 20);
+        }
+
+        write_entry_line (pOut, special_entry_type (pEntry), -1, pPath, false, nullptr, pattern);
+    }
+
+    else if (isDir) {
+        write_entry_line (pOut, (!pCtx.get_option (SHOW_DIR_SIZE) || pSize == -1) ? (" ") : format_int (pSize, fmtIntBuff),
+                            -1, pPath, true, nullptr, pattern);
+    }
+}
+
+/**
+ * @brief                   Prints an entry that matched the search pattern (along with its absolute path)
+ *
+ *                          Each worker prints through its own writer, so this can be called from multiple threads
+ *
+ * @param pCtx              Context of the search
+ * @param pOut              Writer to write the output to
+ * @param pPath             Path of the entry
+ * @param pEntry            Entry to print (along with its metadata)
+ * @param pSize             Size of the entry if it is a regular file, or a directory whose size was calculated (-1 otherwise)
+ * @param pPattern          Pattern that the name of the entry matched (as returned by match_name)
+ */
+void
+print_match (ScanContext &pCtx, OutputWriter &pOut, const fs::path &pPath, const DirEntry &pEntry, const int64_t &pSize,
+                const int32_t &pPattern) noexcept
+{
+    /** Container for error codes reported by std::filesystem */
+    std::error_code         errorCode;
+
+    /** Absolute path of the entry */
+    fs::path                filepath;
+
+    /** Stores the path to the target of the symlink if the entry is a symlink */
+    fs::path                targetPath;
+
+    // symlinks are resolved to their targets, while everything else is resolved from the root of the search
+    filepath    = (pEntry.type == EntryType::SYMLINK) ? (canonical_path (pPath, errorCode)) : (resolved_path (pCtx, pPath.native (), errorCode));
+    if (errorCode.value () != 0) {
+        if (pCtx.get_option (SHOW_ERRORS)) {
+            SHOW_ERR (errorCode, L"Error while converting filepath to canonical value for \"" PATH_FMT L"\"",
+                        pPath.c_str ());
+        }
+        return;
+    }
+
+    // machine-readable records name the symlink itself rather than what it resolves to, along with its target
+    if (pCtx.outputFormat != OutputFormat::TEXT && pEntry.type == EntryType::SYMLINK) {
+        filepath    = fs::absolute (pPath, errorCode).lexically_normal ();
+        targetPath  = fs::read_symlink (pPath, errorCode);
+    }
+
+    write_match (pCtx, pOut, filepath.native (), pEntry, pSize, targetPath, pPattern);
+}
+
+/**
+ * @brief                   Checks whether the name of an entry matches the search pattern (in the given search mode), or
+ *                          any of the patterns of the search if it has more than one
+ *
+ * @param pCtx              Context of the search
+ * @param pName             Name of the entry (as read into a DirBatch)
+ * @param pNameLen          Length of the name of the entry
+ *
+ * @return int32_t          Position of the first pattern that the name matches (0 if the search has a single pattern), or
+ *                          -1 if the name does not match any pattern
+ */
+[[nodiscard]] int32_t
+match_name (const ScanContext &pCtx, const DirBatch::char_t *pName, const size_t &pNameLen)
+{
+    // all the patterns of a list are checked at once
+    if (pCtx.get_option (SEARCH_PATTERNS)) {
+        return pCtx.patternMatcher.match (pName, pNameLen);
+    }
+
+    // globs and regular expressions run through their automaton on the name as it was read
+    if (pCtx.get_option (SEARCH_GLOB) || pCtx.get_option (SEARCH_REGEX)) {
+        return (pCtx.nameAutomaton.matches (pName, pNameLen)) ? (0) : (-1);
+    }
+
+    // the contains search works on the name as it was read, without building a path out of it
+    if (pCtx.get_option (SEARCH_CONTAINS)) {
+        return (pCtx.containsMatcher.matches (pName, pNameLen)) ? (0) : (-1);
+    }
+
+    /** Name of the entry */
+    const PathView          name (pName, pNameLen);
+
+    if (pCtx.get_option (SEARCH_EXACT)) {
+        return (name == pCtx.searchPattern) ? (0) : (-1);
+    }
+
+    /** Position of the last extension of the name (a leading period starts the name rather than an extension) */
+    const size_t            extPos      = name.rfind ('.');
+
+    return (name.substr (0, (extPos == PathView::npos || extPos == 0) ? (name.size ()) : (extPos)) == pCtx.searchPattern)
+            ? (0) : (-1);
+}
+
+/**
+ * @brief                   Returns the metadata that needs to be fetched for an entry found while searching
+ *
+ * @param pCtx              Context of the search
+ * @param pEntry            Entry found while searching
+ * @param pIsMatch          Whether the name of the entry matched the search pattern (it will be printed)
+ * @param pSizeNeeded       Whether the size of the directory containing the entry is needed
+ *
+ * @return uint32_t         Combination of STAT_* bits
+ */
+[[nodiscard]] uint32_t
+search_stat_mask (const ScanContext &pCtx, const DirEntry &pEntry, const bool &pIsMatch, const bool &pSizeNeeded) noexcept
+{
+    /** Metadata needed for the entry (what gets printed or checked if it matched) */
+    uint32_t                mask        = (pIsMatch) ? (pCtx.plan.matchMask) : (0);
+
+    // symlinks are always followed, as the type of the target decides how they are counted
+    // (symlinks to files are sized the same way as calc_dir_size does, but are never printed with a size)
+    if (pEntry.type == EntryType::SYMLINK) {
+        mask    |= STAT_FOLLOW | STAT_TYPE | ((pSizeNeeded) ? (pCtx.plan.sizeMask) : (0));
+    }
+    else if (pEntry.type == EntryType::REGULAR) {
+        mask    |= ((pIsMatch) ? (pCtx.plan.matchFileMask) : (0)) | ((pSizeNeeded) ? (pCtx.plan.sizeMask) : (0));
+    }
+    else if (pEntry.type == EntryType::DIRECTORY) {
+        mask    |= pCtx.plan.descendMask;
+    }
+
+    return mask;
+}
+
+/** Directory of an iterative search, whose entries are being matched */
+struct SearchFrame
+{
+    /** Entries of the directory */
+    DirBatch                *batch              {nullptr};
+    /** Pattern that the name of each entry of the batch matched (-1 if none) */
+    std::vector<int32_t>    nameMatches         {};
+
+    /** Position of the next entry of the batch to match */
+    uint64_t                next                {};
+    /** Level of the directory below the path from which the search started */
+    uint64_t                level               {};
+
+    /** Combined size of the entries matched so far (only calculated if isSizeNeeded is set) */
+    int64_t                 size                {};
+    /** Whether the size of the directory is needed (because it or one of its ancestors matched) */
+    bool                    isSizeNeeded        {};
+    /** Whether the subdirectory being searched (the entry before next) matched, and is printed once it has been searched */
+    bool                    isPendingMatch      {};
+};
+
+/**
+ * @brief                   Reads the entries of a directory that is being searched, matches their names and fetches the
+ *                          metadata of the ones that get printed or sized (the directory is closed once it has been fetched),
+ *                          and sorts them if the search is sorted
+ *
+ * @param pCtx              Context of the search
+ * @param pPath             Path of the directory
+ * @param pFrame            Frame to read the directory into (its batch, level and isSizeNeeded must have been set)
+ * @param pErr              Error that occoured while reading the directory
+ *
+ * @return true             If the directory was read
+ * @return false            If the directory could not be read
+ */
+[[nodiscard]] bool
+read_search_dir (ScanContext &pCtx, const fs::path &pPath, SearchFrame &pFrame, std::error_code &pErr) noexcept
+{
+    /** Entries of the directory */
+    DirBatch                &batch          = *pFrame.batch;
+    /** Sorter of the entries (reused for every directory) */
+    static thread_local EntryOrder  order;
+
+    if (!read_dir_indexed (pCtx, pPath, batch, pErr)) {
+        return false;
+    }
+
+    // names are matched before any metadata is fetched, so that only the entries that get printed (or sized) are stat-ed
+    pFrame.nameMatches.resize (batch.entries.size ());
+    for (uint64_t i = 0; i < batch.entries.size (); ++i) {
+        pFrame.nameMatches[i]       = match_name (pCtx, batch.name_of (batch.entries[i]), batch.entries[i].nameLen);
+        batch.entries[i].statMask   = search_stat_mask (pCtx, batch.entries[i], pFrame.nameMatches[i] != -1, pFrame.isSizeNeeded);
+    }
+    stat_dir_indexed (pCtx, batch);
+    batch.close ();
+
+    // the pattern that each entry matched moves along with it (if the entries can not be sorted, they are searched as they are)
+    if (pCtx.sortOrder != SortOrder::NONE) {
+        try {
+            order.prepare (batch, pCtx.sortOrder);
+            order.apply (batch, &pFrame.nameMatches);
+        }
+        catch (const std::bad_alloc &) {
+        }
+    }
+
+    pFrame.next     = 0;
+    pFrame.size     = 0;
+
+    return true;
+}
+
+/**
+ * @brief                   Scans throug a directory and prints entries that match the given pattern and search mode
+ *
+ *                          The tree is walked with an explicit stack of the directories being searched (each of which
+ *                          is closed before its subdirectories are read), so the depth of the tree is only limited by
+ *                          memory, and a single directory is open at a time. Depth-first, matching directories are
+ *                          printed after their own contents have been searched, so that their sizes can be aggregated
+ *                          from the same walk (instead of walking their subtrees once more). Breadth-first, each level is
+ *                          searched before the next one, and the sizes of matching directories are calculated separately
+ *
+ * @param pCtx              Context of the search
+ * @param pOut              Writer to write the output to
+ * @param pPath             Path to the directory to scan
+ */
+void
+search_path (ScanContext &pCtx, OutputWriter &pOut, const fs::path &pPath) noexcept
+{
+    /** Container for error codes reported by std::filesystem */
+    std::error_code         errorCode;
+
+    /** Batches of the levels of the search (reused for every directory of the same level) */
+    static thread_local BatchStack  batches;
+    /** Directories being searched, from the one the search started from to the deepest one (only the first depth + 1 are in use) */
+    static thread_local std::vector<SearchFrame>    frames;
+    /** Number of directories being searched below the one the search started from */
+    uint64_t                depth;
+
+    /** Directories that a breadth-first search is yet to read, in the order in which they are read */
+    std::deque<PendingDir>  pending;
+    /** Whether the search is breadth-first */
+    const bool              isBfs           = pCtx.get_option (TRAVERSE_BFS);
+
+    /** Counters of the search (a sequential search only uses the first shard) */
+    ScanCounters            &counter        = pCtx.counters[0];
+
+    /** Stores whether the current entry is a directory */
+    bool                    isDir;
+    /** Stores whether the current entry is a regular file */
+    bool                    isFile;
+    /** Stores whether the current entry is a symlink */
+    bool                    isSymlink;
+    /** Stores whether the current entry is a special file */
+    bool                    isSpecial;
+
+    /** Stores whether the current entry matches the search pattern */
+    bool                    isMatch;
+    /** Stores whether the size of the current entry is needed (to be printed or to be added to the size of this directory) */
+    bool                    isSizeNeeded;
+
+    /** Size of file that is being currently processed */
+    int64_t                 curFileSize;
+
+    /** Name of the current entry */
+    fs::path                filepath;
+
+    depth           = 0;
+    if (frames.empty ()) {
+        frames.resize (1);
+    }
+    frames[0].batch         = &batches.at (0);
+    frames[0].level         = 0;
+    frames[0].isSizeNeeded  = false;
+
+    // if an error occoured while trying to read the directory, then report it here
+    if (!read_search_dir (pCtx, pPath, frames[0], errorCode)) {
+        if (pCtx.get_option (SHOW_ERRORS)) {
+            SHOW_ERR (errorCode, L"Error while creating directory iterator for \"" PATH_FMT L"\"",
+                        pPath.c_str ());
+        }
+        pCtx.printSummary   = false;
+
+        return;
+    }
+
+    while (true) {
+
+        // the frame of a subdirectory is always available, so that descending into it does not move the frames below it
+        if (frames.size () < depth + 2) {
+            frames.resize (depth + 2);
+        }
+
+        /** Directory being searched */
+        SearchFrame         &frame          = frames[depth];
+        /** Entries of the directory */
+        DirBatch            &batch          = *frame.batch;
+
+        if (frame.next == batch.entries.size ()) {
+
+            // a breadth-first search reads the next pending directory once the current one is done
+            if (depth == 0) {
+                do {
+                    if (pending.empty ()) {
+                        return;
+                    }
+
+                    frame.level     = pending.front ().level;
+                    filepath        = std::move (pending.front ().path);
+                    pending.pop_front ();
+
+                    if (read_search_dir (pCtx, filepath, frame, errorCode)) {
+                        break;
+                    }
+                    if (pCtx.get_option (SHOW_ERRORS)) {
+                        SHOW_ERR (errorCode, L"Error while creating directory iterator for \"" PATH_FMT L"\"",
+                                    filepath.c_str ());
+                    }
+                } while (true);
+
+                continue;
+            }
+
+            // the subdirectory has been searched, so the entry of the parent that it belongs to can be completed
+            curFileSize     = (frame.isSizeNeeded) ? (frame.size) : (-1);
+            --depth;
+
+            /** Directory that the subdirectory belongs to */
+            SearchFrame     &parent         = frames[depth];
+            /** Entry of the subdirectory */
+            const DirEntry  &subdirEntry    = parent.batch->entries[parent.next - 1];
+
+            if (parent.isSizeNeeded && curFileSize != -1) {
+                parent.size     += curFileSize;
+            }
+            if (parent.isPendingMatch) {
+                filepath        = parent.batch->build_path (subdirEntry);
+                print_match (pCtx, pOut, filepath, subdirEntry, curFileSize, parent.nameMatches[parent.next - 1]);
+            }
+            continue;
+        }
+
+        /** Position of the entry that is being currently processed */
+        const uint64_t      i               = frame.next++;
+        /** Entry that is being currently processed */
+        const DirEntry      &entry          = batch.entries[i];
+
+        // the size of a regular file not being readable is reported further below
+        if (entry.statError && entry.type != EntryType::REGULAR) {
+            if (pCtx.get_option (SHOW_ERRORS)) {
+                SHOW_ERR (entry.statError, L"Error while getting status of \"" PATH_FMT L"\"", batch.path_of (entry).c_str ());
+            }
+            continue;
+        }
+
+        // find out the type of the entry
+        classify_entry (entry, isDir, isFile, isSymlink, isSpecial);
+
+        if (isSymlink) {
+            ++counter.numSymlinksTotal;
+        }
+        else if (isFile) {
+            ++counter.numFilesTotal;
+        }
+        else if (isSpecial) {
+            ++counter.numSpecialTotal;
+        }
+        else if (isDir) {
+            ++counter.numDirsTotal;
+        }
+
+        isMatch         = frame.nameMatches[i] != -1 && walk_passes_filters (pCtx.filters, entry);
+
+        if (isMatch) {
+            if (isSymlink && pCtx.get_option (SHOW_SYMLINKS)) {
+                ++counter.numSymlinksMatched;
+            }
+            else if (isFile && pCtx.get_option (SHOW_FILES)) {
+                ++counter.numFilesMatched;
+            }
+            else if (isSpecial && pCtx.get_option (SHOW_SPECIAL)) {
+                ++counter.numSpecialMatched;
+            }
+            else if (isDir) {
+                ++counter.numDirsMatched;
+            }
+            else {
+                isMatch = false;
+            }
+        }
+
+        // the path is only built for the entries that get printed or walked
+        if (isMatch || (isDir && !isSymlink)) {
+            filepath        = batch.build_path (entry);
+        }
+
+        curFileSize     = -1;
+
+        // the size of a regular file is read if it needs to be printed or added to the size of this directory
+        if (isFile && ((isMatch && !isSymlink) || frame.isSizeNeeded)) {
+            if (entry.statError) {
+                if (pCtx.get_option (SHOW_ERRORS)) {
+                    SHOW_ERR (entry.statError, L"Error while reading size of file \"" PATH_FMT L"\"",
+                                batch.path_of (entry).c_str ());
+                }
+            }
+            else {
+                curFileSize     = entry.stat.size;
+            }
+        }
+
+        else if (isDir && !isSymlink && walk_stays_on_filesystem (pCtx.filters, pCtx.rootDev, entry)) {
+            isSizeNeeded    = frame.isSizeNeeded || (isMatch && pCtx.get_option (SHOW_DIR_SIZE));
+
+            if (frame.level < pCtx.filters.maxDepth) {
+
+                // breadth-first, the subdirectory is searched once everything above it has been
+                if (isBfs) {
+                    pending.push_back (PendingDir {filepath, 1 + frame.level});
+                    if (isSizeNeeded) {
+                        curFileSize     = calc_dir_size (pCtx, pOut, filepath);
+                    }
+                }
+                // depth-first, the contents of the subdirectory are searched first, as its size (if needed) is aggregated
+                // from the same walk
+                else {
+
+                    /** Frame of the subdirectory */
+                    SearchFrame     &child          = frames[depth + 1];
+
+                    child.batch         = &batches.at (depth + 1);
+                    child.level         = 1 + frame.level;
+                    child.isSizeNeeded  = isSizeNeeded;
+
+                    if (read_search_dir (pCtx, filepath, child, errorCode)) {
+                        frame.isPendingMatch    = isMatch;
+                        ++depth;
+                        continue;
+                    }
+                    if (pCtx.get_option (SHOW_ERRORS)) {
+                        SHOW_ERR (errorCode, L"Error while creating directory iterator for \"" PATH_FMT L"\"",
+                                    filepath.c_str ());
+                    }
+                }
+            }
+            else if (isSizeNeeded) {
+                curFileSize     = calc_dir_size (pCtx, pOut, filepath);
+            }
+        }
+
+        // regular files add to the size of this directory as counted_size counts them (which is not always the size printed)
+        if (frame.isSizeNeeded && curFileSize != -1) {
+            frame.size      += (isFile) ? (counted_size (pCtx, entry)) : (curFileSize);
+        }
+
+        if (isMatch) {
+            print_match (pCtx, pOut, filepath, entry, curFileSize, frame.nameMatches[i]);
+        }
+    }
+}
+
+/**
+ * @brief                   Searches through the directories stored in the index of a previous scan (without reading the
+ *                          filesystem at all), and prints the matching entries
+ *
+ *                          Every directory in the index that lies within the given path is searched (as locate would),
+ *                          regardless of the recursion depth. Directories are printed without their sizes
+ *
+ * @param pCtx              Context of the search (prevIndex must be open)
+ * @param pOut              Writer to write the output to
+ * @param pPath             Path to the directory to search (empty to search the whole index)
+ */
+void
+search_index (ScanContext &pCtx, OutputWriter &pOut, const fs::path &pPath) noexcept
+{
+    /** Index that is searched */
+    const ScanIndex         &index          = pCtx.prevIndex;
+
+    /** Entries within the current directory */
+    DirBatch                batch;
+    /** Sorter of the entries of each directory */
+    EntryOrder              order;
+
+    /** Counters of the search */
+    ScanCounters            &counter        = pCtx.counters[0];
+
+    /** Path of the directory to search, as it is stored in the index (empty to search the whole index) */
+    std::string             rootKey;
+    /** Path of the current directory, as it is stored in the index */
+    std::string_view        dirKey;
+
+    /** Separator between the components of a path */
+    const char              separator       = (char)fs::path::preferred_separator;
+
+    /** Stores whether the current entry is a directory */
+    bool                    isDir;
+    /** Stores whether the current entry is a regular file */
+    bool                    isFile;
+    /** Stores whether the current entry is a symlink */
+    bool                    isSymlink;
+    /** Stores whether the current entry is a special file */
+    bool                    isSpecial;
+
+    /** Stores whether the current entry matches the search pattern */
+    bool                    isMatch;
+    /** Pattern that the name of the current entry matched (-1 if none) */
+    int32_t                 pattern;
+    /** Size of file that is being currently processed */
+    int64_t                 curFileSize;
+
+    /** Path of the current entry (held by the batch) */
+    PathView                filepath;
+
+    // the path is compared with the stored paths as is, so trailing separators are dropped ("dir/" is stored as "dir")
+    rootKey     = index_key (pPath);
+    while (rootKey.size () > 1 && rootKey.back () == separator) {
+        rootKey.pop_back ();
+    }
+
+    // the directories within the path come right after it, since they are ordered by path (with other paths that merely
+    // start with the same characters, such as "dir-old" after "dir", mixed in between them)
+    for (uint64_t pos = index.lower_bound (rootKey); pos < index.num_dirs (); ++pos) {
+        dirKey      = index.dir_key (index.dir_at (pos));
+
+        if (dirKey.substr (0, rootKey.size ()) != rootKey) {
+            break;
+        }
+        if (dirKey.size () > rootKey.size () && !rootKey.empty ()
+            && rootKey.back () != separator && dirKey[rootKey.size ()] != separator) {
+            continue;
+        }
+
+        // directories within an excluded one are skipped along with it, as a walk would never have entered them
+        if (!pCtx.filters.excludes.empty () && has_excluded_component (pCtx, dirKey.substr (rootKey.size ()))) {
+            continue;
+        }
+
+        if (!index.restore_dir (index.dir_at (pos), index_path (dirKey), batch)) {
+            if (pCtx.get_option (SHOW_ERRORS)) {
+                SHOW_ERR (std::make_error_code (std::errc::invalid_argument), L"Error while reading \"" PATH_FMT L"\" from the index",
+                            index_path (dirKey).c_str ());
             }
             continue;
         }
+        walk_prune_batch (pCtx.filters, batch);
+
+        // the index holds all the metadata of the entries, so they can be sorted by any key
+        if (pCtx.sortOrder != SortOrder::NONE) {
+            try {
+                order.prepare (batch, pCtx.sortOrder);
+                order.apply (batch);
+            }
+            catch (const std::bad_alloc &) {
+            }
+        }
+
+        for (const auto &entry : batch.entries) {
+
+            if (entry.statError && entry.type != EntryType::REGULAR) {
+                if (pCtx.get_option (SHOW_ERRORS)) {
+                    SHOW_ERR (entry.statError, L"Error while getting status of \"" PATH_FMT L"\"",
+                                batch.path_of (entry).c_str ());
+                }
+                continue;
+            }
+
+            classify_entry (entry, isDir, isFile, isSymlink, isSpecial);
+
+            if (isSymlink) {
+                ++counter.numSymlinksTotal;
+            }
+            else if (isFile) {
+                ++counter.numFilesTotal;
+            }
+            else if (isSpecial) {
+                ++counter.numSpecialTotal;
+            }
+            else if (isDir) {
+                ++counter.numDirsTotal;
+            }
+
+            pattern         = match_name (pCtx, batch.name_of (entry), entry.nameLen);
+            isMatch         = pattern != -1 && walk_passes_filters (pCtx.filters, entry);
+
+            if (isMatch) {
+                if (isSymlink && pCtx.get_option (SHOW_SYMLINKS)) {
+                    ++counter.numSymlinksMatched;
+                }
+                else if (isFile && pCtx.get_option (SHOW_FILES)) {
+                    ++counter.numFilesMatched;
+                }
+                else if (isSpecial && pCtx.get_option (SHOW_SPECIAL)) {
+                    ++counter.numSpecialMatched;
+                }
+                else if (isDir) {
+                    ++counter.numDirsMatched;
+                }
+                else {
+                    isMatch = false;
+                }
+            }
+
+            if (!isMatch) {
+                continue;
+            }
+
+            // the path is only built for the entries that get printed (in place, within the batch)
+            filepath        = batch.build_path (entry);
+
+            curFileSize     = -1;
+            if (isFile && !isSymlink) {
+                if (entry.statError) {
+                    if (pCtx.get_option (SHOW_ERRORS)) {
+                        SHOW_ERR (entry.statError, L"Error while reading size of file \"" PATH_FMT L"\"",
+                                    batch.path_of (entry).c_str ());
+                    }
+                }
+                else {
+                    curFileSize     = entry.stat.size;
+                }
+            }
+
+            // targets of symlinks are not stored in the index
+            write_match (pCtx, pOut, filepath, entry, curFileSize, fs::path {}, pattern);
+        }
+    }
+}
+
+/**
+ * @brief                   Aggregates the size of a directory whose subdirectories are walked in parallel
+ *
+ *                          The node is complete once the directory itself and all of its subdirectories have been walked,
+ *                          at which point its size is added to the parent's node
+ */
+struct DirSizeNode
+{
+    /** Node of the parent directory (nullptr if the size of the parent is not needed) */
+    DirSizeNode             *parent;
+    /** Path of the directory */
+    fs::path                path;
+    /** Entry of the directory, along with its metadata (only used if it matched the search pattern) */
+    DirEntry                entry;
+
+    /** Combined size of everything within the directory that has been walked so far */
+    std::atomic<int64_t>    size                {0};
+    /** Number of walks (of the directory itself, and of its subdirectories) that are yet to complete */
+    std::atomic<uint64_t>   pending             {1};
+
+    /** Whether the directory could not be iterated (its size can not be calculated) */
+    bool                    isFailed            {false};
+    /** Whether the directory matched the search pattern (and needs to be printed once its size is known) */
+    bool                    isMatch             {false};
+    /** Pattern that the name of the directory matched (only used if it matched) */
+    int32_t                 pattern             {-1};
+    /** Whether the size needs to be remembered in pCtx.dirSizeCache for the scan */
+    bool                    isCached            {false};
+};
+
+/** Task of walking a single directory in a parallel traversal */
+struct DirTask
+{
+    /** Path of the directory */
+    fs::path                path;
+    /** Level of the directory below the path from which the traversal started */
+    uint64_t                level;
+    /** Node to add the size of the directory's contents to (nullptr if the size is not needed) */
+    DirSizeNode             *node;
+};
+
+/**
+ * @brief                   Completes one of the pending walks of a node, and finalizes the node (and possibly its ancestors)
+ *                          if that was the last one
+ *
+ * @param pCtx              Context of the scan
+ * @param pWorker           Worker completing the walk
+ * @param pNode             Node to complete a walk of
+ */
+void
+complete_dir_size_node (ScanContext &pCtx, const uint32_t &pWorker, DirSizeNode *pNode) noexcept
+{
+    /** Writer of the worker completing the walk */
+    OutputWriter            &out            = pCtx.writers[pWorker];
+
+    /** Node of the parent directory of the current node */
+    DirSizeNode             *parent;
+    /** Final size of the current node */
+    int64_t                 size;
+
+    for (; pNode != nullptr; pNode = parent) {
+
+        // the last walk to complete finalizes the node, and all the others have published their sizes before this point
+        if (pNode->pending.fetch_sub (1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
 
-        // find out the type of the entry
-        isDir           = entry.is_directory ();
-        isFile          = entry.is_regular_file ();
-        isSymlink       = entry.is_symlink ();
-        isSpecial       = entry.is_other ();
+        size    = (pNode->isFailed) ? (-1) : (pNode->size.load (std::memory_order_relaxed));
+        parent  = pNode->parent;
 
-        if (get_option (SHOW_ABSNOINDENT)) {
+        if (pNode->isMatch) {
+            print_match (pCtx, out, pNode->path, pNode->entry, size, pNode->pattern);
+        }
 
-            // if the entry is a symlink, it is necessary to use the absolute path as the canonical path will evaluate and return the target
-            filepath    = (isSymlink) ? (fs::absolute (filepath, sErrorCode)) : (fs::canonical (filepath, sErrorCode));
+        // the directory the walk starts from is not ranked among the largest entries below it
+        if (pCtx.get_option (TOP_DIRS) && parent != nullptr && pCtx.topShards[pWorker].admits (size)) {
+            pCtx.topShards[pWorker].offer (size, EntryType::DIRECTORY, pNode->path.native ());
+        }
 
-            if (sErrorCode.value () != 0) {
-                if (get_option (SHOW_ERRORS)) {
-                    SHOW_ERR (L"Error while converting filepath to canonical value for \"%ls\"",
-                                filepath.wstring ().c_str ());
-                }
+        if (pNode->isCached) {
+            std::lock_guard<std::mutex> guard (pCtx.dirSizeCacheLock);
+            pCtx.dirSizeCache.emplace (pNode->path.native (), size);
+        }
+
+        if (parent != nullptr && size != -1) {
+            parent->size.fetch_add (size, std::memory_order_relaxed);
+        }
+
+        delete pNode;
+    }
+}
+
+/**
+ * @brief                   Calculates the sizes of all the subdirectories that the scan will list, walking the tree once
+ *                          using multiple threads, and remembers them in pCtx.dirSizeCache
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path to the directory that will be scanned
+ */
+void
+calc_dir_sizes_parallel (ScanContext &pCtx, const fs::path &pPath)
+{
+    /** Deepest level of subdirectories whose sizes will be needed by the scan (none are, if only the largest entries or
+        histograms are printed) */
+    const uint64_t                  maxCachedLevel  = (pCtx.topCount != 0 || pCtx.get_option (SHOW_HISTOGRAMS)) ? (0)
+                                                    : (pCtx.filters.maxDepth == UINT64_MAX) ? (UINT64_MAX)
+                                                    : (pCtx.filters.maxDepth + 1);
+
+    /** Pool of threads walking the directories */
+    WorkStealingPool<DirTask>       pool ((uint32_t)pCtx.numThreads);
+
+    pool.set_timed (!pCtx.profiles.empty ());
+    pCtx.reset_writers (pool.num_workers ());
+    if (pCtx.topCount != 0) {
+        pCtx.topShards.assign (pool.num_workers (), TopEntries (pCtx.topCount));
+    }
+    if (pCtx.get_option (SHOW_HISTOGRAMS)) {
+        pCtx.statsShards.assign (pool.num_workers (), FileStats (time (nullptr)));
+    }
+
+    pool.run (DirTask {pPath, 0, new DirSizeNode {}}, [&] (DirTask &pTask, const uint32_t &pWorker) {
+
+        threadProfile   = profile_of (pCtx, pWorker);
+
+        /** Time spent walking the directory (the walks of its subdirectories are separate tasks) */
+        const PhaseTimer        timer (threadProfile, ProfilePhase::DIR_SIZE);
+
+        /** Container for error codes reported while reading the directory */
+        std::error_code         errorCode;
+        /** Writer of the current worker */
+        OutputWriter            &out        = pCtx.writers[pWorker];
+
+        /** Entries within the current directory (each worker reuses its batch for every directory it reads) */
+        static thread_local DirBatch    batch;
+
+        /** Stores whether the current entry is a directory */
+        bool                    isDir;
+        /** Stores whether the current entry is a regular file */
+        bool                    isFile;
+        /** Stores whether the current entry is a symlink */
+        bool                    isSymlink;
+        /** Stores whether the current entry is a special file */
+        bool                    isSpecial;
+
+        /** Combined size of the files directly within the current directory */
+        int64_t                 totalFileSize;
+        /** Size of the regular file that was added up last */
+        int64_t                 curFileSize;
+
+        /** Node of the subdirectory that is being currently processed */
+        DirSizeNode             *child;
+
+        // the scan reports the errors of the directory it starts from itself
+        if (!read_dir_indexed (pCtx, pTask.path, batch, errorCode)) {
+            if (pCtx.get_option (SHOW_ERRORS) && pTask.level != 0) {
+                SHOW_ERR (errorCode, L"Error while creating directory iterator for \"" PATH_FMT L"\"",
+                        pTask.path.c_str ());
             }
+            pTask.node->isFailed    = true;
+            complete_dir_size_node (pCtx, pWorker, pTask.node);
+            return;
         }
 
-        if (isSymlink) {
-            ++symlinkCnt;
+        for (auto &entry : batch.entries) {
+            entry.statMask  = (entry.type == EntryType::REGULAR) ? (pCtx.plan.sizeMask)
+                            : (entry.type == EntryType::SYMLINK) ? (STAT_FOLLOW | STAT_TYPE | pCtx.plan.sizeMask)
+                            : (entry.type == EntryType::DIRECTORY) ? (pCtx.plan.descendMask)
+                            : (0);
+        }
+        stat_dir_indexed (pCtx, batch);
+        batch.close ();
 
-            if (get_option (SHOW_SYMLINKS)) {
+        totalFileSize   = 0;
 
-#if defined (_WIN32) || defined (_WIN64)
-#else
-                if (get_option (SHOW_PERMISSIONS)) {
-                    print_permissions (entryStatus);
-                }
-#endif
+        for (const auto &entry : batch.entries) {
 
-                if (get_option (SHOW_LASTTIME)) {
-                    wprintf (L"%20c", '-');
+            if (entry.statError && entry.type != EntryType::REGULAR) {
+                if (pCtx.get_option (SHOW_ERRORS)) {
+                    SHOW_ERR (entry.statError, L"Error while getting status of \"" PATH_FMT L"\"", batch.path_of (entry).c_str ());
                 }
+                continue;
+            }
 
-                targetPath  = fs::read_symlink (entry, sErrorCode);
+            classify_entry (entry, isDir, isFile, isSymlink, isSpecial);
 
-                if (sErrorCode.value () != 0) {
-                    if (get_option (SHOW_ERRORS)) {
-                        SHOW_ERR (L"Error while reading target of symlink \"%ls\"",
-                                    filepath.wstring ().c_str ());
+            if (isFile) {
+                if (entry.statError) {
+                    if (pCtx.get_option (SHOW_ERRORS)) {
+                        SHOW_ERR (entry.statError, L"Error while reading size of file \"" PATH_FMT L"\"",
+                                    batch.path_of (entry).c_str ());
                     }
                 }
                 else {
+                    curFileSize     = counted_size (pCtx, entry);
+                    totalFileSize   += curFileSize;
 
-                    if (get_option (SHOW_ABSNOINDENT)) {
-                        wprintf ((isDir) ? (L"%16hs    <%ls> -> <%ls>\n") : (L"%16hs    %ls -> %ls\n"),
-                                    "SYMLINK",
-                                    filepath.wstring ().c_str (),
-                                    targetPath.wstring ().c_str ());
+                    if (pCtx.get_option (TOP_FILES) && !isSymlink && pCtx.topShards[pWorker].admits (curFileSize)
+                        && walk_passes_filters (pCtx.filters, entry)) {
+                        pCtx.topShards[pWorker].offer (curFileSize, EntryType::REGULAR, batch.build_path (entry));
                     }
-                    else {
-                        wprintf ((isDir) ? (L"%16hs    %-*c<%ls> -> <%ls>\n") : (L"%16hs    %-*c%ls -> %ls\n"),
-                                    "SYMLINK",
-                                    indentWidth,
-                                    ' ',
-                                    filepath.filename ().wstring ().c_str (),
-                                    targetPath.wstring ().c_str ());
+                    if (pCtx.get_option (SHOW_HISTOGRAMS) && !isSymlink) {
+                        add_to_histograms (pCtx, pWorker, batch, entry, curFileSize);
                     }
                 }
             }
+            else if (isDir && !isSymlink && walk_stays_on_filesystem (pCtx.filters, pCtx.rootDev, entry)) {
+                child           = new DirSizeNode {};
+                child->parent   = pTask.node;
+                child->path     = batch.build_path (entry);
+                child->isCached = (pTask.level + 1) <= maxCachedLevel;
+
+                pTask.node->pending.fetch_add (1, std::memory_order_relaxed);
+                pool.push (pWorker, DirTask {child->path, 1 + pTask.level, child});
+            }
+            else if (!isSpecial && !isSymlink && pCtx.outputFormat == OutputFormat::TEXT) {
+                out.write ("File type of \"");
+                out.write_path (batch.path_of (entry));
+                out.write ("\" can not be determined");
+                out.end_line ();
+            }
         }
-        else if (isFile) {
 
-            curFileSize     = fs::file_size (entry, sErrorCode);
+        pTask.node->size.fetch_add (totalFileSize, std::memory_order_relaxed);
+        complete_dir_size_node (pCtx, pWorker, pTask.node);
+    });
+    add_pool_profile (pCtx, pool);
 
-            if (sErrorCode.value () != 0) {
-                if (get_option (SHOW_ERRORS)) {
-                    SHOW_ERR (L"Error while reading size of file \"%ls\"",
-                                filepath.wstring ().c_str ());
-                }
+    // the output of every worker must be written out before anything that follows it
+    pCtx.flush_writers ();
+}
 
-                // if the size can not be read, set the isFile flag to false to indicate a failed read
-                curFileSize = -1;
-                isFile      = false;
+/**
+ * @brief                   Searches through a directory (and its subdirectories) using multiple threads, and prints the
+ *                          entries that match the given pattern and search mode
+ *
+ *                          Matching directories whose sizes are needed are printed once their subtrees have been walked
+ *
+ * @param pCtx              Context of the search
+ * @param pPath             Path to the directory to search
+ */
+void
+search_path_parallel (ScanContext &pCtx, const fs::path &pPath)
+{
+    /** Pool of threads walking the directories */
+    WorkStealingPool<DirTask>       pool ((uint32_t)pCtx.numThreads);
+
+    pool.set_timed (!pCtx.profiles.empty ());
+    pCtx.reset_counters (pool.num_workers ());
+    pCtx.reset_writers (pool.num_workers ());
+
+    pool.run (DirTask {pPath, 0, nullptr}, [&] (DirTask &pTask, const uint32_t &pWorker) {
+
+        threadProfile   = profile_of (pCtx, pWorker);
+
+        /** Container for error codes reported while reading the directory */
+        std::error_code         errorCode;
+        /** Writer of the current worker */
+        OutputWriter            &out        = pCtx.writers[pWorker];
+
+        /** Entries within the current directory (each worker reuses its batch for every directory it reads) */
+        static thread_local DirBatch    batch;
+        /** Pattern that the name of each entry of the batch matched (-1 if none) */
+        std::vector<int32_t>    nameMatches;
+
+        /** Counters of the current worker */
+        ScanCounters            &counter    = pCtx.counters[pWorker];
+
+        /** Stores whether the current entry is a directory */
+        bool                    isDir;
+        /** Stores whether the current entry is a regular file */
+        bool                    isFile;
+        /** Stores whether the current entry is a symlink */
+        bool                    isSymlink;
+        /** Stores whether the current entry is a special file */
+        bool                    isSpecial;
+
+        /** Stores whether the current entry matches the search pattern */
+        bool                    isMatch;
+        /** Stores whether the size of the current entry is needed (to be printed or to be added to the size of this directory) */
+        bool                    isSizeNeeded;
+        /** Stores whether printing the current entry is deferred until the size of its subtree is known */
+        bool                    isDeferred;
+
+        /** Combined size of the entries directly within this directory (only calculated if the node is set) */
+        int64_t                 totalDirSize;
+        /** Size of file that is being currently processed */
+        int64_t                 curFileSize;
+
+        /** Path of the current entry */
+        fs::path                filepath;
+
+        /** Node of the subdirectory that is being currently processed */
+        DirSizeNode             *child;
+
+        if (!read_dir_indexed (pCtx, pTask.path, batch, errorCode)) {
+            if (pCtx.get_option (SHOW_ERRORS)) {
+                SHOW_ERR (errorCode, L"Error while creating directory iterator for \"" PATH_FMT L"\"",
+                            pTask.path.c_str ());
             }
-            else {
-                totalFileSize   += curFileSize;
+            if (pTask.level == 0) {
+                pCtx.printSummary   = false;
+            }
+            if (pTask.node != nullptr) {
+                pTask.node->isFailed    = true;
+                complete_dir_size_node (pCtx, pWorker, pTask.node);
             }
+            return;
+        }
+
+        nameMatches.resize (batch.entries.size ());
+        for (uint64_t i = 0; i < batch.entries.size (); ++i) {
+            nameMatches[i]              = match_name (pCtx, batch.name_of (batch.entries[i]), batch.entries[i].nameLen);
+            batch.entries[i].statMask   = search_stat_mask (pCtx, batch.entries[i], nameMatches[i] != -1, pTask.node != nullptr);
+        }
+        stat_dir_indexed (pCtx, batch);
+        batch.close ();
 
-            ++regularFileCnt;
-            if (get_option (SHOW_FILES)) {
+        totalDirSize    = 0;
 
-#if defined (_WIN32) || defined (_WIN64)
-#else
-                if (get_option (SHOW_PERMISSIONS)) {
-                    print_permissions (entryStatus);
-                }
-#endif
+        for (uint64_t i = 0; i < batch.entries.size (); ++i) {
 
-                if (get_option (SHOW_LASTTIME)) {
-                    print_last_modif_time (entry);
-                }
+            /** Entry that is being currently processed */
+            const DirEntry      &entry      = batch.entries[i];
 
-                if (get_option (SHOW_ABSNOINDENT)) {
-                    wprintf (L"%16hs    %ls\n",
-                                format_int (curFileSize),
-                                filepath.wstring ().c_str ());
-                }
-                else {
-                    wprintf (L"%16hs    %-*c%ls\n",
-                                format_int (curFileSize),
-                                indentWidth,
-                                ' ',
-                                filepath.filename ().wstring ().c_str ());
+            if (entry.statError && entry.type != EntryType::REGULAR) {
+                if (pCtx.get_option (SHOW_ERRORS)) {
+                    SHOW_ERR (entry.statError, L"Error while getting status of \"" PATH_FMT L"\"", batch.path_of (entry).c_str ());
                 }
+                continue;
+            }
+
+            // find out the type of the entry
+            classify_entry (entry, isDir, isFile, isSymlink, isSpecial);
+
+            if (isSymlink) {
+                ++counter.numSymlinksTotal;
+            }
+            else if (isFile) {
+                ++counter.numFilesTotal;
+            }
+            else if (isSpecial) {
+                ++counter.numSpecialTotal;
+            }
+            else if (isDir) {
+                ++counter.numDirsTotal;
             }
-        }
-        else if (isSpecial) {
-            ++specialCnt;
 
-            if (get_option (SHOW_SPECIAL)) {
-                specialEntryType    = "SPECIAL";
+            isMatch         = nameMatches[i] != -1 && walk_passes_filters (pCtx.filters, entry);
 
-                if (entry.is_socket ()) {
-                    specialEntryType    = "SOCKET";
+            if (isMatch) {
+                if (isSymlink && pCtx.get_option (SHOW_SYMLINKS)) {
+                    ++counter.numSymlinksMatched;
                 }
-                else if (entry.is_block_file ()) {
-                    specialEntryType    = "BLOCK DEVICE";
+                else if (isFile && pCtx.get_option (SHOW_FILES)) {
+                    ++counter.numFilesMatched;
                 }
-                else if (entry.is_fifo ()) {
-                    specialEntryType    = "FIFO PIPE";
+                else if (isSpecial && pCtx.get_option (SHOW_SPECIAL)) {
+                    ++counter.numSpecialMatched;
                 }
-
-#if defined (_WIN32) || defined (_WIN64)
-#else
-                if (get_option (SHOW_PERMISSIONS)) {
-                    print_permissions (entryStatus);
+                else if (isDir) {
+                    ++counter.numDirsMatched;
                 }
-#endif
-
-                if (get_option (SHOW_LASTTIME)) {
-                    wprintf (L"%20c", ' ');
+                else {
+                    isMatch = false;
                 }
+            }
+
+            // the path is only built for the entries that get printed or walked
+            if (isMatch || (isDir && !isSymlink)) {
+                filepath        = batch.build_path (entry);
+            }
+
+            curFileSize     = -1;
+            isDeferred      = false;
 
-                if (get_option (SHOW_ABSNOINDENT)) {
-                    wprintf (L"%16hs    %ls\n",
-                                specialEntryType,
-                                filepath.wstring ().c_str ());
+            if (isFile && ((isMatch && !isSymlink) || pTask.node != nullptr)) {
+                if (entry.statError) {
+                    if (pCtx.get_option (SHOW_ERRORS)) {
+                        SHOW_ERR (entry.statError, L"Error while reading size of file \"" PATH_FMT L"\"",
+                                    batch.path_of (entry).c_str ());
+                    }
                 }
                 else {
-                    wprintf (L"%16hs    %-*c%ls\n",
-                                specialEntryType,
-                                indentWidth,
-                                ' ',
-                                filepath.filename ().wstring ().c_str ());
+                    curFileSize     = entry.stat.size;
                 }
             }
-        }
-        else if (isDir) {
 
-            ++subdirCnt;
+            // subdirectories are handed to the pool, and their sizes (if needed) are aggregated through their nodes
+            else if (isDir && !isSymlink && walk_stays_on_filesystem (pCtx.filters, pCtx.rootDev, entry)) {
+                isSizeNeeded    = (pTask.node != nullptr) || (isMatch && pCtx.get_option (SHOW_DIR_SIZE));
+
+                if (pTask.level < pCtx.filters.maxDepth) {
+                    child           = nullptr;
 
-            if (get_option (SHOW_DIR_SIZE)) {
-                curFileSize     = calc_dir_size (filepath.wstring ().c_str ());
+                    if (isSizeNeeded) {
+                        child           = new DirSizeNode {};
+                        child->parent   = pTask.node;
+                        child->path     = filepath;
+                        child->entry    = entry;
+                        child->isMatch  = isMatch && pCtx.get_option (SHOW_DIR_SIZE);
+                        child->pattern  = nameMatches[i];
+                        isDeferred      = child->isMatch;
+
+                        if (pTask.node != nullptr) {
+                            pTask.node->pending.fetch_add (1, std::memory_order_relaxed);
+                        }
+                    }
+
+                    pool.push (pWorker, DirTask {filepath, 1 + pTask.level, child});
+                }
+                else if (isSizeNeeded) {
+                    curFileSize     = calc_dir_size (pCtx, out, filepath);
+                }
             }
-            else {
-                curFileSize     = -1;
+
+            if (pTask.node != nullptr && curFileSize != -1) {
+                totalDirSize    += (isFile) ? (counted_size (pCtx, entry)) : (curFileSize);
             }
 
-#if defined (_WIN32) || defined (_WIN64)
-#else
-            if (get_option (SHOW_PERMISSIONS)) {
-                print_permissions (entryStatus);
+            if (isMatch && !isDeferred) {
+                print_match (pCtx, out, filepath, entry, curFileSize, nameMatches[i]);
             }
-#endif
+        }
+
+        if (pTask.node != nullptr) {
+            pTask.node->size.fetch_add (totalDirSize, std::memory_order_relaxed);
+            complete_dir_size_node (pCtx, pWorker, pTask.node);
+        }
+    });
+    add_pool_profile (pCtx, pool);
+
+    // the output of every worker must be written out before anything that follows it
+    pCtx.flush_writers ();
+}
+
+/**
+ * @brief                   Scans through and prints the contents of a directory, followed by a summary of the scan
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path to the directory to scan
+ */
+void
+scan_path_init (ScanContext &pCtx, const fs::path &pPath) noexcept
+{
+    /** Counters of the scan, once it is complete */
+    ScanCounters    counters;
+
+    /** Buffer to store the number of files formatted with periods */
+    char    numFilesFmt[MAX_FMT_INT_LEN];
+    /** Buffer to store the number of symlinks formatted with periods */
+    char    numSymlinksFmt[MAX_FMT_INT_LEN];
+    /** Buffer to store the number of special files formatted with periods */
+    char    numSpecialFmt[MAX_FMT_INT_LEN];
+    /** Buffer to store the number of directories formatted with periods */
+    char    numDirsFmt[MAX_FMT_INT_LEN];
+    /** Buffer to store the total number of filesystem entries formatted with periods */
+    char    numTotalFmt[MAX_FMT_INT_LEN];
+
+    pCtx.printSummary   = true;
+    plan_scan (pCtx);
+    pCtx.reset_counters (1);
+    pCtx.reset_writers (1);
+    pCtx.writers[0].write_stream_header (pCtx.outputFormat);
+
+    // the absolute paths of all entries are built from the resolved root
+    if (pCtx.get_option (SHOW_ABSNOINDENT)) {
+        resolve_root (pCtx, pPath);
+    }
+    find_root_dev (pCtx, pPath);
+
+    // the sizes of the subdirectories are calculated up front with multiple threads, and the scan picks them up
+    if (pCtx.numThreads > 1 && pCtx.get_option (SHOW_DIR_SIZE)) {
+        calc_dir_sizes_parallel (pCtx, pPath);
+    }
+
+    scan_path (pCtx, pCtx.writers[0], pPath);
+
+    if (!pCtx.printSummary || pCtx.outputFormat != OutputFormat::TEXT) {
+        pCtx.flush_writers ();
+        return;
+    }
+
+    counters        = pCtx.merged_counters ();
+
+    format_int (counters.numFilesRoot, numFilesFmt);
+    format_int (counters.numSymlinksRoot, numSymlinksFmt);
+    format_int (counters.numSpecialRoot, numSpecialFmt);
+    format_int (counters.numDirsRoot, numDirsFmt);
+    format_int (counters.numFilesRoot +
+                counters.numSymlinksRoot +
+                counters.numSpecialRoot +
+                counters.numDirsRoot, numTotalFmt);
+
+    pCtx.writers[0].write_fmt (rootSum,
+                (const char *)pPath.u8string ().c_str (),
+                numFilesFmt,
+                numSymlinksFmt,
+                numSpecialFmt,
+                numDirsFmt,
+                numTotalFmt);
+
+    if (pCtx.get_option (SHOW_RECURSIVE)) {
+        format_int (counters.numFilesTotal, numFilesFmt);
+        format_int (counters.numSymlinksTotal, numSymlinksFmt);
+        format_int (counters.numSpecialTotal, numSpecialFmt);
+        format_int (counters.numDirsTotal, numDirsFmt);
+        format_int (counters.numFilesTotal +
+                    counters.numSymlinksTotal +
+                    counters.numSpecialTotal +
+                    counters.numDirsTotal, numTotalFmt);
+
+        pCtx.writers[0].write_fmt (recSum,
+                    numFilesFmt,
+                    numSymlinksFmt,
+                    numSpecialFmt,
+                    numDirsFmt,
+                    numTotalFmt);
+    }
+
+    pCtx.flush_writers ();
+}
+
+/**
+ * @brief                   Searches through a directory and prints the matching entries, followed by a summary of the search
+ *
+ * @param pCtx              Context of the search
+ * @param pPath             Path to the directory to search
+ */
+void
+search_path_init (ScanContext &pCtx, const fs::path &pPath) noexcept
+{
+    /** Counters of the search, once it is complete */
+    ScanCounters    counters;
+
+    /** Buffer to store the number of files formatted with periods */
+    char    numFilesFmt[MAX_FMT_INT_LEN];
+    /** Buffer to store the number of symlinks formatted with periods */
+    char    numSymlinksFmt[MAX_FMT_INT_LEN];
+    /** Buffer to store the number of special files formatted with periods */
+    char    numSpecialFmt[MAX_FMT_INT_LEN];
+    /** Buffer to store the number of directories formatted with periods */
+    char    numDirsFmt[MAX_FMT_INT_LEN];
+    /** Buffer to store the total number of filesystem entries formatted with periods */
+    char    numTotalFmt[MAX_FMT_INT_LEN];
+
+    pCtx.printSummary   = true;
+    plan_scan (pCtx);
+    pCtx.reset_counters (1);
+    pCtx.reset_writers (1);
+
+    pCtx.writers[0].write_stream_header (pCtx.outputFormat);
+
+    // matches are printed with their absolute paths, which are built from the resolved root
+    if (!pCtx.queryIndex) {
+        resolve_root (pCtx, pPath);
+        find_root_dev (pCtx, pPath);
+    }
+
+    if (pCtx.outputFormat == OutputFormat::TEXT && pCtx.get_option (SEARCH_PATTERNS)) {
+        pCtx.writers[0].write_fmt ("Searching for %zu patterns\n\n", pCtx.patternMatcher.size ());
+    }
+    else if (pCtx.outputFormat == OutputFormat::TEXT) {
+        pCtx.writers[0].write_fmt ("Searching for %s\n\n", (const char *)fs::path (pCtx.searchPattern).u8string ().c_str ());
+    }
+
+    if (pCtx.queryIndex) {
+        search_index (pCtx, pCtx.writers[0], pPath);
+    }
+    // a sorted search is walked by a single thread, so that directories are printed in the same order every time
+    else if (pCtx.numThreads > 1 && pCtx.sortOrder == SortOrder::NONE) {
+        search_path_parallel (pCtx, pPath);
+    }
+    else {
+        search_path (pCtx, pCtx.writers[0], pPath);
+    }
+
+    if (!pCtx.printSummary || pCtx.outputFormat != OutputFormat::TEXT) {
+        pCtx.flush_writers ();
+        return;
+    }
+
+    counters        = pCtx.merged_counters ();
+
+    format_int (counters.numFilesMatched, numFilesFmt);
+    format_int (counters.numSymlinksMatched, numSymlinksFmt);
+    format_int (counters.numSpecialMatched, numSpecialFmt);
+    format_int (counters.numDirsMatched, numDirsFmt);
+    format_int (counters.numFilesMatched +
+                counters.numSymlinksMatched +
+                counters.numSpecialMatched +
+                counters.numDirsMatched, numTotalFmt);
+
+    pCtx.writers[0].write_fmt (foundSum,
+                numFilesFmt,
+                numSymlinksFmt,
+                numSpecialFmt,
+                numDirsFmt,
+                numTotalFmt);
+
+    format_int (counters.numFilesTotal, numFilesFmt);
+    format_int (counters.numSymlinksTotal, numSymlinksFmt);
+    format_int (counters.numSpecialTotal, numSpecialFmt);
+    format_int (counters.numDirsTotal, numDirsFmt);
+    format_int (counters.numFilesTotal +
+                counters.numSymlinksTotal +
+                counters.numSpecialTotal +
+                counters.numDirsTotal, numTotalFmt);
+
+    pCtx.writers[0].write_fmt (TotalSum,
+                (const char *)pPath.u8string ().c_str (),
+                numFilesFmt,
+                numSymlinksFmt,
+                numSpecialFmt,
+                numDirsFmt,
+                numTotalFmt);
+
+    pCtx.flush_writers ();
+}
+
+/**
+ * @brief                   Walks the whole tree below a directory, and prints only the largest regular files and/or
+ *                          directories within it, largest first
+ *
+ *                          Nothing is printed while the tree is walked. Each worker keeps the largest entries it has
+ *                          found in its own bounded heap (so memory does not grow with the size of the tree), and the
+ *                          heaps are merged once the walk is complete
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path to the directory to walk
+ */
+void
+top_path_init (ScanContext &pCtx, const fs::path &pPath) noexcept
+{
+    /** Container for error codes reported while resolving the largest entries */
+    std::error_code         errorCode;
+    /** Identity of the directory to walk (only fetched to find out whether it can be read) */
+    DirIdentity             identity;
+
+    /** Largest entries of all the workers, largest first */
+    std::vector<TopEntry>   top;
+    /** Absolute path of the current entry */
+    fs::path                filepath;
+
+    /** Buffer to store the size of the current entry formatted with periods */
+    char                    fmtIntBuff[MAX_FMT_INT_LEN];
+
+    plan_scan (pCtx);
+    pCtx.reset_counters (1);
+    pCtx.reset_writers (1);
+    pCtx.writers[0].write_stream_header (pCtx.outputFormat);
+
+    resolve_root (pCtx, pPath);
+    find_root_dev (pCtx, pPath);
+
+    if (!read_dir_identity (pPath, identity, errorCode)) {
+        if (pCtx.get_option (SHOW_ERRORS)) {
+            SHOW_ERR (errorCode, L"Error iterating over \"" PATH_FMT L"\"", pPath.c_str ());
+        }
+        else if (pCtx.outputFormat == OutputFormat::TEXT) {
+            pCtx.writers[0].write ("Error iterating over \"");
+            pCtx.writers[0].write_path (pPath);
+            pCtx.writers[0].write ("\"");
+            pCtx.writers[0].end_line ();
+        }
+        pCtx.flush_writers ();
+        return;
+    }
+
+    if (pCtx.outputFormat == OutputFormat::TEXT) {
+        pCtx.writers[0].write_fmt ("Largest %llu %s within \"%s\"\n\n", (unsigned long long)pCtx.topCount,
+                    (!pCtx.get_option (TOP_DIRS)) ? ("files") : (!pCtx.get_option (TOP_FILES)) ? ("directories") : ("entries"),
+                    (const char *)pPath.u8string ().c_str ());
+    }
+
+    try {
+        if (pCtx.numThreads > 1) {
+            calc_dir_sizes_parallel (pCtx, pPath);
+        }
+        else {
+            pCtx.topShards.assign (1, TopEntries (pCtx.topCount));
+            (void)calc_dir_size (pCtx, pCtx.writers[0], pPath);
+        }
+
+        for (uint64_t i = 1; i < pCtx.topShards.size (); ++i) {
+            pCtx.topShards[0].merge (pCtx.topShards[i]);
+        }
+        top     = pCtx.topShards[0].take_sorted ();
+    }
+    catch (const std::bad_alloc &) {
+        SHOW_ERR (std::make_error_code (std::errc::not_enough_memory), L"Error while ranking the entries of \"" PATH_FMT L"\"", pPath.c_str ());
+    }
+
+    // only the winners are resolved and printed (their paths are printed as absolute paths, like the matches of a search)
+    for (const auto &entry : top) {
+        filepath    = resolved_path (pCtx, entry.path, errorCode);
+        if (errorCode.value () != 0) {
+            filepath    = entry.path;
+        }
+
+        if (pCtx.outputFormat != OutputFormat::TEXT) {
+            pCtx.writers[0].write_record (pCtx.outputFormat,
+                                            EntryRecord {filepath.native (), nullptr, nullptr, entry.type, RECORD_HAS_SIZE,
+                                                            entry.size, 0, fs::perms::none});
+        }
+        else {
+            write_entry_line (pCtx.writers[0], format_int (entry.size, fmtIntBuff), -1, filepath.native (),
+                                entry.type == EntryType::DIRECTORY);
+        }
+    }
+
+    pCtx.flush_writers ();
+}
+
+/**
+ * @brief                   Writes one line of a histogram (a description of the bucket, followed by its files)
+ *
+ * @param pOut              Writer to write the line to
+ * @param pLabel            Description of the bucket
+ * @param pBucket           Files in the bucket
+ */
+void
+write_histogram_line (OutputWriter &pOut, const char *pLabel, const StatsBucket &pBucket) noexcept
+{
+    /** Buffer to store the number of files formatted with periods */
+    char                    fmtCntBuff[MAX_FMT_INT_LEN];
+    /** Buffer to store the size of the files formatted with periods */
+    char                    fmtIntBuff[MAX_FMT_INT_LEN];
+
+    pOut.write_fmt ("    %-20s %16s files %22s bytes\n", pLabel,
+                    format_int (pBucket.count, fmtCntBuff), format_int (pBucket.bytes, fmtIntBuff));
+}
+
+/**
+ * @brief                   Visitor of a single-threaded walk that adds the regular files it is handed to the histograms of
+ *                          a scan
+ *
+ *                          Directories are read (and their metadata fetched) through the index and the profile of the
+ *                          scan, so the walk behaves like every other walk of the scan, and errors are reported the same
+ *                          way calc_dir_size reports them
+ */
+struct HistogramVisitor
+{
+    /** Context of the scan */
+    ScanContext             &ctx;
+
+    /**
+     * @brief               Returns the metadata fetched up front for the entries of a given type
+     *
+     * @param pType         Type of the entry, as reported by its directory
+     *
+     * @return uint32_t     Metadata to fetch
+     */
+    [[nodiscard]] uint32_t
+    stat_mask (const EntryType &pType) const noexcept
+    {
+        return (pType == EntryType::REGULAR) ? (ctx.plan.sizeMask)
+                : (pType == EntryType::SYMLINK) ? (STAT_FOLLOW | STAT_TYPE | ctx.plan.sizeMask)
+                : (0);
+    }
+
+    /**
+     * @brief               Reads a directory, restoring it from the index of the previous scan if it has not changed since
+     *
+     * @param pPath         Path of the directory
+     * @param pBatch        Batch to read the entries into
+     * @param pErr          Error that occoured while reading the directory
+     *
+     * @return true         If the directory was read
+     * @return false        If the directory could not be read
+     */
+    [[nodiscard]] bool
+    read_dir (const fs::path &pPath, DirBatch &pBatch, std::error_code &pErr) noexcept
+    {
+        return read_dir_indexed (ctx, pPath, pBatch, pErr);
+    }
 
-            if (get_option (SHOW_LASTTIME)) {
-                print_last_modif_time (entry);
-            }
+    /**
+     * @brief               Fetches the metadata of the entries of a directory, and adds the directory to the index
+     *
+     * @param pBatch        Batch read by read_dir
+     */
+    void
+    stat_dir (DirBatch &pBatch) noexcept
+    {
+        stat_dir_indexed (ctx, pBatch);
+    }
 
-            if (get_option (SHOW_ABSNOINDENT)) {
-                wprintf (L"%16hs    <%ls>\n",
-                            (curFileSize == -1) ? (" ") : format_int (curFileSize),
-                            filepath.wstring ().c_str ());
-            }
-            else {
-                wprintf (L"%16hs    %-*c<%ls>\n",
-                            (curFileSize == -1) ? (" ") : format_int (curFileSize),
-                            indentWidth,
-                            ' ',
-                            filepath.filename ().wstring ().c_str ());
+    /**
+     * @brief               Reports a directory that could not be read
+     *
+     * @param pPath         Path of the directory
+     * @param pErr          Error that occoured while reading it
+     */
+    void
+    on_error (const fs::path &pPath, const std::error_code &pErr) noexcept
+    {
+        if (ctx.get_option (SHOW_ERRORS)) {
+            SHOW_ERR (pErr, L"Error while creating directory iterator for \"" PATH_FMT L"\"", pPath.c_str ());
+        }
+    }
+
+    /**
+     * @brief               Adds an entry to the histograms if it is a regular file
+     *
+     * @param pView         Entry to add
+     *
+     * @return WalkAction   Whether the walk enters the entry
+     */
+    WalkAction
+    operator() (EntryView &pView) noexcept
+    {
+        /** Entry that is being visited */
+        const DirEntry      &entry          = pView.entry ();
+
+        /** Stores whether the entry is a directory */
+        bool                isDir;
+        /** Stores whether the entry is a regular file */
+        bool                isFile;
+        /** Stores whether the entry is a symlink */
+        bool                isSymlink;
+        /** Stores whether the entry is a special file */
+        bool                isSpecial;
+
+        if (entry.statError && entry.type != EntryType::REGULAR) {
+            if (ctx.get_option (SHOW_ERRORS)) {
+                SHOW_ERR (entry.statError, L"Error while getting status of \"" PATH_FMT L"\"", pView.batch ().path_of (entry).c_str ());
             }
+            return WalkAction::SKIP;
+        }
 
-            if (get_option (SHOW_RECURSIVE)) {
-                if ((sRecursionLevel == 0) || (pLevel < sRecursionLevel)) {
-                    scan_path (filepath.wstring ().c_str (), 1 + pLevel);
-                }
+        classify_entry (entry, isDir, isFile, isSymlink, isSpecial);
+        if (isFile && entry.statError) {
+            if (ctx.get_option (SHOW_ERRORS)) {
+                SHOW_ERR (entry.statError, L"Error while reading size of file \"" PATH_FMT L"\"",
+                            pView.batch ().path_of (entry).c_str ());
             }
         }
-        else {
-            wprintf (L"File type of \"%ls\" can not be determined\n",
-                    filepath.wstring ().c_str ());
-            wprintf (L"Terminating...\n");
-            exit (-1);
+        else if (isFile && !isSymlink) {
+            add_to_histograms (ctx, 0, pView.batch (), entry, counted_size (ctx, entry));
         }
+        else if (!isDir && !isFile && !isSpecial && !isSymlink && ctx.outputFormat == OutputFormat::TEXT) {
+            ctx.writers[0].write ("File type of \"");
+            ctx.writers[0].write_path (pView.batch ().path_of (entry));
+            ctx.writers[0].write ("\" can not be determined");
+            ctx.writers[0].end_line ();
+        }
+
+        return WalkAction::CONTINUE;
     }
+};
 
-    sNumFilesTotal      += regularFileCnt;
-    sNumSymlinksTotal   += symlinkCnt;
-    sNumSpecialTotal    += specialCnt;
-    sNumDirsTotal       += subdirCnt;
+/**
+ * @brief                   Writes the histograms of the sizes and ages of regular files, followed by their counts and sizes
+ *                          per extension (largest first)
+ *
+ * @param pOut              Writer to write the histograms to
+ * @param pStats            Histograms of all the files
+ * @param pPath             Path to the directory the files were found within
+ */
+void
+write_histograms (OutputWriter &pOut, const FileStats &pStats, const fs::path &pPath) noexcept
+{
+    /** Extensions of all the files, largest first */
+    std::vector<std::pair<fs::path::string_type, StatsBucket>>  extensions;
+    /** All the files, by size (used to print the total) */
+    StatsBucket             total;
+
+    /** Buffer to store the description of the current bucket of sizes */
+    char                    labelBuff[MAX_FMT_INT_LEN];
 
-    if (pLevel == 0) {
-        sNumFilesRoot       += regularFileCnt;
-        sNumSymlinksRoot    += symlinkCnt;
-        sNumSpecialRoot     += specialCnt;
-        sNumDirsRoot        += subdirCnt;
+    try {
+        extensions.assign (pStats.extensions ().begin (), pStats.extensions ().end ());
+    }
+    catch (const std::bad_alloc &) {
+        SHOW_ERR (std::make_error_code (std::errc::not_enough_memory), L"Error while merging the histograms of \"" PATH_FMT L"\"", pPath.c_str ());
+        return;
     }
 
-    // scanning is complete, now print the summary of the current directory if this function call was not for scanning
+    std::sort (extensions.begin (), extensions.end (), [] (const auto &pLeft, const auto &pRight) {
+        return (pLeft.second.bytes != pRight.second.bytes) ? (pLeft.second.bytes > pRight.second.bytes)
+                                                            : (pLeft.first < pRight.first);
+    });
 
-    // if the current dir has some files and the show files option was not set (they were not displayed), then print the number of files atleast
-    if (regularFileCnt != 0 && !get_option (SHOW_FILES)) {
+    for (size_t i = 0; i < STATS_SIZE_BUCKETS; ++i) {
+        total.count     += pStats.size_bucket (i).count;
+        total.bytes     += pStats.size_bucket (i).bytes;
+    }
 
-#if defined (_WIN32) || defined (_WIN64)
-#else
-        // if the permissions and last modification options are set, print gaps before the directory's summary to format it better
-        if (get_option (SHOW_PERMISSIONS)) {
-            wprintf (L"            ");
-        }
-#endif
+    pOut.write_fmt ("Histograms of the regular files within \"%s\"\n\n", (const char *)pPath.u8string ().c_str ());
+    write_histogram_line (pOut, "All files", total);
 
-        if (get_option (SHOW_LASTTIME)) {
-            wprintf (L"%20c", ' ');
+    // only the buckets that hold any files are printed
+    pOut.write ("\nRegular files by size\n");
+    for (size_t i = 0; i < STATS_SIZE_BUCKETS; ++i) {
+        if (pStats.size_bucket (i).count != 0) {
+            FileStats::size_label (i, labelBuff, sizeof (labelBuff));
+            write_histogram_line (pOut, labelBuff, pStats.size_bucket (i));
         }
+    }
 
-        strcpy (fmtIntBuff, format_int (totalFileSize));
-
-        // if either of the noindent options were set, then dont print the indentations for this directory
-        if (get_option (SHOW_ABSNOINDENT)) {
-            wprintf (L"%16hs    %-*c<%hs files>\n",
-                        fmtIntBuff,
-                        (pLevel == 0) ? (0) : (INDENT_COL_WIDTH),   // a single indent needs to be printed if this is not the root dir
-                        ' ',
-                        format_int (regularFileCnt));
-        }
-        else {
-            wprintf (L"%16hs    %-*c<%hs files>\n",
-                        fmtIntBuff,
-                        indentWidth,
-                        ' ',
-                        format_int (regularFileCnt));
+    pOut.write ("\nRegular files by time since last modification\n");
+    for (size_t i = 0; i < STATS_AGE_BUCKETS; ++i) {
+        if (pStats.age_bucket (i).count != 0) {
+            write_histogram_line (pOut, FileStats::age_label (i), pStats.age_bucket (i));
         }
+    }
 
+    pOut.write ("\nRegular files by extension\n");
+    for (const auto &[ext, bucket] : extensions) {
+        write_histogram_line (pOut, (ext.empty ()) ? ("(none)") : ((const char *)fs::path (ext).u8string ().c_str ()), bucket);
     }
-    // if the current dir has some symlinks and the show symlinks option was not set (they were not displayed), then print the number of symlinks atleast
-    if (symlinkCnt != 0 && !get_option (SHOW_SYMLINKS)) {
+}
 
-#if defined (_WIN32) || defined (_WIN64)
-#else
-        // if the permissions and last modification options are set, print gaps before the directory's summary to format it better
-        if (get_option (SHOW_PERMISSIONS)) {
-            wprintf (L"            ");
-        }
-#endif
+/**
+ * @brief                   Walks the whole tree below a directory, and prints only histograms of the sizes and ages of the
+ *                          regular files within it, along with their counts and sizes per extension
+ *
+ *                          Nothing is printed while the tree is walked. Each worker adds the files it finds to its own
+ *                          histograms (so the walk shares nothing between workers), and the histograms are merged once
+ *                          the walk is complete
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path to the directory to walk
+ */
+void
+histogram_path_init (ScanContext &pCtx, const fs::path &pPath) noexcept
+{
+    /** Container for error codes reported while reading the directory */
+    std::error_code         errorCode;
+    /** Identity of the directory to walk (only fetched to find out whether it can be read) */
+    DirIdentity             identity;
 
-        if (get_option (SHOW_LASTTIME)) {
-            wprintf (L"%20c", ' ');
-        }
+    plan_scan (pCtx);
+    pCtx.reset_counters (1);
+    pCtx.reset_writers (1);
 
-        // if either of the noindent options were set, then dont print the indentations for this directory
-        if (get_option (SHOW_ABSNOINDENT)) {
-            wprintf (L"%16c    %-*c<%hs symlinks>\n",
-                        '-',
-                        (pLevel == 0) ? (0) : (INDENT_COL_WIDTH),
-                        ' ',
-                        format_int (symlinkCnt));
+    resolve_root (pCtx, pPath);
+    find_root_dev (pCtx, pPath);
+
+    if (!read_dir_identity (pPath, identity, errorCode)) {
+        if (pCtx.get_option (SHOW_ERRORS)) {
+            SHOW_ERR (errorCode, L"Error iterating over \"" PATH_FMT L"\"", pPath.c_str ());
         }
         else {
-            wprintf (L"%16c    %-*c<%hs symlinks>\n",
-                        '-',
-                        indentWidth,
-                        ' ',
-                        format_int (symlinkCnt));
+            pCtx.writers[0].write ("Error iterating over \"");
+            pCtx.writers[0].write_path (pPath);
+            pCtx.writers[0].write ("\"");
+            pCtx.writers[0].end_line ();
         }
-
+        pCtx.flush_writers ();
+        return;
     }
-    // if the current dir has some files and the show files option was not set (they were not displayed), then print the number of files atleast
-    if (specialCnt != 0 && !get_option (SHOW_SPECIAL)) {
 
-#if defined (_WIN32) || defined (_WIN64)
-#else
-        // if the permissions and last modification options are set, print gaps before the directory's summary to format it better
-        if (get_option (SHOW_PERMISSIONS)) {
-            wprintf (L"            ");
+    try {
+        if (pCtx.numThreads > 1) {
+            calc_dir_sizes_parallel (pCtx, pPath);
         }
-#endif
+        else {
 
-        if (get_option (SHOW_LASTTIME)) {
-            wprintf (L"%20c", ' ');
-        }
+            /** Options of the walk (the scan skips excluded names itself, as it reads each directory) */
+            WalkOptions         options;
+            /** Visitor adding the files to the histograms */
+            HistogramVisitor    visitor {pCtx};
 
-        // if either of the noindent options were set, then dont print the indentations for this directory
-        if (get_option (SHOW_ABSNOINDENT)) {
-            wprintf (L"%16c    %-*c<%hs special entries>\n",
-                        '-',
-                        (pLevel == 0) ? (0) : (INDENT_COL_WIDTH),
-                        ' ',
-                        format_int (specialCnt));
+            options.oneFileSystem   = pCtx.filters.oneFileSystem;
+            pCtx.statsShards.assign (1, FileStats (time (nullptr)));
+            if (!walk_tree (pPath, options, visitor, errorCode)) {
+                visitor.on_error (pPath, errorCode);
+            }
         }
-        else {
-            wprintf (L"%16c    %-*c<%llu special entries>\n",
-                        '-',
-                        indentWidth,
-                        ' ',
-                        format_int (specialCnt));
+
+        for (uint64_t i = 1; i < pCtx.statsShards.size (); ++i) {
+            pCtx.statsShards[0].merge (pCtx.statsShards[i]);
         }
     }
+    catch (const std::bad_alloc &) {
+        SHOW_ERR (std::make_error_code (std::errc::not_enough_memory), L"Error while merging the histograms of \"" PATH_FMT L"\"", pPath.c_str ());
+        pCtx.flush_writers ();
+        return;
+    }
 
-    return;
+    write_histograms (pCtx.writers[0], pCtx.statsShards[0], pPath);
+    pCtx.flush_writers ();
 }
 
 /**
- * @brief                   Scans throug a directory and prints entries that match the given pattern and search mode
+ * @brief                   Writes the totals of the subdirectories of a watched tree, each directory sorted by name and
+ *                          followed by the files directly within it (as a recursive scan with directory sizes would print them)
  *
- * @param pPath             Path to the directory to scan
- * @param pLevel            The number of recursive calls of this function before the current one
+ * @param pOut              Writer to write the totals to
+ * @param pTree             Tree whose subdirectories to write
+ * @param pMaxLevel         Number of levels of subdirectories below the root whose contents are written as well
  */
 void
-search_path (const wchar_t *pPath, const uint64_t &pLevel) noexcept
+write_watch_dirs (OutputWriter &pOut, const WatchTree &pTree, const uint64_t &pMaxLevel)
 {
-    if (pPath == nullptr) {
-        fwprintf (stderr, L"Path can not be NULL");
-        std::exit (-1);
-    }
+    /** Directory of the tree whose subdirectories are being written */
+    struct WatchFrame
+    {
+        /** Position of the directory */
+        uint32_t            dir;
+        /** Positions of the subdirectories, sorted by name */
+        std::vector<uint32_t>   children;
+        /** Position of the next subdirectory to write */
+        size_t              next;
+        /** Level of the subdirectories (0 for the subdirectories of the root) */
+        uint64_t            level;
+    };
+
+    /** Directories whose subdirectories are being written, from the root to the deepest one */
+    std::vector<WatchFrame> frames;
+
+    /** Buffer to store the size of the current entry formatted with periods */
+    char                    fmtIntBuff[MAX_FMT_INT_LEN];
+    /** Buffer to store the number of files formatted with periods */
+    char                    fmtCntBuff[MAX_FMT_INT_LEN];
 
+    /** Adds a directory to the frames, along with its subdirectories sorted by name */
+    const auto              push_frame  = [&] (const uint32_t &pDir, const uint64_t &pLevel) {
+        frames.push_back (WatchFrame {pDir, pTree.dir (pDir).children, 0, pLevel});
+        std::sort (frames.back ().children.begin (), frames.back ().children.end (), [&] (const uint32_t &pLeft,
+                                                                                        const uint32_t &pRight) {
+            return pTree.dir (pLeft).path.filename () < pTree.dir (pRight).path.filename ();
+        });
+    };
 
-    /** Iterator to the elements within the current directory */
-    fs::directory_iterator  iter (pPath, sErrorCode);
-    /** Iterator to the element after the last element in the current directory */
-    fs::directory_iterator  fin;
-    /** Reference to current entry (used while dereferencing iter) */
-    fs::directory_entry     entry;
+    push_frame (0, 0);
+    while (!frames.empty ()) {
 
-    /** Stores whether the current entry is a directory */
-    static bool             isDir;
-    /** Stores whether the current entry is a regular file */
-    static bool             isFile;
-    /** Stores whether the current entry is a symlink */
-    static bool             isSymlink;
-    /** Stores whether the current entry is a special file */
-    static bool             isSpecial;
+        /** Directory whose subdirectories are being written */
+        WatchFrame          &frame          = frames.back ();
 
-    /** Stores whether the current entry matches the search pattern */
-    static bool             isMatch;
+        // once all its subdirectories have been written, the files directly within the directory follow them
+        if (frame.next == frame.children.size ()) {
 
-    /** Size of file that is being currently processed */
-    int64_t                 curFileSize;
+            /** Directory that is complete */
+            const WatchDir  &dir            = pTree.dir (frame.dir);
 
-    /** Status of the current entry (permissions, type, etc.) */
-    fs::file_status         entryStatus;
+            if (dir.ownFiles != 0) {
+                write_count_line (pOut, format_int (dir.ownSize, fmtIntBuff), INDENT_COL_WIDTH * frame.level,
+                                    format_int (dir.ownFiles, fmtCntBuff), "files");
+            }
+            frames.pop_back ();
+            continue;
+        }
 
-    /** Name of the current entry */
-    fs::path                filepath;
+        /** Subdirectory being written */
+        const uint32_t      child           = frame.children[frame.next++];
+        /** Level of the subdirectory */
+        const uint64_t      level           = frame.level;
 
-    /** Stores the specific type of an entry if it is a special entry (if the specific type can not be determined, stores L"SPECIAL") */
-    const char              *specialEntryType;
+        write_entry_line (pOut, format_int (pTree.dir (child).totalSize, fmtIntBuff), (int64_t)(INDENT_COL_WIDTH * level),
+                            pTree.dir (child).path.filename ().native (), true);
+        if (level < pMaxLevel) {
+            push_frame (child, level + 1);
+        }
+    }
+}
 
-    /** Stores the path to the target of the symlink if the entry is a symlink */
-    fs::path                targetPath;
+/**
+ * @brief                   Reads the whole tree below a directory once, and then prints the totals of its subdirectories
+ *                          every watchInterval seconds, keeping them up to date as the tree changes (until the program is
+ *                          interrupted)
+ *
+ *                          Only the directories that changed since the last totals were printed are read again, and the
+ *                          difference is added to the totals of their ancestors (see WatchTree), so after the first walk
+ *                          the cost of an update depends on how much of the tree changed rather than on how large it is
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path to the directory to watch
+ */
+void
+watch_path_init (ScanContext &pCtx, const fs::path &pPath) noexcept
+{
+    /** Container for error codes reported while reading the directory */
+    std::error_code         errorCode;
+    /** Time at which the tree was first read */
+    const auto              start       = chrono::steady_clock::now ();
 
+    /** Number of levels of subdirectories whose contents are printed */
+    const uint64_t          maxLevel    = pCtx.filters.maxDepth;
 
-    // if an error occoured while trying to get the directory iterator, then report it here
-    if (sErrorCode.value () != 0) {
-        if (get_option (SHOW_ERRORS)) {
-            SHOW_ERR (L"Error while creating directory iterator for \"%ls\"",
-                        pPath);
-        }
-        if (pLevel == 0) {
-            sPrintSummary   = false;
-        }
+    /** Buffer to store the counts and sizes of the summary formatted with periods */
+    char                    fmtIntBuff[3][MAX_FMT_INT_LEN];
 
-        return;
-    }
+    pCtx.reset_counters (1);
+    pCtx.reset_writers (1);
 
+    try {
 
-    for (fin = end (iter); iter != fin; ++iter) {
+        /** Options of the walks of the tree */
+        WalkOptions         options;
+        /** Tree being watched */
+        WatchTree           tree;
 
-        // get the current entry, its name and its status
-        entry           = *iter;
-        filepath        = entry.path ();
-        entryStatus     = entry.status (sErrorCode);
+        options.oneFileSystem   = pCtx.filters.oneFileSystem;
+        options.statMode        = pCtx.statMode;
+        options.excludes        = pCtx.filters.excludes;
 
-        if (sErrorCode.value () != 0) {
-            if (get_option (SHOW_ERRORS)) {
-                SHOW_ERR (L"Error while getting status of \"%ls\"", filepath.wstring ().c_str ());
+        if (!tree.build (pPath, options, pCtx.get_option (SIZE_ALLOCATED), errorCode)) {
+            if (pCtx.get_option (SHOW_ERRORS)) {
+                SHOW_ERR (errorCode, L"Error iterating over \"" PATH_FMT L"\"", pPath.c_str ());
             }
-            continue;
+            else {
+                pCtx.writers[0].write ("Error iterating over \"");
+                pCtx.writers[0].write_path (pPath);
+                pCtx.writers[0].write ("\"");
+                pCtx.writers[0].end_line ();
+            }
+            pCtx.flush_writers ();
+            return;
         }
 
+        while (true) {
+
+            /** Root of the tree */
+            const WatchDir  &root       = tree.dir (0);
+
+            pCtx.writers[0].write_fmt ("Totals of \"%s\" after %llu seconds (%zu directories watched%s)\n\n",
+                                        (const char *)pPath.u8string ().c_str (),
+                                        (unsigned long long)chrono::duration_cast<chrono::seconds> (
+                                            chrono::steady_clock::now () - start).count (),
+                                        tree.num_watched (),
+                                        (tree.is_complete ()) ? ("") : (", the whole tree is read again on every update"));
+            write_watch_dirs (pCtx.writers[0], tree, maxLevel);
+            pCtx.writers[0].write_fmt ("\n<%s files>\n<%s subdirectories>\n<%s bytes>\n\n",
+                                        format_int (root.totalFiles, fmtIntBuff[0]),
+                                        format_int (root.totalDirs, fmtIntBuff[1]),
+                                        format_int (root.totalSize, fmtIntBuff[2]));
+            pCtx.flush_writers ();
+
+            tree.wait (pCtx.watchInterval * 1000);
+            tree.refresh ();
+        }
+    }
+    catch (const std::bad_alloc &) {
+        SHOW_ERR (std::make_error_code (std::errc::not_enough_memory), L"Error while watching \"" PATH_FMT L"\"", pPath.c_str ());
+        pCtx.flush_writers ();
+    }
+}
 
-        // find out the type of the entry
-        isDir           = entry.is_directory ();
-        isFile          = entry.is_regular_file ();
-        isSymlink       = entry.is_symlink ();
-        isSpecial       = entry.is_other ();
+/**
+ * @brief                   Checks whether an entry of a model passes the size and time predicates of the scan (only
+ *                          regular files are filtered by them)
+ *
+ * @param pCtx              Context of the scan
+ * @param pModel            Model containing the entry
+ * @param pPos              Position of the entry
+ *
+ * @return true             If the entry passes the predicates (or is not a regular file)
+ * @return false            If the entry is a regular file that fails (or whose metadata could not be fetched)
+ */
+[[nodiscard]] inline bool
+model_passes_predicates (const ScanContext &pCtx, const TreeModel &pModel, const uint32_t &pPos) noexcept
+{
+    return pModel.type (pPos) != EntryType::REGULAR || walk_passes_filters (pCtx.filters, pModel.size (pPos), pModel.mtime (pPos));
+}
 
-        // reset the match status
-        isMatch         = false;
+/**
+ * @brief                   Writes the sizes of the subdirectories of a model, each directory sorted by name, through the
+ *                          same lines as a recursive scan with directory sizes (and with its regular files listed along
+ *                          with the subdirectories if they are shown, or summarized after them otherwise)
+ *
+ * @param pCtx              Context of the scan
+ * @param pOut              Writer to write the sizes to
+ * @param pModel            Model whose subdirectories to write
+ * @param pMaxLevel         Number of levels of subdirectories below the root whose contents are written as well
+ */
+void
+write_model_dirs (const ScanContext &pCtx, OutputWriter &pOut, const TreeModel &pModel, const uint64_t &pMaxLevel)
+{
+    /** Directory of the model whose subdirectories are being written */
+    struct ModelFrame
+    {
+        /** Position of the directory */
+        uint32_t            dir;
+        /** Positions of the subdirectories (and of the regular files that are listed), sorted by name */
+        std::vector<uint32_t>   children;
+        /** Position of the next entry to write */
+        size_t              next;
+        /** Level of the entries (0 for the entries of the root) */
+        uint64_t            level;
+        /** Number of regular files directly within the directory */
+        uint64_t            numFiles;
+        /** Combined size of the regular files directly within the directory */
+        int64_t             filesSize;
+        /** Number of symlinks directly within the directory */
+        uint64_t            numSymlinks;
+        /** Number of special files directly within the directory */
+        uint64_t            numSpecial;
+    };
+
+    /** Whether the regular files are listed along with the subdirectories */
+    const bool              isFilesShown    = pCtx.get_option (SHOW_FILES);
+
+    /** Directories whose subdirectories are being written, from the root to the deepest one */
+    std::vector<ModelFrame> frames;
+
+    /** Buffer to store the size of the current entry formatted with periods */
+    char                    fmtIntBuff[MAX_FMT_INT_LEN];
+    /** Buffer to store the number of files formatted with periods */
+    char                    fmtCntBuff[MAX_FMT_INT_LEN];
 
-        if (isSymlink) {
-            ++sNumSymlinksTotal;
-        }
-        else if (isFile) {
-            ++sNumFilesTotal;
-        }
-        else if (isSpecial) {
-            ++sNumSpecialTotal;
-        }
-        else if (isDir) {
-            ++sNumDirsTotal;
-        }
+    /** Adds a directory to the frames, along with its subdirectories sorted by name and the totals of its files */
+    const auto              push_frame  = [&] (const uint32_t &pDir, const uint64_t &pLevel) {
 
-        if (get_option (SEARCH_EXACT)) {
-            isMatch = filepath.filename ().wstring () == sSearchPattern;
-        }
-        else if (get_option (SEARCH_NOEXT)) {
-            isMatch = filepath.stem ().wstring () == sSearchPattern;
-        }
-        else {
-            isMatch = check_contains (filepath.filename ().wstring ());
-        }
+        /** Positions of the entries of the directory */
+        const auto          [first, last]   = pModel.children (pDir);
 
-        if (isMatch) {
-            if (isSymlink && get_option (SHOW_SYMLINKS)) {
-                ++sNumSymlinksMatched;
+        frames.push_back (ModelFrame {pDir, {}, 0, pLevel, 0, 0, 0, 0});
+        for (uint32_t i = first; i < last; ++i) {
+            if (pModel.type (i) == EntryType::DIRECTORY) {
+                frames.back ().children.push_back (i);
             }
-            else if (isFile && get_option (SHOW_FILES)) {
-                ++sNumFilesMatched;
-            }
-            else if (isSpecial && get_option (SHOW_SPECIAL)) {
-                ++sNumSpecialMatched;
+            else if (pModel.type (i) == EntryType::REGULAR) {
+                ++frames.back ().numFiles;
+                frames.back ().filesSize    += std::max<int64_t> (pModel.size (i), 0);
+                if (isFilesShown && model_passes_predicates (pCtx, pModel, i)) {
+                    frames.back ().children.push_back (i);
+                }
             }
-            else if (isDir) {
-                ++sNumDirsMatched;
+            else if (pModel.type (i) == EntryType::SYMLINK) {
+                ++frames.back ().numSymlinks;
             }
             else {
-                isMatch = false;
+                ++frames.back ().numSpecial;
+            }
+        }
+        std::sort (frames.back ().children.begin (), frames.back ().children.end (), [&] (const uint32_t &pLeft,
+                                                                                        const uint32_t &pRight) {
+            return PathView (pModel.name (pLeft), pModel.name_len (pLeft))
+                    < PathView (pModel.name (pRight), pModel.name_len (pRight));
+        });
+    };
+
+    push_frame (0, 0);
+    while (!frames.empty ()) {
+
+        /** Directory whose subdirectories are being written */
+        ModelFrame          &frame          = frames.back ();
+
+        // once all its entries have been written, the entries that were not listed are summarized (as finish_scan_dir does)
+        if (frame.next == frame.children.size ()) {
+            if (frame.numFiles != 0 && !isFilesShown) {
+                write_count_line (pOut, format_int (frame.filesSize, fmtIntBuff), INDENT_COL_WIDTH * frame.level,
+                                    format_int (frame.numFiles, fmtCntBuff), "files");
+            }
+            if (frame.numSymlinks != 0) {
+                write_count_line (pOut, "-", INDENT_COL_WIDTH * frame.level, format_int (frame.numSymlinks, fmtCntBuff), "symlinks");
+            }
+            if (frame.numSpecial != 0) {
+                write_count_line (pOut, "-", INDENT_COL_WIDTH * frame.level, format_int (frame.numSpecial, fmtCntBuff),
+                                    "special entries");
             }
+            frames.pop_back ();
+            continue;
         }
 
-        if (isMatch) {
+        /** Entry being written */
+        const uint32_t      child           = frame.children[frame.next++];
+        /** Level of the entry */
+        const uint64_t      level           = frame.level;
+        /** Whether the entry is a subdirectory (rather than a regular file) */
+        const bool          isDir           = pModel.type (child) == EntryType::DIRECTORY;
+
+        write_entry_line (pOut, (isDir && pModel.size (child) == -1) ? (" ") : (format_int (pModel.size (child), fmtIntBuff)),
+                            (int64_t)(INDENT_COL_WIDTH * level), PathView (pModel.name (child), pModel.name_len (child)), isDir);
+        if (isDir && level < pMaxLevel) {
+            push_frame (child, level + 1);
+        }
+    }
+}
 
-            filepath    = fs::canonical (filepath, sErrorCode);
-            if (sErrorCode.value () != 0) {
-                if (get_option (SHOW_ERRORS)) {
-                    SHOW_ERR (L"Error while converting filepath to canonical value for \"%ls\"",
-                                filepath.wstring ().c_str ());
-                }
-            }
+/**
+ * @brief                   Prints the entries of a model whose names match the search, followed by a summary of the
+ *                          matches and of the whole model
+ *
+ * @param pCtx              Context of the search
+ * @param pModel            Model to search
+ * @param pPath             Path to the directory the model was built from
+ */
+void
+search_model (ScanContext &pCtx, const TreeModel &pModel, const fs::path &pPath)
+{
+    /** Writer to write the matches to */
+    OutputWriter            &out        = pCtx.writers[0];
 
-            else {
+    /** Number of matching entries of each type (files, symlinks, special files and directories) */
+    uint64_t                matched[4]  {};
+    /** Number of entries of each type within the whole model */
+    uint64_t                total[4]    {};
 
-#if defined (_WIN32) || defined (_WIN64)
-#else
-                if (get_option (SHOW_PERMISSIONS)) {
-                    print_permissions (entryStatus);
-                }
-#endif
+    /** Buffers to store the counts of the summaries formatted with periods */
+    char                    fmtIntBuff[5][MAX_FMT_INT_LEN];
+    /** Buffer to store the size of the current entry formatted with periods */
+    char                    fmtSizeBuff[MAX_FMT_INT_LEN];
 
-                if (get_option (SHOW_LASTTIME)) {
-                    print_last_modif_time (entry);
-                }
+    if (pCtx.get_option (SEARCH_PATTERNS)) {
+        out.write_fmt ("Searching for %zu patterns\n\n", pCtx.patternMatcher.size ());
+    }
+    else {
+        out.write_fmt ("Searching for %s\n\n", (const char *)fs::path (pCtx.searchPattern).u8string ().c_str ());
+    }
 
-                if (isSymlink) {
-                    wprintf ((isDir) ? (L"%16hs    <%ls> -> <%ls>\n") : (L"%16hs    %ls -> %ls\n"),
-                                "SYMLINK",
-                                filepath.wstring ().c_str (),
-                                targetPath.wstring ().c_str ());
-                }
+    // the names are scanned from start to end, and a path is only built for the entries that match
+    for (uint32_t i = 1; i < pModel.num_entries (); ++i) {
 
-                else if (isFile) {
-                    curFileSize     = fs::file_size (entry, sErrorCode);
+        /** Type of the entry */
+        const EntryType     type        = pModel.type (i);
+        /** Position of the counters of the type */
+        const size_t        kind        = (type == EntryType::REGULAR) ? (0) : (type == EntryType::SYMLINK) ? (1)
+                                        : (type == EntryType::DIRECTORY) ? (3) : (2);
 
-                    if (sErrorCode.value () != 0) {
-                        if (get_option (SHOW_ERRORS)) {
-                            SHOW_ERR (L"Error while reading size of file \"%ls\"",
-                                        filepath.wstring ().c_str ());
-                        }
+        ++total[kind];
 
-                        // if the size can not be read, set the isFile flag to false to indicate a failed read
-                        curFileSize = -1;
-                    }
+        if (!model_passes_predicates (pCtx, pModel, i)) {
+            continue;
+        }
 
-                    wprintf (L"%16hs    %ls\n",
-                                format_int (curFileSize),
-                                filepath.wstring ().c_str ());
-                }
+        /** Pattern that the name of the entry matched */
+        const int32_t       pattern     = match_name (pCtx, pModel.name (i), pModel.name_len (i));
 
-                else if (isSpecial) {
-                    specialEntryType    = "SPECIAL";
+        if (pattern == -1) {
+            continue;
+        }
+        ++matched[kind];
+
+        /** Pattern that the entry matched, reported only if the search has more than one */
+        const std::string   *display    = (pCtx.get_option (SEARCH_PATTERNS)) ? (&pCtx.patternMatcher.display (pattern)) : (nullptr);
+        /** Path of the entry */
+        const fs::path      path        = pModel.path_of (i);
+
+        write_entry_line (out, (kind == 0) ? (format_int (pModel.size (i), fmtSizeBuff))
+                                : (kind == 1) ? ("SYMLINK")
+                                : (kind == 2) ? (special_type_name (type))
+                                : (!pCtx.get_option (SHOW_DIR_SIZE) || pModel.size (i) == -1) ? (" ")
+                                : (format_int (pModel.size (i), fmtSizeBuff)),
+                            -1, path.native (), kind == 3, nullptr, display);
+    }
 
-                    if (entry.is_socket ()) {
-                        specialEntryType    = "SOCKET";
-                    }
-                    else if (entry.is_block_file ()) {
-                        specialEntryType    = "BLOCK DEVICE";
-                    }
-                    else if (entry.is_fifo ()) {
-                        specialEntryType    = "FIFO PIPE";
-                    }
+    out.write_fmt (foundSum, format_int (matched[0], fmtIntBuff[0]), format_int (matched[1], fmtIntBuff[1]),
+                    format_int (matched[2], fmtIntBuff[2]), format_int (matched[3], fmtIntBuff[3]),
+                    format_int (matched[0] + matched[1] + matched[2] + matched[3], fmtIntBuff[4]));
+    out.write_fmt (TotalSum, (const char *)pPath.u8string ().c_str (),
+                    format_int (total[0], fmtIntBuff[0]), format_int (total[1], fmtIntBuff[1]),
+                    format_int (total[2], fmtIntBuff[2]), format_int (total[3], fmtIntBuff[3]),
+                    format_int (total[0] + total[1] + total[2] + total[3], fmtIntBuff[4]));
+}
 
-#if defined (_WIN32) || defined (_WIN64)
-#else
-                    if (get_option (SHOW_PERMISSIONS)) {
-                        print_permissions (entryStatus);
-                    }
-#endif
+/**
+ * @brief                   Reads the whole tree below a directory into memory once, and then answers every query that was
+ *                          asked for from the model, one after the other: the sizes of the directories, the entries that
+ *                          match the search, the largest entries and the histograms of the regular files
+ *
+ *                          Each query is a linear scan over the columns of the model that it needs (see TreeModel), so
+ *                          asking for several of them costs a single walk of the filesystem. The sizes of the directories
+ *                          are printed if they were asked for, or if nothing else was
+ *
+ * @param pCtx              Context of the scan
+ * @param pPath             Path to the directory to read
+ */
+void
+model_path_init (ScanContext &pCtx, const fs::path &pPath) noexcept
+{
+    /** Container for error codes reported while reading the directory */
+    std::error_code         errorCode;
 
-                    if (get_option (SHOW_LASTTIME)) {
-                        wprintf (L"%20c", ' ');
-                    }
+    /** Whether the search has any patterns */
+    const bool              isSearch    = !pCtx.searchPattern.empty () || pCtx.get_option (SEARCH_PATTERNS);
+    /** Number of levels of subdirectories whose contents are printed */
+    const uint64_t          maxLevel    = pCtx.filters.maxDepth;
 
-                    wprintf (L"%16hs    %ls\n",
-                                specialEntryType,
-                                filepath.wstring ().c_str ());
-                }
+    /** Buffer to store the counts and sizes of the summary formatted with periods */
+    char                    fmtIntBuff[3][MAX_FMT_INT_LEN];
 
-                else if (isDir) {
+    pCtx.reset_counters (1);
+    pCtx.reset_writers (1);
 
-                    if (get_option (SHOW_DIR_SIZE)) {
-                        // curFileSize = scan_path<true> (filepath.wstring ().c_str (), 0);
-                        curFileSize = calc_dir_size (filepath.wstring ().c_str ());
-                    }
-                    else {
-                        curFileSize = -1;
-                    }
+    // paths built by the model are absolute, like the paths of the matches of a search
+    resolve_root (pCtx, pPath);
+
+    try {
+
+        /** Options of the walk */
+        WalkOptions         options;
+        /** Model of the tree */
+        TreeModel           model;
+
+        options.oneFileSystem   = pCtx.filters.oneFileSystem;
+        options.statMode        = pCtx.statMode;
+        options.excludes        = pCtx.filters.excludes;
+
+        if (!model.build ((pCtx.resolvedRoot.empty ()) ? (pPath) : (pCtx.resolvedRoot), options,
+                            pCtx.get_option (SIZE_ALLOCATED), errorCode)) {
+            if (pCtx.get_option (SHOW_ERRORS)) {
+                SHOW_ERR (errorCode, L"Error iterating over \"" PATH_FMT L"\"", pPath.c_str ());
+            }
+            else {
+                pCtx.writers[0].write ("Error iterating over \"");
+                pCtx.writers[0].write_path (pPath);
+                pCtx.writers[0].write ("\"");
+                pCtx.writers[0].end_line ();
+            }
+            pCtx.flush_writers ();
+            return;
+        }
+
+        if (threadProfile != nullptr) {
+            threadProfile->dirsRead         += model.num_dirs ();
+            threadProfile->entriesSeen      += model.num_entries () - 1;
+            threadProfile->errors[(size_t)ProfileError::READ_DIR]   += model.num_errors ();
+        }
+
+        if (pCtx.get_option (SHOW_DIR_SIZE) || (!isSearch && pCtx.topCount == 0 && !pCtx.get_option (SHOW_HISTOGRAMS))) {
+
+            /** Number of regular files and directories within the whole model */
+            uint64_t        counts[2]   {};
+
+            for (uint32_t i = 1; i < model.num_entries (); ++i) {
+                counts[0]   += model.type (i) == EntryType::REGULAR;
+                counts[1]   += model.type (i) == EntryType::DIRECTORY;
+            }
+
+            pCtx.writers[0].write_fmt ("Sizes of the directories within \"%s\"\n\n",
+                                        (const char *)pPath.u8string ().c_str ());
+            write_model_dirs (pCtx, pCtx.writers[0], model, maxLevel);
+            pCtx.writers[0].write_fmt ("\n<%s files>\n<%s subdirectories>\n<%s bytes>\n\n",
+                                        format_int (counts[0], fmtIntBuff[0]), format_int (counts[1], fmtIntBuff[1]),
+                                        format_int (model.size (0), fmtIntBuff[2]));
+        }
+
+        if (isSearch) {
+            search_model (pCtx, model, pPath);
+        }
+
+        if (pCtx.topCount != 0) {
 
-                    wprintf (L"%16hs    <%ls>\n",
-                            (curFileSize == -1) ? (" ") : format_int (curFileSize),
-                            filepath.wstring ().c_str ());
+            /** Largest entries of the model */
+            TopEntries      top (pCtx.topCount);
+
+            // symlinks are not ranked, and neither is the root itself
+            for (uint32_t i = 1; i < model.num_entries (); ++i) {
+                if (((model.type (i) == EntryType::REGULAR && pCtx.get_option (TOP_FILES) && model_passes_predicates (pCtx, model, i))
+                    || (model.type (i) == EntryType::DIRECTORY && pCtx.get_option (TOP_DIRS)))
+                    && top.admits (model.size (i))) {
+                    top.offer (model.size (i), model.type (i), model.path_of (i).native ());
                 }
             }
 
+            pCtx.writers[0].write_fmt ("Largest %llu %s within \"%s\"\n\n", (unsigned long long)pCtx.topCount,
+                        (!pCtx.get_option (TOP_DIRS)) ? ("files") : (!pCtx.get_option (TOP_FILES)) ? ("directories") : ("entries"),
+                        (const char *)pPath.u8string ().c_str ());
+            for (const auto &entry : top.take_sorted ()) {
+                write_entry_line (pCtx.writers[0], format_int (entry.size, fmtIntBuff[0]), -1, entry.path,
+                                    entry.type == EntryType::DIRECTORY);
+            }
+            pCtx.writers[0].write ("\n");
         }
 
-        if (isDir && !isSymlink && get_option (SHOW_RECURSIVE)) {
-            if ((sRecursionLevel == 0) || (pLevel < sRecursionLevel)) {
-                search_path (filepath.wstring ().c_str (), 1 + pLevel);
+        if (pCtx.get_option (SHOW_HISTOGRAMS)) {
+
+            /** Histograms of the regular files of the model */
+            FileStats       stats (time (nullptr));
+
+            for (uint32_t i = 1; i < model.num_entries (); ++i) {
+                if (model.type (i) == EntryType::REGULAR && model.size (i) != -1 && model_passes_predicates (pCtx, model, i)) {
+                    stats.add (model.size (i), model.mtime (i), model.name (i), model.name_len (i));
+                }
             }
+            write_histograms (pCtx.writers[0], stats, pPath);
         }
     }
+    catch (const std::bad_alloc &) {
+        SHOW_ERR (std::make_error_code (std::errc::not_enough_memory), L"Error while reading \"" PATH_FMT L"\" into memory", pPath.c_str ());
+    }
+
+    pCtx.flush_writers ();
+}
+
+/**
+ * @brief                   Converts a duration in nanoseconds to milliseconds
+ *
+ * @param pNs               Duration in nanoseconds
+ *
+ * @return double           Duration in milliseconds
+ */
+[[nodiscard]] inline double
+to_ms (const uint64_t &pNs) noexcept
+{
+    return (double)pNs / 1e6;
 }
 
 /**
- * @brief
+ * @brief                   Writes one counter of the profile of a scan
  *
- * @param pPath
+ * @param pOut              Writer to write the counter to
+ * @param pLabel            Description of the counter
+ * @param pValue            Value of the counter
  */
 void
-scan_path_init (const wchar_t *pPath) noexcept
+write_profile_line (OutputWriter &pOut, const char *pLabel, const uint64_t &pValue) noexcept
 {
-    /** Buffer to store the number of files formatted with periods */
-    char    numFilesFmt[MAX_FMT_INT_LEN];
-    /** Buffer to store the number of symlinks formatted with periods */
-    char    numSymlinksFmt[MAX_FMT_INT_LEN];
-    /** Buffer to store the number of special files formatted with periods */
-    char    numSpecialFmt[MAX_FMT_INT_LEN];
-    /** Buffer to store the number of directories formatted with periods */
-    char    numDirsFmt[MAX_FMT_INT_LEN];
-    /** Buffer to store the total number of filesystem entries formatted with periods */
-    char    numTotalFmt[MAX_FMT_INT_LEN];
+    /** Buffer to store the value formatted with periods */
+    char                    fmtIntBuff[MAX_FMT_INT_LEN];
 
-    sPrintSummary   = true;
+    pOut.write_fmt ("    %-36s %16s\n", pLabel, format_int (pValue, fmtIntBuff));
+}
 
-    scan_path (pPath, 0);
+/**
+ * @brief                   Prints the profile of a scan once it is complete: its counters, the time spent in each phase
+ *                          (summed over all the workers), and how busy each worker of the multi-threaded walks was
+ *
+ *                          The text report follows the output of the scan on the standard output, unless the output is
+ *                          machine-readable, in which case it (like the JSON report) goes to the standard error
+ *
+ * @param pCtx              Context of the scan (which must be profiled)
+ * @param pWallNs           Time taken by the whole scan, in nanoseconds
+ */
+void
+print_profile (ScanContext &pCtx, const uint64_t &pWallNs) noexcept
+{
+    /** Counters and times of all the workers combined */
+    ScanProfile             total;
+    /** Number of bytes written out by the scan */
+    uint64_t                outputBytes     = pCtx.outputBytes;
+
+    /** Labels of the phases, in the order of ProfilePhase */
+    static const char       *phaseLabels[(size_t)ProfilePhase::COUNT]   = {
+        "Reading directories", "Fetching metadata", "Resolving paths", "Calculating directory sizes", "Writing output"
+    };
+    /** Keys of the phases in the JSON report, in the order of ProfilePhase */
+    static const char       *phaseKeys[(size_t)ProfilePhase::COUNT]     = {
+        "read_dir", "stat", "resolve", "dir_size", "output"
+    };
+
+    // everything the scan printed must go out before the report
+    pCtx.flush_writers ();
+
+    total.phaseNs[(size_t)ProfilePhase::OUTPUT]     = pCtx.outputNs;
+    for (const auto &writer : pCtx.writers) {
+        outputBytes                                 += writer.bytes_written ();
+        total.phaseNs[(size_t)ProfilePhase::OUTPUT] += writer.write_ns ();
+    }
+    for (const auto &profile : pCtx.profiles) {
+        total.merge (profile);
+    }
 
-    if (!sPrintSummary) {
+    /** Writer of the report */
+    OutputWriter            out ((pCtx.get_option (PROFILE_JSON) || pCtx.outputFormat != OutputFormat::TEXT)
+                                    ? (SCAN_STDERR_FD) : (SCAN_STDOUT_FD));
+
+    if (pCtx.get_option (PROFILE_JSON)) {
+        out.write_fmt ("{\"wall_ms\":%.3f,\"dirs_read\":%" PRIu64 ",\"dirs_restored\":%" PRIu64 ",\"entries_seen\":%" PRIu64
+                        ",\"entries_stat\":%" PRIu64 ",\"paths_resolved\":%" PRIu64 ",\"size_walks\":%" PRIu64,
+                        to_ms (pWallNs), total.dirsRead, total.dirsRestored, total.entriesSeen, total.entriesStat,
+                        total.pathsResolved, total.sizeWalks);
+        out.write_fmt (",\"errors\":{\"read_dir\":%" PRIu64 ",\"stat\":%" PRIu64 ",\"resolve\":%" PRIu64
+                        ",\"permission\":%" PRIu64 ",\"missing\":%" PRIu64 "}",
+                        total.errors[(size_t)ProfileError::READ_DIR], total.errors[(size_t)ProfileError::STAT],
+                        total.errors[(size_t)ProfileError::RESOLVE], total.permissionErrors, total.missingErrors);
+        out.write (",\"phases_ms\":{");
+        for (size_t i = 0; i < (size_t)ProfilePhase::COUNT; ++i) {
+            out.write_fmt ("%s\"%s\":%.3f", (i == 0) ? ("") : (","), phaseKeys[i], to_ms (total.phaseNs[i]));
+        }
+        out.write_fmt ("},\"output_bytes\":%" PRIu64 ",\"dirs_prefetched\":%" PRIu64 ",\"dirs_dropped\":%" PRIu64
+                        ",\"throttle_wait_ms\":%.3f,\"throttle_peak_workers\":%" PRIu32 ",\"workers\":[",
+                        outputBytes, pCtx.prefetcher.num_read (), pCtx.prefetcher.num_dropped (),
+                        to_ms (pCtx.throttle.wait_ns ()), pCtx.throttle.peak_limit ());
+        for (size_t i = 0; i < pCtx.profiles.size (); ++i) {
+            out.write_fmt ("%s{\"tasks\":%" PRIu64 ",\"steals\":%" PRIu64 ",\"busy_ms\":%.3f,\"pool_ms\":%.3f}",
+                            (i == 0) ? ("") : (","), pCtx.profiles[i].tasks, pCtx.profiles[i].steals,
+                            to_ms (pCtx.profiles[i].busyNs), to_ms (pCtx.profiles[i].poolNs));
+        }
+        out.write ("]}");
+        out.end_line ();
+        out.flush ();
         return;
     }
 
-    strcpy (numFilesFmt, format_int (sNumFilesRoot));
-    strcpy (numSymlinksFmt, format_int (sNumSymlinksRoot));
-    strcpy (numSpecialFmt, format_int (sNumSpecialRoot));
-    strcpy (numDirsFmt, format_int (sNumDirsRoot));
-    strcpy (numTotalFmt, format_int (sNumFilesRoot +
-                                sNumSymlinksRoot +
-                                sNumSpecialRoot +
-                                sNumDirsRoot));
-
-    wprintf (rootSum,
-                pPath,
-                numFilesFmt,
-                numSymlinksFmt,
-                numSpecialFmt,
-                numDirsFmt,
-                numTotalFmt);
+    out.write_fmt ("\nProfile of the scan (%.3f ms)\n", to_ms (pWallNs));
+    write_profile_line (out, "Directories read", total.dirsRead);
+    write_profile_line (out, "Directories restored from the index", total.dirsRestored);
+    write_profile_line (out, "Entries seen", total.entriesSeen);
+    write_profile_line (out, "Entries whose metadata was fetched", total.entriesStat);
+    write_profile_line (out, "Paths resolved", total.pathsResolved);
+    write_profile_line (out, "Subtrees walked for their sizes", total.sizeWalks);
+    write_profile_line (out, "Bytes of output", outputBytes);
+    if (pCtx.prefetchThreads != 0) {
+        write_profile_line (out, "Directories prefetched", pCtx.prefetcher.num_read ());
+        write_profile_line (out, "Prefetched directories dropped", pCtx.prefetcher.num_dropped ());
+    }
+    if (pCtx.throttle.is_active ()) {
+        write_profile_line (out, "Milliseconds waited on the throttle", pCtx.throttle.wait_ns () / 1000000);
+    }
+    if (pCtx.throttle.peak_limit () != 0) {
+        write_profile_line (out, "Most threads reading at once", pCtx.throttle.peak_limit ());
+    }
 
-    if (get_option (SHOW_RECURSIVE)) {
-        strcpy (numFilesFmt, format_int (sNumFilesTotal));
-        strcpy (numSymlinksFmt, format_int (sNumSymlinksTotal));
-        strcpy (numSpecialFmt, format_int (sNumSpecialTotal));
-        strcpy (numDirsFmt, format_int (sNumDirsTotal));
-        strcpy (numTotalFmt, format_int (sNumFilesTotal +
-                                    sNumSymlinksTotal +
-                                    sNumSpecialTotal +
-                                    sNumDirsTotal));
-
-        wprintf (recSum,
-                    numFilesFmt,
-                    numSymlinksFmt,
-                    numSpecialFmt,
-                    numDirsFmt,
-                    numTotalFmt);
+    out.write ("\nErrors\n");
+    write_profile_line (out, "Reading directories", total.errors[(size_t)ProfileError::READ_DIR]);
+    write_profile_line (out, "Fetching metadata", total.errors[(size_t)ProfileError::STAT]);
+    write_profile_line (out, "Resolving paths", total.errors[(size_t)ProfileError::RESOLVE]);
+    write_profile_line (out, "Of which permission denied", total.permissionErrors);
+    write_profile_line (out, "Of which no longer existing", total.missingErrors);
+
+    // the time of reading and fetching the metadata of the directories walked for their sizes is also part of their phases
+    out.write ("\nTime per phase, summed over all workers (directory sizes include their reads and metadata)\n");
+    for (size_t i = 0; i < (size_t)ProfilePhase::COUNT; ++i) {
+        out.write_fmt ("    %-36s %13.3f ms\n", phaseLabels[i], to_ms (total.phaseNs[i]));
+    }
+
+    // the per-worker breakdown is only meaningful if a multi-threaded walk ran
+    if (total.poolNs != 0) {
+        out.write ("\nWorkers of the multi-threaded walks\n");
+        for (size_t i = 0; i < pCtx.profiles.size (); ++i) {
+            out.write_fmt ("    Worker %-4zu %10" PRIu64 " tasks %10" PRIu64 " stolen %13.3f ms busy (%5.1f%%)\n", i,
+                            pCtx.profiles[i].tasks, pCtx.profiles[i].steals, to_ms (pCtx.profiles[i].busyNs),
+                            (pCtx.profiles[i].poolNs == 0) ? (0.0)
+                            : (100.0 * (double)pCtx.profiles[i].busyNs / (double)pCtx.profiles[i].poolNs));
+        }
     }
+
+    out.flush ();
 }
 
 /**
- * @brief
+ * @brief                   Checks whether a search mode other than the given one has already been set
+ *
+ * @param pCtx              Context of the scan
+ * @param pMode             Search mode that is being set
  *
- * @param pPath
+ * @return true             If a different search mode has been set
+ * @return false            If no search mode (or only the given one) has been set
  */
-void
-search_path_init (const wchar_t *pPath) noexcept
+[[nodiscard]] bool
+other_search_mode_set (const ScanContext &pCtx, const uint8_t &pMode) noexcept
 {
-    /** Buffer to store the number of files formatted with periods */
-    char    numFilesFmt[MAX_FMT_INT_LEN];
-    /** Buffer to store the number of symlinks formatted with periods */
-    char    numSymlinksFmt[MAX_FMT_INT_LEN];
-    /** Buffer to store the number of special files formatted with periods */
-    char    numSpecialFmt[MAX_FMT_INT_LEN];
-    /** Buffer to store the number of directories formatted with periods */
-    char    numDirsFmt[MAX_FMT_INT_LEN];
-    /** Buffer to store the total number of filesystem entries formatted with periods */
-    char    numTotalFmt[MAX_FMT_INT_LEN];
-
-    sPrintSummary   = true;
-
-    wprintf (L"Searching for %ls\n\n", sSearchPattern);
+    for (const uint8_t mode : {SEARCH_EXACT, SEARCH_NOEXT, SEARCH_CONTAINS, SEARCH_PATTERNS, SEARCH_GLOB, SEARCH_REGEX}) {
+        if (mode != pMode && pCtx.get_option (mode)) {
+            return true;
+        }
+    }
 
-    search_path (pPath, 0);
+    return false;
+}
 
-    if (!sPrintSummary) {
-        return;
+/**
+ * @brief                   Parses the number of threads following the jobs option (0 means one thread per hardware thread)
+ *
+ * @param pCtx              Context of the scan to set the number of threads of
+ * @param pArgc             Number of command line arguments
+ * @param pArgv             Command line arguments
+ * @param pIdx              Index of the jobs option (advanced past the number of threads)
+ *
+ * @return true             If the number of threads was parsed
+ * @return false            If the number of threads was missing or invalid (the error has been printed)
+ */
+[[nodiscard]] bool
+parse_num_threads (ScanContext &pCtx, const int &pArgc, char *pArgv[], uint64_t &pIdx) noexcept
+{
+    if ((pIdx + 1) >= (uint64_t)pArgc || strnlen (pArgv[pIdx + 1], MAX_ARG_LEN) == 0) {
+        wprintf (L"No number of threads provided after \"%hs\" flag\n", pArgv[pIdx]);
+        return false;
     }
 
-    strcpy (numFilesFmt, format_int (sNumFilesMatched));
-    strcpy (numSymlinksFmt, format_int (sNumSymlinksMatched));
-    strcpy (numSpecialFmt, format_int (sNumSpecialMatched));
-    strcpy (numDirsFmt, format_int (sNumDirsMatched));
-    strcpy (numTotalFmt, format_int (sNumFilesMatched +
-                                sNumSymlinksMatched +
-                                sNumSpecialMatched +
-                                sNumDirsMatched));
+    pCtx.numThreads     = 0;
+    if (!parse_str_to_uint64 (pArgv[pIdx + 1], pCtx.numThreads)) {
+        wprintf (L"Invalid value for number of threads \"%hs\"\nPlease provide a positive whole number\n", pArgv[pIdx + 1]);
+        return false;
+    }
 
-    wprintf (foundSum,
-                numFilesFmt,
-                numSymlinksFmt,
-                numSpecialFmt,
-                numDirsFmt,
-                numTotalFmt);
+    if (pCtx.numThreads == 0) {
+        pCtx.numThreads     = std::thread::hardware_concurrency ();
+    }
+    if (pCtx.numThreads == 0) {
+        pCtx.numThreads     = 1;
+    }
 
-    strcpy (numFilesFmt, format_int (sNumFilesTotal));
-    strcpy (numSymlinksFmt, format_int (sNumSymlinksTotal));
-    strcpy (numSpecialFmt, format_int (sNumSpecialTotal));
-    strcpy (numDirsFmt, format_int (sNumDirsTotal));
-    strcpy (numTotalFmt, format_int (sNumFilesTotal +
-                                sNumSymlinksTotal +
-                                sNumSpecialTotal +
-                                sNumDirsTotal));
-
-    wprintf (TotalSum,
-                pPath,
-                numFilesFmt,
-                numSymlinksFmt,
-                numSpecialFmt,
-                numDirsFmt,
-                numTotalFmt);
+    ++pIdx;
+    return true;
 }
 
-
 int
 main (int argc, char *argv[]) noexcept
 {
+    /** Context of the scan (or search) requested by the command line arguments */
+    ScanContext         ctx;
+
     /** Path to start the scan process from, as a narrow string */
     const char          *initPathStr;
+    /** Path to start the scan process from, in the native encoding */
+    fs::path            initPath;
     /** Pattern to search for, as a narrow string */
     const char          *searchPattern;
+    /** Path of the file of patterns to search for all at once, as a narrow string */
+    const char          *patternsPath;
+    /** Globs of the names of entries to skip, as narrow strings */
+    std::vector<const char *>   excludeGlobs;
+
+    /** Container for error codes of opening and writing the index */
+    std::error_code     errorCode;
+    /** Description of what is wrong with the search pattern */
+    const char          *patternErr;
+
+    /** Number of directories the scan may read per second (0 if it is not limited) */
+    uint64_t            maxDirsPerSec   = 0;
+    /** Number of entries whose metadata the scan may fetch per second (0 if it is not limited) */
+    uint64_t            maxStatsPerSec  = 0;
+    /** Latency of each call to stay under by limiting how many workers make calls at once, in milliseconds (0 if not limited) */
+    uint64_t            maxLatencyMs    = 0;
+    /** Number of levels of directories to go within if the recursive option is set (0 if unlimited) */
+    uint64_t            recursionLevel  = 0;
+    /** Smallest size of the regular files that are shown, as it is given (before it becomes a filter of the walks) */
+    uint64_t            minSize         = 0;
 
     // initialize all paths to null (represents a value that has not been provided)
     initPathStr         = nullptr;
     searchPattern       = nullptr;
+    patternsPath        = nullptr;
+    patternErr          = nullptr;
+
+    // the native paths within messages are converted by the wide streams with the encoding of the locale, which is
+    // ASCII until one is set (UTF-8 is assumed if the environment of the user names no multi-byte encoding)
+    if (setlocale (LC_CTYPE, "") == nullptr || MB_CUR_MAX == 1) {
+        (void)setlocale (LC_CTYPE, "C.UTF-8");
+    }
 
     // iterate through all the command line arguments (except the first one, which is the name of the executable)
     for (uint64_t i = 1, argLen; i < (uint64_t)argc; ++i) {
@@ -1499,13 +4647,13 @@ main (int argc, char *argv[]) noexcept
 
         case 2:
             if (strncmp (argv[i], "-r", 2) == 0) {
-                set_option (SHOW_RECURSIVE);
+                ctx.set_option (SHOW_RECURSIVE);
 
                 // if the user has provided the number of levels, then parse it into a string
                 if ((i + 1) < (uint64_t)argc
                     && strnlen (argv[i + 1], MAX_ARG_LEN) != 0
                     && argv[i + 1][0] != '-') {
-                    if (!parse_str_to_uint64 (argv[i + 1], sRecursionLevel)) {
+                    if (!parse_str_to_uint64 (argv[i + 1], recursionLevel)) {
                         wprintf (L"Invalid value for recursion depth \"%hs\"\nPlease provide a positive whole number\n", argv[i + 1]);
                         return -1;
                     }
@@ -1515,34 +4663,37 @@ main (int argc, char *argv[]) noexcept
 #if defined (_WIN32) || defined (_WIN64)
 #else
             else if (strncmp (argv[i], "-p", 2) == 0) {
-                set_option (SHOW_PERMISSIONS);
+                ctx.set_option (SHOW_PERMISSIONS);
             }
 #endif
             else if (strncmp (argv[i], "-t", 2) == 0) {
-                set_option (SHOW_LASTTIME);
+                ctx.set_option (SHOW_LASTTIME);
             }
 
             else if (strncmp (argv[i], "-f", 2) == 0) {
-                set_option (SHOW_FILES);
+                ctx.set_option (SHOW_FILES);
             }
             else if (strncmp (argv[i], "-l", 2) == 0) {
-                set_option (SHOW_SYMLINKS);
+                ctx.set_option (SHOW_SYMLINKS);
             }
             else if (strncmp (argv[i], "-s", 2) == 0) {
-                set_option (SHOW_SPECIAL);
+                ctx.set_option (SHOW_SPECIAL);
+            }
+            else if (strncmp (argv[i], "-x", 2) == 0) {
+                ctx.filters.oneFileSystem = true;
             }
 
             else if (strncmp (argv[i], "-d", 2) == 0) {
-                set_option (SHOW_DIR_SIZE);
+                ctx.set_option (SHOW_DIR_SIZE);
             }
             else if (strncmp (argv[i], "-a", 2) == 0) {
-                set_option (SHOW_ABSNOINDENT);
+                ctx.set_option (SHOW_ABSNOINDENT);
             }
 
             else if (strncmp (argv[i], "-S", 2) == 0) {
 
                 // make sure that multiple search modes are not being used simultaneously
-                if (get_option (SEARCH_NOEXT) || get_option (SEARCH_CONTAINS)) {
+                if (other_search_mode_set (ctx, SEARCH_EXACT)) {
                     wprintf (L"Can only set one search mode at a time\n");
                     wprintf (L"Terminating...\n");
                     std::exit (-1);
@@ -1557,14 +4708,19 @@ main (int argc, char *argv[]) noexcept
                 }
 
                 // set the option and skip the next argument (that is the search pattern)
-                set_option (SEARCH_EXACT);
+                ctx.set_option (SEARCH_EXACT);
                 searchPattern = argv[++i];
             }
+            else if (strncmp (argv[i], "-j", 2) == 0) {
+                if (!parse_num_threads (ctx, argc, argv, i)) {
+                    return -1;
+                }
+            }
             else if (strncmp (argv[i], "-e", 2) == 0) {
-                set_option (SHOW_ERRORS);
+                ctx.set_option (SHOW_ERRORS);
             }
             else if (strncmp (argv[i], "-h", 2) == 0) {
-                set_option (HELP);
+                ctx.set_option (HELP);
             }
             else {
                 wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
@@ -1574,7 +4730,28 @@ main (int argc, char *argv[]) noexcept
         case 5:
 
             if (strncmp (argv[i], "--abs", 5) == 0) {
-                set_option (SHOW_ABSNOINDENT);
+                ctx.set_option (SHOW_ABSNOINDENT);
+            }
+            else if (strncmp (argv[i], "--top", 5) == 0) {
+                if (i == (uint64_t)(argc - 1) || !parse_str_to_uint64 (argv[i + 1], ctx.topCount) || ctx.topCount == 0) {
+                    wprintf (L"Invalid or missing number of entries after \"%hs\" flag\nPlease provide a positive whole number\n", argv[i]);
+                    return -1;
+                }
+                ++i;
+
+                // the kind of entries to rank is optional (both are ranked together if it is left out)
+                if ((i + 1) < (uint64_t)argc && strncmp (argv[i + 1], "files", MAX_ARG_LEN) == 0) {
+                    ctx.set_option (TOP_FILES);
+                    ++i;
+                }
+                else if ((i + 1) < (uint64_t)argc && strncmp (argv[i + 1], "dirs", MAX_ARG_LEN) == 0) {
+                    ctx.set_option (TOP_DIRS);
+                    ++i;
+                }
+                else {
+                    ctx.set_option (TOP_FILES);
+                    ctx.set_option (TOP_DIRS);
+                }
             }
             else {
                 wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
@@ -1583,7 +4760,34 @@ main (int argc, char *argv[]) noexcept
 
         case 6:
             if (strncmp (argv[i], "--help", 6) == 0) {
-                set_option (HELP);
+                ctx.set_option (HELP);
+            }
+            else if (strncmp (argv[i], "--idle", 6) == 0) {
+                ctx.set_option (IDLE_PRIORITY);
+            }
+            else if (strncmp (argv[i], "--jobs", 6) == 0) {
+                if (!parse_num_threads (ctx, argc, argv, i)) {
+                    return -1;
+                }
+            }
+            else if (strncmp (argv[i], "--glob", 6) == 0) {
+
+                // make sure that multiple search modes are not being used simultaneously
+                if (other_search_mode_set (ctx, SEARCH_GLOB)) {
+                    wprintf (L"Can only set one search mode at a time\n");
+                    wprintf (L"Terminating...\n");
+                    std::exit (-1);
+                }
+                // make sure that a search pattern was provided
+                if (i == (uint64_t)(argc - 1) || strnlen (argv[i + 1], MAX_ARG_LEN) == 0) {
+                    wprintf (L"No Search pattern provided after \"%hs\" flag\n", argv[i]);
+                    wprintf (L"Terminating...\n");
+                    std::exit (-1);
+                }
+
+                // set the option and skip the next argument (that is the search pattern)
+                ctx.set_option (SEARCH_GLOB);
+                searchPattern = argv[++i];
             }
             else {
                 wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
@@ -1592,7 +4796,49 @@ main (int argc, char *argv[]) noexcept
 
         case 7:
             if (strncmp (argv[i], "--files", 7) == 0) {
-                set_option (SHOW_FILES);
+                ctx.set_option (SHOW_FILES);
+            }
+            else if (strncmp (argv[i], "--stats", 7) == 0) {
+                ctx.set_option (SHOW_PROFILE);
+            }
+            else if (strncmp (argv[i], "--watch", 7) == 0) {
+                if (i == (uint64_t)(argc - 1) || !parse_str_to_uint64 (argv[i + 1], ctx.watchInterval) || ctx.watchInterval == 0) {
+                    wprintf (L"Invalid or missing interval after \"%hs\" flag\nPlease provide a positive whole number of seconds\n", argv[i]);
+                    return -1;
+                }
+                ++i;
+            }
+            else if (strncmp (argv[i], "--index", 7) == 0) {
+
+                // make sure that the path of the index was provided
+                if (i == (uint64_t)(argc - 1) || strnlen (argv[i + 1], MAX_ARG_LEN) == 0) {
+                    wprintf (L"No index file provided after \"%hs\" flag\n", argv[i]);
+                    wprintf (L"Terminating...\n");
+                    std::exit (-1);
+                }
+
+                // set the path and skip the next argument (that is the index file)
+                ctx.indexPath   = argv[++i];
+                ctx.queryIndex  = true;
+            }
+            else if (strncmp (argv[i], "--regex", 7) == 0) {
+
+                // make sure that multiple search modes are not being used simultaneously
+                if (other_search_mode_set (ctx, SEARCH_REGEX)) {
+                    wprintf (L"Can only set one search mode at a time\n");
+                    wprintf (L"Terminating...\n");
+                    std::exit (-1);
+                }
+                // make sure that a search pattern was provided
+                if (i == (uint64_t)(argc - 1) || strnlen (argv[i + 1], MAX_ARG_LEN) == 0) {
+                    wprintf (L"No Search pattern provided after \"%hs\" flag\n", argv[i]);
+                    wprintf (L"Terminating...\n");
+                    std::exit (-1);
+                }
+
+                // set the option and skip the next argument (that is the search pattern)
+                ctx.set_option (SEARCH_REGEX);
+                searchPattern = argv[++i];
             }
             else {
                 wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
@@ -1603,7 +4849,7 @@ main (int argc, char *argv[]) noexcept
             if (strncmp (argv[i], "--search", 8) == 0) {
 
                 // make sure that multiple search modes are not being used simultaneously
-                if (get_option (SEARCH_NOEXT) || get_option (SEARCH_CONTAINS)) {
+                if (other_search_mode_set (ctx, SEARCH_EXACT)) {
                     wprintf (L"Can only set one search mode at a time\n");
                     wprintf (L"Terminating...\n");
                     std::exit (-1);
@@ -1612,13 +4858,13 @@ main (int argc, char *argv[]) noexcept
                 // make sure that a search pattern was provided
                 // if (i == (uint64_t)(argc - 1) || strnlen (argv[i + 1], MAX_ARG_LEN) == 0 || argv[i + 1] == '-') {
                 if (i == (uint64_t)(argc - 1) || strnlen (argv[i + 1], MAX_ARG_LEN) == 0) {
-                    wprintf (L"No Search pattern provided after \"%ls\" flag\n", argv[i]);
+                    wprintf (L"No Search pattern provided after \"%hs\" flag\n", argv[i]);
                     wprintf (L"Terminating...\n");
                     std::exit (-1);
                 }
 
                 // set the option and skip the next argument (that is the search pattern)
-                set_option (SEARCH_EXACT);
+                ctx.set_option (SEARCH_EXACT);
                 searchPattern = argv[++i];
             }
             else {
@@ -1628,7 +4874,19 @@ main (int argc, char *argv[]) noexcept
 
         case 9:
             if (strncmp (argv[i], "--special", 9) == 0) {
-                set_option (SHOW_SPECIAL);
+                ctx.set_option (SHOW_SPECIAL);
+            }
+            else if (strncmp (argv[i], "--exclude", 9) == 0) {
+
+                // make sure that the glob was provided
+                if (i == (uint64_t)(argc - 1) || strnlen (argv[i + 1], MAX_ARG_LEN) == 0) {
+                    wprintf (L"No glob provided after \"%hs\" flag\n", argv[i]);
+                    wprintf (L"Terminating...\n");
+                    std::exit (-1);
+                }
+
+                // skip the next argument (that is the glob), which is compiled along with the search pattern
+                excludeGlobs.push_back (argv[++i]);
             }
             else {
                 wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
@@ -1637,12 +4895,12 @@ main (int argc, char *argv[]) noexcept
 
         case 10:
             if (strncmp (argv[i], "--symlinks", 10) == 0) {
-                set_option (SHOW_SYMLINKS);
+                ctx.set_option (SHOW_SYMLINKS);
             }
             else if (strncmp (argv[i], "--contains", 10) == 0) {
 
                 // make sure that multiple search modes are not being used simultaneously
-                if (get_option (SEARCH_NOEXT) || get_option (SEARCH_EXACT)) {
+                if (other_search_mode_set (ctx, SEARCH_CONTAINS)) {
                     wprintf (L"Can only set one search mode at a time\n");
                     wprintf (L"Terminating...\n");
                     std::exit (-1);
@@ -1650,20 +4908,52 @@ main (int argc, char *argv[]) noexcept
                 // make sure that a search pattern was provided
                 // if (i == (uint64_t)(argc - 1) || strnlen (argv[i + 1], MAX_ARG_LEN) == 0 || argv[i + 1] == '-') {
                 if (i == (uint64_t)(argc - 1) || strnlen (argv[i + 1], MAX_ARG_LEN) == 0) {
-                    wprintf (L"No Search pattern provided after \"%ls\" flag\n", argv[i]);
+                    wprintf (L"No Search pattern provided after \"%hs\" flag\n", argv[i]);
                     wprintf (L"Terminating...\n");
                     std::exit (-1);
                 }
 
                 // set the option and skip the next argument (that is the search pattern)
-                set_option (SEARCH_CONTAINS);
+                ctx.set_option (SEARCH_CONTAINS);
                 searchPattern = argv[++i];
             }
+            else if (strncmp (argv[i], "--max-dirs", 10) == 0) {
+                if (i == (uint64_t)(argc - 1) || !parse_str_to_uint64 (argv[i + 1], maxDirsPerSec) || maxDirsPerSec == 0) {
+                    wprintf (L"Invalid or missing rate after \"%hs\" flag\nPlease provide a positive whole number of directories per second\n", argv[i]);
+                    return -1;
+                }
+                ++i;
+            }
+            else if (strncmp (argv[i], "--prefetch", 10) == 0) {
+                ctx.prefetchThreads = PREFETCH_DEFAULT_THREADS;
+
+                // if the user has provided the number of threads, then parse it
+                if ((i + 1) < (uint64_t)argc && strnlen (argv[i + 1], MAX_ARG_LEN) != 0 && argv[i + 1][0] != '-') {
+                    if (!parse_str_to_uint64 (argv[i + 1], ctx.prefetchThreads) || ctx.prefetchThreads == 0
+                        || ctx.prefetchThreads > UINT32_MAX) {
+                        wprintf (L"Invalid number of prefetching threads \"%hs\"\nPlease provide a positive whole number\n", argv[i + 1]);
+                        return -1;
+                    }
+                    ++i;
+                }
+            }
+            else if (strncmp (argv[i], "--min-size", 10) == 0) {
+                if (i == (uint64_t)(argc - 1) || !parse_size (argv[i + 1], minSize)) {
+                    wprintf (L"Invalid or missing size after \"%hs\" flag\nPlease provide a whole number of bytes, optionally followed by K, M, G or T\n", argv[i]);
+                    return -1;
+                }
+                // no file is larger than the largest signed size, so larger minimums are clamped to it
+                ctx.filters.minSize = (int64_t)std::min<uint64_t> (minSize, INT64_MAX);
+                ++i;
+            }
+            else if (strncmp (argv[i], "--io-uring", 10) == 0) {
+                ctx.statMode    = StatMode::IO_URING;
+            }
             else if (strncmp (argv[i], "--dir-size", 10) == 0) {
-                set_option (SHOW_DIR_SIZE);
+                ctx.set_option (SHOW_DIR_SIZE);
             }
             else if (strncmp (argv[i], "--show-err", 10) == 0) {
-                set_option (SHOW_ERRORS);
+                ctx.set_option (SHOW_ERRORS);
             }
             else {
                 wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
@@ -1672,37 +4962,118 @@ main (int argc, char *argv[]) noexcept
 
         case 11:
             if (strncmp (argv[i], "--recursive", 11) == 0) {
-                set_option (SHOW_RECURSIVE);
+                ctx.set_option (SHOW_RECURSIVE);
 
                 // if the user has provided the number of levels, then parse it into a string
                 if ((i + 1) < (uint64_t)argc && strnlen (argv[i + 1], MAX_ARG_LEN) != 0 && argv[i + 1][0] != '-') {
-                    if (!parse_str_to_uint64 (argv[i + 1], sRecursionLevel)) {
+                    if (!parse_str_to_uint64 (argv[i + 1], recursionLevel)) {
                         wprintf (L"Invalid value for recursion depth \"%hs\"\nPlease provide a positive whole number\n", argv[i + 1]);
                         return -1;
                     }
                     ++i;
                 }
             }
+            else if (strncmp (argv[i], "--histogram", 11) == 0) {
+                ctx.set_option (SHOW_HISTOGRAMS);
+            }
+            else if (strncmp (argv[i], "--max-stats", 11) == 0) {
+                if (i == (uint64_t)(argc - 1) || !parse_str_to_uint64 (argv[i + 1], maxStatsPerSec) || maxStatsPerSec == 0) {
+                    wprintf (L"Invalid or missing rate after \"%hs\" flag\nPlease provide a positive whole number of entries per second\n", argv[i]);
+                    return -1;
+                }
+                ++i;
+            }
+            else if (strncmp (argv[i], "--in-memory", 11) == 0) {
+                ctx.set_option (IN_MEMORY_MODEL);
+            }
+            else if (strncmp (argv[i], "--sort=name", 11) == 0) {
+                ctx.sortOrder       = SortOrder::NAME;
+            }
+            else if (strncmp (argv[i], "--sort=size", 11) == 0) {
+                ctx.sortOrder       = SortOrder::SIZE;
+            }
+            else {
+                wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
+            }
+            break;
+        case 12:
+            if (strncmp (argv[i], "--format=bin", 12) == 0) {
+                ctx.outputFormat    = OutputFormat::BIN;
+            }
+            else if (strncmp (argv[i], "--sort=mtime", 12) == 0) {
+                ctx.sortOrder       = SortOrder::MTIME;
+            }
+            else if (strncmp (argv[i], "--stats=json", 12) == 0) {
+                ctx.set_option (SHOW_PROFILE);
+                ctx.set_option (PROFILE_JSON);
+            }
+            else if (strncmp (argv[i], "--disk-usage", 12) == 0) {
+                ctx.set_option (SIZE_ALLOCATED);
+            }
+            else if (strncmp (argv[i], "--newer-than", 12) == 0) {
+                if (i == (uint64_t)(argc - 1) || !parse_time (argv[i + 1], ctx.filters.newerThan)) {
+                    wprintf (L"Invalid or missing time after \"%hs\" flag\nPlease provide a date (YYYY-MM-DD[THH:MM[:SS]]) or an age (such as 12h or 7d)\n", argv[i]);
+                    return -1;
+                }
+                ++i;
+            }
             else {
                 wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
             }
             break;
+
+        case 13:
 #if defined (_WIN32) || defined (_WIN64)
 #else
-        case 13:
             if (strncmp (argv[i], "--permissions", 13) == 0) {
-                set_option (SHOW_PERMISSIONS);
+                ctx.set_option (SHOW_PERMISSIONS);
+            }
+            else
+#endif
+            if (strncmp (argv[i], "--max-latency", 13) == 0) {
+                if (i == (uint64_t)(argc - 1) || !parse_str_to_uint64 (argv[i + 1], maxLatencyMs) || maxLatencyMs == 0
+                    || maxLatencyMs > UINT32_MAX) {
+                    wprintf (L"Invalid or missing latency after \"%hs\" flag\nPlease provide a positive whole number of milliseconds\n", argv[i]);
+                    return -1;
+                }
+                ++i;
+            }
+            else
+            if (strncmp (argv[i], "--format=text", 13) == 0) {
+                ctx.outputFormat    = OutputFormat::TEXT;
+            }
+            else if (strncmp (argv[i], "--format=null", 13) == 0) {
+                ctx.outputFormat    = OutputFormat::NUL;
             }
             else {
                 wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
             }
             break;
-#endif
+
         case 14:
-            if (strncmp (argv[i], "--search-noext", 14) == 0) {
+            if (strncmp (argv[i], "--format=jsonl", 14) == 0) {
+                ctx.outputFormat    = OutputFormat::JSONL;
+            }
+            else if (strncmp (argv[i], "--dedup-inodes", 14) == 0) {
+                ctx.set_option (SIZE_DEDUP_INODES);
+            }
+            else if (strncmp (argv[i], "--update-index", 14) == 0) {
+
+                // make sure that the path of the index was provided
+                if (i == (uint64_t)(argc - 1) || strnlen (argv[i + 1], MAX_ARG_LEN) == 0) {
+                    wprintf (L"No index file provided after \"%hs\" flag\n", argv[i]);
+                    wprintf (L"Terminating...\n");
+                    std::exit (-1);
+                }
+
+                // set the path and skip the next argument (that is the index file)
+                ctx.indexPath   = argv[++i];
+                ctx.queryIndex  = false;
+            }
+            else if (strncmp (argv[i], "--search-noext", 14) == 0) {
 
                 // make sure that multiple search modes are not being used simultaneously
-                if (get_option (SEARCH_CONTAINS) || get_option (SEARCH_EXACT)) {
+                if (other_search_mode_set (ctx, SEARCH_NOEXT)) {
                     wprintf (L"Can only set one search mode at a time\n");
                     wprintf (L"Terminating...\n");
                     std::exit (-1);
@@ -1716,16 +5087,51 @@ main (int argc, char *argv[]) noexcept
                 }
 
                 // set the option and skip the next argument (that is the search pattern)
-                set_option (SEARCH_NOEXT);
+                ctx.set_option (SEARCH_NOEXT);
                 searchPattern = argv[++i];
             }
             else {
                 wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
             }
             break;
+        case 15:
+            if (strncmp (argv[i], "--patterns-from", 15) == 0) {
+
+                // make sure that multiple search modes are not being used simultaneously
+                if (other_search_mode_set (ctx, SEARCH_PATTERNS)) {
+                    wprintf (L"Can only set one search mode at a time\n");
+                    wprintf (L"Terminating...\n");
+                    std::exit (-1);
+                }
+                // make sure that the file of patterns was provided
+                if (i == (uint64_t)(argc - 1) || strnlen (argv[i + 1], MAX_ARG_LEN) == 0) {
+                    wprintf (L"No file of patterns provided after \"%hs\" flag\n", argv[i]);
+                    wprintf (L"Terminating...\n");
+                    std::exit (-1);
+                }
+
+                // set the option and skip the next argument (that is the file of patterns)
+                ctx.set_option (SEARCH_PATTERNS);
+                patternsPath = argv[++i];
+            }
+            else if (strncmp (argv[i], "--breadth-first", 15) == 0) {
+                ctx.set_option (TRAVERSE_BFS);
+            }
+            else {
+                wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
+            }
+            break;
+        case 17:
+            if (strncmp (argv[i], "--one-file-system", 17) == 0) {
+                ctx.filters.oneFileSystem = true;
+            }
+            else {
+                wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
+            }
+            break;
         case 19:
             if (strncmp (argv[i], "--modification-time", 19) == 0) {
-                set_option (SHOW_LASTTIME);
+                ctx.set_option (SHOW_LASTTIME);
             }
             else {
                 wprintf (L"Ignoring Unknown Option \"%hs\"\n", argv[i]);
@@ -1738,36 +5144,206 @@ main (int argc, char *argv[]) noexcept
     }
 
     // print the usage instructions and terminate
-    if (get_option (HELP)) {
+    if (ctx.get_option (HELP)) {
         wprintf (usage, argv[0], argv[0]);
         return 0;
     }
 
-    // convert the provided path to a wide string (if no path was provided, use the relative path to the working directory '.')
-    // it is very important to not use L"." directory, since sInitPath is freed at the end of the program
-    // using a string literal would cause wrong behaviour (possibly crash the program)
-    // sInitPath           = widen_string ((initPathStr == nullptr) ? (".") : (initPathStr));
-    sInitPath           = (initPathStr == nullptr) ? widen_string (".") : widen_string (initPathStr);
+    // io_uring may be missing (or blocked) even on Linux, in which case the blocking calls are used
+    if (ctx.statMode == StatMode::IO_URING && !stat_mode_available (ctx.statMode)) {
+        if (ctx.get_option (SHOW_ERRORS)) {
+            fwprintf (stderr, L"io_uring is not available, fetching metadata with blocking calls instead\n");
+        }
+        ctx.statMode    = StatMode::SYNC;
+    }
+
+    // the patterns are compiled once, before anything is searched
+    if (patternsPath != nullptr && !ctx.patternMatcher.load (patternsPath, errorCode)) {
+        SHOW_ERR (errorCode, L"Error while reading patterns from \"%hs\"", patternsPath);
+        return -1;
+    }
+    if ((ctx.get_option (SEARCH_GLOB) || ctx.get_option (SEARCH_REGEX))
+        && !ctx.nameAutomaton.compile ((ctx.get_option (SEARCH_GLOB)) ? (PatternSyntax::GLOB) : (PatternSyntax::REGEX),
+                                        searchPattern, patternErr)) {
+        wprintf (L"Invalid search pattern \"%hs\": %hs\n", searchPattern, patternErr);
+        wprintf (L"Terminating...\n");
+        return -1;
+    }
+    ctx.filters.excludes.resize (excludeGlobs.size ());
+    for (uint64_t i = 0; i < excludeGlobs.size (); ++i) {
+        if (!ctx.filters.excludes[i].compile (PatternSyntax::GLOB, excludeGlobs[i], patternErr)) {
+            wprintf (L"Invalid glob to exclude \"%hs\": %hs\n", excludeGlobs[i], patternErr);
+            wprintf (L"Terminating...\n");
+            return -1;
+        }
+    }
+    ctx.filters.maxDepth    = (!ctx.get_option (SHOW_RECURSIVE)) ? (0)
+                            : (recursionLevel == 0) ? (UINT64_MAX)
+                            : (recursionLevel);
+
+    if (ctx.get_option (IN_MEMORY_MODEL)
+        && (!ctx.indexPath.empty () || ctx.watchInterval != 0 || ctx.outputFormat != OutputFormat::TEXT
+            || ctx.get_option (SIZE_DEDUP_INODES))) {
+        wprintf (L"Can only read a tree into memory with its output printed as text, every link to a file counted, and without an index or watching it\n");
+        wprintf (L"Terminating...\n");
+        return -1;
+    }
+
+    // the model only keeps the name, type, size and time of each entry, and lists each directory sorted by name
+    if (ctx.get_option (IN_MEMORY_MODEL)
+        && (ctx.get_option (SHOW_SYMLINKS) || ctx.get_option (SHOW_SPECIAL) || ctx.get_option (SHOW_PERMISSIONS)
+            || ctx.get_option (SHOW_LASTTIME) || ctx.get_option (SHOW_ABSNOINDENT) || ctx.get_option (TRAVERSE_BFS)
+            || (ctx.sortOrder != SortOrder::NONE && ctx.sortOrder != SortOrder::NAME))) {
+        wprintf (L"Can only read a tree into memory with its directories listed by name, and without showing symlinks, special files, permissions, times or absolute paths\n");
+        wprintf (L"Terminating...\n");
+        return -1;
+    }
+
+    // the queries are answered one after the other from the model, so any of them can be combined
+    if (!ctx.get_option (IN_MEMORY_MODEL) && ctx.topCount != 0 && (searchPattern != nullptr || patternsPath != nullptr || ctx.queryIndex)) {
+        wprintf (L"Can not rank the largest entries while searching\n");
+        wprintf (L"Terminating...\n");
+        return -1;
+    }
+    if (!ctx.get_option (IN_MEMORY_MODEL) && ctx.get_option (SHOW_HISTOGRAMS)
+        && (searchPattern != nullptr || patternsPath != nullptr || ctx.queryIndex || ctx.topCount != 0)) {
+        wprintf (L"Can only print histograms on their own, without searching or ranking the largest entries\n");
+        wprintf (L"Terminating...\n");
+        return -1;
+    }
+    if (ctx.get_option (SHOW_HISTOGRAMS) && ctx.outputFormat != OutputFormat::TEXT) {
+        wprintf (L"Can only print histograms as text\n");
+        wprintf (L"Terminating...\n");
+        return -1;
+    }
+
+    if (ctx.watchInterval != 0
+        && (searchPattern != nullptr || patternsPath != nullptr || !ctx.indexPath.empty () || ctx.topCount != 0
+            || ctx.get_option (SHOW_HISTOGRAMS))) {
+        wprintf (L"Can only watch a tree on its own, without searching, ranking the largest entries, printing histograms or using an index\n");
+        wprintf (L"Terminating...\n");
+        return -1;
+    }
+    if (ctx.watchInterval != 0 && (ctx.outputFormat != OutputFormat::TEXT || ctx.get_option (SIZE_DEDUP_INODES))) {
+        wprintf (L"Can only watch a tree with its output printed as text, and with every link to a file counted\n");
+        wprintf (L"Terminating...\n");
+        return -1;
+    }
+
+    // only the walks of the filesystem read through the index of the scan find the directories to prefetch
+    if (ctx.prefetchThreads != 0 && (ctx.queryIndex || ctx.watchInterval != 0 || ctx.get_option (IN_MEMORY_MODEL))) {
+        wprintf (L"Can not prefetch directories while answering a search from an index, watching a tree or reading it into memory\n");
+        wprintf (L"Terminating...\n");
+        return -1;
+    }
+
+    // only the walks of the filesystem read through the index of the scan are throttled
+    if ((maxDirsPerSec != 0 || maxStatsPerSec != 0 || maxLatencyMs != 0)
+        && (ctx.prefetchThreads != 0 || ctx.watchInterval != 0 || ctx.get_option (IN_MEMORY_MODEL))) {
+        wprintf (L"Can not throttle a scan while prefetching directories, watching a tree or reading it into memory\n");
+        wprintf (L"Terminating...\n");
+        return -1;
+    }
+    ctx.throttle.set_rates (maxDirsPerSec, maxStatsPerSec);
+    ctx.throttle.set_latency_target (maxLatencyMs * 1000000, (uint32_t)ctx.numThreads);
+
+    // the priority is lowered before any thread is started, so that all of them inherit it (the scan still runs if it can not be)
+    if (ctx.get_option (IDLE_PRIORITY) && !enter_idle_priority (errorCode)) {
+        fwprintf (stderr, L"Could not lower the priority of the scan (Code %d, %hs)\n", errorCode.value (), errorCode.message ().c_str ());
+    }
+
+    // searching an index answers the search from the index alone, so the index must exist
+    if (ctx.queryIndex) {
+        if (searchPattern == nullptr && patternsPath == nullptr) {
+            wprintf (L"Can only use an index with one of the search options\n");
+            wprintf (L"Terminating...\n");
+            return -1;
+        }
+        if (!ctx.prevIndex.open (ctx.indexPath, errorCode)) {
+            SHOW_ERR (errorCode, L"Error while opening index \"" PATH_FMT L"\"", ctx.indexPath.c_str ());
+            return -1;
+        }
+    }
+    // the index of the previous scan is optional (if it does not exist or is not valid, every directory is read)
+    else if (!ctx.indexPath.empty () && !ctx.prevIndex.open (ctx.indexPath, errorCode)) {
+        if (ctx.get_option (SHOW_ERRORS) && errorCode != std::errc::no_such_file_or_directory) {
+            SHOW_ERR (errorCode, L"Ignoring index \"" PATH_FMT L"\"", ctx.indexPath.c_str ());
+        }
+    }
+
+    // the arguments are already in the native encoding everywhere except on Windows, where they are converted once here
+    // (if no path was provided, use the relative path to the working directory '.')
+    // searching an index without a path searches every directory in it
+    initPath            = (initPathStr != nullptr) ? fs::path (initPathStr)
+                        : (ctx.queryIndex) ? fs::path ()
+                        : fs::path (".");
+
+    // the scan writes to the standard output directly, so anything printed while parsing the options must go out first
+    fflush (stdout);
+
+    // each worker counts into its own profile (the main thread being worker 0)
+    if (ctx.get_option (SHOW_PROFILE)) {
+        ctx.profiles.assign ((ctx.numThreads == 0) ? (1) : (ctx.numThreads), ScanProfile {});
+        threadProfile   = &ctx.profiles[0];
+    }
+
+    /** Time at which the scan started (only used if the scan is profiled) */
+    const auto          scanStart       = chrono::steady_clock::now ();
 
-    // if a search pattern was provided, convert it to a wide string and use the search function
+    // if a search pattern was provided, keep it in the native encoding of paths (only converted on Windows, where it is wide)
     if (searchPattern != nullptr) {
-        sSearchPattern  = widen_string (searchPattern);
+        ctx.searchPattern  = fs::path (searchPattern).native ();
 
-#if defined (USE_KMP_SEARCH)
-        if (get_option (SEARCH_CONTAINS)) {
-            sSearchPatternLen   = strnlen (searchPattern, MAX_ARG_LEN);
-            compute_lps ();
+        // the pattern is compared with the names as they are read from the directory, in the native encoding
+        if (ctx.get_option (SEARCH_CONTAINS)) {
+            ctx.containsMatcher = SubstringMatcher (ctx.searchPattern);
         }
-#endif
-        search_path_init (sInitPath);
+    }
+
+    // if the threads can not be started, the walk reads every directory on its own
+    if (ctx.prefetchThreads != 0 && !ctx.prefetcher.start ((uint32_t)ctx.prefetchThreads, prefetch_file_mask (ctx))) {
+        if (ctx.get_option (SHOW_ERRORS)) {
+            fwprintf (stderr, L"Could not start prefetching threads, reading every directory on the walk instead\n");
+        }
+    }
+
+    // every query is answered from one model of the tree, read before any of them
+    if (ctx.get_option (IN_MEMORY_MODEL)) {
+        model_path_init (ctx, initPath);
+    }
+    else if (searchPattern != nullptr || patternsPath != nullptr) {
+        search_path_init (ctx, initPath);
+    }
+    // if only the largest entries are asked for, nothing else is printed
+    else if (ctx.topCount != 0) {
+        top_path_init (ctx, initPath);
+    }
+    // if only histograms are asked for, nothing else is printed
+    else if (ctx.get_option (SHOW_HISTOGRAMS)) {
+        histogram_path_init (ctx, initPath);
+    }
+    // a watched tree is printed over and over, until the program is interrupted
+    else if (ctx.watchInterval != 0) {
+        watch_path_init (ctx, initPath);
     }
     // if no search pattern was provided, use the regular scan function
     else {
-        scan_path_init (sInitPath);
+        scan_path_init (ctx, initPath);
+    }
+
+    ctx.prefetcher.stop ();
+
+    // the previous index is closed first, since it is replaced by the new one
+    if (!ctx.indexPath.empty () && !ctx.queryIndex) {
+        ctx.prevIndex.close ();
+        if (!ctx.nextIndex.write (ctx.indexPath, errorCode)) {
+            SHOW_ERR (errorCode, L"Error while writing index \"" PATH_FMT L"\"", ctx.indexPath.c_str ());
+        }
     }
 
-    free ((void *)sInitPath);
-    free ((void *)sSearchPattern);
+    if (ctx.get_option (SHOW_PROFILE)) {
+        print_profile (ctx, (uint64_t)chrono::duration_cast<chrono::nanoseconds> (chrono::steady_clock::now () - scanStart).count ());
+    }
 
     return 0;
 }
@@ -0,0 +1,1204 @@
+/**
+ * @file            name_automaton.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Glob and regular expression patterns for the names of entries, compiled once into a DFA
+ *
+ *                  A pattern is first parsed into a tree (PatternNode), which is turned into an NFA (one state per
+ *                  position, with transitions on sets of bytes and on nothing at all) and then into a DFA by the subset
+ *                  construction. Bytes that no part of the pattern tells apart share a single class, so the DFA only
+ *                  has a column for each class rather than for each of the 256 bytes
+ *
+ */
+
+#include <cctype>
+#include <cstring>
+
+#include <algorithm>
+#include <bitset>
+#include <filesystem>
+#include <map>
+#include <utility>
+
+#include "name_automaton.h"
+
+/** Largest number of states of the NFA of a pattern, beyond which the pattern is rejected */
+#define NFA_MAX_STATES          (65536)
+/** Deepest nesting of groups within a regular expression */
+#define PATTERN_MAX_DEPTH       (64)
+/** Largest count of a bounded repetition within a regular expression */
+#define PATTERN_MAX_REPEAT      (255)
+/** Upper bound of a repetition that has none */
+#define REPEAT_UNBOUNDED        (UINT32_MAX)
+
+
+/** Set of bytes */
+using ByteSet                   = std::bitset<256>;
+
+/** Node of a parsed pattern */
+struct PatternNode
+{
+    /** What a node matches */
+    enum class Kind : uint8_t
+    {
+        /** A single byte out of a set */
+        BYTE,
+        /** A single UTF-8 character, other than a set of ASCII characters */
+        CHAR,
+        /** All of the children, one after another */
+        CONCAT,
+        /** Any one of the children */
+        ALTERNATE,
+        /** The only child, repeated */
+        REPEAT
+    };
+
+    /** What the node matches */
+    Kind                        kind            {Kind::CONCAT};
+    /** Bytes matched by a BYTE node, or ASCII characters not matched by a CHAR node */
+    ByteSet                     bytes           {};
+    /** Children of the node */
+    std::vector<PatternNode>    children        {};
+    /** Smallest number of repetitions of a REPEAT node */
+    uint32_t                    minCount        {};
+    /** Largest number of repetitions of a REPEAT node (REPEAT_UNBOUNDED if there is no limit) */
+    uint32_t                    maxCount        {};
+};
+
+/**
+ * @brief                   Creates a node matching a single byte out of a set
+ *
+ * @param pBytes            Bytes matched by the node
+ *
+ * @return PatternNode      Node that was created
+ */
+[[nodiscard]] static PatternNode
+make_byte_node (const ByteSet &pBytes)
+{
+    /** Node that is created */
+    PatternNode             node;
+
+    node.kind   = PatternNode::Kind::BYTE;
+    node.bytes  = pBytes;
+
+    return node;
+}
+
+/**
+ * @brief                   Creates a node matching a single character
+ *
+ * @param pExcluded         ASCII characters that the node does not match
+ *
+ * @return PatternNode      Node that was created
+ */
+[[nodiscard]] static PatternNode
+make_char_node (const ByteSet &pExcluded)
+{
+    /** Node that is created */
+    PatternNode             node;
+
+    node.kind   = PatternNode::Kind::CHAR;
+    node.bytes  = pExcluded;
+
+    return node;
+}
+
+/**
+ * @brief                   Creates a node repeating another one
+ *
+ *                          Any number of characters matches the same names as any number of bytes (as long as names are
+ *                          valid UTF-8), so that is what it is turned into, which the prefix and suffix shortcuts recognize
+ *
+ * @param pChild            Node to repeat
+ * @param pMinCount         Smallest number of repetitions
+ * @param pMaxCount         Largest number of repetitions (REPEAT_UNBOUNDED if there is no limit)
+ *
+ * @return PatternNode      Node that was created
+ */
+[[nodiscard]] static PatternNode
+make_repeat_node (PatternNode pChild, const uint32_t &pMinCount, const uint32_t &pMaxCount)
+{
+    /** Node that is created */
+    PatternNode             node;
+
+    if (pChild.kind == PatternNode::Kind::CHAR && pChild.bytes.none () && pMinCount == 0 && pMaxCount == REPEAT_UNBOUNDED) {
+        pChild  = make_byte_node (ByteSet {}.set ());
+    }
+
+    node.kind       = PatternNode::Kind::REPEAT;
+    node.minCount   = pMinCount;
+    node.maxCount   = pMaxCount;
+    node.children.push_back (std::move (pChild));
+
+    return node;
+}
+
+/**
+ * @brief                   Checks whether a node matches any sequence of bytes at all
+ *
+ * @param pNode             Node to check
+ *
+ * @return true             If the node is a repetition of any byte, with no limit
+ * @return false            If the node matches anything less
+ */
+[[nodiscard]] static bool
+is_any_sequence (const PatternNode &pNode) noexcept
+{
+    return pNode.kind == PatternNode::Kind::REPEAT && pNode.minCount == 0 && pNode.maxCount == REPEAT_UNBOUNDED
+            && pNode.children[0].kind == PatternNode::Kind::BYTE && pNode.children[0].bytes.all ();
+}
+
+/**
+ * @brief                   Returns the only byte matched by a node, if it matches a single byte
+ *
+ * @param pNode             Node to check
+ * @param pByte             Byte matched by the node
+ *
+ * @return true             If the node matches exactly one byte
+ * @return false            If the node matches anything else
+ */
+[[nodiscard]] static bool
+literal_byte (const PatternNode &pNode, char &pByte) noexcept
+{
+    if (pNode.kind != PatternNode::Kind::BYTE || pNode.bytes.count () != 1) {
+        return false;
+    }
+
+    for (uint32_t ch = 0; ch < 256; ++ch) {
+        if (pNode.bytes[ch]) {
+            pByte   = (char)ch;
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief                   Parses glob and regular expression patterns into a tree
+ */
+class PatternParser
+{
+    /** Pattern being parsed */
+    std::string_view        mPattern;
+    /** Position of the next character of the pattern */
+    size_t                  mPos                {};
+    /** Number of groups that the next character is within */
+    uint32_t                mDepth              {};
+    /** Whether the current alternative of a regular expression is anchored to the end of names */
+    bool                    mIsAnchoredEnd      {false};
+
+public:
+
+    /** Description of what is wrong with the pattern (nullptr if nothing has been found yet) */
+    const char              *err                {nullptr};
+    /** Whether the last bracket expression that was parsed is not terminated */
+    bool                    isUnterminated      {false};
+
+    explicit
+    PatternParser (const std::string_view &pPattern)
+        : mPattern (pPattern)
+    {
+    }
+
+    /**
+     * @brief               Parses a bracket expression (the opening bracket has already been read)
+     *
+     * @param pSyntax       Language in which the pattern is written
+     * @param pNode         Node matching any of the characters of the expression
+     *
+     * @return true         If the expression was parsed
+     * @return false        If the expression is not terminated or is not valid
+     */
+    [[nodiscard]] bool
+    parse_bracket (const PatternSyntax &pSyntax, PatternNode &pNode)
+    {
+        /** Characters listed within the brackets */
+        ByteSet             bytes;
+        /** Whether the expression matches the characters that are not listed */
+        bool                isNegated           = false;
+        /** Whether the current character is the first one within the brackets */
+        bool                isFirst             = true;
+
+        /** First character of the current range */
+        unsigned char       low;
+        /** Last character of the current range */
+        unsigned char       high;
+
+        if (mPos < mPattern.size () && (mPattern[mPos] == '^' || (pSyntax == PatternSyntax::GLOB && mPattern[mPos] == '!'))) {
+            isNegated   = true;
+            ++mPos;
+        }
+
+        // a closing bracket right after the opening one is listed rather than closing the expression
+        while (mPos < mPattern.size () && (mPattern[mPos] != ']' || isFirst)) {
+            isFirst     = false;
+
+            if (mPattern[mPos] == '[' && mPos + 1 < mPattern.size () && mPattern[mPos + 1] == ':') {
+                if (add_named_class (bytes)) {
+                    continue;
+                }
+                if (err != nullptr) {
+                    return false;
+                }
+            }
+
+            if (mPattern[mPos] == '\\' && mPos + 1 < mPattern.size ()) {
+                ++mPos;
+
+                if (pSyntax == PatternSyntax::REGEX && add_class_escape (mPattern[mPos], bytes)) {
+                    ++mPos;
+                    continue;
+                }
+                if (err != nullptr) {
+                    return false;
+                }
+            }
+
+            low     = (unsigned char)mPattern[mPos++];
+            high    = low;
+
+            if (mPos + 1 < mPattern.size () && mPattern[mPos] == '-' && mPattern[mPos + 1] != ']') {
+                high    = (unsigned char)mPattern[mPos + 1];
+                mPos    += 2;
+                if (high == '\\' && mPos < mPattern.size ()) {
+                    high    = (unsigned char)mPattern[mPos++];
+                }
+            }
+
+            if (low >= 0x80 || high >= 0x80) {
+                err     = "bracket expressions may only list ASCII characters";
+                return false;
+            }
+            if (low > high) {
+                err     = "range in bracket expression is out of order";
+                return false;
+            }
+
+            for (uint32_t ch = low; ch <= high; ++ch) {
+                bytes.set (ch);
+            }
+        }
+
+        if (mPos >= mPattern.size ()) {
+            err             = "bracket expression is not terminated";
+            isUnterminated  = true;
+            return false;
+        }
+        ++mPos;
+
+        pNode   = (isNegated) ? (make_char_node (bytes)) : (make_byte_node (bytes));
+        return true;
+    }
+
+    /**
+     * @brief               Parses a glob (matched against the whole name)
+     *
+     * @param pNode         Node matching the glob
+     *
+     * @return true         If the glob was parsed
+     * @return false        If the glob is not valid
+     */
+    [[nodiscard]] bool
+    parse_glob (PatternNode &pNode)
+    {
+        /** Node of a bracket expression */
+        PatternNode         bracket;
+        /** Position of the current bracket expression */
+        size_t              bracketPos;
+
+        pNode   = PatternNode {};
+
+        while (mPos < mPattern.size ()) {
+            switch (mPattern[mPos]) {
+
+            case '*':
+                ++mPos;
+                if (pNode.children.empty () || !is_any_sequence (pNode.children.back ())) {
+                    pNode.children.push_back (make_repeat_node (make_byte_node (ByteSet {}.set ()), 0, REPEAT_UNBOUNDED));
+                }
+                break;
+
+            case '?':
+                ++mPos;
+                pNode.children.push_back (make_char_node (ByteSet {}));
+                break;
+
+            // a bracket that is never closed is an ordinary character (as it is for the shell)
+            case '[':
+                bracketPos  = mPos++;
+                if (parse_bracket (PatternSyntax::GLOB, bracket)) {
+                    pNode.children.push_back (std::move (bracket));
+                    break;
+                }
+                if (!isUnterminated) {
+                    return false;
+                }
+                err             = nullptr;
+                isUnterminated  = false;
+                mPos    = bracketPos + 1;
+                pNode.children.push_back (make_byte_node (ByteSet {}.set ('[')));
+                break;
+
+            case '\\':
+                if (mPos + 1 < mPattern.size ()) {
+                    ++mPos;
+                }
+                pNode.children.push_back (make_byte_node (ByteSet {}.set ((unsigned char)mPattern[mPos++])));
+                break;
+
+            default:
+                pNode.children.push_back (make_byte_node (ByteSet {}.set ((unsigned char)mPattern[mPos++])));
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief               Parses a regular expression, as a sequence matched against the whole name
+     *
+     *                      Each alternative at the top level of the expression may be anchored on its own, and any part
+     *                      of the name that an alternative is not anchored to may hold any text at all
+     *
+     * @param pNode         Node matching the whole name (a sequence, or any one of several sequences)
+     *
+     * @return true         If the regular expression was parsed
+     * @return false        If the regular expression is not valid
+     */
+    [[nodiscard]] bool
+    parse_regex (PatternNode &pNode)
+    {
+        /** Current alternative */
+        PatternNode         branch;
+        /** Current alternative, along with the text that may surround it */
+        PatternNode         anchored;
+        /** Whether the current alternative is anchored to the start of names */
+        bool                isAnchoredStart;
+
+        pNode       = PatternNode {};
+        pNode.kind  = PatternNode::Kind::ALTERNATE;
+
+        do {
+            if (!pNode.children.empty ()) {
+                ++mPos;
+            }
+
+            isAnchoredStart = mPos < mPattern.size () && mPattern[mPos] == '^';
+            if (isAnchoredStart) {
+                ++mPos;
+            }
+            mIsAnchoredEnd  = false;
+
+            if (!parse_concat (branch)) {
+                return false;
+            }
+
+            anchored    = PatternNode {};
+            if (!isAnchoredStart) {
+                anchored.children.push_back (make_repeat_node (make_byte_node (ByteSet {}.set ()), 0, REPEAT_UNBOUNDED));
+            }
+            for (auto &child : branch.children) {
+                anchored.children.push_back (std::move (child));
+            }
+            if (!mIsAnchoredEnd) {
+                anchored.children.push_back (make_repeat_node (make_byte_node (ByteSet {}.set ()), 0, REPEAT_UNBOUNDED));
+            }
+            pNode.children.push_back (std::move (anchored));
+        } while (mPos < mPattern.size () && mPattern[mPos] == '|');
+
+        if (mPos < mPattern.size ()) {
+            err     = "unbalanced parenthesis";
+            return false;
+        }
+
+        // a single alternative is the sequence itself, whose literal ends can then be compared directly
+        if (pNode.children.size () == 1) {
+            branch  = std::move (pNode.children[0]);
+            pNode   = std::move (branch);
+        }
+
+        return true;
+    }
+
+private:
+
+    /**
+     * @brief               Adds the characters of a shorthand class ("\d", "\w" or "\s") to a set
+     *
+     * @param pEscaped      Character following the backslash
+     * @param pBytes        Set to add the characters to
+     *
+     * @return true         If the escape is a shorthand class
+     * @return false        If the escape is an ordinary character (or could not be used, if err is set)
+     */
+    [[nodiscard]] bool
+    add_class_escape (const char &pEscaped, ByteSet &pBytes)
+    {
+        switch (pEscaped) {
+        case 'd':
+            for (uint32_t ch = '0'; ch <= '9'; ++ch) {
+                pBytes.set (ch);
+            }
+            return true;
+        case 'w':
+            for (uint32_t ch = 0; ch < 0x80; ++ch) {
+                if ((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_') {
+                    pBytes.set (ch);
+                }
+            }
+            return true;
+        case 's':
+            for (const char ch : {' ', '\t', '\n', '\r', '\f', '\v'}) {
+                pBytes.set ((unsigned char)ch);
+            }
+            return true;
+        case 'D':
+        case 'W':
+        case 'S':
+            err     = "negated shorthand classes can not be used within bracket expressions";
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    /**
+     * @brief               Adds the characters of a named class ("[:alpha:]", "[:digit:]", ...) to a set (the opening
+     *                      bracket and colon have not been read yet)
+     *
+     * @param pBytes        Set to add the characters to
+     *
+     * @return true         If a named class was read
+     * @return false        If the bracket is an ordinary character (or the class is not known, if err is set)
+     */
+    [[nodiscard]] bool
+    add_named_class (ByteSet &pBytes)
+    {
+        /** Named classes, along with the ASCII characters within each */
+        // (standard library functions may not have their address taken, hence the lambdas)
+        static constexpr std::pair<std::string_view, int (*) (int)> classes[] {
+            {"alnum", [] (int pCh) { return isalnum (pCh); }},
+            {"alpha", [] (int pCh) { return isalpha (pCh); }},
+            {"blank", [] (int pCh) { return isblank (pCh); }},
+            {"cntrl", [] (int pCh) { return iscntrl (pCh); }},
+            {"digit", [] (int pCh) { return isdigit (pCh); }},
+            {"graph", [] (int pCh) { return isgraph (pCh); }},
+            {"lower", [] (int pCh) { return islower (pCh); }},
+            {"print", [] (int pCh) { return isprint (pCh); }},
+            {"punct", [] (int pCh) { return ispunct (pCh); }},
+            {"space", [] (int pCh) { return isspace (pCh); }},
+            {"upper", [] (int pCh) { return isupper (pCh); }},
+            {"xdigit", [] (int pCh) { return isxdigit (pCh); }}
+        };
+
+        /** Position of the colon and bracket closing the class */
+        const size_t        end     = mPattern.find (":]", mPos + 2);
+        /** Name of the class */
+        std::string_view    name;
+
+        // an opening bracket and colon that are never closed are ordinary characters
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        name    = mPattern.substr (mPos + 2, end - mPos - 2);
+
+        for (const auto &[className, isMember] : classes) {
+            if (name != className) {
+                continue;
+            }
+
+            // the classes are those of the C locale, as bracket expressions only list ASCII characters anyway
+            for (int ch = 0; ch < 0x80; ++ch) {
+                if (isMember (ch)) {
+                    pBytes.set ((size_t)ch);
+                }
+            }
+            mPos    = end + 2;
+            return true;
+        }
+
+        err     = "unknown character class in bracket expression";
+        return false;
+    }
+
+    /**
+     * @brief               Parses any number of alternatives, up to the end of the current group
+     *
+     * @param pNode         Node matching any of the alternatives
+     *
+     * @return true         If the alternatives were parsed
+     * @return false        If any of them is not valid
+     */
+    [[nodiscard]] bool
+    parse_alternate (PatternNode &pNode)
+    {
+        /** Current alternative */
+        PatternNode         branch;
+
+        if (!parse_concat (pNode)) {
+            return false;
+        }
+
+        while (mPos < mPattern.size () && mPattern[mPos] == '|') {
+            ++mPos;
+
+            if (pNode.kind != PatternNode::Kind::ALTERNATE) {
+                branch          = std::move (pNode);
+                pNode           = PatternNode {};
+                pNode.kind      = PatternNode::Kind::ALTERNATE;
+                pNode.children.push_back (std::move (branch));
+            }
+
+            if (!parse_concat (branch)) {
+                return false;
+            }
+            pNode.children.push_back (std::move (branch));
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief               Parses a sequence of (possibly repeated) atoms, up to the next alternative
+     *
+     * @param pNode         Node matching the sequence
+     *
+     * @return true         If the sequence was parsed
+     * @return false        If any part of it is not valid
+     */
+    [[nodiscard]] bool
+    parse_concat (PatternNode &pNode)
+    {
+        /** Current atom */
+        PatternNode         atom;
+        /** Whether an atom was read (anchors are not atoms) */
+        bool                isAtom;
+
+        pNode   = PatternNode {};
+
+        while (mPos < mPattern.size () && mPattern[mPos] != '|' && mPattern[mPos] != ')') {
+            if (!parse_atom (atom, isAtom)) {
+                return false;
+            }
+            if (!isAtom) {
+                continue;
+            }
+            if (!parse_quantifiers (atom)) {
+                return false;
+            }
+            pNode.children.push_back (std::move (atom));
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief               Parses the quantifiers ("*", "+", "?" and "{m,n}") following an atom
+     *
+     * @param pAtom         Atom to apply the quantifiers to
+     *
+     * @return true         If the quantifiers were parsed
+     * @return false        If any of them is not valid
+     */
+    [[nodiscard]] bool
+    parse_quantifiers (PatternNode &pAtom)
+    {
+        /** Smallest number of repetitions */
+        uint32_t            minCount;
+        /** Largest number of repetitions */
+        uint32_t            maxCount;
+
+        while (mPos < mPattern.size ()) {
+            switch (mPattern[mPos]) {
+            case '*':
+                minCount    = 0;
+                maxCount    = REPEAT_UNBOUNDED;
+                ++mPos;
+                break;
+            case '+':
+                minCount    = 1;
+                maxCount    = REPEAT_UNBOUNDED;
+                ++mPos;
+                break;
+            case '?':
+                minCount    = 0;
+                maxCount    = 1;
+                ++mPos;
+                break;
+
+            // a brace that does not start a count is an ordinary character
+            case '{':
+                if (mPos + 1 >= mPattern.size () || mPattern[mPos + 1] < '0' || mPattern[mPos + 1] > '9') {
+                    return true;
+                }
+                ++mPos;
+                if (!parse_count (minCount)) {
+                    return false;
+                }
+                maxCount    = minCount;
+                if (mPos < mPattern.size () && mPattern[mPos] == ',') {
+                    ++mPos;
+                    maxCount    = REPEAT_UNBOUNDED;
+                    if (mPos < mPattern.size () && mPattern[mPos] != '}' && !parse_count (maxCount)) {
+                        return false;
+                    }
+                }
+                if (mPos >= mPattern.size () || mPattern[mPos] != '}') {
+                    err     = "repetition count is not terminated";
+                    return false;
+                }
+                ++mPos;
+                if (maxCount < minCount) {
+                    err     = "repetition counts are out of order";
+                    return false;
+                }
+                break;
+
+            default:
+                return true;
+            }
+
+            pAtom   = make_repeat_node (std::move (pAtom), minCount, maxCount);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief               Parses the count of a bounded repetition
+     *
+     * @param pCount        Count that was parsed
+     *
+     * @return true         If the count was parsed
+     * @return false        If there is no count, or it is too large
+     */
+    [[nodiscard]] bool
+    parse_count (uint32_t &pCount)
+    {
+        if (mPos >= mPattern.size () || mPattern[mPos] < '0' || mPattern[mPos] > '9') {
+            err     = "repetition count is not a number";
+            return false;
+        }
+
+        pCount  = 0;
+        while (mPos < mPattern.size () && mPattern[mPos] >= '0' && mPattern[mPos] <= '9') {
+            pCount  = 10 * pCount + (uint32_t)(mPattern[mPos++] - '0');
+            if (pCount > PATTERN_MAX_REPEAT) {
+                err     = "repetition count is too large";
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief               Parses a single atom (a character, a class, a group or an anchor)
+     *
+     * @param pNode         Node matching the atom
+     * @param pIsAtom       Whether an atom was read (it is not if an anchor was read instead)
+     *
+     * @return true         If the atom was parsed
+     * @return false        If the atom is not valid
+     */
+    [[nodiscard]] bool
+    parse_atom (PatternNode &pNode, bool &pIsAtom)
+    {
+        /** Current character */
+        const unsigned char ch                  = (unsigned char)mPattern[mPos];
+        /** Characters of a shorthand class */
+        ByteSet             bytes;
+        /** Bytes of a character made up of more than one */
+        PatternNode         sequence;
+
+        pIsAtom     = true;
+
+        switch (ch) {
+
+        case '*':
+        case '+':
+        case '?':
+            err     = "nothing to repeat";
+            return false;
+
+        case '^':
+            err     = "\"^\" can only be used at the start of the pattern, or of an alternative outside of groups";
+            return false;
+
+        case '$':
+            if (mDepth != 0 || (mPos + 1 != mPattern.size () && mPattern[mPos + 1] != '|')) {
+                err     = "\"$\" can only be used at the end of the pattern, or of an alternative outside of groups";
+                return false;
+            }
+            ++mPos;
+            mIsAnchoredEnd  = true;
+            pIsAtom         = false;
+            return true;
+
+        case '(':
+            if (++mDepth > PATTERN_MAX_DEPTH) {
+                err     = "groups are nested too deeply";
+                return false;
+            }
+            ++mPos;
+            if (!parse_alternate (pNode)) {
+                return false;
+            }
+            if (mPos >= mPattern.size () || mPattern[mPos] != ')') {
+                err     = "unbalanced parenthesis";
+                return false;
+            }
+            ++mPos;
+            --mDepth;
+            return true;
+
+        case '[':
+            ++mPos;
+            return parse_bracket (PatternSyntax::REGEX, pNode);
+
+        case '.':
+            ++mPos;
+            pNode   = make_char_node (ByteSet {});
+            return true;
+
+        case '\\':
+            if (++mPos >= mPattern.size ()) {
+                err     = "pattern ends with a backslash";
+                return false;
+            }
+            switch (mPattern[mPos]) {
+            case 'D':
+            case 'W':
+            case 'S':
+                (void)add_class_escape ((char)(mPattern[mPos] - 'A' + 'a'), bytes);
+                ++mPos;
+                pNode   = make_char_node (bytes);
+                return true;
+            case 't':
+                ++mPos;
+                pNode   = make_byte_node (ByteSet {}.set ('\t'));
+                return true;
+            case 'n':
+                ++mPos;
+                pNode   = make_byte_node (ByteSet {}.set ('\n'));
+                return true;
+            default:
+                break;
+            }
+            if (add_class_escape (mPattern[mPos], bytes)) {
+                ++mPos;
+                pNode   = make_byte_node (bytes);
+                return true;
+            }
+            if ((mPattern[mPos] >= 'a' && mPattern[mPos] <= 'z') || (mPattern[mPos] >= 'A' && mPattern[mPos] <= 'Z')
+                || (mPattern[mPos] >= '0' && mPattern[mPos] <= '9')) {
+                err     = "unknown escape sequence";
+                return false;
+            }
+            pNode   = make_byte_node (ByteSet {}.set ((unsigned char)mPattern[mPos++]));
+            return true;
+
+        default:
+            break;
+        }
+
+        // all the bytes of a character are a single atom, so that quantifiers apply to the whole character
+        pNode   = make_byte_node (ByteSet {}.set (ch));
+        ++mPos;
+        if (ch >= 0xC0) {
+            sequence.children.push_back (std::move (pNode));
+            pNode   = std::move (sequence);
+            while (mPos < mPattern.size () && ((unsigned char)mPattern[mPos] & 0xC0) == 0x80) {
+                pNode.children.push_back (make_byte_node (ByteSet {}.set ((unsigned char)mPattern[mPos++])));
+            }
+        }
+
+        return true;
+    }
+};
+
+/**
+ * @brief                   NFA of a pattern, built out of its tree
+ */
+class NfaBuilder
+{
+public:
+
+    /** State of the NFA */
+    struct State
+    {
+        /** Transitions on bytes (the bytes, and the next state) */
+        std::vector<std::pair<ByteSet, uint32_t>>   edges       {};
+        /** Transitions on nothing at all */
+        std::vector<uint32_t>                       epsilons    {};
+    };
+
+    /** States of the NFA */
+    std::vector<State>      states              {};
+    /** Whether the NFA needed more than NFA_MAX_STATES states (it is incomplete) */
+    bool                    isTooLarge          {false};
+
+    /**
+     * @brief               Adds a state
+     *
+     * @return uint32_t     New state
+     */
+    [[nodiscard]] uint32_t
+    add_state ()
+    {
+        if (states.size () >= NFA_MAX_STATES) {
+            isTooLarge  = true;
+            return 0;
+        }
+
+        states.emplace_back ();
+        return (uint32_t)states.size () - 1;
+    }
+
+    /**
+     * @brief               Adds the states of a node, starting from a given state
+     *
+     * @param pNode         Node to add
+     * @param pFrom         State from which the node starts
+     *
+     * @return uint32_t     State at which the node ends
+     */
+    [[nodiscard]] uint32_t
+    build (const PatternNode &pNode, uint32_t pFrom)
+    {
+        /** State at which the node ends */
+        uint32_t            to;
+        /** Start of the current part of the node */
+        uint32_t            partFrom;
+
+        if (isTooLarge) {
+            return pFrom;
+        }
+
+        switch (pNode.kind) {
+
+        case PatternNode::Kind::BYTE:
+            to  = add_state ();
+            states[pFrom].edges.emplace_back (pNode.bytes, to);
+            return to;
+
+        case PatternNode::Kind::CHAR:
+            to  = add_state ();
+            states[pFrom].edges.emplace_back (byte_range (0x00, 0x7F) & ~pNode.bytes, to);
+            states[pFrom].edges.emplace_back (byte_range (0x80, 0xC1) | byte_range (0xF5, 0xFF), to);
+            add_sequence (pFrom, to, byte_range (0xC2, 0xDF), 1);
+            add_sequence (pFrom, to, byte_range (0xE0, 0xEF), 2);
+            add_sequence (pFrom, to, byte_range (0xF0, 0xF4), 3);
+            return to;
+
+        case PatternNode::Kind::CONCAT:
+            for (const auto &child : pNode.children) {
+                pFrom   = build (child, pFrom);
+            }
+            return pFrom;
+
+        case PatternNode::Kind::ALTERNATE:
+            to  = add_state ();
+            for (const auto &child : pNode.children) {
+                partFrom    = add_state ();
+                states[pFrom].epsilons.push_back (partFrom);
+                partFrom    = build (child, partFrom);
+                states[partFrom].epsilons.push_back (to);
+            }
+            return to;
+
+        case PatternNode::Kind::REPEAT:
+            for (uint32_t i = 0; i < pNode.minCount && !isTooLarge; ++i) {
+                pFrom   = build (pNode.children[0], pFrom);
+            }
+
+            if (pNode.maxCount == REPEAT_UNBOUNDED) {
+                partFrom    = add_state ();
+                states[pFrom].epsilons.push_back (partFrom);
+                states[build (pNode.children[0], partFrom)].epsilons.push_back (partFrom);
+                to          = add_state ();
+                states[partFrom].epsilons.push_back (to);
+                return to;
+            }
+
+            to  = add_state ();
+            for (uint32_t i = pNode.minCount; i < pNode.maxCount && !isTooLarge; ++i) {
+                states[pFrom].epsilons.push_back (to);
+                pFrom   = build (pNode.children[0], pFrom);
+            }
+            states[pFrom].epsilons.push_back (to);
+            return to;
+        }
+
+        return pFrom;
+    }
+
+private:
+
+    /**
+     * @brief               Returns the set of bytes within a range
+     *
+     * @param pLow          First byte of the range
+     * @param pHigh         Last byte of the range
+     *
+     * @return ByteSet      Bytes within the range
+     */
+    [[nodiscard]] static ByteSet
+    byte_range (const uint32_t &pLow, const uint32_t &pHigh)
+    {
+        /** Bytes within the range */
+        ByteSet             bytes;
+
+        for (uint32_t ch = pLow; ch <= pHigh; ++ch) {
+            bytes.set (ch);
+        }
+        return bytes;
+    }
+
+    /**
+     * @brief               Adds the states of a multi-byte UTF-8 character
+     *
+     * @param pFrom         State from which the character starts
+     * @param pTo           State at which the character ends
+     * @param pLeadBytes    Bytes that start the character
+     * @param pNumTrailing  Number of continuation bytes following the first byte
+     */
+    void
+    add_sequence (const uint32_t &pFrom, const uint32_t &pTo, const ByteSet &pLeadBytes, const uint32_t &pNumTrailing)
+    {
+        /** State after the current byte of the character */
+        uint32_t            cur     = add_state ();
+
+        states[pFrom].edges.emplace_back (pLeadBytes, cur);
+        for (uint32_t i = 1; i < pNumTrailing; ++i) {
+
+            /** State after the next byte of the character */
+            const uint32_t  next    = add_state ();
+
+            states[cur].edges.emplace_back (byte_range (0x80, 0xBF), next);
+            cur     = next;
+        }
+        states[cur].edges.emplace_back (byte_range (0x80, 0xBF), pTo);
+    }
+};
+
+/**
+ * @brief                   Adds a set of states of an NFA, along with every state reachable from them on nothing at all
+ *
+ * @param pNfa              NFA whose states are added
+ * @param pStates           Set of states to add to (kept sorted)
+ * @param pIsAdded          Whether each state of the NFA is in the set (kept in sync with pStates)
+ */
+static void
+epsilon_closure (const NfaBuilder &pNfa, std::vector<uint32_t> &pStates, std::vector<uint8_t> &pIsAdded)
+{
+    /** States whose transitions are yet to be followed */
+    std::vector<uint32_t>   pending (pStates);
+
+    while (!pending.empty ()) {
+
+        /** State whose transitions are followed */
+        const uint32_t      state   = pending.back ();
+
+        pending.pop_back ();
+        for (const uint32_t next : pNfa.states[state].epsilons) {
+            if (!pIsAdded[next]) {
+                pIsAdded[next]  = 1;
+                pStates.push_back (next);
+                pending.push_back (next);
+            }
+        }
+    }
+
+    std::sort (pStates.begin (), pStates.end ());
+}
+
+bool
+NameAutomaton::compile (const PatternSyntax &pSyntax, const std::string_view &pPattern, const char *&pErr)
+{
+    /** Parser of the pattern */
+    PatternParser           parser (pPattern);
+    /** Tree of the pattern */
+    PatternNode             parsed;
+    /** Tree of the pattern, as a sequence matched against the whole name */
+    PatternNode             root;
+
+    /** NFA of the pattern */
+    NfaBuilder              nfa;
+    /** Start state of the NFA */
+    uint32_t                nfaStart;
+    /** Accepting state of the NFA */
+    uint32_t                nfaAccept;
+
+    /** Sets of states of the NFA that make up each state of the DFA, keyed by the set */
+    std::map<std::vector<uint32_t>, uint32_t>   dfaIds;
+    /** Sets of states of the NFA that make up each state of the DFA */
+    std::vector<std::vector<uint32_t>>          dfaSets;
+    /** Whether each state of the NFA is in the set being built */
+    std::vector<uint8_t>    isAdded;
+    /** Set of states of the NFA being built */
+    std::vector<uint32_t>   nextSet;
+    /** Byte representing each class of bytes */
+    std::vector<uint32_t>   classBytes;
+    /** Classes of bytes after being split by the current set of bytes */
+    std::vector<uint32_t>   splitClasses;
+
+    /** Current byte of the prefix or the suffix */
+    char                    literal     = 0;
+    /** Number of nodes of the sequence making up the prefix */
+    size_t                  prefixLen;
+    /** Position of the first node of the sequence making up the suffix */
+    size_t                  suffixPos;
+
+    *this   = NameAutomaton {};
+
+    if ((pSyntax == PatternSyntax::GLOB) ? (!parser.parse_glob (parsed)) : (!parser.parse_regex (parsed))) {
+        pErr    = parser.err;
+        return false;
+    }
+
+    if (parsed.kind == PatternNode::Kind::CONCAT) {
+        for (auto &child : parsed.children) {
+            root.children.push_back (std::move (child));
+        }
+    }
+    else {
+        root.children.push_back (std::move (parsed));
+    }
+
+    // the literal text at either end of the sequence is compared directly, before the automaton is run
+    for (prefixLen = 0; prefixLen < root.children.size () && literal_byte (root.children[prefixLen], literal); ++prefixLen) {
+        mPrefix.push_back (literal);
+    }
+    for (suffixPos = root.children.size (); suffixPos > prefixLen && literal_byte (root.children[suffixPos - 1], literal); --suffixPos) {
+        mSuffix.insert (mSuffix.begin (), literal);
+    }
+
+    if (prefixLen == root.children.size ()) {
+        mShortcut   = Shortcut::LITERAL;
+        return true;
+    }
+    if (suffixPos - prefixLen == 1 && is_any_sequence (root.children[prefixLen])) {
+        mShortcut   = Shortcut::PREFIX_SUFFIX;
+        return true;
+    }
+
+    nfaStart    = nfa.add_state ();
+    nfaAccept   = nfa.build (root, nfaStart);
+    if (nfa.isTooLarge) {
+        pErr    = "pattern is too large";
+        return false;
+    }
+
+    // bytes start out in a single class, which is split by every set of bytes that some transition is taken on
+    for (const auto &state : nfa.states) {
+        for (const auto &[bytes, next] : state.edges) {
+            splitClasses.assign (2 * mNumClasses, UINT32_MAX);
+            mNumClasses = 0;
+            for (uint32_t ch = 0; ch < 256; ++ch) {
+
+                /** Class of the byte once it is split by the set */
+                uint32_t    &split      = splitClasses[2 * mByteClasses[ch] + (bytes[ch] ? 1 : 0)];
+
+                if (split == UINT32_MAX) {
+                    split   = mNumClasses++;
+                }
+                mByteClasses[ch]    = (uint8_t)split;
+            }
+        }
+    }
+
+    classBytes.assign (mNumClasses, 0);
+    for (uint32_t ch = 256; ch-- > 0;) {
+        classBytes[mByteClasses[ch]]    = ch;
+    }
+
+    // the state that never leads to a match comes first, so that it is the one that a zero-initialized table points to
+    isAdded.assign (nfa.states.size (), 0);
+    dfaIds.emplace (std::vector<uint32_t> {}, 0);
+    dfaSets.emplace_back ();
+
+    nextSet     = {nfaStart};
+    isAdded[nfaStart]   = 1;
+    epsilon_closure (nfa, nextSet, isAdded);
+    dfaIds.emplace (nextSet, 1);
+    dfaSets.push_back (nextSet);
+
+    for (uint32_t dfaState = 0; dfaState < dfaSets.size (); ++dfaState) {
+        mTransitions.resize (mTransitions.size () + mNumClasses, 0);
+        mAccepting.push_back (std::binary_search (dfaSets[dfaState].begin (), dfaSets[dfaState].end (), nfaAccept) ? 1 : 0);
+
+        for (uint32_t byteClass = 0; byteClass < mNumClasses; ++byteClass) {
+            for (const uint32_t nfaState : nextSet) {
+                isAdded[nfaState]   = 0;
+            }
+            nextSet.clear ();
+
+            for (const uint32_t nfaState : dfaSets[dfaState]) {
+                for (const auto &[bytes, next] : nfa.states[nfaState].edges) {
+                    if (bytes[classBytes[byteClass]] && !isAdded[next]) {
+                        isAdded[next]   = 1;
+                        nextSet.push_back (next);
+                    }
+                }
+            }
+            epsilon_closure (nfa, nextSet, isAdded);
+
+            /** State of the DFA for the set (added if it is new) */
+            const auto      [it, isNew]     = dfaIds.emplace (nextSet, (uint32_t)dfaSets.size ());
+
+            if (isNew) {
+                if (dfaSets.size () >= AUTOMATON_MAX_STATES) {
+                    pErr    = "pattern is too complex";
+                    return false;
+                }
+                dfaSets.push_back (nextSet);
+            }
+            mTransitions[(size_t)dfaState * mNumClasses + byteClass]    = it->second;
+        }
+    }
+
+    mPrefixState    = 1;
+    for (const char ch : mPrefix) {
+        mPrefixState    = mTransitions[(size_t)mPrefixState * mNumClasses + mByteClasses[(unsigned char)ch]];
+    }
+
+    return true;
+}
+
+bool
+NameAutomaton::matches (const DirBatch::char_t *pName, const size_t &pNameLen) const
+{
+#if defined (_WIN32) || defined (_WIN64)
+    /** Name converted to UTF-8 (names are UTF-16 on Windows) */
+    const std::u8string     utf8Name    = std::filesystem::path (std::wstring_view (pName, pNameLen)).u8string ();
+    /** Bytes of the name */
+    const std::string_view  name ((const char *)utf8Name.data (), utf8Name.size ());
+#else
+    /** Bytes of the name */
+    const std::string_view  name (pName, pNameLen);
+#endif
+
+    /** Current state of the automaton */
+    uint32_t                state;
+
+    if (name.size () < mPrefix.size () + mSuffix.size ()
+        || memcmp (name.data (), mPrefix.data (), mPrefix.size ()) != 0
+        || memcmp (name.data () + name.size () - mSuffix.size (), mSuffix.data (), mSuffix.size ()) != 0) {
+        return false;
+    }
+
+    if (mShortcut == Shortcut::LITERAL) {
+        return name.size () == mPrefix.size ();
+    }
+    if (mShortcut == Shortcut::PREFIX_SUFFIX) {
+        return true;
+    }
+
+    state   = mPrefixState;
+    for (size_t i = mPrefix.size (); i < name.size () && state != 0; ++i) {
+        state   = mTransitions[(size_t)state * mNumClasses + mByteClasses[(unsigned char)name[i]]];
+    }
+
+    return mAccepting[state] != 0;
+}
@@ -0,0 +1,391 @@
+/**
+ * @file            name_matcher.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Matchers for the names of entries, prepared once before a search starts
+ *
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <fstream>
+#include <string_view>
+
+#include "name_matcher.h"
+
+// names are only compared a vector register at a time where they are made up of bytes (everywhere except Windows)
+#if defined (_WIN32) || defined (_WIN64)
+#elif defined (__AVX2__)
+#include <immintrin.h>
+
+/** Number of positions of a name checked at once */
+#define MATCH_BLOCK_LEN         (32)
+/** Number of bits of a mask of candidates for each position */
+#define MATCH_BITS_PER_POS      (1)
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+
+/** Number of positions of a name checked at once */
+#define MATCH_BLOCK_LEN         (16)
+/** Number of bits of a mask of candidates for each position */
+#define MATCH_BITS_PER_POS      (1)
+#elif defined (__ARM_NEON)
+#include <arm_neon.h>
+
+/** Number of positions of a name checked at once */
+#define MATCH_BLOCK_LEN         (16)
+/** Number of bits of a mask of candidates for each position */
+#define MATCH_BITS_PER_POS      (4)
+#endif
+
+/** Number of transitions of each state of the automaton of a MultiPatternMatcher (one for every byte) */
+#define AUTOMATON_FANOUT        (256)
+/** Transition of the automaton of a MultiPatternMatcher that has not been filled yet */
+#define AUTOMATON_NO_STATE      (UINT32_MAX)
+
+#if defined (MATCH_BLOCK_LEN)
+
+static_assert (MATCH_BLOCK_LEN <= DIR_NAME_PADDING, "Blocks read past the end of a name must stay within the padding");
+
+/** Vector register holding a whole block of characters */
+#if defined (__AVX2__)
+using MatchBlock                = __m256i;
+#elif defined (__SSE2__)
+using MatchBlock                = __m128i;
+#else
+using MatchBlock                = uint8x16_t;
+#endif
+
+/**
+ * @brief                   Repeats a character across a whole vector register
+ *
+ * @param pChar             Character to repeat
+ *
+ * @return MatchBlock       Register holding the character at every position
+ */
+[[nodiscard]] static inline MatchBlock
+broadcast (const char &pChar) noexcept
+{
+#if defined (__AVX2__)
+    return _mm256_set1_epi8 (pChar);
+#elif defined (__SSE2__)
+    return _mm_set1_epi8 (pChar);
+#else
+    return vdupq_n_u8 ((uint8_t)pChar);
+#endif
+}
+
+/**
+ * @brief                   Finds the positions of a block of a name where both the first and the last character of
+ *                          the pattern match
+ *
+ * @param pFirst            Characters of the name compared with the first character of the pattern
+ * @param pLast             Characters of the name compared with the last character of the pattern (the length of the
+ *                          pattern minus one after pFirst)
+ * @param pFirstChar        First character of the pattern, repeated
+ * @param pLastChar         Last character of the pattern, repeated
+ *
+ * @return uint64_t         Mask with MATCH_BITS_PER_POS bits set for every such position
+ */
+[[nodiscard]] static inline uint64_t
+find_candidates (const char *pFirst, const char *pLast, const MatchBlock &pFirstChar, const MatchBlock &pLastChar) noexcept
+{
+#if defined (__AVX2__)
+    /** Positions where the first character matches */
+    const __m256i           eqFirst     = _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *)pFirst), pFirstChar);
+    /** Positions where the last character matches */
+    const __m256i           eqLast      = _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *)pLast), pLastChar);
+
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8 (_mm256_and_si256 (eqFirst, eqLast));
+#elif defined (__SSE2__)
+    /** Positions where the first character matches */
+    const __m128i           eqFirst     = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *)pFirst), pFirstChar);
+    /** Positions where the last character matches */
+    const __m128i           eqLast      = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *)pLast), pLastChar);
+
+    return (uint64_t)(uint32_t)_mm_movemask_epi8 (_mm_and_si128 (eqFirst, eqLast));
+#else
+    /** Positions where both characters match (every byte is either all ones or all zeros) */
+    const uint8x16_t        eqBoth      = vandq_u8 (vceqq_u8 (vld1q_u8 ((const uint8_t *)pFirst), pFirstChar),
+                                                    vceqq_u8 (vld1q_u8 ((const uint8_t *)pLast), pLastChar));
+
+    // NEON has no movemask, but narrowing every 16 bit lane by 4 bits keeps 4 bits for every byte
+    return vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16 (vreinterpretq_u16_u8 (eqBoth), 4)), 0);
+#endif
+}
+
+#endif
+
+bool
+SubstringMatcher::matches (const DirBatch::char_t *pName, const size_t &pNameLen) const noexcept
+{
+    /** Length of the pattern */
+    const size_t            patternLen  = mPattern.size ();
+
+    if (patternLen == 0) {
+        return true;
+    }
+    if (patternLen > pNameLen) {
+        return false;
+    }
+
+#if defined (MATCH_BLOCK_LEN)
+    if (patternLen == 1) {
+        return memchr (pName, mPattern[0], pNameLen) != nullptr;
+    }
+
+    /** First character of the pattern, repeated */
+    const MatchBlock        firstChar   = broadcast (mPattern.front ());
+    /** Last character of the pattern, repeated */
+    const MatchBlock        lastChar    = broadcast (mPattern.back ());
+
+    /** Last position of the name at which the pattern can start */
+    const size_t            lastPos     = pNameLen - patternLen;
+
+    /** Positions of the current block where the first and the last character of the pattern match */
+    uint64_t                candidates;
+    /** Position (within the name) of the current candidate */
+    size_t                  pos;
+
+    for (size_t i = 0; i <= lastPos; i += MATCH_BLOCK_LEN) {
+        candidates  = find_candidates (pName + i, pName + i + patternLen - 1, firstChar, lastChar);
+
+        // positions after the last one belong to the padding (or to the next names), so they are discarded
+        if (lastPos - i < MATCH_BLOCK_LEN - 1) {
+            candidates  &= (1ULL << ((lastPos - i + 1) * MATCH_BITS_PER_POS)) - 1;
+        }
+
+        while (candidates != 0) {
+            pos         = i + (size_t)__builtin_ctzll (candidates) / MATCH_BITS_PER_POS;
+
+            if (memcmp (pName + pos + 1, mPattern.data () + 1, patternLen - 2) == 0) {
+                return true;
+            }
+
+            candidates  &= ~(((1ULL << MATCH_BITS_PER_POS) - 1) << ((pos - i) * MATCH_BITS_PER_POS));
+        }
+    }
+
+    return false;
+#else
+    return std::basic_string_view<DirBatch::char_t> (pName, pNameLen).find (mPattern) != std::basic_string_view<DirBatch::char_t>::npos;
+#endif
+}
+
+/**
+ * @brief                   Returns whichever of two positions of patterns comes first
+ *
+ * @param pFirst            Position of a pattern (-1 if none)
+ * @param pSecond           Position of another pattern (-1 if none)
+ *
+ * @return int32_t          Smaller of the two positions (-1 if both are -1)
+ */
+[[nodiscard]] static inline int32_t
+first_pattern (const int32_t &pFirst, const int32_t &pSecond) noexcept
+{
+    if (pFirst == -1) {
+        return pSecond;
+    }
+    if (pSecond == -1) {
+        return pFirst;
+    }
+
+    return (pFirst < pSecond) ? (pFirst) : (pSecond);
+}
+
+void
+MultiPatternMatcher::add (const PatternMode &pMode, const std::string_view &pText, std::string pDisplay)
+{
+    /** Position of the new pattern */
+    const int32_t           pattern     = (int32_t)mPatterns.size ();
+    /** Current state of the automaton while the pattern is inserted */
+    uint32_t                state;
+
+    mPatterns.push_back (std::move (pDisplay));
+
+    // patterns with the same text as an earlier one are kept (so that they are counted), but the earlier one is reported
+    if (pMode == PatternMode::EXACT) {
+        mExact.emplace (pText, pattern);
+        return;
+    }
+    if (pMode == PatternMode::NOEXT) {
+        mStems.emplace (pText, pattern);
+        return;
+    }
+
+    // the root of the automaton is only created once there is a pattern to look for within names
+    if (mTransitions.empty ()) {
+        mTransitions.assign (AUTOMATON_FANOUT, AUTOMATON_NO_STATE);
+        mOutputs.assign (1, -1);
+    }
+
+    state   = 0;
+    for (const char ch : pText) {
+        if (mTransitions[state * AUTOMATON_FANOUT + (unsigned char)ch] == AUTOMATON_NO_STATE) {
+            mTransitions[state * AUTOMATON_FANOUT + (unsigned char)ch]  = (uint32_t)mOutputs.size ();
+            mTransitions.resize (mTransitions.size () + AUTOMATON_FANOUT, AUTOMATON_NO_STATE);
+            mOutputs.push_back (-1);
+        }
+        state   = mTransitions[state * AUTOMATON_FANOUT + (unsigned char)ch];
+    }
+
+    mOutputs[state]     = first_pattern (mOutputs[state], pattern);
+}
+
+void
+MultiPatternMatcher::build ()
+{
+    /** State reached on the longest proper suffix (that is in the automaton) of the text leading to each state */
+    std::vector<uint32_t>   fallbacks (mOutputs.size (), 0);
+    /** States in breadth-first order, so that a fallback is always complete before the states that fall back to it */
+    std::vector<uint32_t>   order;
+
+    /** Next state on the current byte */
+    uint32_t                next;
+
+    if (mTransitions.empty ()) {
+        return;
+    }
+
+    order.reserve (mOutputs.size ());
+
+    // bytes that do not continue any pattern from the root stay at the root
+    for (uint32_t ch = 0; ch < AUTOMATON_FANOUT; ++ch) {
+        next    = mTransitions[ch];
+        if (next == AUTOMATON_NO_STATE) {
+            mTransitions[ch]    = 0;
+        }
+        else {
+            fallbacks[next]     = 0;
+            order.push_back (next);
+        }
+    }
+
+    // every missing transition is replaced by the one of the fallback, so that matching never needs to follow fallbacks
+    for (size_t i = 0; i < order.size (); ++i) {
+
+        /** State being completed */
+        const uint32_t      state       = order[i];
+
+        for (uint32_t ch = 0; ch < AUTOMATON_FANOUT; ++ch) {
+            next    = mTransitions[state * AUTOMATON_FANOUT + ch];
+            if (next == AUTOMATON_NO_STATE) {
+                mTransitions[state * AUTOMATON_FANOUT + ch] = mTransitions[fallbacks[state] * AUTOMATON_FANOUT + ch];
+            }
+            else {
+                fallbacks[next] = mTransitions[fallbacks[state] * AUTOMATON_FANOUT + ch];
+                mOutputs[next]  = first_pattern (mOutputs[next], mOutputs[fallbacks[next]]);
+                order.push_back (next);
+            }
+        }
+    }
+}
+
+bool
+MultiPatternMatcher::load (const std::filesystem::path &pPath, std::error_code &pErr)
+{
+    /** Modes of patterns, along with the prefixes that select them */
+    static const std::pair<std::string_view, PatternMode>   modePrefixes[] = {
+        {"exact:", PatternMode::EXACT},
+        {"noext:", PatternMode::NOEXT},
+        {"contains:", PatternMode::CONTAINS}
+    };
+
+    /** File holding the patterns */
+    std::ifstream           file (pPath, std::ios::binary);
+    /** Current line of the file */
+    std::string             line;
+
+    /** Mode of the current pattern */
+    PatternMode             mode;
+    /** Text of the current pattern (without the prefix of its mode) */
+    std::string_view        text;
+
+    if (!file.is_open ()) {
+        pErr    = std::error_code (errno, std::generic_category ());
+        return false;
+    }
+
+    while (std::getline (file, line)) {
+
+        // files written on Windows end each line with "\r\n"
+        if (!line.empty () && line.back () == '\r') {
+            line.pop_back ();
+        }
+        if (line.empty () || line[0] == '#') {
+            continue;
+        }
+
+        mode    = PatternMode::EXACT;
+        text    = line;
+        for (const auto &[prefix, prefixMode] : modePrefixes) {
+            if (text.substr (0, prefix.size ()) == prefix) {
+                mode    = prefixMode;
+                text.remove_prefix (prefix.size ());
+                break;
+            }
+        }
+
+        add (mode, text, line);
+    }
+
+    if (file.bad ()) {
+        pErr    = std::make_error_code (std::errc::io_error);
+        return false;
+    }
+    if (mPatterns.empty ()) {
+        pErr    = std::make_error_code (std::errc::invalid_argument);
+        return false;
+    }
+
+    build ();
+    return true;
+}
+
+int32_t
+MultiPatternMatcher::match (const DirBatch::char_t *pName, const size_t &pNameLen) const
+{
+#if defined (_WIN32) || defined (_WIN64)
+    /** Name converted to UTF-8 (names are UTF-16 on Windows) */
+    const std::u8string     utf8Name    = std::filesystem::path (std::wstring_view (pName, pNameLen)).u8string ();
+    /** Bytes of the name */
+    const std::string_view  name ((const char *)utf8Name.data (), utf8Name.size ());
+#else
+    /** Bytes of the name */
+    const std::string_view  name (pName, pNameLen);
+#endif
+
+    /** First pattern matched so far (-1 if none) */
+    int32_t                 result      = -1;
+    /** Position of the dot before the extension of the name */
+    size_t                  dotPos;
+    /** Current state of the automaton */
+    uint32_t                state;
+
+    if (!mExact.empty ()) {
+        if (const auto it = mExact.find (name); it != mExact.end ()) {
+            result  = it->second;
+        }
+    }
+
+    // the stem is taken the same way as std::filesystem::path::stem takes it (a leading dot does not start an extension)
+    if (!mStems.empty ()) {
+        dotPos  = (name == "..") ? (0) : (name.rfind ('.'));
+        if (const auto it = mStems.find ((dotPos == std::string_view::npos || dotPos == 0) ? (name) : (name.substr (0, dotPos)));
+            it != mStems.end ()) {
+            result  = first_pattern (result, it->second);
+        }
+    }
+
+    if (!mTransitions.empty ()) {
+        state   = 0;
+        result  = first_pattern (result, mOutputs[0]);
+        for (const char ch : name) {
+            state   = mTransitions[state * AUTOMATON_FANOUT + (unsigned char)ch];
+            result  = first_pattern (result, mOutputs[state]);
+        }
+    }
+
+    return result;
+}
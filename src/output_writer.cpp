@@ -0,0 +1,419 @@
+/**
+ * @file            output_writer.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Buffered writer that formats the output of a scan as narrow (UTF-8) text
+ *
+ */
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include <chrono>
+
+#include <string_view>
+
+#include "output_writer.h"
+
+#if defined (_WIN32) || defined (_WIN64)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs                    = std::filesystem;
+
+
+/** Abbreviated names of the months (as printed by "%b" in the C locale) */
+static const char       *monthNames[]   = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+
+/** Names of the types of entries in JSON records (indexed by EntryType) */
+static const char       *typeNames[]    = {
+    "unknown", "file", "dir", "symlink", "block", "char", "fifo", "socket"
+};
+
+
+/**
+ * @brief                   Writes a number as exactly two digits (with a leading zero if needed)
+ *
+ * @param pValue            Number to write (between 0 and 99)
+ * @param pBuff             Buffer to write the digits to
+ *
+ * @return char*            Position in the buffer after the digits
+ */
+static char
+*write_two_digits (const int &pValue, char *pBuff) noexcept
+{
+    pBuff[0]    = (char)('0' + (pValue / 10) % 10);
+    pBuff[1]    = (char)('0' + pValue % 10);
+
+    return pBuff + 2;
+}
+
+OutputWriter::OutputWriter (const int &pFd, std::mutex *pLock)
+    : mFd (pFd)
+    , mLock (pLock)
+{
+#if defined (_WIN32) || defined (_WIN64)
+    mIsLineBuffered = _isatty (pFd) != 0;
+#else
+    mIsLineBuffered = isatty (pFd) != 0;
+#endif
+
+    mBuff.reserve (OUTPUT_BUFF_LEN);
+}
+
+void
+OutputWriter::write_padded (const char *pStr, const uint64_t &pWidth)
+{
+    /** Length of the string */
+    const size_t            len     = strlen (pStr);
+
+    if (len < pWidth) {
+        mBuff.append (pWidth - len, ' ');
+    }
+    mBuff.append (pStr, len);
+}
+
+void
+OutputWriter::write_path (const fs::path &pPath)
+{
+#if defined (_WIN32) || defined (_WIN64)
+    /** Path converted to UTF-8 (native paths are UTF-16 on Windows) */
+    const std::u8string     utf8Path    = pPath.u8string ();
+
+    mBuff.append ((const char *)utf8Path.data (), utf8Path.size ());
+#else
+    mBuff.append (pPath.native ());
+#endif
+}
+
+void
+OutputWriter::write_path (const PathView &pPath)
+{
+#if defined (_WIN32) || defined (_WIN64)
+    write_path (fs::path (pPath));
+#else
+    mBuff.append (pPath);
+#endif
+}
+
+void
+OutputWriter::write_permissions (const fs::perms &pPerms)
+{
+    /** Formatted permissions */
+    char                    buff[12];
+
+    buff[0]     = ((pPerms & fs::perms::owner_read) != fs::perms::none) ? ('r') : ('-');
+    buff[1]     = ((pPerms & fs::perms::owner_write) != fs::perms::none) ? ('w') : ('-');
+    buff[2]     = ((pPerms & fs::perms::owner_exec) != fs::perms::none) ? ('x') : ('-');
+    buff[3]     = ((pPerms & fs::perms::group_read) != fs::perms::none) ? ('r') : ('-');
+    buff[4]     = ((pPerms & fs::perms::group_write) != fs::perms::none) ? ('w') : ('-');
+    buff[5]     = ((pPerms & fs::perms::group_exec) != fs::perms::none) ? ('x') : ('-');
+    buff[6]     = ((pPerms & fs::perms::others_read) != fs::perms::none) ? ('r') : ('-');
+    buff[7]     = ((pPerms & fs::perms::others_write) != fs::perms::none) ? ('w') : ('-');
+    buff[8]     = ((pPerms & fs::perms::others_exec) != fs::perms::none) ? ('x') : ('-');
+    buff[9]     = ' ';
+    buff[10]    = ' ';
+    buff[11]    = ' ';
+
+    mBuff.append (buff, sizeof (buff));
+}
+
+void
+OutputWriter::write_time (const time_t &pTime)
+{
+    /** Time point broken down into its components (in local time) */
+    std::tm                 tm;
+    /** Formatted time point */
+    char                    buff[32];
+    /** Position in the buffer to write the next character at */
+    char                    *pos;
+    /** Year of the time point */
+    int                     year;
+    /** Digits of the year, in reverse */
+    char                    yearDigits[12];
+    /** Number of digits of the year */
+    int                     numYearDigits;
+
+    // std::localtime shares its result between threads, so the reentrant variants are used instead
+#if defined (_WIN32) || defined (_WIN64)
+    localtime_s (&tm, &pTime);
+#else
+    localtime_r (&pTime, &tm);
+#endif
+
+    pos     = buff;
+
+    memcpy (pos, monthNames[(tm.tm_mon >= 0 && tm.tm_mon < 12) ? (tm.tm_mon) : (0)], 3);
+    pos     += 3;
+    *pos++  = ' ';
+
+    pos     = write_two_digits (tm.tm_mday, pos);
+    *pos++  = ' ';
+
+    year    = tm.tm_year + 1900;
+    if (year < 0) {
+        *pos++  = '-';
+        year    = -year;
+    }
+    numYearDigits   = 0;
+    do {
+        yearDigits[numYearDigits++] = (char)('0' + year % 10);
+        year                        /= 10;
+    } while (year != 0);
+    while (numYearDigits != 0) {
+        *pos++  = yearDigits[--numYearDigits];
+    }
+
+    *pos++  = ' ';
+    *pos++  = ' ';
+    pos     = write_two_digits (tm.tm_hour, pos);
+    *pos++  = ':';
+    pos     = write_two_digits (tm.tm_min, pos);
+    *pos    = 0;
+
+    write_padded (buff, 20);
+}
+
+void
+OutputWriter::write_fmt (const char *pFmt, ...)
+{
+    /** Arguments to format */
+    va_list                 args;
+    /** Copy of the arguments, in case the buffer needs to grow */
+    va_list                 argsCopy;
+    /** Length of the buffer before the formatted text was appended */
+    const size_t            prevLen     = mBuff.size ();
+    /** Length of the formatted text */
+    int                     len;
+
+    va_start (args, pFmt);
+    va_copy (argsCopy, args);
+
+    len     = vsnprintf (nullptr, 0, pFmt, args);
+    if (len > 0) {
+        mBuff.resize (prevLen + (size_t)len + 1);
+        vsnprintf (mBuff.data () + prevLen, (size_t)len + 1, pFmt, argsCopy);
+        mBuff.resize (prevLen + (size_t)len);
+    }
+
+    va_end (argsCopy);
+    va_end (args);
+}
+
+void
+OutputWriter::write_le (uint64_t pValue, const uint32_t &pNumBytes)
+{
+    for (uint32_t i = 0; i < pNumBytes; ++i) {
+        mBuff.push_back ((char)(pValue & 0xFF));
+        pValue  >>= 8;
+    }
+}
+
+void
+OutputWriter::write_json_string (const std::string_view &pStr)
+{
+    /** Digits used to escape control characters */
+    static const char       hexDigits[]     = "0123456789abcdef";
+
+    mBuff.push_back ('"');
+
+    // bytes that are not valid UTF-8 are passed through as they are (a path is not required to be valid UTF-8)
+    for (const char ch : pStr) {
+        switch (ch) {
+        case '"':   mBuff.append ("\\\"", 2);    break;
+        case '\\':  mBuff.append ("\\\\", 2);   break;
+        case '\n':  mBuff.append ("\\n", 2);     break;
+        case '\t':  mBuff.append ("\\t", 2);     break;
+        default:
+            if ((unsigned char)ch < 0x20) {
+                mBuff.append ("\\u00", 4);
+                mBuff.push_back (hexDigits[((unsigned char)ch >> 4) & 0xF]);
+                mBuff.push_back (hexDigits[(unsigned char)ch & 0xF]);
+            }
+            else {
+                mBuff.push_back (ch);
+            }
+            break;
+        }
+    }
+
+    mBuff.push_back ('"');
+}
+
+void
+OutputWriter::write_json_path (const PathView &pPath)
+{
+#if defined (_WIN32) || defined (_WIN64)
+    /** Path converted to UTF-8 (native paths are UTF-16 on Windows) */
+    const std::u8string     utf8Path        = fs::path (pPath).u8string ();
+
+    write_json_string (std::string_view ((const char *)utf8Path.data (), utf8Path.size ()));
+#else
+    write_json_string (pPath);
+#endif
+}
+
+void
+OutputWriter::write_bin_path (const PathView &pPath)
+{
+    /** Offset of the length of the path within the buffer (the length is only known once the path has been appended) */
+    const size_t            pathLenOffset   = mBuff.size ();
+    /** Length of the path, once it has been appended */
+    size_t                  pathLen;
+
+    write_le (0, 4);
+    write_path (pPath);
+
+    pathLen     = mBuff.size () - pathLenOffset - 4;
+    for (uint32_t i = 0; i < 4; ++i) {
+        mBuff[pathLenOffset + i]    = (char)((pathLen >> (8 * i)) & 0xFF);
+    }
+}
+
+void
+OutputWriter::write_stream_header (const OutputFormat &pFormat)
+{
+    if (pFormat == OutputFormat::BIN) {
+        mBuff.append (OUTPUT_BIN_MAGIC, 4);
+        write_le (OUTPUT_BIN_VERSION, 1);
+        write_le (0, 3);
+    }
+}
+
+void
+OutputWriter::write_record (const OutputFormat &pFormat, const EntryRecord &pRecord)
+{
+    /** Buffer to store integers formatted as text */
+    char                    intBuff[32];
+    /** Offset of the length of a binary record within the buffer */
+    size_t                  lenOffset;
+    /** Length of a binary record (excluding its length) */
+    uint64_t                recordLen;
+
+    switch (pFormat) {
+
+    case OutputFormat::NUL:
+        write_path (pRecord.path);
+        mBuff.push_back (0);
+        break;
+
+    case OutputFormat::JSONL:
+        mBuff.append ("{\"path\":", 8);
+        write_json_path (pRecord.path);
+        mBuff.append (",\"type\":\"", 9);
+        mBuff.append (typeNames[(uint8_t)pRecord.type]);
+        mBuff.push_back ('"');
+
+        if ((pRecord.fields & RECORD_HAS_SIZE) != 0) {
+            write_fmt (",\"size\":%lld", (long long)pRecord.size);
+        }
+        if ((pRecord.fields & RECORD_HAS_MTIME) != 0) {
+            write_fmt (",\"mtime\":%lld", (long long)pRecord.mtime);
+        }
+        if ((pRecord.fields & RECORD_HAS_PERMS) != 0) {
+            snprintf (intBuff, sizeof (intBuff), "%04o", (unsigned int)pRecord.perms & 07777U);
+            mBuff.append (",\"perms\":\"", 10);
+            mBuff.append (intBuff);
+            mBuff.push_back ('"');
+        }
+        if (pRecord.target != nullptr) {
+            mBuff.append (",\"target\":", 10);
+            write_json_path (pRecord.target->native ());
+        }
+        if (pRecord.pattern != nullptr) {
+            mBuff.append (",\"pattern\":", 11);
+            write_json_string (*pRecord.pattern);
+        }
+
+        mBuff.append ("}\n", 2);
+        break;
+
+    case OutputFormat::BIN:
+        lenOffset   = mBuff.size ();
+        write_le (0, 4);
+
+        write_le ((uint8_t)pRecord.type, 1);
+        write_le ((pRecord.fields & (RECORD_HAS_SIZE | RECORD_HAS_MTIME | RECORD_HAS_PERMS))
+                    | ((pRecord.target != nullptr) ? (RECORD_HAS_TARGET) : (0))
+                    | ((pRecord.pattern != nullptr) ? (RECORD_HAS_PATTERN) : (0)), 1);
+        write_le (((pRecord.fields & RECORD_HAS_PERMS) != 0) ? ((uint64_t)pRecord.perms & 07777U) : (0), 2);
+        write_le ((uint64_t)(((pRecord.fields & RECORD_HAS_SIZE) != 0) ? (pRecord.size) : (-1)), 8);
+        write_le ((uint64_t)(((pRecord.fields & RECORD_HAS_MTIME) != 0) ? ((int64_t)pRecord.mtime) : (0)), 8);
+
+        write_bin_path (pRecord.path);
+        if (pRecord.target != nullptr) {
+            write_bin_path (pRecord.target->native ());
+        }
+
+        if (pRecord.pattern != nullptr) {
+            write_le (pRecord.pattern->size (), 4);
+            mBuff.append (*pRecord.pattern);
+        }
+
+        recordLen   = mBuff.size () - lenOffset - 4;
+        for (uint32_t i = 0; i < 4; ++i) {
+            mBuff[lenOffset + i]    = (char)((recordLen >> (8 * i)) & 0xFF);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    end_record ();
+}
+
+void
+OutputWriter::flush () noexcept
+{
+    /** Number of bytes written out so far */
+    size_t                  written;
+    /** Result of the last write */
+    long                    res;
+
+    if (mBuff.empty ()) {
+        return;
+    }
+
+    /** Time at which the buffer started being written out (only read if the writer is timed) */
+    const auto              start           = (mIsTimed) ? (std::chrono::steady_clock::now ())
+                                            : (std::chrono::steady_clock::time_point {});
+
+    {
+        /** Lock shared with the other writers of the same output (if any) */
+        std::unique_lock<std::mutex>    guard;
+
+        if (mLock != nullptr) {
+            guard   = std::unique_lock<std::mutex> (*mLock);
+        }
+
+        for (written = 0; written < mBuff.size (); written += (size_t)res) {
+#if defined (_WIN32) || defined (_WIN64)
+            res     = _write (mFd, mBuff.data () + written, (unsigned int)(mBuff.size () - written));
+#else
+            res     = ::write (mFd, mBuff.data () + written, mBuff.size () - written);
+#endif
+            if (res < 0 && errno == EINTR) {
+                res = 0;
+                continue;
+            }
+
+            // the output went away (for example, a closed pipe), so there is nothing more that can be done with it
+            if (res <= 0) {
+                break;
+            }
+        }
+    }
+
+    mBytesWritten   += written;
+    if (mIsTimed) {
+        mWriteNs    += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - start).count ();
+    }
+    mBuff.clear ();
+}
@@ -0,0 +1,437 @@
+/**
+ * @file            scan_index.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Persistent on-disk index of the directories read by a scan
+ *
+ */
+
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <string_view>
+
+#include "scan_index.h"
+
+#if defined (_WIN32) || defined (_WIN64)
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs                    = std::filesystem;
+
+
+std::string
+index_key (const fs::path &pPath)
+{
+#if defined (_WIN32) || defined (_WIN64)
+    /** Path converted to UTF-8 (native paths are UTF-16 on Windows) */
+    const std::u8string     utf8Path    = pPath.u8string ();
+
+    return std::string ((const char *)utf8Path.data (), utf8Path.size ());
+#else
+    return pPath.native ();
+#endif
+}
+
+fs::path
+index_path (const std::string_view &pKey)
+{
+#if defined (_WIN32) || defined (_WIN64)
+    return fs::path (std::u8string ((const char8_t *)pKey.data (), pKey.size ()));
+#else
+    return fs::path (std::string (pKey));
+#endif
+}
+
+bool
+ScanIndex::open (const fs::path &pPath, std::error_code &pErr) noexcept
+{
+    /** Length of the tables and the names, as given by the header */
+    uint64_t                requiredLen;
+
+    close ();
+    pErr.clear ();
+
+#if defined (_WIN32) || defined (_WIN64)
+    try {
+        /** Stream to read the index from */
+        std::ifstream           file (pPath, std::ios::binary);
+
+        if (!file) {
+            pErr    = std::make_error_code (std::errc::no_such_file_or_directory);
+            return false;
+        }
+        mBuff.assign (std::istreambuf_iterator<char> (file), std::istreambuf_iterator<char> ());
+    }
+    catch (const std::bad_alloc &) {
+        pErr    = std::make_error_code (std::errc::not_enough_memory);
+        return false;
+    }
+
+    mData   = mBuff.data ();
+    mLen    = mBuff.size ();
+#else
+    /** File descriptor of the index */
+    const int               fd          = ::open (pPath.c_str (), O_RDONLY | O_CLOEXEC);
+    /** Status of the index (for its length) */
+    struct stat             st;
+    /** Contents of the index, mapped into memory */
+    void                    *data;
+
+    if (fd == -1) {
+        pErr.assign (errno, std::generic_category ());
+        return false;
+    }
+    if (fstat (fd, &st) != 0) {
+        pErr.assign (errno, std::generic_category ());
+        ::close (fd);
+        return false;
+    }
+    if ((size_t)st.st_size < sizeof (IndexHeader)) {
+        pErr    = std::make_error_code (std::errc::invalid_argument);
+        ::close (fd);
+        return false;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    data    = mmap (nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close (fd);
+    if (data == MAP_FAILED) {
+        pErr.assign (errno, std::generic_category ());
+        return false;
+    }
+
+    mData   = (const char *)data;
+    mLen    = (size_t)st.st_size;
+#endif
+
+    mHeader = (const IndexHeader *)mData;
+
+    // the tables must fit within the index (they are checked one at a time, so that the lengths can not overflow)
+    if (mLen < sizeof (IndexHeader)
+        || memcmp (mHeader->magic, INDEX_MAGIC, sizeof (mHeader->magic)) != 0
+        || mHeader->version != INDEX_VERSION
+        || mHeader->numDirs > mLen / sizeof (IndexDir)
+        || mHeader->numEntries > mLen / sizeof (IndexEntry)
+        || mHeader->namesLen > mLen) {
+        close ();
+        pErr    = std::make_error_code (std::errc::invalid_argument);
+        return false;
+    }
+
+    requiredLen = sizeof (IndexHeader)
+                + mHeader->numDirs * sizeof (IndexDir)
+                + mHeader->numEntries * sizeof (IndexEntry)
+                + mHeader->namesLen;
+    if (requiredLen > mLen) {
+        close ();
+        pErr    = std::make_error_code (std::errc::invalid_argument);
+        return false;
+    }
+
+    mDirs       = (const IndexDir *)(mData + sizeof (IndexHeader));
+    mEntries    = (const IndexEntry *)(mDirs + mHeader->numDirs);
+    mNames      = (const char *)(mEntries + mHeader->numEntries);
+
+    return true;
+}
+
+void
+ScanIndex::close () noexcept
+{
+    if (mData == nullptr) {
+        return;
+    }
+
+#if defined (_WIN32) || defined (_WIN64)
+    mBuff.clear ();
+    mBuff.shrink_to_fit ();
+#else
+    munmap ((void *)mData, mLen);
+#endif
+
+    mData       = nullptr;
+    mLen        = 0;
+    mHeader     = nullptr;
+    mDirs       = nullptr;
+    mEntries    = nullptr;
+    mNames      = nullptr;
+}
+
+uint64_t
+ScanIndex::lower_bound (const std::string_view &pKey) const noexcept
+{
+    if (mData == nullptr) {
+        return 0;
+    }
+
+    // directories whose paths lie outside the names have empty keys, so they are ordered first (and never match)
+    return (uint64_t)(std::lower_bound (mDirs, mDirs + mHeader->numDirs, pKey,
+                                        [this] (const IndexDir &pDir, const std::string_view &pKey) {
+                                            return dir_key (pDir) < pKey;
+                                        }) - mDirs);
+}
+
+const IndexDir
+*ScanIndex::find_dir (const fs::path &pPath) const noexcept
+{
+    /** Path of the directory, in the form in which it is stored */
+    std::string             key;
+    /** Position of the first directory that is not ordered before the path */
+    uint64_t                pos;
+
+    if (mData == nullptr) {
+        return nullptr;
+    }
+
+    try {
+        key     = index_key (pPath);
+    }
+    catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+
+    pos     = lower_bound (key);
+    if (pos == mHeader->numDirs || key.empty () || dir_key (mDirs[pos]) != key) {
+        return nullptr;
+    }
+
+    return mDirs + pos;
+}
+
+bool
+ScanIndex::restore_dir (const IndexDir &pDir, const fs::path &pPath, DirBatch &pBatch) const
+{
+    /** Entry of the index that is being currently restored */
+    const IndexEntry        *entry;
+    /** Offset at which the name of the current entry is stored in the batch */
+    uint32_t                nameOffset;
+
+    if (pDir.firstEntry > mHeader->numEntries || pDir.numEntries > mHeader->numEntries - pDir.firstEntry) {
+        return false;
+    }
+
+    pBatch.close ();
+    pBatch.entries.clear ();
+    pBatch.names.clear ();
+    pBatch.set_path (pPath);
+    pBatch.isRestored   = true;
+
+    pBatch.entries.reserve (pDir.numEntries);
+
+    for (uint64_t i = pDir.firstEntry; i < pDir.firstEntry + pDir.numEntries; ++i) {
+        entry   = mEntries + i;
+
+        if (entry->nameOffset > mHeader->namesLen || entry->nameLen > mHeader->namesLen - entry->nameOffset) {
+            pBatch.entries.clear ();
+            pBatch.names.clear ();
+            pBatch.isRestored   = false;
+            return false;
+        }
+
+        nameOffset  = (uint32_t)pBatch.names.size ();
+
+#if defined (_WIN32) || defined (_WIN64)
+        {
+            /** Name of the entry, converted back to the native encoding */
+            const fs::path          name (std::u8string ((const char8_t *)(mNames + entry->nameOffset), entry->nameLen));
+
+            pBatch.names.insert (pBatch.names.end (), name.native ().begin (), name.native ().end ());
+            pBatch.names.push_back (0);
+
+            pBatch.entries.push_back (DirEntry {nameOffset, (uint32_t)name.native ().size (), (EntryType)entry->type, 0, 0,
+                                        EntryStat {}, std::error_code {}});
+        }
+#else
+        pBatch.names.insert (pBatch.names.end (), mNames + entry->nameOffset, mNames + entry->nameOffset + entry->nameLen);
+        pBatch.names.push_back (0);
+
+        pBatch.entries.push_back (DirEntry {nameOffset, entry->nameLen, (EntryType)entry->type, 0, 0,
+                                    EntryStat {}, std::error_code {}});
+#endif
+
+        pBatch.entries.back ().stat.type    = (EntryType)entry->statType;
+        pBatch.entries.back ().stat.perms   = (fs::perms)entry->perms;
+        pBatch.entries.back ().stat.size    = entry->size;
+        pBatch.entries.back ().stat.mtime   = (time_t)entry->mtime;
+        pBatch.entries.back ().stat.dev     = entry->dev;
+        pBatch.entries.back ().stat.ino     = entry->ino;
+        pBatch.entries.back ().stat.nlink   = entry->nlink;
+        pBatch.entries.back ().stat.allocSize = entry->allocSize;
+        if (entry->statErrno != 0) {
+            pBatch.entries.back ().statError.assign ((int)entry->statErrno, std::generic_category ());
+        }
+    }
+    pBatch.pad_names ();
+
+    return true;
+}
+
+void
+IndexBuilder::add_dir (const DirBatch &pBatch)
+{
+    /** Directory that is being added */
+    PendingDir              dir;
+    /** Entry of the index that is being currently filled */
+    IndexEntry              record;
+    /** Name of the current entry, in the form in which it is stored */
+    std::string             name;
+
+    dir.path        = index_key (pBatch.dirPath);
+    dir.identity    = pBatch.identity;
+
+    dir.entries.reserve (pBatch.entries.size ());
+
+    for (const auto &entry : pBatch.entries) {
+#if defined (_WIN32) || defined (_WIN64)
+        name        = index_key (fs::path (pBatch.name_of (entry)));
+#else
+        name.assign (pBatch.name_of (entry), entry.nameLen);
+#endif
+
+        record              = IndexEntry {};
+        record.nameOffset   = dir.names.size ();
+        record.nameLen      = (uint32_t)name.size ();
+        record.statErrno    = (uint32_t)entry.statError.value ();
+        record.type         = (uint8_t)entry.type;
+        record.statType     = (uint8_t)entry.stat.type;
+        record.perms        = (uint16_t)((uint32_t)entry.stat.perms & 07777);
+        record.size         = (entry.stat.type == EntryType::REGULAR) ? (entry.stat.size) : (-1);
+        record.mtime        = (int64_t)entry.stat.mtime;
+        record.nlink        = (entry.stat.nlink > UINT32_MAX) ? (UINT32_MAX) : ((uint32_t)entry.stat.nlink);
+        record.dev          = entry.stat.dev;
+        record.ino          = entry.stat.ino;
+        record.allocSize    = entry.stat.allocSize;
+
+        dir.names.append (name);
+        dir.names.push_back (0);
+        dir.entries.push_back (record);
+    }
+
+    std::lock_guard<std::mutex> guard (mLock);
+    mDirs.push_back (std::move (dir));
+}
+
+bool
+IndexBuilder::write (const fs::path &pPath, std::error_code &pErr)
+{
+    /** Positions of the directories to write, ordered by path */
+    std::vector<uint64_t>   order;
+
+    /** Header of the index */
+    IndexHeader             header          {};
+    /** Directory of the index that is being currently written */
+    IndexDir                dirRecord;
+    /** Entry of the index that is being currently written */
+    IndexEntry              entryRecord;
+
+    /** Offset of the next path or name */
+    uint64_t                nameOffset;
+    /** Position of the next entry */
+    uint64_t                entryPos;
+
+    /** Path of the index while it is being written (it is renamed once complete) */
+    fs::path                tmpPath         = pPath;
+
+    pErr.clear ();
+
+    std::lock_guard<std::mutex> guard (mLock);
+
+    order.resize (mDirs.size ());
+    for (uint64_t i = 0; i < order.size (); ++i) {
+        order[i]    = i;
+    }
+
+    // a directory may be read more than once by the same scan, in which case only one copy of it is kept
+    std::stable_sort (order.begin (), order.end (), [this] (const uint64_t &pLeft, const uint64_t &pRight) {
+        return mDirs[pLeft].path < mDirs[pRight].path;
+    });
+    order.erase (std::unique (order.begin (), order.end (), [this] (const uint64_t &pLeft, const uint64_t &pRight) {
+        return mDirs[pLeft].path == mDirs[pRight].path;
+    }), order.end ());
+
+    memcpy (header.magic, INDEX_MAGIC, sizeof (header.magic));
+    header.version  = INDEX_VERSION;
+    header.numDirs  = order.size ();
+    for (const auto &pos : order) {
+        header.numEntries   += mDirs[pos].entries.size ();
+        header.namesLen     += mDirs[pos].path.size () + 1 + mDirs[pos].names.size ();
+    }
+
+    tmpPath         += ".tmp";
+
+    {
+        /** Stream to write the index to */
+        std::ofstream           file (tmpPath, std::ios::binary | std::ios::trunc);
+
+        if (!file) {
+            pErr    = std::make_error_code (std::errc::permission_denied);
+            return false;
+        }
+
+        file.write ((const char *)&header, sizeof (header));
+
+        // the names of each directory come right after its path
+        nameOffset  = 0;
+        entryPos    = 0;
+        for (const auto &pos : order) {
+            dirRecord               = IndexDir {};
+            dirRecord.pathOffset    = nameOffset;
+            dirRecord.pathLen       = (uint32_t)mDirs[pos].path.size ();
+            dirRecord.numEntries    = (uint32_t)mDirs[pos].entries.size ();
+            dirRecord.firstEntry    = entryPos;
+            dirRecord.ino           = mDirs[pos].identity.ino;
+            dirRecord.mtimeNs       = mDirs[pos].identity.mtimeNs;
+
+            file.write ((const char *)&dirRecord, sizeof (dirRecord));
+
+            nameOffset  += mDirs[pos].path.size () + 1 + mDirs[pos].names.size ();
+            entryPos    += mDirs[pos].entries.size ();
+        }
+
+        nameOffset  = 0;
+        for (const auto &pos : order) {
+            for (const auto &entry : mDirs[pos].entries) {
+                entryRecord             = entry;
+                entryRecord.nameOffset  += nameOffset + mDirs[pos].path.size () + 1;
+
+                file.write ((const char *)&entryRecord, sizeof (entryRecord));
+            }
+            nameOffset  += mDirs[pos].path.size () + 1 + mDirs[pos].names.size ();
+        }
+
+        for (const auto &pos : order) {
+            file.write (mDirs[pos].path.c_str (), (std::streamsize)mDirs[pos].path.size () + 1);
+            file.write (mDirs[pos].names.data (), (std::streamsize)mDirs[pos].names.size ());
+        }
+
+        file.flush ();
+        if (!file) {
+            /** Error ignored while cleaning up (the error of writing is reported instead) */
+            std::error_code         ignoredErr;
+
+            file.close ();
+            fs::remove (tmpPath, ignoredErr);
+            pErr    = std::make_error_code (std::errc::io_error);
+            return false;
+        }
+    }
+
+    // readers of the previous index (which may have it mapped) keep seeing it until they open it again
+    fs::rename (tmpPath, pPath, pErr);
+    if (pErr) {
+        /** Error ignored while cleaning up (the error of renaming is reported instead) */
+        std::error_code         ignoredErr;
+
+        fs::remove (tmpPath, ignoredErr);
+        return false;
+    }
+
+    mDirs.clear ();
+
+    return true;
+}
@@ -0,0 +1,219 @@
+/**
+ * @file            scan_throttle.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Bounds on how fast a scan reads directories and fetches metadata, and on how many workers do so at
+ *                  once, so that a scan of a busy host does not starve the rest of its workload
+ *
+ */
+
+#include <cerrno>
+
+#include <algorithm>
+#include <thread>
+
+#include "scan_throttle.h"
+
+#if defined (__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined (_WIN32) || defined (_WIN64)
+#else
+#include <sys/resource.h>
+#endif
+
+namespace chrono                = std::chrono;
+
+
+#if defined (__linux__)
+/** Class of I/O priority that is only served when no other process wants the disk (see ioprio_set(2)) */
+#define IOPRIO_CLASS_IDLE_VAL   (3)
+/** Offset of the class within an I/O priority */
+#define IOPRIO_CLASS_SHIFT_VAL  (13)
+/** Target of ioprio_set that is a single process (or thread, 0 meaning the calling one) */
+#define IOPRIO_WHO_PROCESS_VAL  (1)
+#endif
+
+
+chrono::nanoseconds
+TokenBucket::reserve (const uint64_t &pCount, const chrono::steady_clock::time_point &pNow) noexcept
+{
+    if (rate == 0) {
+        return chrono::nanoseconds (0);
+    }
+
+    // the bucket holds at most one second worth of calls (and at least one call, however low the rate is)
+    tokens  = std::min (tokens + chrono::duration<double> (pNow - last).count () * rate, std::max (rate, 1.0));
+    last    = pNow;
+
+    tokens  -= (double)pCount;
+    if (tokens >= 0) {
+        return chrono::nanoseconds (0);
+    }
+
+    return chrono::nanoseconds ((int64_t)(-tokens / rate * 1e9));
+}
+
+void
+ScanThrottle::set_rates (const uint64_t &pDirsPerSec, const uint64_t &pStatsPerSec) noexcept
+{
+    /** Time at which the buckets start filling up */
+    const auto              now         = chrono::steady_clock::now ();
+
+    std::lock_guard<std::mutex> guard (mBucketLock);
+
+    mDirs   = TokenBucket {(double)pDirsPerSec, (double)pDirsPerSec, now};
+    mStats  = TokenBucket {(double)pStatsPerSec, (double)pStatsPerSec, now};
+}
+
+void
+ScanThrottle::set_latency_target (const uint64_t &pTargetNs, const uint32_t &pMaxWorkers) noexcept
+{
+    std::lock_guard<std::mutex> guard (mGateLock);
+
+    mTargetNs       = pTargetNs;
+    mMaxWorkers     = std::max<uint32_t> (pMaxWorkers, 1);
+    mLimit          = 1;
+    mWindowNs       = 0;
+    mWindowCalls    = 0;
+    mPeakLimit.store ((pTargetNs != 0) ? (1) : (0), std::memory_order_relaxed);
+}
+
+void
+ScanThrottle::acquire_dir () noexcept
+{
+    /** Time to wait for before the directory may be read */
+    chrono::nanoseconds     delay;
+
+    {
+        std::lock_guard<std::mutex> guard (mBucketLock);
+
+        delay   = mDirs.reserve (1, chrono::steady_clock::now ());
+    }
+
+    if (delay.count () > 0) {
+        std::this_thread::sleep_for (delay);
+        mWaitNs.fetch_add ((uint64_t)delay.count (), std::memory_order_relaxed);
+    }
+}
+
+void
+ScanThrottle::acquire_stats (const uint64_t &pCount) noexcept
+{
+    /** Time to wait for before the metadata may be fetched */
+    chrono::nanoseconds     delay;
+
+    {
+        std::lock_guard<std::mutex> guard (mBucketLock);
+
+        delay   = mStats.reserve (pCount, chrono::steady_clock::now ());
+    }
+
+    if (delay.count () > 0) {
+        std::this_thread::sleep_for (delay);
+        mWaitNs.fetch_add ((uint64_t)delay.count (), std::memory_order_relaxed);
+    }
+}
+
+chrono::steady_clock::time_point
+ScanThrottle::enter () noexcept
+{
+    /** Time at which the worker asked for its turn */
+    const auto              start       = chrono::steady_clock::now ();
+
+    if (mTargetNs == 0) {
+        return start;
+    }
+
+    std::unique_lock<std::mutex>    guard (mGateLock);
+
+    if (mActive >= mLimit) {
+        mGateFree.wait (guard, [&] () { return mActive < mLimit; });
+        ++mActive;
+        guard.unlock ();
+
+        /** Time at which the turn of the worker started */
+        const auto          now         = chrono::steady_clock::now ();
+
+        mWaitNs.fetch_add ((uint64_t)chrono::duration_cast<chrono::nanoseconds> (now - start).count (), std::memory_order_relaxed);
+        return now;
+    }
+    ++mActive;
+
+    return start;
+}
+
+void
+ScanThrottle::leave (const chrono::steady_clock::time_point &pStart, const uint64_t &pCalls) noexcept
+{
+    /** Whether the limit grew, so that more than one waiting worker may take a turn */
+    bool                    isGrown     = false;
+
+    if (mTargetNs == 0) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard (mGateLock);
+
+        --mActive;
+        mWindowNs       += (uint64_t)chrono::duration_cast<chrono::nanoseconds> (chrono::steady_clock::now () - pStart).count ();
+        mWindowCalls    += pCalls;
+
+        // the limit is raised additively (while the filesystem keeps up) and lowered multiplicatively (as soon as it does not)
+        if (mWindowCalls >= THROTTLE_WINDOW_CALLS) {
+            if (mWindowNs <= mTargetNs * mWindowCalls) {
+                isGrown = mLimit < mMaxWorkers;
+                mLimit  = std::min (mLimit + 1, mMaxWorkers);
+                if (mLimit > mPeakLimit.load (std::memory_order_relaxed)) {
+                    mPeakLimit.store (mLimit, std::memory_order_relaxed);
+                }
+            }
+            else {
+                mLimit  = std::max<uint32_t> (mLimit / 2, 1);
+            }
+            mWindowNs       = 0;
+            mWindowCalls    = 0;
+        }
+    }
+
+    if (isGrown) {
+        mGateFree.notify_all ();
+    }
+    else {
+        mGateFree.notify_one ();
+    }
+}
+
+bool
+enter_idle_priority (std::error_code &pErr) noexcept
+{
+    pErr.clear ();
+
+#if defined (__linux__)
+    /** Parameters of SCHED_IDLE (which has no static priority) */
+    struct sched_param      param       {};
+
+    // glibc has no wrapper for ioprio_set, and the scheduler of the disk only honours the class on some of its schedulers
+    if (syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS_VAL, 0, IOPRIO_CLASS_IDLE_VAL << IOPRIO_CLASS_SHIFT_VAL) != 0) {
+        pErr.assign (errno, std::generic_category ());
+        return false;
+    }
+    if (sched_setscheduler (0, SCHED_IDLE, &param) != 0) {
+        pErr.assign (errno, std::generic_category ());
+        return false;
+    }
+
+    return true;
+#elif defined (_WIN32) || defined (_WIN64)
+    pErr    = std::make_error_code (std::errc::operation_not_supported);
+    return false;
+#else
+    if (setpriority (PRIO_PROCESS, 0, 19) != 0) {
+        pErr.assign (errno, std::generic_category ());
+        return false;
+    }
+
+    return true;
+#endif
+}
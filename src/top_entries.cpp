@@ -0,0 +1,82 @@
+/**
+ * @file            top_entries.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Largest entries found by a walk, kept in a heap that never grows beyond the number asked for
+ *
+ */
+
+#include <algorithm>
+#include <utility>
+
+#include "top_entries.h"
+
+
+/**
+ * @brief                   Orders entries so that the smallest one is at the front of a heap
+ *
+ * @param pLeft             Entry to compare
+ * @param pRight            Entry to compare it with
+ *
+ * @return true             If pLeft is larger than pRight
+ * @return false            If pLeft is not larger than pRight
+ */
+[[nodiscard]] static inline bool
+is_larger (const TopEntry &pLeft, const TopEntry &pRight) noexcept
+{
+    return pLeft.size > pRight.size;
+}
+
+void
+TopEntries::offer (const int64_t &pSize, const EntryType &pType, const PathView &pPath)
+{
+    if (!admits (pSize)) {
+        return;
+    }
+
+    // once the heap is full, the smallest entry makes way for the new one
+    if (mHeap.size () == mCapacity) {
+        std::pop_heap (mHeap.begin (), mHeap.end (), is_larger);
+        mHeap.back ().size  = pSize;
+        mHeap.back ().type  = pType;
+        mHeap.back ().path.assign (pPath);
+    }
+    else {
+        mHeap.push_back (TopEntry {pSize, pType, std::filesystem::path::string_type (pPath)});
+    }
+    std::push_heap (mHeap.begin (), mHeap.end (), is_larger);
+}
+
+void
+TopEntries::merge (TopEntries &pOther)
+{
+    for (auto &entry : pOther.mHeap) {
+        if (!admits (entry.size)) {
+            continue;
+        }
+
+        if (mHeap.size () == mCapacity) {
+            std::pop_heap (mHeap.begin (), mHeap.end (), is_larger);
+            mHeap.back ()   = std::move (entry);
+        }
+        else {
+            mHeap.push_back (std::move (entry));
+        }
+        std::push_heap (mHeap.begin (), mHeap.end (), is_larger);
+    }
+
+    pOther.mHeap.clear ();
+}
+
+std::vector<TopEntry>
+TopEntries::take_sorted ()
+{
+    /** Entries kept, in the order in which they are returned */
+    std::vector<TopEntry>   sorted;
+
+    sorted.swap (mHeap);
+    std::sort (sorted.begin (), sorted.end (), [] (const TopEntry &pLeft, const TopEntry &pRight) {
+        return (pLeft.size != pRight.size) ? (pLeft.size > pRight.size) : (pLeft.path < pRight.path);
+    });
+
+    return sorted;
+}
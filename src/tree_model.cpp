@@ -0,0 +1,185 @@
+/**
+ * @file            tree_model.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Compact in-memory model of a whole tree, stored as columns, that any number of queries can be answered
+ *                  from after a single walk
+ *
+ */
+
+#include <algorithm>
+
+#include "tree_model.h"
+
+namespace fs                    = std::filesystem;
+
+
+uint32_t
+TreeModel::add_entry (const uint32_t &pParent, const char_t *pName, const size_t &pNameLen, const EntryType &pType,
+                        const int64_t &pSize, const int64_t &pMtime)
+{
+    /** Position of the new entry */
+    const uint32_t          pos         = (uint32_t)mTypes.size ();
+
+    mParents.push_back (pParent);
+    mTypes.push_back (pType);
+    mSizes.push_back (pSize);
+    mMtimes.push_back (pMtime);
+
+    mNames.insert (mNames.end (), pName, pName + pNameLen);
+    mNames.push_back (0);
+    mNameOffsets.push_back ((uint32_t)mNames.size ());
+
+    return pos;
+}
+
+bool
+TreeModel::build (const fs::path &pRoot, const WalkOptions &pOptions, const bool &pIsAllocated, std::error_code &pErr)
+{
+    /** Directory waiting to be read (in the order in which they were found, so the walk is breadth-first) */
+    struct PendingDir
+    {
+        /** Position of the directory */
+        uint32_t            pos;
+        /** Number of directories between the root and the directory */
+        uint64_t            depth;
+    };
+
+    /** Metadata fetched for each regular file (and for the target of each symlink) */
+    const uint32_t          fileMask        = STAT_SIZE | STAT_MTIME | ((pIsAllocated) ? (STAT_BLOCKS) : (0));
+    /** Metadata fetched for each subdirectory to check which filesystem it is on */
+    const uint32_t          descendMask     = (pOptions.oneFileSystem) ? (STAT_LINKS) : (0);
+
+    /** Error that occoured while reading a directory below the root */
+    std::error_code         errorCode;
+    /** Identity of the root, whose device is the one the walk stays on */
+    DirIdentity             rootIdentity;
+    /** Entries of the directory being read (reused for every directory) */
+    DirBatch                batch;
+    /** Directories waiting to be read */
+    std::vector<PendingDir> pending;
+
+    mParents.clear ();
+    mNameOffsets.clear ();
+    mTypes.clear ();
+    mSizes.clear ();
+    mMtimes.clear ();
+    mNames.clear ();
+    mNumDirs        = 0;
+    mNumErrors      = 0;
+    pErr.clear ();
+
+    mNameOffsets.push_back (0);
+    (void)add_entry (MODEL_NO_PARENT, pRoot.c_str (), pRoot.native ().size (), EntryType::DIRECTORY, 0, 0);
+
+    if (pOptions.oneFileSystem && !read_dir_identity (pRoot, rootIdentity, pErr)) {
+        mSizes[0]   = -1;
+        mNames.insert (mNames.end (), DIR_NAME_PADDING, 0);
+        return false;
+    }
+
+    pending.push_back (PendingDir {0, 0});
+    for (size_t next = 0; next < pending.size (); ++next) {
+
+        /** Directory being read */
+        const PendingDir    dir             = pending[next];
+
+        if (!read_dir (path_of (dir.pos), batch, (dir.pos == 0) ? (pErr) : (errorCode))) {
+            mSizes[dir.pos] = -1;
+            ++mNumErrors;
+            continue;
+        }
+        ++mNumDirs;
+
+        if (!pOptions.excludes.empty ()) {
+            std::erase_if (batch.entries, [&] (const DirEntry &pEntry) {
+                for (const auto &glob : pOptions.excludes) {
+                    if (glob.matches (batch.name_of (pEntry), pEntry.nameLen)) {
+                        return true;
+                    }
+                }
+                return false;
+            });
+        }
+
+        // positions and offsets of names are 32 bits wide, which is checked once per directory
+        if (batch.entries.size () >= (size_t)MODEL_NO_PARENT - mTypes.size ()
+            || batch.names.size () >= (size_t)UINT32_MAX - mNames.size ()) {
+            pErr        = std::make_error_code (std::errc::value_too_large);
+            break;
+        }
+
+        // symlinks are followed to find out what they point to, so that symlinks to files are added up like the files
+        for (auto &entry : batch.entries) {
+            entry.statMask  = (entry.type == EntryType::REGULAR) ? (fileMask)
+                            : (entry.type == EntryType::SYMLINK) ? (STAT_FOLLOW | STAT_TYPE | fileMask)
+                            : (entry.type == EntryType::DIRECTORY) ? (descendMask)
+                            : (0);
+        }
+        stat_dir_entries (batch, pOptions.statMode);
+        batch.close ();
+
+        for (const auto &entry : batch.entries) {
+
+            /** Type of the entry (of the target, if the entry is a symlink) */
+            const EntryType type            = (entry.type == EntryType::SYMLINK) ? (entry.stat.type) : (entry.type);
+            /** Whether the size and time of the entry are known */
+            const bool      isFile          = type == EntryType::REGULAR && !entry.statError;
+
+            if (!walk_passes_filters (pOptions, entry)) {
+                continue;
+            }
+
+            /** Position of the entry */
+            const uint32_t  pos             = add_entry (dir.pos, batch.name_of (entry), entry.nameLen, entry.type,
+                                                (isFile) ? ((pIsAllocated && entry.stat.allocSize != -1)
+                                                                ? (entry.stat.allocSize) : (entry.stat.size))
+                                                : (entry.type == EntryType::DIRECTORY) ? (0)
+                                                : (-1),
+                                                (isFile) ? ((int64_t)entry.stat.mtime) : (0));
+
+            if (entry.type == EntryType::DIRECTORY && dir.depth < pOptions.maxDepth
+                && (!pOptions.oneFileSystem || (!entry.statError && entry.stat.dev == rootIdentity.dev))) {
+                pending.push_back (PendingDir {pos, dir.depth + 1});
+            }
+        }
+    }
+    mNames.insert (mNames.end (), DIR_NAME_PADDING, 0);
+
+    // every entry comes after its parent, so going backwards adds up each directory before it is added to its own parent
+    for (uint32_t i = num_entries () - 1; i > 0; --i) {
+        if (mSizes[i] > 0) {
+            mSizes[mParents[i]] += mSizes[i];
+        }
+    }
+
+    return mSizes[0] != -1 && !pErr;
+}
+
+std::pair<uint32_t, uint32_t>
+TreeModel::children (const uint32_t &pPos) const noexcept
+{
+    // the parents are sorted, apart from the root (which has none)
+    const auto              range       = std::equal_range (mParents.begin () + 1, mParents.end (), pPos);
+
+    return std::pair<uint32_t, uint32_t> ((uint32_t)(range.first - mParents.begin ()), (uint32_t)(range.second - mParents.begin ()));
+}
+
+fs::path
+TreeModel::path_of (const uint32_t &pPos) const
+{
+    /** Positions of the entry and its ancestors, from the entry up to the root */
+    std::vector<uint32_t>   chain;
+    /** Path of the entry */
+    fs::path                path;
+
+    for (uint32_t cur = pPos; cur != MODEL_NO_PARENT; cur = mParents[cur]) {
+        chain.push_back (cur);
+    }
+
+    path    = name (chain.back ());
+    for (auto it = chain.rbegin () + 1; it != chain.rend (); ++it) {
+        path    /= name (*it);
+    }
+
+    return path;
+}
@@ -0,0 +1,523 @@
+/**
+ * @file            watch_tree.cpp
+ * @author          Aditya Agarwal (aditya.agarwal@dumblebots.com)
+ * @brief           Tree of the directories below a path with the aggregate sizes and counts of their subtrees, kept up to
+ *                  date by watching the directories for changes
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "watch_tree.h"
+
+#if defined (FSS_LINUX_BACKEND)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs                    = std::filesystem;
+namespace chrono                = std::chrono;
+
+
+#if defined (FSS_LINUX_BACKEND)
+/** Changes that mark a watched directory (entries added, removed, renamed, written to or changed in any other way) */
+#define WATCH_EVENTS            (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE \
+                                | IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+/** Size of the buffer that events are read into (in bytes) */
+#define WATCH_EVENT_BUFF_LEN    (16 * 1024)
+#endif
+
+
+uint32_t
+WatchTree::add_dir (const fs::path &pPath, const uint32_t &pParent)
+{
+    /** Position of the new directory (one that is no longer part of the tree is reused, if there is any) */
+    uint32_t                pos;
+
+    if (!mFreeDirs.empty ()) {
+        pos         = mFreeDirs.back ();
+        mFreeDirs.pop_back ();
+    }
+    else {
+        pos         = (uint32_t)mDirs.size ();
+        mDirs.emplace_back ();
+    }
+
+    /** New directory */
+    WatchDir                &dir        = mDirs[pos];
+
+    dir.path        = pPath;
+    dir.parent      = pParent;
+    dir.depth       = (pParent == WATCH_NO_PARENT) ? (0) : (mDirs[pParent].depth + 1);
+    dir.wd          = -1;
+    dir.isLive      = true;
+    dir.isDirty     = false;
+    dir.ownSize     = 0;
+    dir.ownFiles    = 0;
+    dir.totalSize   = 0;
+    dir.totalFiles  = 0;
+    dir.totalDirs   = 0;
+    dir.children.clear ();
+
+    if (pParent != WATCH_NO_PARENT) {
+        mDirs[pParent].children.push_back (pos);
+    }
+
+    return pos;
+}
+
+bool
+WatchTree::read_own (const uint32_t &pDir, std::vector<fs::path::string_type> &pSubdirs, std::error_code &pErr)
+{
+    /** Metadata fetched for each regular file (and for the target of each symlink) */
+    const uint32_t          sizeMask        = STAT_SIZE | ((mIsAllocated) ? (STAT_BLOCKS) : (0))
+                                            | ((mOptions.newerThan != 0) ? (STAT_MTIME) : (0));
+    /** Metadata fetched for each subdirectory to check which filesystem it is on */
+    const uint32_t          descendMask     = (mOptions.oneFileSystem) ? (STAT_LINKS) : (0);
+
+    watch_dir (pDir);
+
+    /** Directory being read */
+    WatchDir                &dir            = mDirs[pDir];
+
+    dir.ownSize     = 0;
+    dir.ownFiles    = 0;
+
+    if (!read_dir (dir.path, mBatch, pErr)) {
+        return false;
+    }
+
+    if (!mOptions.excludes.empty ()) {
+        std::erase_if (mBatch.entries, [&] (const DirEntry &pEntry) {
+            for (const auto &glob : mOptions.excludes) {
+                if (glob.matches (mBatch.name_of (pEntry), pEntry.nameLen)) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+
+    // symlinks are followed to find out what they point to, so that symlinks to files are added up like the files
+    for (auto &entry : mBatch.entries) {
+        entry.statMask  = (entry.type == EntryType::REGULAR) ? (sizeMask)
+                        : (entry.type == EntryType::SYMLINK) ? (STAT_FOLLOW | STAT_TYPE | sizeMask)
+                        : (entry.type == EntryType::DIRECTORY) ? (descendMask)
+                        : (0);
+    }
+    stat_dir_entries (mBatch, mOptions.statMode);
+    mBatch.close ();
+
+    for (const auto &entry : mBatch.entries) {
+
+        /** Type of the entry (of the target, if the entry is a symlink) */
+        const EntryType     type            = (entry.type == EntryType::SYMLINK) ? (entry.stat.type) : (entry.type);
+
+        if (type == EntryType::REGULAR) {
+            if (!entry.statError && walk_passes_filters (mOptions, entry)) {
+                dir.ownSize     += (mIsAllocated && entry.stat.allocSize != -1) ? (entry.stat.allocSize) : (entry.stat.size);
+                ++dir.ownFiles;
+            }
+        }
+        else if (entry.type == EntryType::DIRECTORY && dir.depth < mOptions.maxDepth
+                && (!mOptions.oneFileSystem || (!entry.statError && entry.stat.dev == mRootDev))) {
+            pSubdirs.emplace_back (mBatch.name_of (entry), entry.nameLen);
+        }
+    }
+
+    return true;
+}
+
+bool
+WatchTree::build_subtree (const uint32_t &pDir, std::error_code &pErr)
+{
+    /** Error that occoured while reading a directory below pDir */
+    std::error_code         errorCode;
+
+    /** Directories that still need to be read */
+    std::vector<uint32_t>   pending         {pDir};
+    /** Directories in the order in which they were read (each one comes after its parent) */
+    std::vector<uint32_t>   order;
+    /** Names of the subdirectories of the directory read last */
+    std::vector<fs::path::string_type>  subdirs;
+
+    /** Whether pDir itself was read */
+    bool                    isRead          = true;
+
+    while (!pending.empty ()) {
+
+        /** Directory being read */
+        const uint32_t      cur             = pending.back ();
+
+        pending.pop_back ();
+        order.push_back (cur);
+
+        subdirs.clear ();
+        if (!read_own (cur, subdirs, (cur == pDir) ? (pErr) : (errorCode))) {
+            isRead          = isRead && cur != pDir;
+            continue;
+        }
+
+        for (const auto &name : subdirs) {
+
+            /** Path of the subdirectory (built before adding it, which may move the directories of the tree) */
+            fs::path        subdirPath      = mDirs[cur].path / name;
+
+            pending.push_back (add_dir (subdirPath, cur));
+        }
+    }
+
+    // the totals are added up bottom-up, so every directory comes after all of its subdirectories
+    for (auto it = order.rbegin (); it != order.rend (); ++it) {
+
+        /** Directory whose totals are added up */
+        WatchDir            &dir            = mDirs[*it];
+
+        dir.totalSize   = dir.ownSize;
+        dir.totalFiles  = dir.ownFiles;
+        dir.totalDirs   = dir.children.size ();
+        for (const auto &child : dir.children) {
+            dir.totalSize   += mDirs[child].totalSize;
+            dir.totalFiles  += mDirs[child].totalFiles;
+            dir.totalDirs   += mDirs[child].totalDirs;
+        }
+    }
+
+    return isRead;
+}
+
+void
+WatchTree::remove_subtree (const uint32_t &pDir)
+{
+    /** Directories that still need to be removed */
+    std::vector<uint32_t>   pending         {pDir};
+
+    while (!pending.empty ()) {
+
+        /** Directory being removed */
+        WatchDir            &dir            = mDirs[pending.back ()];
+
+        mFreeDirs.push_back (pending.back ());
+        pending.pop_back ();
+
+        if (dir.wd != -1) {
+#if defined (FSS_LINUX_BACKEND)
+            inotify_rm_watch (mNotifyFd, dir.wd);
+#endif
+            mWatches.erase (dir.wd);
+        }
+
+        pending.insert (pending.end (), dir.children.begin (), dir.children.end ());
+
+        dir.wd          = -1;
+        dir.isLive      = false;
+        dir.isDirty     = false;
+        dir.path.clear ();
+        dir.children.clear ();
+    }
+}
+
+void
+WatchTree::refresh_dir (const uint32_t &pDir)
+{
+    /** Error that occoured while reading a directory */
+    std::error_code         errorCode;
+
+    /** Names of the subdirectories that the directory holds now (sorted, so that the old ones can be looked up) */
+    std::vector<fs::path::string_type>  subdirs;
+    /** Whether each name of subdirs belongs to a subdirectory that was already part of the tree */
+    std::vector<bool>       isKnown;
+    /** Subdirectories that were part of the tree before the directory was read again */
+    std::vector<uint32_t>   children;
+
+    /** Combined size of the files directly within the directory, before it was read again */
+    const int64_t           oldSize         = mDirs[pDir].ownSize;
+    /** Number of the files directly within the directory, before it was read again */
+    const uint64_t          oldFiles        = mDirs[pDir].ownFiles;
+
+    // a directory that can no longer be read holds nothing (if it was removed, its parent removes it from the tree as well)
+    if (!read_own (pDir, subdirs, errorCode)) {
+        subdirs.clear ();
+    }
+    std::sort (subdirs.begin (), subdirs.end ());
+    isKnown.assign (subdirs.size (), false);
+
+    /** Change in the combined size of the files of the subtree */
+    int64_t                 deltaSize       = mDirs[pDir].ownSize - oldSize;
+    /** Change in the number of files of the subtree */
+    int64_t                 deltaFiles      = (int64_t)mDirs[pDir].ownFiles - (int64_t)oldFiles;
+    /** Change in the number of directories of the subtree */
+    int64_t                 deltaDirs       = 0;
+
+    children.swap (mDirs[pDir].children);
+    for (const auto &child : children) {
+
+        /** Subdirectory that was part of the tree */
+        const WatchDir      &subdir         = mDirs[child];
+        /** Name of the subdirectory */
+        const fs::path      name            = subdir.path.filename ();
+        /** Position of the name among the current subdirectories */
+        const auto          found           = std::lower_bound (subdirs.begin (), subdirs.end (), name.native ());
+
+        // subdirectories that went away are removed, and so are the ones that are no longer watched (which are walked again)
+        if (found != subdirs.end () && *found == name.native () && subdir.wd != -1) {
+            isKnown[(size_t)(found - subdirs.begin ())] = true;
+            mDirs[pDir].children.push_back (child);
+            continue;
+        }
+
+        deltaSize       -= subdir.totalSize;
+        deltaFiles      -= (int64_t)subdir.totalFiles;
+        deltaDirs       -= (int64_t)subdir.totalDirs + 1;
+        remove_subtree (child);
+    }
+
+    for (size_t i = 0; i < subdirs.size (); ++i) {
+        if (isKnown[i]) {
+            continue;
+        }
+
+        /** Path of the new subdirectory (built before adding it, which may move the directories of the tree) */
+        fs::path            subdirPath      = mDirs[pDir].path / subdirs[i];
+        /** Position of the new subdirectory */
+        const uint32_t      child           = add_dir (subdirPath, pDir);
+
+        (void)build_subtree (child, errorCode);
+
+        deltaSize       += mDirs[child].totalSize;
+        deltaFiles      += (int64_t)mDirs[child].totalFiles;
+        deltaDirs       += (int64_t)mDirs[child].totalDirs + 1;
+    }
+
+    for (uint32_t cur = pDir; cur != WATCH_NO_PARENT; cur = mDirs[cur].parent) {
+        mDirs[cur].totalSize    += deltaSize;
+        mDirs[cur].totalFiles   = (uint64_t)((int64_t)mDirs[cur].totalFiles + deltaFiles);
+        mDirs[cur].totalDirs    = (uint64_t)((int64_t)mDirs[cur].totalDirs + deltaDirs);
+    }
+}
+
+void
+WatchTree::mark_dirty (const uint32_t &pDir)
+{
+    if (!mDirs[pDir].isDirty) {
+        mDirs[pDir].isDirty     = true;
+        mDirtyDirs.push_back (pDir);
+    }
+}
+
+void
+WatchTree::watch_dir (const uint32_t &pDir)
+{
+#if defined (FSS_LINUX_BACKEND)
+    if (mNotifyFd == -1) {
+        return;
+    }
+
+    /** Watch descriptor of the directory (the same one if the directory is already watched) */
+    const int               wd          = inotify_add_watch (mNotifyFd, mDirs[pDir].path.c_str (), WATCH_EVENTS);
+
+    // once a single directory is not watched, changes to it could be missed, so every refresh reads the whole tree
+    if (wd == -1) {
+        mIsComplete     = false;
+        return;
+    }
+
+    /** Directory that the watch descriptor belongs to */
+    const auto              [watch, isNew]  = mWatches.try_emplace (wd, pDir);
+
+    // the directory is already watched at another position, either because it was moved (and the old position is removed
+    // once its old parent is read again), or because it is reached through two paths (such as a bind mount), in which case
+    // only one of them can be kept up to date (which is checked once the tree has been read)
+    if (!isNew && watch->second != pDir) {
+        mDirs[watch->second].wd = -1;
+        mDisplacedDirs.push_back (watch->second);
+        watch->second   = pDir;
+    }
+    mDirs[pDir].wd  = wd;
+#else
+    (void)pDir;
+#endif
+}
+
+void
+WatchTree::check_displaced () noexcept
+{
+    // a directory whose watch was taken over, and which is still part of the tree, is reached through another path as well
+    for (const auto &pos : mDisplacedDirs) {
+        if (mDirs[pos].isLive && mDirs[pos].wd == -1) {
+            mIsComplete     = false;
+        }
+    }
+    mDisplacedDirs.clear ();
+}
+
+void
+WatchTree::clear () noexcept
+{
+#if defined (FSS_LINUX_BACKEND)
+    // closing the inotify instance drops all of its watches at once
+    if (mNotifyFd != -1) {
+        ::close (mNotifyFd);
+        mNotifyFd       = -1;
+    }
+#endif
+
+    mDirs.clear ();
+    mFreeDirs.clear ();
+    mDirtyDirs.clear ();
+    mDisplacedDirs.clear ();
+    mWatches.clear ();
+    mIsComplete     = false;
+}
+
+bool
+WatchTree::build (const fs::path &pRoot, const WalkOptions &pOptions, const bool &pIsAllocated, std::error_code &pErr)
+{
+    /** Identity of the root, whose device is the one the tree stays on */
+    DirIdentity             rootIdentity;
+
+    // the arguments may be the members themselves (when the tree is read again), so they are copied before anything is cleared
+    if (&pRoot != &mRootPath) {
+        mRootPath   = pRoot;
+    }
+    if (&pOptions != &mOptions) {
+        mOptions    = pOptions;
+    }
+    mIsAllocated    = pIsAllocated;
+    clear ();
+
+    if (!read_dir_identity (mRootPath, rootIdentity, pErr)) {
+        (void)add_dir (mRootPath, WATCH_NO_PARENT);
+        return false;
+    }
+    mRootDev        = rootIdentity.dev;
+
+#if defined (FSS_LINUX_BACKEND)
+    mNotifyFd       = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    mIsComplete     = mNotifyFd != -1;
+#endif
+
+    if (!build_subtree (add_dir (mRootPath, WATCH_NO_PARENT), pErr)) {
+        mIsComplete     = false;
+        return false;
+    }
+    check_displaced ();
+
+    return true;
+}
+
+void
+WatchTree::wait (const uint64_t &pTimeoutMs)
+{
+    /** Time at which the wait ends */
+    const auto              deadline    = chrono::steady_clock::now () + chrono::milliseconds (pTimeoutMs);
+
+#if defined (FSS_LINUX_BACKEND)
+    /** Buffer that events are read into */
+    alignas (inotify_event) char    events[WATCH_EVENT_BUFF_LEN];
+
+    if (mNotifyFd == -1) {
+        std::this_thread::sleep_until (deadline);
+        return;
+    }
+
+    // events are read as soon as they arrive (rather than once the time is up), so that the queue does not overflow
+    while (true) {
+
+        /** Time left to wait for, in milliseconds */
+        const int64_t       remaining   = chrono::duration_cast<chrono::milliseconds> (
+                                            deadline - chrono::steady_clock::now ()).count ();
+        /** Descriptor to wait on */
+        pollfd              request     {mNotifyFd, POLLIN, 0};
+
+        if (remaining <= 0) {
+            return;
+        }
+        if (poll (&request, 1, (int)std::min<int64_t> (remaining, INT32_MAX)) <= 0) {
+            continue;
+        }
+
+        /** Number of bytes of events read at once */
+        ssize_t             len;
+
+        while ((len = read (mNotifyFd, events, sizeof (events))) > 0) {
+            for (char *ptr = events; ptr < events + len; ptr += sizeof (inotify_event) + ((inotify_event *)ptr)->len) {
+
+                /** Event that was read */
+                const inotify_event *event      = (const inotify_event *)ptr;
+
+                // if events were lost, the changes they reported can not be found out without reading everything again
+                if (event->mask & IN_Q_OVERFLOW) {
+                    mIsComplete     = false;
+                    continue;
+                }
+
+                /** Directory that the event happened in */
+                const auto          watch       = mWatches.find (event->wd);
+
+                if (watch == mWatches.end ()) {
+                    continue;
+                }
+
+                // a directory that is no longer watched (because it was removed or unmounted) is walked again by its parent
+                if (event->mask & IN_IGNORED) {
+
+                    /** Position of the directory */
+                    const uint32_t  pos         = watch->second;
+
+                    mDirs[pos].wd   = -1;
+                    mWatches.erase (watch);
+                    if (mDirs[pos].parent == WATCH_NO_PARENT) {
+                        mIsComplete     = false;
+                    }
+                    else {
+                        mark_dirty (mDirs[pos].parent);
+                    }
+                    continue;
+                }
+
+                mark_dirty (watch->second);
+            }
+        }
+    }
+#else
+    // without a way of watching directories, the whole tree is read again by every refresh
+    std::this_thread::sleep_until (deadline);
+#endif
+}
+
+void
+WatchTree::refresh ()
+{
+    /** Error that occoured while reading the root */
+    std::error_code         errorCode;
+
+    if (!mIsComplete) {
+        (void)build (mRootPath, mOptions, mIsAllocated, errorCode);
+        return;
+    }
+
+    // parents are read before their subdirectories, so that subdirectories that went away are not read for nothing
+    std::sort (mDirtyDirs.begin (), mDirtyDirs.end (), [&] (const uint32_t &pLeft, const uint32_t &pRight) {
+        return mDirs[pLeft].depth < mDirs[pRight].depth;
+    });
+
+    for (size_t i = 0; i < mDirtyDirs.size (); ++i) {
+
+        /** Directory that changed (its position may have been reused by a directory added since then) */
+        const uint32_t      pos         = mDirtyDirs[i];
+
+        if (!mDirs[pos].isLive || !mDirs[pos].isDirty) {
+            continue;
+        }
+
+        mDirs[pos].isDirty  = false;
+        refresh_dir (pos);
+    }
+    mDirtyDirs.clear ();
+    check_displaced ();
+}